@@ -1,4 +1,23 @@
 #define LOCAL_TERM	1
+/* the file to log all of the data received from the remote host
+ * to; comment this out to disable logging, a ".gz" suffix requests
+ * compression (see vt102-log.h) */
+#define LOG_FILE_NAME		"term-log.txt"
+/* the file to record the session to - the data received from the
+ * remote host, along with the time it was received at, and keyframes
+ * of the screen state, so that the session can be replayed, and seeked
+ * in (see vt102-record.h); comment this out to disable recording */
+#define RECORD_FILE_NAME	"term-log.rec"
+/* define this to run the vt102 command parser in a thread of its
+ * own, separate from the thread rendering the terminal window and
+ * handling the x server events - so that rendering never stalls
+ * the reading of the data from the remote host */
+/* #define PARSER_THREAD	1 */
+/* define this to render the terminal window by rasterizing the
+ * characters into a framebuffer shared with the x server (see
+ * vt102-xshm.h), when the x server supports it; requires linking
+ * with -lXext */
+/* #define USE_XSHM	1 */
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -9,6 +28,8 @@
 #include <netinet/in.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
 
 #ifdef LOCAL_TERM
 #include <sys/ioctl.h>
@@ -16,6 +37,11 @@
 #include <unistd.h>
 #endif
 
+#ifdef PARSER_THREAD
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
 #include <X11/Xlib.h>
 
 /* these needed for passing the terminal
@@ -24,12 +50,26 @@
 #include <X11/Xatom.h>
 
 #include "vt102-backend-generic.h"
+#include "vt102-frame-sched.h"
+#include "vt102-resize-sched.h"
+#include "vt102-log.h"
+#include "vt102-input.h"
+#include "vt102-record.h"
+#include "vt102-trace.h"
+#ifdef PARSER_THREAD
+#include "vt102-snapshot.h"
+#endif
+#ifdef USE_XSHM
+#include "vt102-xshm.h"
+#endif
 
 #define panic(msg) do { printf("%i\n", __LINE__); while(1); } while(0)
 
 #define NR_ANSI_COLORS		8
 #define MAX_CON_WIDTH_IN_CHARS		(255 * 3)
 #define MAX_CON_HEIGHT_IN_CHARS		(255 * 3)
+/* the maximum terminal window refresh rate, in frames per second */
+#define FRAME_RATE			60
 
 
 /* the terminal window data structure */
@@ -54,6 +94,12 @@ struct xterm_data
 	 *
 	 * background is black */
 	/*GC*/QPen ansi_color_gcs[NR_ANSI_COLORS];
+	/* graphics contexts for rendering text in ansi color 'fg'
+	 * on a background of ansi color 'bg', indexed as
+	 * text_gcs[fg][bg]; these are all constructed upfront, so
+	 * that any stride of text, whatever its background, is
+	 * rendered with a single request to the x server */
+	GC text_gcs[NR_ANSI_COLORS][NR_ANSI_COLORS];
 	/* font dimensions, a monospaced font is assumed */
 	int font_width, font_height, lbearing, ascent;
 	/* the primary pixmap canvas used for refreshing the
@@ -66,77 +112,354 @@ struct xterm_data
 	 * is then copied to the terminal window - this reduces
 	 * flicker and is generally faster */
 	QPixmap pixmap_canvas;
+	/* the amount of drawing done while rendering the
+	 * current frame - the number of rows and character
+	 * cells redrawn, and the number of x server requests
+	 * made; reported to the frame scheduler */
+	int nr_rows_drawn, nr_cells_drawn, nr_draw_requests;
+#ifdef USE_XSHM
+	/* the shared memory renderer, null if the x server
+	 * does not support it - in which case the terminal
+	 * window is rendered by means of the pixmap canvas */
+	struct vt102_xshm * xshm;
+#endif
 };
 
+/* returns the index in the xdata->ansi_color_gcs[] array of the
+ * ansi color nearest to the color palette index 'color' (see the
+ * VT102_ATTR_xxx constants in vt102-backend-generic.h) - only the
+ * eight ansi colors are allocated */
+static int palette_gc_idx(int color)
+{
+int r, g, b;
+
+	if (color < 16)
+		/* the ansi colors, and their bright variants */
+		return color & 7;
+	if (color >= 232)
+		/* the grayscale ramp */
+		return color < 244 ? 0 : 7;
+	/* the color cube - the ansi color indices have
+	 * red in bit 0, green in bit 1 and blue in bit 2 */
+	color -= 16;
+	r = color / 36;
+	g = color / 6 % 6;
+	b = color % 6;
+	return (r >= 3) | ((g >= 3) << 1) | ((b >= 3) << 2);
+}
+
 /* updates the terminal window pixmap canvas at character position
  * (x; y) by writing out the text pointed to by the 'text'
  * parameter (with length 'text_len'); all of the text is
- * rendered with the graphics context data foreground and
- * background colors specified as indices in the xdata->ansi_color_gcs[]
- * array by the 'fg_gc_idx' and 'bg_gc_idx' parameters */
+ * rendered with the foreground and background colors specified
+ * as ansi color indices by the 'fg_gc_idx' and 'bg_gc_idx'
+ * parameters; the text and its background are drawn with a
+ * single XDrawImageString() request, using the graphics
+ * context for the color pair in xdata->text_gcs[][] */
 static void update_term_pixmap_stride(struct xterm_data * xdata, int x, int y, int fg_gc_idx, int bg_gc_idx, char * text, int text_len)
 {
 	/* update the pixmap canvas */
-	/* optimize for the most common case - black background */
-	if (bg_gc_idx == 0)
+	XDrawImageString(xdata->disp,
+			xdata->pixmap_canvas,
+			xdata->text_gcs[fg_gc_idx][bg_gc_idx],
+			xdata->lbearing + x * xdata->font_width,
+			xdata->ascent + y * xdata->font_height,
+			text,
+			text_len);
+	xdata->nr_draw_requests ++;
+	xdata->tdata->must_refresh = true;
+}
+
+/* applies the scroll operations queued by the vt102 backend
+ * to the terminal window pixmap canvas, by moving the scrolled
+ * rows contents within the pixmap canvas; the rows scrolled in
+ * are marked by the backend for refreshing, and are redrawn by
+ * update_term_pixmap() afterwards */
+static void scroll_term_pixmap(struct xterm_data * xdata)
+{
+int i, n, delta;
+struct vt102_scroll_op * op;
+
+	for (i = 0; i < xdata->tdata->nr_scroll_ops; i++)
 	{
-		/* the background is black - use a stock
-		 * graphics context */
-		XDrawImageString(xdata->disp,
+		op = xdata->tdata->scroll_ops + i;
+		n = op->bottom - op->top + 1;
+		delta = op->delta < 0 ? - op->delta : op->delta;
+		/* see if anything is left to be moved */
+		if (delta >= n)
+			continue;
+		/* overlapping source and destination areas
+		 * are handled by the x server */
+		XCopyArea(xdata->disp,
+				xdata->pixmap_canvas,
 				xdata->pixmap_canvas,
-				(xdata->ansi_color_gcs[fg_gc_idx]/* , xdata->ansi_color_gcs[7]*/),
-				xdata->lbearing + x * xdata->font_width,
-				xdata->ascent + y * xdata->font_height,
-				text,
-				text_len);
+				xdata->gc,
+				0,
+				(op->delta > 0 ? op->top + delta : op->top) * xdata->font_height,
+				xdata->tdata->con_width * xdata->font_width,
+				(n - delta) * xdata->font_height,
+				0,
+				(op->delta > 0 ? op->top : op->top + delta) * xdata->font_height);
+		xdata->nr_draw_requests ++;
 	}
-	else
+	xdata->tdata->nr_scroll_ops = 0;
+}
+
+/* prints the session logger counters, and closes the session
+ * logger, writing out any data still pending; the session logger
+ * may be null, if logging is disabled */
+static void close_session_log(struct vt102_log * log)
+{
+struct vt102_log_stats stats;
+
+	if (!log)
+		return;
+	vt102_log_get_stats(log, &stats);
+	printf("session log: %llu bytes logged, %llu bytes dropped, "
+			"%llu bytes written in %lu writes, %lu stalls, %lu errors\n",
+			stats.nr_bytes_logged, stats.nr_bytes_dropped,
+			stats.nr_bytes_written, stats.nr_writes,
+			stats.nr_stalls, stats.nr_errors);
+	vt102_log_destroy(log);
+}
+
+/* prints the session recorder counters, and closes the session
+ * recorder and its session logger, writing out the keyframe index,
+ * and any data still pending; the session recorder may be null, if
+ * recording is disabled */
+static void close_session_record(struct vt102_recorder * rec, struct vt102_log * log)
+{
+	if (!rec)
+		return;
+	vt102_record_print_stats(rec, stdout);
+	vt102_record_destroy(rec);
+	close_session_log(log);
+}
+
+/* returns the number of screen rows that need refreshing */
+static int count_changed_rows(struct term_data * tdata)
+{
+int i, n;
+
+	for (i = n = 0; i < tdata->con_height; i++)
+		if (tdata->must_refresh_line_buf[i])
+			n++;
+	return n;
+}
+
+/* set by the SIGUSR1 signal handler, and by the ctrl+shift+s hotkey,
+ * to request the emulator counters to be printed */
+static volatile sig_atomic_t stats_dump_requested;
+
+/* the SIGUSR1 signal handler - requests the emulator
+ * counters to be printed */
+static void request_stats_dump(int signo)
+{
+	stats_dump_requested = 1;
+}
+
+/* prints the vt102 command parser and backend counters */
+static void print_emulator_stats(struct vt102_state * vtstate)
+{
+	vt102_print_stats(vtstate, stdout);
+	vt102_generic_backend_print_stats(vtstate, stdout);
+}
+
+#ifdef PARSER_THREAD
+/* the data shared by the main thread, which renders the terminal
+ * window and handles the x server events, and the parser thread,
+ * which reads the data from the remote host and runs it through
+ * the vt102 command parser; the parser thread owns the vt102 state
+ * and backend data, and passes snapshots of the screen to the main
+ * thread by means of a snapshot handoff */
+struct parser_thread_data
+{
+	/* the vt102 emulator state variable, only accessed
+	 * by the parser thread */
+	struct vt102_state * vtstate;
+	/* the snapshot handoff */
+	struct vt102_snapshot_handoff * handoff;
+	/* the socket file descriptor used for
+	 * communicating with the remote (shell)
+         * process */
+	int comm_fd;
+	/* the remote host data reader */
+	struct vt102_input * input;
+	/* the session logger, null if logging is disabled */
+	struct vt102_log * session_log;
+	/* the session recorder, and the session logger it writes
+	 * the recording with, null if recording is disabled */
+	struct vt102_recorder * session_rec;
+	struct vt102_log * session_rec_log;
+	/* a pipe written to by the parser thread
+	 * when it has published a new snapshot */
+	int snapshot_ready_pipe[2];
+	/* a pipe written to by the main thread when it has
+	 * taken a snapshot, or requested the terminal to be
+	 * resized */
+	int wakeup_pipe[2];
+	/* a pending terminal resize request - the new width
+	 * in the upper 16 bits, and the new height in the
+	 * lower 16 bits; zero if no resize is pending */
+	atomic_int pending_resize;
+	/* set by the main thread to request the parser
+	 * thread to print the emulator counters */
+	atomic_int dump_stats;
+};
+
+/* creates a pipe used for waking up a thread blocked in select(),
+ * with both ends of the pipe in non-blocking mode, so that neither
+ * writing to a full pipe, nor draining an empty one ever blocks;
+ * returns zero on success, -1 on failure */
+static int create_wakeup_pipe(int fds[2])
+{
+	if (pipe(fds)
+			|| fcntl(fds[0], F_SETFL, O_NONBLOCK)
+			|| fcntl(fds[1], F_SETFL, O_NONBLOCK))
+		return -1;
+	return 0;
+}
+
+/* the parser thread */
+static void * parser_thread(void * arg)
+{
+struct parser_thread_data * pdata;
+struct term_data * tdata;
+fd_set descriptor_set;
+unsigned char buf[16];
+int size;
+/* only used for holding off publishing the screen while
+ * the remote host is in the middle of a synchronized update,
+ * the main thread schedules the frames on its own */
+struct vt102_frame_sched sync_sched;
+struct timeval timeout;
+bool held;
+
+	pdata = (struct parser_thread_data *) arg;
+	tdata = vt102_generic_backend_get_data(pdata->vtstate);
+	vt102_frame_sched_init(&sync_sched, 0);
+	held = false;
+	while (1)
 	{
-		/* non-black background - first render
-		 * the background, then the character image */
-		/* first, draw the background */
-		XFillRectangle(xdata->disp,
-				xdata->pixmap_canvas,
-				(xdata->ansi_color_gcs[bg_gc_idx]/* , xdata->ansi_color_gcs[7]*/),
-				x * xdata->font_width,
-				y * xdata->font_height,
-				xdata->font_width * text_len,
-				xdata->font_height);
-		/* then, display the character (without rendereing
-		 * the background) */
-		XDrawString(xdata->disp,
-				xdata->pixmap_canvas,
-				xdata->ansi_color_gcs[fg_gc_idx],
-				xdata->lbearing + x * xdata->font_width,
-				xdata->ascent + y * xdata->font_height,
-				text,
-				text_len);
+		FD_ZERO(&descriptor_set);
+		FD_SET(pdata->comm_fd, &descriptor_set);
+		FD_SET(pdata->wakeup_pipe[0], &descriptor_set);
+		/* if holding off the screen, wake up in time to
+		 * publish it, should the update not complete */
+		if (select(FD_SETSIZE, &descriptor_set, NULL, NULL, held ? &timeout : NULL) < 0)
+		{
+			if (errno != EINTR)
+			{
+				perror("select");
+				exit(1);
+			}
+			FD_ZERO(&descriptor_set);
+		}
+		if (FD_ISSET(pdata->wakeup_pipe[0], &descriptor_set))
+			while (read(pdata->wakeup_pipe[0], buf, sizeof buf) > 0)
+				;
+		/* resize the data buffers first, so that any data
+		 * sent by the remote host after it has been notified
+		 * about the resize is processed after resizing */
+		if ((size = atomic_exchange(&pdata->pending_resize, 0)))
+		{
+			if (!vt102_generic_backend_resize_buffers(pdata->vtstate, size >> 16, size & 0xffff))
+				printf("cannot resize the screen, out of memory\n");
+			else if (pdata->session_rec)
+				vt102_record_resize(pdata->session_rec, pdata->vtstate);
+		}
+		if (atomic_exchange(&pdata->dump_stats, 0))
+			print_emulator_stats(pdata->vtstate);
+		/* see if there are characters pending from
+		 * the remote host */
+		if (FD_ISSET(pdata->comm_fd, &descriptor_set))
+		{
+			if (vt102_input_drain(pdata->input, pdata->vtstate) < 0)
+			{
+				perror("read");
+				print_emulator_stats(pdata->vtstate);
+				close_session_log(pdata->session_log);
+				close_session_record(pdata->session_rec, pdata->session_rec_log);
+#if VT102_TRACE_LEVEL > VT102_TRACE_LEVEL_NONE
+				vt102_trace_dump(stdout);
+#endif
+				exit(1);
+			}
+			vt102_frame_sched_note_sync_update(&sync_sched, tdata->sync_update,
+					tdata->stats.nr_sync_updates);
+		}
+		/* hand the screen over to the main thread, unless the
+		 * remote host is in the middle of a synchronized update,
+		 * or the main thread has not taken the previous snapshot
+		 * yet - in which case it will wake this thread up when
+		 * it does */
+		held = tdata->must_refresh && vt102_frame_sched_sync_hold(&sync_sched, &timeout);
+		if (tdata->must_refresh && !held && vt102_snapshot_publish(pdata->handoff, tdata))
+			if (write(pdata->snapshot_ready_pipe[1], "", 1) != 1)
+				/* the pipe is full - the main thread
+				 * has been notified already */
+				;
 	}
-	xdata->tdata->must_refresh = true;
+	return 0;
 }
+#endif /* PARSER_THREAD */
 
 static void update_term_pixmap(struct xterm_data * xdata)
 {
-int i, j, k, grdata;
+int i, j, k, x, x1;
+unsigned char * chrow;
+uint32_t * grrow, grdata;
 
+	/* first move the screen contents scrolled, then
+	 * redraw the rows that have changed */
+	scroll_term_pixmap(xdata);
 	for (i = 0; i < xdata->tdata->con_height; i++)
 	{
 		if (!xdata->tdata->must_refresh_line_buf[i])
 			continue;
-		for (j = 0; j < xdata->tdata->con_width; j = k)
+		chrow = vt102_generic_backend_chrow(xdata->tdata, i);
+		grrow = vt102_generic_backend_grrow(xdata->tdata, i);
+		/* only redraw the characters that have changed */
+		x1 = xdata->tdata->dirty_spans[i].x1;
+		xdata->nr_rows_drawn ++;
+		for (j = xdata->tdata->dirty_spans[i].x0; j < x1; j = k)
 		{
-			grdata = xdata->tdata->grbuf[i * xdata->tdata->con_width + j];
-			for (k = j + 1; k < xdata->tdata->con_width; k++)
-				if (xdata->tdata->grbuf[i * xdata->tdata->con_width + k]
-						!= grdata)
+			grdata = grrow[j];
+			for (k = j + 1; k < x1; k++)
+				if (grrow[k] != grdata)
 					break;
-			update_term_pixmap_stride(xdata,
-					j,
-					i,
-					grdata & 7,
-					(grdata >> 4) & 7,
-					xdata->tdata->chbuf + i * xdata->tdata->con_width + j,
-					k - j);
+			if (grdata >> VT102_ATTR_CHAR_SHIFT)
+				/* the font only has glyphs for the characters
+				 * in the range 0 - 255 - draw placeholders
+				 * for the rest */
+				for (x = j; x < k; x++)
+					update_term_pixmap_stride(xdata,
+							x,
+							i,
+							palette_gc_idx(vt102_attr_fg(grdata)),
+							palette_gc_idx(vt102_attr_bg(grdata)),
+							"?",
+							1);
+			else
+				update_term_pixmap_stride(xdata,
+						j,
+						i,
+						palette_gc_idx(vt102_attr_fg(grdata)),
+						palette_gc_idx(vt102_attr_bg(grdata)),
+						chrow + j,
+						k - j);
+			if (grdata & VT102_ATTR_UNDERLINE)
+			{
+				XDrawLine(xdata->disp,
+						xdata->pixmap_canvas,
+						xdata->ansi_color_gcs[palette_gc_idx(vt102_attr_fg(grdata))],
+						j * xdata->font_width,
+						xdata->ascent + i * xdata->font_height + 1,
+						k * xdata->font_width - 1,
+						xdata->ascent + i * xdata->font_height + 1);
+				xdata->nr_draw_requests ++;
+			}
+			xdata->nr_cells_drawn += k - j;
 		}
 		xdata->tdata->must_refresh_line_buf[i] = false;
 	}
@@ -175,6 +498,23 @@ int main(void)
  * terminal window and generally speeding up
  * the displaying of the terminal window */
 struct timeval timeout, * ptimeout;	
+/* the frame scheduler, deciding when to refresh the terminal window */
+struct vt102_frame_sched frame_sched;
+/* the resize scheduler, deciding when to apply window size changes */
+struct vt102_resize_sched resize_sched;
+/* the timeout used for applying a window size change pending in time */
+struct timeval resize_timeout;
+/* the terminal window size to apply, in characters */
+int width, height;
+/* the screen to render in the terminal window, null if there are no changes to render */
+struct term_data * screen;
+/* true, if there is no data from the remote host pending */
+bool input_idle;
+#ifdef PARSER_THREAD
+/* the data shared with the parser thread */
+struct parser_thread_data pdata;
+pthread_t parser_thread_id;
+#endif
 static const struct
 {
 	KeySym keysym;
@@ -221,8 +561,14 @@ fd_set descriptor_set;
 /* the vt102 emulator state variable, used when calling into the emulator
  * command parser */
 struct vt102_state * vtstate;
-/* log file descriptor */
-int log_fd;
+/* the session logger, null if logging is disabled */
+struct vt102_log * session_log;
+/* the session recorder, and the session logger it writes the
+ * recording with, null if recording is disabled */
+struct vt102_recorder * session_rec;
+struct vt102_log * session_rec_log;
+/* the remote host data reader */
+struct vt102_input * input;
 
 	if (!(vtstate = init_vt102_generic_backend(80, 24)))
 	{
@@ -230,8 +576,38 @@ int log_fd;
 		exit(1);
 	}
 	xdata.tdata = vt102_generic_backend_get_data(vtstate);
+	/* scrolling is done by moving the pixmap canvas contents */
+	xdata.tdata->record_scroll_ops = true;
+	vt102_frame_sched_init(&frame_sched, FRAME_RATE);
+	vt102_resize_sched_init(&resize_sched, xdata.tdata->con_width, xdata.tdata->con_height);
 	/* override the terminal id query backend function */
 	vt102_get_backend_ops(vtstate)->query_terminal_id = query_terminal_id;
+	/* start the session logger */
+	session_log = 0;
+#ifdef LOG_FILE_NAME
+	if (!(session_log = vt102_log_create(LOG_FILE_NAME, 0, VT102_LOG_DROP)))
+	{
+		printf("could not create log file");
+		exit(1);
+	}
+#endif
+	if (!(input = vt102_input_create(xdata.comm_fd, session_log)))
+	{
+		printf("error initializing the remote host data reader\n");
+		exit(1);
+	}
+	/* start the session recorder */
+	session_rec = 0;
+	session_rec_log = 0;
+#ifdef RECORD_FILE_NAME
+	if (!(session_rec_log = vt102_log_create(RECORD_FILE_NAME, 0, VT102_LOG_DROP))
+			|| !(session_rec = vt102_record_create(session_rec_log, vtstate)))
+	{
+		printf("could not create session recording file");
+		exit(1);
+	}
+	vt102_input_set_recorder(input, session_rec);
+#endif
 
 	/* load the font to be used for the terminal window */
 	if (!(font = XLoadQueryFont(xdata.disp, "-misc-fixed-bold-*-*-*-*-*-*-*-*-*-*-*")))
@@ -271,18 +647,39 @@ int log_fd;
 	gcvals.background = black_pixel;
 	gcvals.foreground = white_pixel;
 	xdata.gc = XCreateGC(xdata.disp, xdata.win, GCBackground | GCForeground | GCFont, &gcvals);
+	/* no exposure events are needed when copying from the pixmap canvas */
+	XSetGraphicsExposures(xdata.disp, xdata.gc, False);
 	/* construct the ansi color graphics contexts */
 {
 	XColor xc, dummy;
+	unsigned long pixels[NR_ANSI_COLORS];
+	int j;
 	for (i = 0; i < NR_ANSI_COLORS; i++)
 	{
 		if (!XAllocNamedColor(xdata.disp, DefaultColormap(xdata.disp, DefaultScreen(xdata.disp)),
 					ansi_color_strings[i],
 					&dummy, &xc))
 			printf("error allocating color\n");
-		gcvals.foreground = xc.pixel;
+		pixels[i] = gcvals.foreground = xc.pixel;
 		xdata.ansi_color_gcs[i] = XCreateGC(xdata.disp, xdata.win, GCBackground | GCForeground | GCFont, &gcvals);
 	}
+	/* construct the graphics contexts for all of the color
+	 * pairs; the ones with a black background are the ansi
+	 * color graphics contexts constructed above */
+	for (i = 0; i < NR_ANSI_COLORS; i++)
+		for (j = 0; j < NR_ANSI_COLORS; j++)
+			if (!j)
+				xdata.text_gcs[i][j] = xdata.ansi_color_gcs[i];
+			else
+			{
+				gcvals.foreground = pixels[i];
+				gcvals.background = pixels[j];
+				xdata.text_gcs[i][j] = XCreateGC(xdata.disp, xdata.win, GCBackground | GCForeground | GCFont, &gcvals);
+			}
+#ifdef USE_XSHM
+	if (!(xdata.xshm = vt102_xshm_create(xdata.disp, xdata.win, font, pixels)))
+		printf("shared memory rendering not available, using x requests\n");
+#endif
 }
 	/* create the main and working pixmap canvases */
 	i = DefaultDepth(xdata.disp, DefaultScreen(xdata.disp));
@@ -297,6 +694,33 @@ int log_fd;
 		printf("error creating terminal window pixmaps\n");
 		exit(1);
 	}
+#ifdef PARSER_THREAD
+	/* start the parser thread; from now on, the vt102
+	 * emulator state and backend data are only accessed
+	 * by the parser thread, and the terminal window is
+	 * rendered from the snapshots the parser thread
+	 * publishes */
+	pdata.vtstate = vtstate;
+	pdata.comm_fd = xdata.comm_fd;
+	pdata.input = input;
+	pdata.session_log = session_log;
+	pdata.session_rec = session_rec;
+	pdata.session_rec_log = session_rec_log;
+	atomic_init(&pdata.pending_resize, 0);
+	atomic_init(&pdata.dump_stats, 0);
+	if (!(pdata.handoff = vt102_snapshot_handoff_create())
+			|| create_wakeup_pipe(pdata.snapshot_ready_pipe)
+			|| create_wakeup_pipe(pdata.wakeup_pipe)
+			|| pthread_create(&parser_thread_id, 0, parser_thread, &pdata))
+	{
+		XCloseDisplay(xdata.disp);
+		printf("error starting the parser thread\n");
+		exit(1);
+	}
+	xdata.tdata = 0;
+#endif
+	/* print the emulator counters on SIGUSR1 */
+	signal(SIGUSR1, request_stats_dump);
 	/* enter main loop */
 	while (1)
 	{
@@ -330,6 +754,14 @@ int log_fd;
 							1,
 							&ksym,
 							0);
+					/* ctrl+shift+s requests the emulator
+					 * counters to be printed */
+					if ((xkey->state & (ControlMask | ShiftMask)) == (ControlMask | ShiftMask)
+							&& (ksym == XK_S || ksym == XK_s))
+					{
+						stats_dump_requested = 1;
+						break;
+					}
 					/* filter out some control
 					 * keys */
 					switch (xkey->keycode)
@@ -379,60 +811,14 @@ int log_fd;
 				case ConfigureNotify:
 				{
 					XConfigureEvent * xconf;
-					int w, h;
-					/* compress ConfigureNotify events */
-					while (XPending(xdata.disp))
-					{
-						XEvent lxevt;
-						XPeekEvent(xdata.disp, &lxevt);
-						if (lxevt.type == ConfigureNotify)
-							XNextEvent(xdata.disp, &xevt);
-						else
-							break;
-					}
-
 					xconf = (XConfigureEvent *) &xevt;
-					w = xconf->width / xdata.font_width;
-					h = xconf->height / xdata.font_height;
-					/* resize the data buffers */
-					vt102_generic_backend_resize_buffers(vtstate, w, h);
-
-
-#ifdef LOCAL_TERM
-				{
-				struct winsize winsz;
-					if (ioctl(xdata.comm_fd,
-							TIOCGWINSZ,
-							&winsz))
-						perror("ioctl(): cannot obtain terminal window size");
-					else
-					{
-						winsz.ws_col = w;
-						winsz.ws_row = h;
-						if (ioctl(xdata.comm_fd,
-								TIOCSWINSZ,
-								&winsz))
-							perror("ioctl(): cannot set terminal window size");
-					}
-				}
-#else
-				{
-				unsigned char buf[5];
-
-					buf[0] = 0;
-					buf[1] = w;
-					buf[2] = w >> 8;
-					buf[3] = h;
-					buf[4] = h >> 8;
-					/* send a resize request to the remote host */
-					if (write(xdata.comm_fd, buf, sizeof buf) != sizeof buf)
-					{
-						XCloseDisplay(xdata.disp);
-						perror("write");
-						exit(1);
-					}
-				}
-#endif /* LOCAL_TERM */
+					/* window managers send lots of these while the
+					 * window is being resized (or moved) - leave
+					 * it to the resize scheduler to decide when to
+					 * apply the window size change, see below */
+					vt102_resize_sched_request(&resize_sched,
+							xconf->width / xdata.font_width,
+							xconf->height / xdata.font_height);
 				}
 					break;
 				case ConfigureRequest:
@@ -444,82 +830,224 @@ int log_fd;
 					break;
 			}
 		}
+		/* apply the window size change pending, if it is due;
+		 * only the final size of a burst of window size changes
+		 * gets applied, and sent to the remote host */
+		if (vt102_resize_sched_due(&resize_sched, &width, &height))
+		{
+			/* resize the data buffers */
+#ifdef PARSER_THREAD
+			/* the parser thread owns the data
+			 * buffers - have it resize them */
+			atomic_store(&pdata.pending_resize, (width << 16) | height);
+			if (write(pdata.wakeup_pipe[1], "", 1) != 1)
+				;
+#else
+			if (!vt102_generic_backend_resize_buffers(vtstate, width, height))
+			{
+				/* keep the remote host in sync with the
+				 * screen size actually in effect */
+				printf("cannot resize the screen, out of memory\n");
+				width = xdata.tdata->con_width;
+				height = xdata.tdata->con_height;
+				vt102_resize_sched_set_size(&resize_sched, width, height);
+			}
+			else if (session_rec)
+				vt102_record_resize(session_rec, vtstate);
+#endif
+
+#ifdef LOCAL_TERM
+			{
+			struct winsize winsz;
+				if (ioctl(xdata.comm_fd,
+						TIOCGWINSZ,
+						&winsz))
+					perror("ioctl(): cannot obtain terminal window size");
+				else
+				{
+					winsz.ws_col = width;
+					winsz.ws_row = height;
+					if (ioctl(xdata.comm_fd,
+							TIOCSWINSZ,
+							&winsz))
+						perror("ioctl(): cannot set terminal window size");
+				}
+			}
+#else
+			{
+			unsigned char buf[5];
+
+				buf[0] = 0;
+				buf[1] = width;
+				buf[2] = width >> 8;
+				buf[3] = height;
+				buf[4] = height >> 8;
+				/* send a resize request to the remote host */
+				if (write(xdata.comm_fd, buf, sizeof buf) != sizeof buf)
+				{
+					XCloseDisplay(xdata.disp);
+					perror("write");
+					exit(1);
+				}
+			}
+#endif /* LOCAL_TERM */
+		}
 		FD_ZERO(&descriptor_set);
+#ifdef PARSER_THREAD
+		/* render the latest snapshot published by
+		 * the parser thread, if any */
+		screen = vt102_snapshot_peek(pdata.handoff);
+		FD_SET(pdata.snapshot_ready_pipe[0], &descriptor_set);
+#else
+		screen = xdata.tdata;
 		FD_SET(xdata.comm_fd, &descriptor_set);
+#endif
 		FD_SET(xdata.x_fd, &descriptor_set);
 
-		if (xdata.tdata->must_refresh)
-		{
-			/* set up the timeout - if there
-			 * is no new data until the timeout
-		         * elapses - update the terminal
-			 * window, otherwisee (new data arrived
-			 * and the timeout has not elapsed -
-			 * process the new data before updating
-			 * the terminal window
-			 *
-			 * this is here for speeding up the
-			 * updating of the terminal window */
-			timeout.tv_sec = 0;
-			timeout.tv_usec = 10000;
-			ptimeout = &timeout;
-		}
+		if (screen && screen->must_refresh)
+			/* set up the timeout - if there is no
+			 * new data until the timeout elapses -
+			 * update the terminal window, otherwise
+			 * process the new data first; the frame
+			 * scheduler makes sure that the terminal
+			 * window still gets updated regularly
+			 * when new data keeps arriving */
+			ptimeout = vt102_frame_sched_get_timeout(&frame_sched,
+					count_changed_rows(screen), &timeout);
 		else
 			ptimeout = 0;
+		/* wake up in time to apply the window size change pending, if any */
+		ptimeout = vt102_resize_sched_get_timeout(&resize_sched,
+				&resize_timeout, ptimeout);
 		if ((i = select(FD_SETSIZE, &descriptor_set, NULL, NULL, ptimeout)) < 0)
 		{
-			XCloseDisplay(xdata.disp);
-			perror("select");
-			exit(1);
+			if (errno != EINTR)
+			{
+				XCloseDisplay(xdata.disp);
+				perror("select");
+				exit(1);
+			}
+			/* interrupted by a signal - nothing is pending */
+			FD_ZERO(&descriptor_set);
+		}
+		if (stats_dump_requested)
+		{
+			stats_dump_requested = 0;
+#ifdef PARSER_THREAD
+			/* the parser thread owns the emulator
+			 * state - have it print the counters */
+			atomic_store(&pdata.dump_stats, 1);
+			if (write(pdata.wakeup_pipe[1], "", 1) != 1)
+				;
+#else
+			print_emulator_stats(vtstate);
+#endif
+			vt102_frame_sched_print_stats(&frame_sched, stdout);
+			vt102_resize_sched_print_stats(&resize_sched, stdout);
+		}
+#ifdef PARSER_THREAD
+		if (FD_ISSET(pdata.snapshot_ready_pipe[0], &descriptor_set))
+		{
+			unsigned char buf[16];
+			while (read(pdata.snapshot_ready_pipe[0], buf, sizeof buf) > 0)
+				;
+			if ((screen = vt102_snapshot_peek(pdata.handoff)))
+			{
+				vt102_frame_sched_note_input(&frame_sched, 0, screen->must_refresh);
+				/* the parser thread has already held the
+				 * screen off while an update was in progress */
+				vt102_frame_sched_note_sync_update(&frame_sched, false,
+						screen->stats.nr_sync_updates);
+			}
 		}
-		/* see if the timeout has elapsed */
-		if (i == 0)
+		/* the parser thread drains the input on its own */
+		input_idle = true;
+#else
+		input_idle = !FD_ISSET(xdata.comm_fd, &descriptor_set);
+#endif
+		/* see if the terminal window should be updated */
+		if (screen && screen->must_refresh
+				&& vt102_frame_sched_frame_due(&frame_sched,
+					count_changed_rows(screen),
+					input_idle))
 		{
-			/* refresh any lines marked for update */
-			update_term_pixmap(&xdata);
-			/* update the terminal window from the
-			 * primary pixmap canvas */
-			XCopyArea(xdata.disp,
-					xdata.pixmap_canvas,
-					xdata.win,
-					xdata.gc,
-					0, 0,
-					xdata.tdata->con_width * xdata.font_width,
-					xdata.tdata->con_height * xdata.font_height,
-					0, 0);
-			/* draw the cursor */
-			XDrawRectangle(xdata.disp,
-					xdata.win,
-					xdata.ansi_color_gcs[7],
-					xdata.tdata->cursor_x * xdata.font_width,
-					xdata.tdata->cursor_y * xdata.font_height,
-					xdata.font_width - 1,
-					xdata.font_height - 1);
+			vt102_frame_sched_frame_begin(&frame_sched);
+#ifdef PARSER_THREAD
+			/* take the snapshot, and let the parser
+			 * thread publish any changes made since */
+			xdata.tdata = vt102_snapshot_take(pdata.handoff);
+			if (write(pdata.wakeup_pipe[1], "", 1) != 1)
+				;
+#endif
+			xdata.nr_rows_drawn = xdata.nr_cells_drawn = xdata.nr_draw_requests = 0;
+#ifdef USE_XSHM
+			if (xdata.xshm)
+			{
+				struct vt102_xshm_frame_stats stats;
+
+				/* rasterize the lines marked for
+				 * update, and present the frame */
+				vt102_xshm_render(xdata.xshm, xdata.tdata, &stats);
+				xdata.nr_rows_drawn = stats.nr_rows_drawn;
+				xdata.nr_cells_drawn = stats.nr_cells_drawn;
+				xdata.nr_draw_requests = stats.nr_requests;
+			}
+			else
+#endif
+			{
+				/* refresh any lines marked for update */
+				update_term_pixmap(&xdata);
+				/* update the terminal window from the
+				 * primary pixmap canvas */
+				XCopyArea(xdata.disp,
+						xdata.pixmap_canvas,
+						xdata.win,
+						xdata.gc,
+						0, 0,
+						xdata.tdata->con_width * xdata.font_width,
+						xdata.tdata->con_height * xdata.font_height,
+						0, 0);
+				/* draw the cursor */
+				XDrawRectangle(xdata.disp,
+						xdata.win,
+						xdata.ansi_color_gcs[7],
+						xdata.tdata->cursor_x * xdata.font_width,
+						xdata.tdata->cursor_y * xdata.font_height,
+						xdata.font_width - 1,
+						xdata.font_height - 1);
+				/* account for the copying to the window,
+				 * and for the cursor drawn */
+				xdata.nr_draw_requests += 2;
+			}
 			xdata.tdata->must_refresh = false;
+			vt102_frame_sched_note_render(&frame_sched, xdata.nr_rows_drawn,
+					xdata.nr_cells_drawn, xdata.nr_draw_requests);
+			vt102_frame_sched_frame_end(&frame_sched);
 		}
+#ifndef PARSER_THREAD
 		/* see if there are characters pending from
 		 * the remote host */
 		if (FD_ISSET(xdata.comm_fd, &descriptor_set))
 		{
-			unsigned char buf[128];
-			int nr_bytes;
-			if ((nr_bytes = read(xdata.comm_fd, buf, sizeof buf)) <= 0)
+			ssize_t nr_bytes;
+			if ((nr_bytes = vt102_input_drain(input, vtstate)) < 0)
 			{
 				XCloseDisplay(xdata.disp);
 				perror("read");
+				print_emulator_stats(vtstate);
+				vt102_frame_sched_print_stats(&frame_sched, stdout);
+				close_session_log(session_log);
+				close_session_record(session_rec, session_rec_log);
+#if VT102_TRACE_LEVEL > VT102_TRACE_LEVEL_NONE
+				vt102_trace_dump(stdout);
+#endif
 				exit(1);
 			}
-			if (0) if (write(0, buf, nr_bytes) != nr_bytes)
-				;
-			if (write(log_fd, buf, nr_bytes) != nr_bytes)
-			{
-				XCloseDisplay(xdata.disp);
-				perror("write");
-				exit(1);
-			}
-			for (i = 0; i < nr_bytes; i++)
-				vt102_command_input_parser(vtstate, buf[i]);
+			vt102_frame_sched_note_input(&frame_sched, nr_bytes, xdata.tdata->must_refresh);
+			vt102_frame_sched_note_sync_update(&frame_sched, xdata.tdata->sync_update,
+					xdata.tdata->stats.nr_sync_updates);
 		}
+#endif /* PARSER_THREAD */
 	}
 }
 
@@ -45,6 +45,67 @@
 #include <stdio.h>
 
 #include "vt102-backend-generic.h"
+#include "vt102-trace.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the number of character cells swapped at a time when reordering the screen rows in place */
+	SWAP_CHUNK_SIZE		=	64,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! a line pulled back from the scrollback history buffer, when reflowing the screen */
+struct reflow_line
+{
+	/*! the character codes of the line */
+	unsigned char * chrow;
+	/*! the graphics rendition attributes of the line */
+	uint32_t * grrow;
+	/*! the width of the line */
+	int width;
+	/*! set if the line wraps onto the next line */
+	bool wrapped;
+};
+
+/*! the state of reflowing the screen contents to a new width
+ *
+ * the screen contents are taken to be a sequence of lines - the
+ * lines pulled back from the scrollback history buffer, oldest
+ * first, followed by the screen rows retained; the logical lines
+ * these make up are laid out at the new width, as a sequence
+ * of (new) rows - the rows that do not fit in the new screen
+ * are pushed to the scrollback history buffer */
+struct reflow
+{
+	/*! the screen being reflowed */
+	struct term_data * tdata;
+	/*! the new screen buffers, and dimensions */
+	struct term_data * dst;
+	/*! the lines pulled back from the scrollback history buffer, most recent one first */
+	struct reflow_line * pulled;
+	/*! the number of lines in the pulled buffer above */
+	int nr_pulled;
+	/*! the number of screen rows retained, counting from the top of the screen */
+	int nr_rows_retained;
+	/*! the number of the first row laid out that is shown in the new screen;
+	 * the rows above it are pushed to the scrollback history buffer */
+	int top;
+	/*! the number of rows laid out */
+	int nr_rows;
+	/*! the new cursor position, counting the rows laid out */
+	int cursor_x, cursor_y;
+};
 
 /*
  *
@@ -58,6 +119,808 @@ static void handle_linefeed(struct term_data * tdata);
  *
  */
 
+/*!
+ *	\fn	static void reset_row_offsets(struct term_data * tdata)
+ *	\brief	resets the screen row offsets so that the screen rows are stored in order in the screen buffers
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\return	none */
+static void reset_row_offsets(struct term_data * tdata)
+{
+int i;
+
+	for (i = 0; i < tdata->con_height; i++)
+		tdata->row_offsets[i] = i * tdata->con_width;
+}
+
+/*!
+ *	\fn	static size_t arena_size(int cell_capacity, int row_capacity)
+ *	\brief	computes the size of a screen buffer memory block
+ *
+ *	\param	cell_capacity	the number of character cells to have room for
+ *	\param	row_capacity	the number of screen rows to have room for
+ *	\return	the size of the memory block, in bytes */
+static size_t arena_size(int cell_capacity, int row_capacity)
+{
+	return (size_t) cell_capacity * (sizeof(uint32_t) + sizeof(unsigned char))
+		+ (size_t) row_capacity * (sizeof(struct vt102_dirty_span) + sizeof(int) + 2 * sizeof(bool));
+}
+
+/*!
+ *	\fn	static void set_arena(struct term_data * tdata, void * arena, int cell_capacity, int row_capacity)
+ *	\brief	points the screen buffers into a screen buffer memory block
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	arena	the memory block, of size arena_size(cell_capacity, row_capacity)
+ *	\param	cell_capacity	the number of character cells the block has room for
+ *	\param	row_capacity	the number of screen rows the block has room for
+ *	\return	none */
+static void set_arena(struct term_data * tdata, void * arena, int cell_capacity, int row_capacity)
+{
+unsigned char * p;
+
+	tdata->arena = arena;
+	tdata->cell_capacity = cell_capacity;
+	tdata->row_capacity = row_capacity;
+	/* the buffers are laid out in the order of decreasing
+	 * alignment requirements, so that no padding is needed */
+	p = arena;
+	tdata->grbuf = (uint32_t *) p;
+	p += cell_capacity * sizeof * tdata->grbuf;
+	tdata->dirty_spans = (struct vt102_dirty_span *) p;
+	p += row_capacity * sizeof * tdata->dirty_spans;
+	tdata->row_offsets = (int *) p;
+	p += row_capacity * sizeof * tdata->row_offsets;
+	tdata->chbuf = p;
+	p += cell_capacity;
+	tdata->must_refresh_line_buf = (bool *) p;
+	p += row_capacity * sizeof * tdata->must_refresh_line_buf;
+	tdata->wrapped_line_buf = (bool *) p;
+}
+
+/*!
+ *	\fn	static void swap_cells(struct term_data * tdata, int offset0, int offset1, int nr_cells)
+ *	\brief	swaps the contents of two non-overlapping ranges of character cells in the screen buffers
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	offset0	the offset of the first range in the screen buffers
+ *	\param	offset1	the offset of the second range in the screen buffers
+ *	\param	nr_cells	the number of character cells in each range
+ *	\return	none */
+static void swap_cells(struct term_data * tdata, int offset0, int offset1, int nr_cells)
+{
+unsigned char ch[SWAP_CHUNK_SIZE];
+uint32_t gr[SWAP_CHUNK_SIZE];
+int n;
+
+	for (; nr_cells > 0; nr_cells -= n, offset0 += n, offset1 += n)
+	{
+		n = (nr_cells < SWAP_CHUNK_SIZE) ? nr_cells : SWAP_CHUNK_SIZE;
+		memcpy(ch, tdata->chbuf + offset0, n);
+		memcpy(tdata->chbuf + offset0, tdata->chbuf + offset1, n);
+		memcpy(tdata->chbuf + offset1, ch, n);
+		memcpy(gr, tdata->grbuf + offset0, n * sizeof * gr);
+		memcpy(tdata->grbuf + offset0, tdata->grbuf + offset1, n * sizeof * gr);
+		memcpy(tdata->grbuf + offset1, gr, n * sizeof * gr);
+	}
+}
+
+/*!
+ *	\fn	static void sort_rows(struct term_data * tdata)
+ *	\brief	moves the screen rows around in the screen buffers, so that they are stored in order
+ *
+ *	the row offsets are always a permutation of the
+ *	offsets set by reset_row_offsets() (scrolling only
+ *	rotates them), so each row can be swapped into place
+ *	with the row occupying its place
+ *
+ *	\note	the row refresh-needed flags are not moved along
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\return	none */
+static void sort_rows(struct term_data * tdata)
+{
+int i, j, w;
+
+	w = tdata->con_width;
+	for (i = 0; i < tdata->con_height; i++)
+	{
+		if (tdata->row_offsets[i] == i * w)
+			continue;
+		/* rows 0 to i - 1 are in place, so the row now
+		 * stored in the place of row i comes after it */
+		for (j = i + 1; tdata->row_offsets[j] != i * w; j++)
+			;
+		swap_cells(tdata, tdata->row_offsets[i], i * w, w);
+		tdata->row_offsets[j] = tdata->row_offsets[i];
+		tdata->row_offsets[i] = i * w;
+		tdata->stats.nr_bytes_moved += 2 * w * (sizeof * tdata->chbuf + sizeof * tdata->grbuf);
+	}
+}
+
+/*!
+ *	\fn	static void mark_dirty(struct term_data * tdata, int row, int x0, int x1)
+ *	\brief	schedules a span of characters in a screen row for refreshing
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	row	the screen row containing the characters
+ *	\param	x0	the first column of the span
+ *	\param	x1	the column past the last column of the span
+ *	\return	none */
+static void mark_dirty(struct term_data * tdata, int row, int x0, int x1)
+{
+struct vt102_dirty_span * d;
+
+	d = tdata->dirty_spans + row;
+	if (!tdata->must_refresh_line_buf[row])
+	{
+		tdata->must_refresh_line_buf[row] = true;
+		d->x0 = x0;
+		d->x1 = x1;
+	}
+	else
+	{
+		if (x0 < d->x0)
+			d->x0 = x0;
+		if (x1 > d->x1)
+			d->x1 = x1;
+	}
+}
+
+/*!
+ *	\fn	static void mark_rows_dirty(struct term_data * tdata, int first_row, int nr_rows)
+ *	\brief	schedules a number of consecutive screen rows for refreshing in their entirety
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	first_row	the first screen row to refresh
+ *	\param	nr_rows	the number of rows to refresh
+ *	\return	none */
+static void mark_rows_dirty(struct term_data * tdata, int first_row, int nr_rows)
+{
+	for (; nr_rows > 0; nr_rows--, first_row++)
+	{
+		tdata->must_refresh_line_buf[first_row] = true;
+		tdata->dirty_spans[first_row].x0 = 0;
+		tdata->dirty_spans[first_row].x1 = tdata->con_width;
+	}
+}
+
+/*!
+ *	\fn	static void clear_cells(struct term_data * tdata, int row, int x, int nr_cells)
+ *	\brief	clears (fills with spaces and default graphics rendition attributes) a span of characters in a screen row
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	row	the screen row containing the span
+ *	\param	x	the first column of the span
+ *	\param	nr_cells	the number of characters in the span
+ *	\return	none */
+static void clear_cells(struct term_data * tdata, int row, int x, int nr_cells)
+{
+	memset(vt102_generic_backend_chrow(tdata, row) + x, ' ', nr_cells);
+	memset(vt102_generic_backend_grrow(tdata, row) + x, 0, nr_cells * sizeof * tdata->grbuf);
+	tdata->stats.nr_bytes_cleared += nr_cells * (sizeof * tdata->chbuf + sizeof * tdata->grbuf);
+}
+
+/*!
+ *	\fn	static void clear_rows(struct term_data * tdata, int first_row, int nr_rows)
+ *	\brief	clears (fills with spaces and default graphics rendition attributes) a number of consecutive screen rows
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	first_row	the first screen row to clear
+ *	\param	nr_rows	the number of rows to clear
+ *	\return	none */
+static void clear_rows(struct term_data * tdata, int first_row, int nr_rows)
+{
+	for (; nr_rows > 0; nr_rows--, first_row++)
+	{
+		clear_cells(tdata, first_row, 0, tdata->con_width);
+		tdata->wrapped_line_buf[first_row] = false;
+	}
+}
+
+/*!
+ *	\fn	static void reverse_rows(struct term_data * tdata, int first_row, int nr_rows)
+ *	\brief	reverses the order of a range of screen rows
+ *
+ *	no screen contents are moved - the row offsets of the rows
+ *	in the range are reversed, along with the rows refresh-needed
+ *	flags, spans of characters to refresh and auto-wrap flags
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	first_row	the first row of the range
+ *	\param	nr_rows	the number of rows in the range
+ *	\return	none */
+static void reverse_rows(struct term_data * tdata, int first_row, int nr_rows)
+{
+int i, j, t;
+bool f;
+struct vt102_dirty_span d;
+
+	for (i = first_row, j = first_row + nr_rows - 1; i < j; i++, j--)
+	{
+		t = tdata->row_offsets[i];
+		tdata->row_offsets[i] = tdata->row_offsets[j];
+		tdata->row_offsets[j] = t;
+		f = tdata->must_refresh_line_buf[i];
+		tdata->must_refresh_line_buf[i] = tdata->must_refresh_line_buf[j];
+		tdata->must_refresh_line_buf[j] = f;
+		d = tdata->dirty_spans[i];
+		tdata->dirty_spans[i] = tdata->dirty_spans[j];
+		tdata->dirty_spans[j] = d;
+		f = tdata->wrapped_line_buf[i];
+		tdata->wrapped_line_buf[i] = tdata->wrapped_line_buf[j];
+		tdata->wrapped_line_buf[j] = f;
+	}
+}
+
+/*!
+ *	\fn	static void record_scroll(struct term_data * tdata, int top, int bottom, int delta)
+ *	\brief	records a scroll operation for the rendering module, or schedules the scrolled rows for refreshing
+ *
+ *	if the rendering module has requested that scroll operations
+ *	be recorded (by setting record_scroll_ops in struct term_data),
+ *	the scroll operation is appended to the scroll_ops queue
+ *	(merging it with the last operation queued, if they both scroll
+ *	the same range in the same direction); otherwise - or if the
+ *	queue is full - the rows are scheduled for refreshing instead
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	top	the first row of the range scrolled
+ *	\param	bottom	the last row (inclusive) of the range scrolled
+ *	\param	delta	the number of rows scrolled by; positive values
+ *			mean scrolling up, negative values - scrolling down
+ *	\return	none */
+static void record_scroll(struct term_data * tdata, int top, int bottom, int delta)
+{
+struct vt102_scroll_op * op;
+
+	if (!tdata->record_scroll_ops)
+	{
+		mark_rows_dirty(tdata, top, bottom - top + 1);
+		return;
+	}
+	if (tdata->nr_scroll_ops)
+	{
+		op = tdata->scroll_ops + tdata->nr_scroll_ops - 1;
+		if (op->top == top && op->bottom == bottom && (op->delta > 0) == (delta > 0))
+		{
+			op->delta += delta;
+			return;
+		}
+	}
+	if (tdata->nr_scroll_ops == VT102_MAX_SCROLL_OPS)
+	{
+		/* the queue is full - drop it, and have the whole
+		 * screen refreshed instead */
+		tdata->nr_scroll_ops = 0;
+		mark_rows_dirty(tdata, 0, tdata->con_height);
+		tdata->stats.nr_scroll_op_overflows ++;
+		return;
+	}
+	tdata->stats.nr_scroll_ops_recorded ++;
+	op = tdata->scroll_ops + tdata->nr_scroll_ops++;
+	op->top = top;
+	op->bottom = bottom;
+	op->delta = delta;
+}
+
+/*!
+ *	\fn	static void scroll_rows_up(struct term_data * tdata, int top, int bottom, int nr_rows)
+ *	\brief	scrolls up a range of screen rows, clearing the rows scrolled in at the bottom
+ *
+ *	no screen contents are moved - the row offsets of the
+ *	rows in the range are rotated instead, so that the
+ *	rows scrolled out at the top are reused as the rows
+ *	scrolled in at the bottom; the rows refresh-needed flags
+ *	are rotated along, and the rows scrolled in are scheduled
+ *	for refreshing
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	top	the first row of the range to scroll
+ *	\param	bottom	the last row (inclusive) of the range to scroll
+ *	\param	nr_rows	the number of rows to scroll by; must be in the
+ *			range 0 <= nr_rows <= bottom - top + 1
+ *	\return	none */
+static void scroll_rows_up(struct term_data * tdata, int top, int bottom, int nr_rows)
+{
+int n;
+
+	n = bottom - top + 1;
+	/* rotate the rows left by nr_rows entries */
+	reverse_rows(tdata, top, nr_rows);
+	reverse_rows(tdata, top + nr_rows, n - nr_rows);
+	reverse_rows(tdata, top, n);
+	clear_rows(tdata, bottom - nr_rows + 1, nr_rows);
+	mark_rows_dirty(tdata, bottom - nr_rows + 1, nr_rows);
+	record_scroll(tdata, top, bottom, nr_rows);
+	tdata->stats.nr_scrolls ++;
+	tdata->stats.nr_rows_scrolled += nr_rows;
+}
+
+/*!
+ *	\fn	static void scroll_rows_down(struct term_data * tdata, int top, int bottom, int nr_rows)
+ *	\brief	scrolls down a range of screen rows, clearing the rows scrolled in at the top
+ *
+ *	no screen contents are moved - see the comments for
+ *	scroll_rows_up()
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	top	the first row of the range to scroll
+ *	\param	bottom	the last row (inclusive) of the range to scroll
+ *	\param	nr_rows	the number of rows to scroll by; must be in the
+ *			range 0 <= nr_rows <= bottom - top + 1
+ *	\return	none */
+static void scroll_rows_down(struct term_data * tdata, int top, int bottom, int nr_rows)
+{
+int n;
+
+	n = bottom - top + 1;
+	/* rotate the rows right by nr_rows entries */
+	reverse_rows(tdata, top, n);
+	reverse_rows(tdata, top, nr_rows);
+	reverse_rows(tdata, top + nr_rows, n - nr_rows);
+	clear_rows(tdata, top, nr_rows);
+	mark_rows_dirty(tdata, top, nr_rows);
+	record_scroll(tdata, top, bottom, - nr_rows);
+	tdata->stats.nr_scrolls ++;
+	tdata->stats.nr_rows_scrolled += nr_rows;
+}
+
+/*!
+ *	\fn	static void wrap_cursor(struct term_data * tdata, struct vt102_state * state)
+ *	\brief	moves the cursor to the beginning of the next line, after it has been advanced past the last screen column - scrolls if necessary
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	state	the vt102_state variable associated with this terminal backend;
+ *			this is needed for invoking the handle_linefeed() routine
+ *			in effect (see the comments for display_char())
+ *	\return	none */
+static void wrap_cursor(struct term_data * tdata, struct vt102_state * state)
+{
+	/* the line continues on the next line */
+	tdata->wrapped_line_buf[tdata->cursor_y] = true;
+	tdata->cursor_x = 0;
+	tdata->cursor_y ++;
+	if (tdata->cursor_y == tdata->con_height)
+	{
+		/*! \todo	not really needed... move_cursor_absolute()
+		 *		invoked by handle_linefeed() below will take care
+		 *		of this, but anyway, this is safer... */
+		tdata->cursor_y --;
+		/*! \todo	is this correct? i(sgs) think there is no problem with this... */
+		VT102_BACKEND_CALL(vt102_get_backend_ops(state), handle_linefeed, tdata);
+	}
+	else
+		mark_dirty(tdata, tdata->cursor_y, 0, 1);
+}
+
+/*!
+ *	\fn	static int trimmed_row_width(struct term_data * tdata, int row)
+ *	\brief	returns the width of a screen row, with the trailing blank characters removed
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	row	the screen row
+ *	\return	the width of the row, not counting any trailing
+ *		spaces with default graphics rendition attributes */
+static int trimmed_row_width(struct term_data * tdata, int row)
+{
+const unsigned char * chrow;
+const uint32_t * grrow;
+int w;
+
+	chrow = vt102_generic_backend_chrow(tdata, row);
+	grrow = vt102_generic_backend_grrow(tdata, row);
+	for (w = tdata->con_width; w > 0 && chrow[w - 1] == ' ' && grrow[w - 1] == 0; w--)
+		;
+	return w;
+}
+
+/*!
+ *	\fn	static int get_reflow_line(struct reflow * rf, int i, const unsigned char ** chrow, const uint32_t ** grrow, bool * wrapped)
+ *	\brief	returns a line of the screen contents being reflowed
+ *
+ *	\param	rf	the reflow state
+ *	\param	i	the number of the line (see the comments for struct reflow)
+ *	\param	chrow	where to store a pointer to the character codes of the line
+ *	\param	grrow	where to store a pointer to the graphics rendition
+ *			attributes of the line
+ *	\param	wrapped	where to store if the line wraps onto the next line
+ *	\return	the width of the line - lines which do not wrap are
+ *		trimmed of their trailing blanks, except for the line
+ *		containing the cursor, which is never trimmed up to the
+ *		cursor column */
+static int get_reflow_line(struct reflow * rf, int i, const unsigned char ** chrow, const uint32_t ** grrow, bool * wrapped)
+{
+struct term_data * tdata;
+int row, w;
+
+	if (i < rf->nr_pulled)
+	{
+		i = rf->nr_pulled - 1 - i;
+		* chrow = rf->pulled[i].chrow;
+		* grrow = rf->pulled[i].grrow;
+		* wrapped = rf->pulled[i].wrapped;
+		return rf->pulled[i].width;
+	}
+	tdata = rf->tdata;
+	row = i - rf->nr_pulled;
+	* chrow = vt102_generic_backend_chrow(tdata, row);
+	* grrow = vt102_generic_backend_grrow(tdata, row);
+	* wrapped = tdata->wrapped_line_buf[row] && row < rf->nr_rows_retained - 1;
+	w = tdata->wrapped_line_buf[row] ? tdata->con_width : trimmed_row_width(tdata, row);
+	if (row == tdata->cursor_y && w < tdata->cursor_x)
+		w = tdata->cursor_x;
+	return w;
+}
+
+/*!
+ *	\fn	static void emit_reflow_line(struct reflow * rf, int first_line, int len, int first_row, int nr_rows)
+ *	\brief	lays out a logical line at the new screen width
+ *
+ *	the rows above the new screen are pushed to the scrollback
+ *	history buffer (they are put together in the first row of the
+ *	new screen, which is only filled in afterwards), and the rows
+ *	below the new screen are discarded
+ *
+ *	\param	rf	the reflow state
+ *	\param	first_line	the number of the first line of the logical line
+ *	\param	len	the length of the logical line
+ *	\param	first_row	the number of the first row of the logical line
+ *	\param	nr_rows	the number of rows the logical line takes
+ *	\return	none */
+static void emit_reflow_line(struct reflow * rf, int first_line, int len, int first_row, int nr_rows)
+{
+struct term_data * dst;
+const unsigned char * src_ch;
+const uint32_t * src_gr;
+unsigned char * chrow;
+uint32_t * grrow;
+bool wrapped;
+int i, row, x, n, pos, line, src_width, src_pos;
+
+	dst = rf->dst;
+	line = first_line;
+	src_width = get_reflow_line(rf, line, &src_ch, &src_gr, &wrapped);
+	for (pos = src_pos = i = 0; i < nr_rows; i++)
+	{
+		row = first_row + i;
+		if (row >= rf->top + dst->con_height)
+			return;
+		chrow = vt102_generic_backend_chrow(dst, (row < rf->top) ? 0 : row - rf->top);
+		grrow = vt102_generic_backend_grrow(dst, (row < rf->top) ? 0 : row - rf->top);
+		for (x = 0; x < dst->con_width && pos < len; x += n, pos += n, src_pos += n)
+		{
+			if (src_pos == src_width)
+			{
+				src_width = get_reflow_line(rf, ++ line, &src_ch, &src_gr, &wrapped);
+				src_pos = n = 0;
+				continue;
+			}
+			n = src_width - src_pos;
+			if (n > dst->con_width - x)
+				n = dst->con_width - x;
+			memcpy(chrow + x, src_ch + src_pos, n);
+			memcpy(grrow + x, src_gr + src_pos, n * sizeof * grrow);
+		}
+		memset(chrow + x, ' ', dst->con_width - x);
+		memset(grrow + x, 0, (dst->con_width - x) * sizeof * grrow);
+		rf->tdata->stats.nr_bytes_moved += x * (sizeof * chrow + sizeof * grrow);
+		if (row >= rf->top)
+			dst->wrapped_line_buf[row - rf->top] = i < nr_rows - 1;
+		else if (rf->tdata->scrollback)
+			vt102_scrollback_push_line(rf->tdata->scrollback, chrow, grrow, dst->con_width, i < nr_rows - 1);
+	}
+}
+
+/*!
+ *	\fn	static void layout_reflow(struct reflow * rf, bool emit)
+ *	\brief	lays out the screen contents being reflowed at the new screen width
+ *
+ *	\param	rf	the reflow state
+ *	\param	emit	if false, only the number of rows laid out, and the
+ *			new cursor position, are computed; otherwise, the rows
+ *			are stored (see emit_reflow_line())
+ *	\return	none */
+static void layout_reflow(struct reflow * rf, bool emit)
+{
+const unsigned char * chrow;
+const uint32_t * grrow;
+bool wrapped;
+int i, j, len, cursor_offset, cursor_line, row, nr_rows, width;
+
+	width = rf->dst->con_width;
+	cursor_line = rf->nr_pulled + rf->tdata->cursor_y;
+	for (row = i = 0; i < rf->nr_pulled + rf->nr_rows_retained; i = j, row += nr_rows)
+	{
+		/* find the extent of the logical line starting at line i */
+		cursor_offset = -1;
+		for (len = 0, j = i; j < rf->nr_pulled + rf->nr_rows_retained; )
+		{
+			if (j == cursor_line)
+				cursor_offset = len + rf->tdata->cursor_x;
+			len += get_reflow_line(rf, j++, &chrow, &grrow, &wrapped);
+			if (!wrapped)
+				break;
+		}
+		nr_rows = len ? (len + width - 1) / width : 1;
+		if (cursor_offset != -1)
+		{
+			if (cursor_offset / width >= nr_rows)
+				nr_rows = cursor_offset / width + 1;
+			rf->cursor_x = cursor_offset % width;
+			rf->cursor_y = row + cursor_offset / width;
+		}
+		if (emit)
+			emit_reflow_line(rf, i, len, row, nr_rows);
+	}
+	rf->nr_rows = row;
+}
+
+/*!
+ *	\fn	static struct reflow_line * pull_history(struct reflow * rf)
+ *	\brief	pulls lines back from the scrollback history buffer, to fill the space freed at the top of the reflowed screen
+ *
+ *	lines are pulled back until the reflowed screen contents are
+ *	(about to be) at least as high as the new screen, at the start
+ *	of a logical line; in any case, the lines of the logical line
+ *	continuing at the top of the screen are pulled back, so that
+ *	the logical line can be reflowed as a whole - unless it is
+ *	more than twice as high as the new screen, in which case only
+ *	its most recent part is pulled back
+ *
+ *	\param	rf	the reflow state; the number of rows of the screen
+ *			contents alone must have been computed
+ *	\return	a pointer to the memory block holding the lines pulled
+ *		back (which the caller must release), or null if no lines
+ *		have been pulled back (or on failure - out of memory) */
+static struct reflow_line * pull_history(struct reflow * rf)
+{
+struct vt102_scrollback * sb;
+struct reflow_line * pulled;
+unsigned char * chbuf;
+uint32_t * grbuf;
+bool wrapped, boundary;
+int i, n, w, nr_lines, nr_rows, len, nr_cells, width;
+
+	if (!(sb = rf->tdata->scrollback) || !(nr_lines = vt102_scrollback_get_nr_lines(sb)))
+		return 0;
+	width = rf->dst->con_width;
+	vt102_scrollback_get_line_info(sb, 0, &wrapped);
+	if (rf->nr_rows >= rf->dst->con_height && !wrapped)
+		return 0;
+	/* decide how many lines to pull back */
+	for (nr_rows = rf->nr_rows, nr_cells = len = n = 0; n < nr_lines; )
+	{
+		nr_cells += (w = vt102_scrollback_get_line_info(sb, n ++, 0));
+		len += w;
+		boundary = n == nr_lines || (vt102_scrollback_get_line_info(sb, n, &wrapped), !wrapped);
+		if (boundary)
+		{
+			nr_rows += len ? (len + width - 1) / width : 1;
+			len = 0;
+			if (nr_rows >= rf->dst->con_height)
+				break;
+		}
+		else if (nr_rows + len / width >= 2 * rf->dst->con_height)
+			break;
+	}
+	if (!(pulled = malloc(n * sizeof * pulled + nr_cells * (sizeof * chbuf + sizeof * grbuf))))
+		return 0;
+	grbuf = (uint32_t *) (pulled + n);
+	chbuf = (unsigned char *) (grbuf + nr_cells);
+	/* retrieve the lines, most recent first, and remove them from the history */
+	for (i = 0; i < n; i++)
+	{
+		w = vt102_scrollback_get_line_info(sb, 0, &pulled[i].wrapped);
+		if (vt102_scrollback_get_line(sb, 0, chbuf, grbuf, w) == -1)
+			break;
+		pulled[i].chrow = chbuf;
+		pulled[i].grrow = grbuf;
+		pulled[i].width = w;
+		chbuf += w;
+		grbuf += w;
+		vt102_scrollback_pop_line(sb);
+	}
+	if (!(rf->nr_pulled = i))
+	{
+		free(pulled);
+		return 0;
+	}
+	return pulled;
+}
+
+/*!
+ *	\fn	static bool grow_arena(struct term_data * tdata, int new_width, int new_height, int nr_rows)
+ *	\brief	moves the screen buffers to a memory block large enough for new screen dimensions
+ *
+ *	the spare memory block (see the spare_arena field of struct
+ *	term_data) is used if the new dimensions fit within its capacity,
+ *	otherwise a new block is allocated, leaving some room for growing
+ *	further; the block the screen was held in becomes the spare one
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	new_width	the new width of the screen
+ *	\param	new_height	the new height of the screen
+ *	\param	nr_rows	the number of rows, from the top of the screen,
+ *			to copy over to the new block, at the current screen
+ *			width; the rows are stored in order in the new block,
+ *			the row offsets must be reset (see reset_row_offsets())
+ *			once the new screen dimensions are set
+ *	\return	true on success, false on failure (out of memory) - in
+ *		which case the screen buffers are left unchanged */
+static bool grow_arena(struct term_data * tdata, int new_width, int new_height, int nr_rows)
+{
+void * old_arena;
+unsigned char * old_chbuf;
+uint32_t * old_grbuf;
+int * old_row_offsets;
+bool * old_wrapped_line_buf;
+int i, w, cell_capacity, row_capacity, old_cell_capacity, old_row_capacity;
+
+	w = tdata->con_width;
+	old_arena = tdata->arena;
+	old_cell_capacity = tdata->cell_capacity;
+	old_row_capacity = tdata->row_capacity;
+	old_chbuf = tdata->chbuf;
+	old_grbuf = tdata->grbuf;
+	old_row_offsets = tdata->row_offsets;
+	old_wrapped_line_buf = tdata->wrapped_line_buf;
+	if (tdata->spare_arena && new_width * new_height <= tdata->spare_cell_capacity
+			&& new_height <= tdata->spare_row_capacity)
+	{
+		tdata->arena = tdata->spare_arena;
+		cell_capacity = tdata->spare_cell_capacity;
+		row_capacity = tdata->spare_row_capacity;
+	}
+	else
+	{
+		cell_capacity = new_width * new_height;
+		if (cell_capacity < tdata->cell_capacity + tdata->cell_capacity / 2)
+			cell_capacity = tdata->cell_capacity + tdata->cell_capacity / 2;
+		row_capacity = new_height;
+		if (row_capacity < tdata->row_capacity + tdata->row_capacity / 2)
+			row_capacity = tdata->row_capacity + tdata->row_capacity / 2;
+		if (!(tdata->arena = malloc(arena_size(cell_capacity, row_capacity))))
+		{
+			tdata->arena = old_arena;
+			return false;
+		}
+		free(tdata->spare_arena);
+		tdata->stats.nr_resize_allocs ++;
+	}
+	set_arena(tdata, tdata->arena, cell_capacity, row_capacity);
+	for (i = 0; i < nr_rows; i++)
+	{
+		memcpy(tdata->chbuf + i * w, old_chbuf + old_row_offsets[i], w);
+		memcpy(tdata->grbuf + i * w, old_grbuf + old_row_offsets[i], w * sizeof * tdata->grbuf);
+	}
+	memcpy(tdata->wrapped_line_buf, old_wrapped_line_buf, nr_rows * sizeof * tdata->wrapped_line_buf);
+	/* the old block becomes the spare one */
+	tdata->spare_arena = old_arena;
+	tdata->spare_cell_capacity = old_cell_capacity;
+	tdata->spare_row_capacity = old_row_capacity;
+	tdata->stats.nr_bytes_moved += nr_rows * w * (sizeof * tdata->chbuf + sizeof * tdata->grbuf);
+	return true;
+}
+
+/*!
+ *	\fn	static bool reflow_screen(struct term_data * tdata, int new_width, int new_height)
+ *	\brief	changes the screen dimensions, reflowing the logical lines on the screen to the new width
+ *
+ *	the screen contents are laid out anew, in another memory block -
+ *	the spare one (see the spare_arena field of struct term_data), if
+ *	the new dimensions fit within its capacity, or a new one;
+ *	when the reflowed contents do not fit in the new screen, the
+ *	rows at the top are pushed to the scrollback history buffer,
+ *	and when there is room left, lines are pulled back from the
+ *	scrollback history buffer (see pull_history()); the cursor
+ *	stays at the same character of its logical line, and is
+ *	always kept on the screen
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	new_width	the new width of the vt102 terminal screen
+ *	\param	new_height	the new height of the vt102 terminal screen
+ *	\return	true on success, false on failure (out of memory) - in
+ *		which case the screen is left unchanged */
+static bool reflow_screen(struct term_data * tdata, int new_width, int new_height)
+{
+struct term_data dst;
+struct reflow rf;
+struct reflow_line * pulled;
+int cell_capacity, row_capacity, i;
+
+	cell_capacity = tdata->cell_capacity;
+	row_capacity = tdata->row_capacity;
+	if (new_width * new_height > cell_capacity)
+	{
+		cell_capacity = new_width * new_height;
+		if (cell_capacity < tdata->cell_capacity + tdata->cell_capacity / 2)
+			cell_capacity = tdata->cell_capacity + tdata->cell_capacity / 2;
+	}
+	if (new_height > row_capacity)
+	{
+		row_capacity = new_height;
+		if (row_capacity < tdata->row_capacity + tdata->row_capacity / 2)
+			row_capacity = tdata->row_capacity + tdata->row_capacity / 2;
+	}
+	memset(&dst, 0, sizeof dst);
+	if (tdata->spare_arena && new_width * new_height <= tdata->spare_cell_capacity
+			&& new_height <= tdata->spare_row_capacity)
+	{
+		/* reflow into the spare block */
+		dst.arena = tdata->spare_arena;
+		cell_capacity = tdata->spare_cell_capacity;
+		row_capacity = tdata->spare_row_capacity;
+	}
+	else
+	{
+		if (!(dst.arena = malloc(arena_size(cell_capacity, row_capacity))))
+			return false;
+		free(tdata->spare_arena);
+		tdata->spare_arena = 0;
+		tdata->stats.nr_resize_allocs ++;
+	}
+	set_arena(&dst, dst.arena, cell_capacity, row_capacity);
+	dst.con_width = new_width;
+	dst.con_height = new_height;
+	reset_row_offsets(&dst);
+
+	memset(&rf, 0, sizeof rf);
+	rf.tdata = tdata;
+	rf.dst = &dst;
+	/* blank rows below the cursor are not retained */
+	for (rf.nr_rows_retained = tdata->con_height; rf.nr_rows_retained > tdata->cursor_y + 1; rf.nr_rows_retained--)
+	{
+		i = rf.nr_rows_retained - 1;
+		if (tdata->wrapped_line_buf[i] || trimmed_row_width(tdata, i))
+			break;
+	}
+	layout_reflow(&rf, false);
+	if ((pulled = pull_history(&rf)))
+	{
+		rf.pulled = pulled;
+		layout_reflow(&rf, false);
+	}
+	/* keep the most recent rows, and the cursor, on the screen */
+	rf.top = (rf.nr_rows > new_height) ? rf.nr_rows - new_height : 0;
+	if (rf.cursor_y < rf.top)
+		rf.top = rf.cursor_y;
+	layout_reflow(&rf, true);
+	free(pulled);
+	/* clear the rows not filled in */
+	for (i = rf.nr_rows - rf.top; i < new_height; i++)
+	{
+		clear_cells(&dst, i, 0, new_width);
+		dst.wrapped_line_buf[i] = false;
+	}
+
+	/* the block the screen was held in becomes the spare one */
+	tdata->spare_arena = tdata->arena;
+	tdata->spare_cell_capacity = tdata->cell_capacity;
+	tdata->spare_row_capacity = tdata->row_capacity;
+	set_arena(tdata, dst.arena, cell_capacity, row_capacity);
+	tdata->con_width = new_width;
+	tdata->con_height = new_height;
+	tdata->cursor_x = rf.cursor_x;
+	tdata->cursor_y = rf.cursor_y - rf.top;
+	return true;
+}
 
 /*
  *
@@ -129,8 +992,8 @@ int prev_x, prev_y;
  *
  *	\param	tdata	a pointer to the term_data
  *			structure holding the vt102 screen state
- *	\param	ch	the input character to put in the buffer
- *			(at the current cursor position)
+ *	\param	ch	the input character (a unicode code point) to put in
+ *			the buffer (at the current cursor position)
  *	\param	state	the vt102_state variable associated with this terminal backend;
  *			the 'state' pointer variable is needed because
  *			the display_char() routine may need to scroll
@@ -164,33 +1027,79 @@ int i, cx, cy;
 	cx = tdata->cursor_x;
 	cy = tdata->cursor_y;
 
-	tdata->chbuf[cy * tdata->con_width + cx] = ch;
-	i = tdata->grbuf[cy * tdata->con_width + cx]
-		= tdata->cur_fg_gc_idx | (tdata->cur_bg_gc_idx << 4);
-	/* schedule this line for updating */
-	tdata->must_refresh_line_buf[cy] = true;
+	if (ch > VT102_MAX_CELL_CHAR)
+		ch = VT102_REPLACEMENT_CHAR;
+	i = tdata->row_offsets[cy] + cx;
+	tdata->chbuf[i] = ch;
+	tdata->grbuf[i] = tdata->cur_attr | (ch >> 8) << VT102_ATTR_CHAR_SHIFT;
+	/* schedule this character for updating */
+	mark_dirty(tdata, cy, cx, cx + 1);
+	tdata->stats.nr_chars_written ++;
 
 	/* advance cursor */
         tdata->cursor_x ++;
         if (tdata->cursor_x == tdata->con_width)
-        {
-                tdata->cursor_x = 0;
-                tdata->cursor_y ++;
-                if (tdata->cursor_y == tdata->con_height)
-                {
-                        /*! \todo	not really needed... move_cursor_absolute()
-                         *		invoked by handle_linefeed() below will take care
-                         *		of this, but anyway, this is safer... */
-                        tdata->cursor_y --;
-                        /*! \todo	is this correct? i(sgs) think there is no problem with this... */
-                        vt102_get_backend_ops(state)->handle_linefeed(tdata);
-                }
-                else
-                        tdata->must_refresh_line_buf[cy + 1] = true;
-        }
+                wrap_cursor(tdata, state);
         tdata->must_refresh = true;
 }
 
+/*!
+ *	\fn	static void display_string(struct term_data * tdata, const unsigned char * s, int n, struct vt102_state * state)
+ *	\brief	puts a string of characters in the vt102 screen buffer (starting at the current cursor position)
+ *
+ *	the effect is the same as calling display_char() for each
+ *	of the characters in the string, but whole row spans are
+ *	copied at once and each row touched is only marked for
+ *	refreshing once
+ *
+ *	\note	this function is invoked by the vt102 terminal
+ *		emulator command parser module
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	s	the characters to put in the buffer
+ *	\param	n	the number of characters to put in the buffer
+ *	\param	state	the vt102_state variable associated with this terminal backend;
+ *			see the comments for display_char() about why this is needed
+ *	\return	none */
+static void display_string(struct term_data * tdata, const unsigned char * s, int n, struct vt102_state * state)
+{
+int i, j, pos;
+uint32_t gr, * grrow;
+
+	if (tdata->cursor_x >= tdata->con_width)
+	{
+		*(int *)0 = 0;
+	}
+	if (tdata->cursor_y >= tdata->con_height)
+	{
+		*(int *)0 = 0;
+	}
+
+	gr = tdata->cur_attr;
+	while (n > 0)
+	{
+		/* compute the number of characters that fit in the current row */
+		i = tdata->con_width - tdata->cursor_x;
+		if (i > n)
+			i = n;
+		pos = tdata->row_offsets[tdata->cursor_y] + tdata->cursor_x;
+		memcpy(tdata->chbuf + pos, s, i);
+		for (grrow = tdata->grbuf + pos, j = 0; j < i; j++)
+			grrow[j] = gr;
+		tdata->stats.nr_chars_written += i;
+		/* schedule these characters for updating */
+		mark_dirty(tdata, tdata->cursor_y, tdata->cursor_x, tdata->cursor_x + i);
+		s += i;
+		n -= i;
+		/* advance cursor */
+		tdata->cursor_x += i;
+		if (tdata->cursor_x == tdata->con_width)
+			wrap_cursor(tdata, state);
+	}
+	tdata->must_refresh = true;
+}
+
 
 /*!
  *	\fn	static void move_cursor_absolute(struct term_data * tdata, int x, int y)
@@ -254,9 +1163,8 @@ static void move_cursor_column_absolute(struct term_data * tdata, int x)
  *	\return	none */
 static void erase_line_at_cursor(struct term_data * tdata)
 {
-	memset(tdata->chbuf + tdata->cursor_y * tdata->con_width, ' ', tdata->con_width);
-	memset(tdata->grbuf + tdata->cursor_y * tdata->con_width, 0, tdata->con_width);
-	tdata->must_refresh_line_buf[tdata->cursor_y] = true;
+	clear_rows(tdata, tdata->cursor_y, 1);
+	mark_rows_dirty(tdata, tdata->cursor_y, 1);
 
 	tdata->must_refresh = true;
 }
@@ -275,9 +1183,8 @@ static void erase_line_at_cursor(struct term_data * tdata)
  *	\return	none */
 static void erase_line_from_beginning_to_cursor(struct term_data * tdata)
 {
-	memset(tdata->chbuf + tdata->cursor_y * tdata->con_width, ' ', tdata->cursor_x + 1);
-	memset(tdata->grbuf + tdata->cursor_y * tdata->con_width, 0, tdata->cursor_x + 1);
-	tdata->must_refresh_line_buf[tdata->cursor_y] = true;
+	clear_cells(tdata, tdata->cursor_y, 0, tdata->cursor_x + 1);
+	mark_dirty(tdata, tdata->cursor_y, 0, tdata->cursor_x + 1);
 
 	tdata->must_refresh = true;
 }
@@ -295,9 +1202,9 @@ static void erase_line_from_beginning_to_cursor(struct term_data * tdata)
  *	\return	none */
 static void erase_line_from_cursor_to_end(struct term_data * tdata)
 {
-	memset(tdata->chbuf + tdata->cursor_y * tdata->con_width + tdata->cursor_x, ' ', tdata->con_width - tdata->cursor_x);
-	memset(tdata->grbuf + tdata->cursor_y * tdata->con_width + tdata->cursor_x, 0, tdata->con_width - tdata->cursor_x);
-	tdata->must_refresh_line_buf[tdata->cursor_y] = true;
+	clear_cells(tdata, tdata->cursor_y, tdata->cursor_x, tdata->con_width - tdata->cursor_x);
+	mark_dirty(tdata, tdata->cursor_y, tdata->cursor_x, tdata->con_width);
+	tdata->wrapped_line_buf[tdata->cursor_y] = false;
 
 	tdata->must_refresh = true;
 }
@@ -314,9 +1221,13 @@ static void erase_line_from_cursor_to_end(struct term_data * tdata)
  *	\return	none */
 static void erase_display(struct term_data * tdata)
 {
+	/* the row offsets are a permutation of the rows
+	 * in the buffers - just clear the buffers */
 	memset(tdata->chbuf, ' ', tdata->con_height * tdata->con_width);
-	memset(tdata->grbuf, 0, tdata->con_height * tdata->con_width);
-	memset(tdata->must_refresh_line_buf, true, tdata->con_height);
+	memset(tdata->grbuf, 0, tdata->con_height * tdata->con_width * sizeof * tdata->grbuf);
+	tdata->stats.nr_bytes_cleared += tdata->con_height * tdata->con_width * (sizeof * tdata->chbuf + sizeof * tdata->grbuf);
+	memset(tdata->wrapped_line_buf, 0, tdata->con_height * sizeof * tdata->wrapped_line_buf);
+	mark_rows_dirty(tdata, 0, tdata->con_height);
 
 	tdata->must_refresh = true;
 }
@@ -334,9 +1245,8 @@ static void erase_display(struct term_data * tdata)
  *	\return	none */
 static void erase_display_from_beginning_to_cursor(struct term_data * tdata)
 {
-	memset(tdata->chbuf, ' ', tdata->cursor_y * tdata->con_width + tdata->cursor_x + 1);
-	memset(tdata->grbuf, 0, tdata->cursor_y * tdata->con_width + tdata->cursor_x + 1);
-	memset(tdata->must_refresh_line_buf, true, tdata->cursor_y + 1);
+	clear_rows(tdata, 0, tdata->cursor_y);
+	mark_rows_dirty(tdata, 0, tdata->cursor_y);
 	/* erase (the part of) the line containing the cursor */
 	erase_line_from_beginning_to_cursor(tdata);
 
@@ -356,9 +1266,8 @@ static void erase_display_from_beginning_to_cursor(struct term_data * tdata)
  *	\return	none */
 static void erase_display_from_cursor_to_end(struct term_data * tdata)
 {
-	memset(tdata->chbuf + tdata->cursor_y * tdata->con_width + tdata->cursor_x, ' ', tdata->con_width * tdata->con_height - (tdata->cursor_y * tdata->con_width + tdata->cursor_x));
-	memset(tdata->grbuf + tdata->cursor_y * tdata->con_width + tdata->cursor_x, 0, tdata->con_width * tdata->con_height - (tdata->cursor_y * tdata->con_width + tdata->cursor_x));
-	memset(tdata->must_refresh_line_buf + tdata->cursor_y, true, tdata->con_height - tdata->cursor_y);
+	clear_rows(tdata, tdata->cursor_y + 1, tdata->con_height - tdata->cursor_y - 1);
+	mark_rows_dirty(tdata, tdata->cursor_y + 1, tdata->con_height - tdata->cursor_y - 1);
 	/* erase (the part of) the line containing the cursor */
 	erase_line_from_cursor_to_end(tdata);
 
@@ -410,7 +1319,7 @@ int i;
 	i = ((tdata->cursor_x + 8) & ~ 7) - tdata->cursor_x;
 	/* insert spaces */
 	while (i--)
-                vt102_get_backend_ops(state)->display_char(tdata, ' ', state);
+                VT102_BACKEND_CALL(vt102_get_backend_ops(state), display_char, tdata, ' ', state);
 
 	tdata->must_refresh = true;
 }
@@ -429,17 +1338,15 @@ static void handle_linefeed(struct term_data * tdata)
 {
 	if (tdata->cursor_y == tdata->margin_bottom)
 	{
+		/* save the line scrolled off the top of the screen */
+		if (tdata->scrollback && tdata->margin_top == 0)
+			vt102_scrollback_push_line(tdata->scrollback,
+					vt102_generic_backend_chrow(tdata, 0),
+					vt102_generic_backend_grrow(tdata, 0),
+					tdata->con_width,
+					tdata->wrapped_line_buf[0]);
 		/* scroll up */
-		memmove(tdata->chbuf + tdata->margin_top * tdata->con_width,
-				tdata->chbuf + (tdata->margin_top + 1) * tdata->con_width,
-				(tdata->margin_bottom - tdata->margin_top) * tdata->con_width);
-		memmove(tdata->grbuf + tdata->margin_top * tdata->con_width,
-				tdata->grbuf + (tdata->margin_top + 1) * tdata->con_width,
-				(tdata->margin_bottom - tdata->margin_top) * tdata->con_width);
-		memset(tdata->chbuf + tdata->margin_bottom * tdata->con_width, ' ', tdata->con_width);
-		memset(tdata->grbuf + tdata->margin_bottom * tdata->con_width, 0, tdata->con_width);
-		memset(tdata->must_refresh_line_buf + tdata->margin_top, 1,
-				tdata->margin_bottom - tdata->margin_top + 1);
+		scroll_rows_up(tdata, tdata->margin_top, tdata->margin_bottom, 1);
 	}
 	move_cursor_absolute(tdata, tdata->cursor_x, tdata->cursor_y + 1);
 
@@ -493,6 +1400,25 @@ static void set_top_and_bottom_margins(struct term_data * tdata, int top, int bo
 	tdata->margin_bottom = bottom;
 }
 
+/*!
+ *	\fn	static void set_synchronized_update(struct term_data * tdata, bool enable)
+ *	\brief	begins or ends a synchronized update (see the comments
+ *		about the sync_update field of struct term_data)
+ *
+ *	\note	this function is invoked by the vt102 terminal
+ *		emulator command parser module
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	enable	true when the update begins, false when it ends
+ *	\return	none */
+static void set_synchronized_update(struct term_data * tdata, bool enable)
+{
+	if (!enable && tdata->sync_update)
+		tdata->stats.nr_sync_updates ++;
+	tdata->sync_update = enable;
+}
+
 /*!
  *	\fn	static void insert_lines_at_cursor(struct term_data * tdata, int nr_lines)
  *	\brief	inserts a number of lines at (before) the line containing the cursor
@@ -518,20 +1444,7 @@ int i;
 	i = tdata->cursor_y + nr_lines;
 	if (i > tdata->margin_bottom)
 		nr_lines = tdata->margin_bottom - tdata->cursor_y + 1;
-	else
-	{
-		/* move lines */
-		memmove(tdata->chbuf + i * tdata->con_width,
-				tdata->chbuf + tdata->cursor_y * tdata->con_width,
-				(tdata->margin_bottom - i + 1) * tdata->con_width);
-		memmove(tdata->grbuf + i * tdata->con_width,
-				tdata->grbuf + tdata->cursor_y * tdata->con_width,
-				(tdata->margin_bottom - i + 1) * tdata->con_width);
-	}
-	memset(tdata->chbuf + tdata->cursor_y * tdata->con_width, ' ', nr_lines * tdata->con_width);
-	memset(tdata->grbuf + tdata->cursor_y * tdata->con_width, 0, nr_lines * tdata->con_width);
-	memset(tdata->must_refresh_line_buf + tdata->cursor_y, 1,
-			tdata->margin_bottom - tdata->cursor_y + 1);
+	scroll_rows_down(tdata, tdata->cursor_y, tdata->margin_bottom, nr_lines);
 	tdata->must_refresh = true;
 }
 
@@ -561,24 +1474,7 @@ int i;
 	i = tdata->cursor_y + nr_lines;
 	if (i > tdata->margin_bottom)
 		nr_lines = tdata->margin_bottom - tdata->cursor_y + 1;
-	else
-	{
-		/* move lines */
-		memmove(tdata->chbuf + tdata->cursor_y * tdata->con_width,
-				tdata->chbuf + i * tdata->con_width,
-				(tdata->margin_bottom - i + 1) * tdata->con_width);
-		memmove(tdata->grbuf + tdata->cursor_y * tdata->con_width,
-				tdata->grbuf + i * tdata->con_width,
-				(tdata->margin_bottom - i + 1) * tdata->con_width);
-	}
-	memset(tdata->chbuf + (tdata->margin_bottom - nr_lines + 1) * tdata->con_width,
-			' ',
-			nr_lines * tdata->con_width);
-	memset(tdata->grbuf + (tdata->margin_bottom - nr_lines + 1) * tdata->con_width,
-			0,
-			nr_lines * tdata->con_width);
-	memset(tdata->must_refresh_line_buf + tdata->cursor_y, 1,
-			tdata->margin_bottom - tdata->cursor_y + 1);
+	scroll_rows_up(tdata, tdata->cursor_y, tdata->margin_bottom, nr_lines);
 	tdata->must_refresh = true;
 }
 /*!
@@ -597,19 +1493,26 @@ int i;
 static void delete_characters_at_cursor(struct term_data * tdata, int nr_characters)
 {
 int i;
+unsigned char * chrow;
+uint32_t * grrow;
 
         if (nr_characters <= 0)
                 return;
         i = tdata->con_width - tdata->cursor_x;
         if (nr_characters > i)
                 nr_characters = i;
-        memmove(tdata->chbuf + tdata->cursor_y * tdata->con_width + tdata->cursor_x,
-                      tdata->chbuf + tdata->cursor_y * tdata->con_width + tdata->cursor_x + nr_characters,
+        chrow = vt102_generic_backend_chrow(tdata, tdata->cursor_y);
+        grrow = vt102_generic_backend_grrow(tdata, tdata->cursor_y);
+        memmove(chrow + tdata->cursor_x,
+                      chrow + tdata->cursor_x + nr_characters,
                       i - nr_characters);
-        memset(tdata->chbuf + (tdata->cursor_y + 1) * tdata->con_width - nr_characters,
-                      ' ',
-                      nr_characters);
-        tdata->must_refresh_line_buf[tdata->cursor_y] = true;
+        /* the attributes move along with the characters */
+        memmove(grrow + tdata->cursor_x,
+                      grrow + tdata->cursor_x + nr_characters,
+                      (i - nr_characters) * sizeof * grrow);
+        tdata->stats.nr_bytes_moved += (i - nr_characters) * (sizeof * chrow + sizeof * grrow);
+        clear_cells(tdata, tdata->cursor_y, tdata->con_width - nr_characters, nr_characters);
+        mark_dirty(tdata, tdata->cursor_y, tdata->cursor_x, tdata->con_width);
         tdata->must_refresh = true;
 
 }
@@ -629,23 +1532,80 @@ static void cursor_reverse_index(struct term_data * tdata)
 	if (tdata->cursor_y == tdata->margin_top)
 	{
 		/* scroll down */
-		memmove(tdata->chbuf + (tdata->margin_top + 1) * tdata->con_width,
-				tdata->chbuf + tdata->margin_top * tdata->con_width,
-				(tdata->margin_bottom - tdata->margin_top) * tdata->con_width);
-		memmove(tdata->grbuf + (tdata->margin_top + 1) * tdata->con_width,
-				tdata->grbuf + tdata->margin_top * tdata->con_width,
-				(tdata->margin_bottom - tdata->margin_top) * tdata->con_width);
-		memset(tdata->chbuf + tdata->margin_top * tdata->con_width, ' ', tdata->con_width);
-		memset(tdata->grbuf + tdata->margin_top * tdata->con_width, ' ', tdata->con_width);
-
-		memset(tdata->must_refresh_line_buf + tdata->margin_top, 1,
-				tdata->margin_bottom - tdata->margin_top + 1);
+		scroll_rows_down(tdata, tdata->margin_top, tdata->margin_bottom, 1);
 	}
 	move_cursor_relative(tdata, tdata->cursor_x, -1);
 
 	tdata->must_refresh = true;
 }
 
+/*!
+ *	\fn	static void set_color(struct term_data * tdata, int shift, int color)
+ *	\brief	selects the foreground or the background color of the graphics rendition attributes currently selected
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	shift	VT102_ATTR_FG_SHIFT to select the foreground
+ *			color, VT102_ATTR_BG_SHIFT to select the
+ *			background color
+ *	\param	color	the color palette index to select
+ *	\return	none */
+static void set_color(struct term_data * tdata, int shift, int color)
+{
+	tdata->cur_attr = (tdata->cur_attr & ~ (VT102_ATTR_COLOR_MASK << shift)) | (color << shift);
+}
+
+/*!
+ *	\fn	static int color_cube_level(unsigned int intensity)
+ *	\brief	maps a color component intensity to the nearest level of the palette color cube
+ *
+ *	\param	intensity	the color component intensity, 0 - 255;
+ *				larger values are treated as 255
+ *	\return	the color cube level, 0 - 5 */
+static int color_cube_level(unsigned int intensity)
+{
+	if (intensity > 255)
+		intensity = 255;
+	/* the color cube levels are 0, 95, 135, 175, 215, 255 */
+	return intensity < 48 ? 0 : intensity < 115 ? 1 : (intensity - 35) / 40;
+}
+
+/*!
+ *	\fn	static int parse_extended_color(unsigned int * cmd_params, int nr_params, int * color)
+ *	\brief	parses the parameters of an extended color selection (the SGR 38 and 48 parameters)
+ *
+ *	the parameters supported are '5; n' (palette index
+ *	'n') and '2; r; g; b' (24 bit color, mapped to the
+ *	nearest color in the palette color cube)
+ *
+ *	\param	cmd_params	a pointer to the parameters following
+ *				the 38 or 48 parameter
+ *	\param	nr_params	the number of parameters in the
+ *				cmd_params buffer
+ *	\param	color	the color palette index selected is stored here,
+ *			or -1, if the parameters are invalid
+ *	\return	the number of parameters consumed */
+static int parse_extended_color(unsigned int * cmd_params, int nr_params, int * color)
+{
+	* color = -1;
+	if (nr_params >= 2 && cmd_params[0] == 5)
+	{
+		if (cmd_params[1] < VT102_NR_PALETTE_COLORS)
+			* color = cmd_params[1];
+		return 2;
+	}
+	if (nr_params >= 4 && cmd_params[0] == 2)
+	{
+		* color = 16 + 36 * color_cube_level(cmd_params[1])
+			+ 6 * color_cube_level(cmd_params[2])
+			+ color_cube_level(cmd_params[3]);
+		return 4;
+	}
+	/* malformed - there is no telling where the extended
+	 * color selection ends, so skip the rest of the parameters */
+	return nr_params;
+}
+
 /*!
  *	\fn	void select_graphic_rendition(struct term_data * tdata, unsigned int * cmd_params, int nr_params)
  *	\brief	handles a graphic rendition command request
@@ -654,7 +1614,9 @@ static void cursor_reverse_index(struct term_data * tdata)
  *		emulator command parser module
  *
  *	\note	consult the DEC vt102 and/or the ecma 048
- *		standard for details
+ *		standard for details; the aixterm bright colors
+ *		(90 - 97, 100 - 107) and the xterm extended colors
+ *		(38 and 48) are supported as well
  *
  *	\param	tdata	a pointer to the term_data
  *			structure holding the vt102 screen state
@@ -673,30 +1635,64 @@ int i, t;
 		{
 			case 0:
 				/* revert to default */
-				tdata->cur_fg_gc_idx = 7;
-				tdata->cur_bg_gc_idx = 0;
+				tdata->cur_attr = VT102_ATTR_DEFAULT;
+				break;
+			case 1:
+				tdata->cur_attr |= VT102_ATTR_BOLD;
+				break;
+			case 4:
+				tdata->cur_attr |= VT102_ATTR_UNDERLINE;
+				break;
+			case 5:
+				tdata->cur_attr |= VT102_ATTR_BLINK;
+				break;
+			case 7:
+				/* negative image */
+				tdata->cur_attr |= VT102_ATTR_REVERSE;
+				break;
+			case 22:
+				tdata->cur_attr &= ~ VT102_ATTR_BOLD;
+				break;
+			case 24:
+				tdata->cur_attr &= ~ VT102_ATTR_UNDERLINE;
+				break;
+			case 25:
+				tdata->cur_attr &= ~ VT102_ATTR_BLINK;
+				break;
+			case 27:
+				tdata->cur_attr &= ~ VT102_ATTR_REVERSE;
 				break;
 			case 30 ... 37:
-				t = cmd_params[i] - 30;
-				tdata->cur_fg_gc_idx = t;
+				set_color(tdata, VT102_ATTR_FG_SHIFT, cmd_params[i] - 30);
+				break;
+			case 38:
+				i += parse_extended_color(cmd_params + i + 1, nr_params - i - 1, &t);
+				if (t != -1)
+					set_color(tdata, VT102_ATTR_FG_SHIFT, t);
 				break;
 			case 39:
-                                tdata->cur_fg_gc_idx = 7;
+				set_color(tdata, VT102_ATTR_FG_SHIFT, 7);
 				break;
 			case 40 ... 47:
-				t = cmd_params[i] - 40;
-				tdata->cur_bg_gc_idx = t;
+				set_color(tdata, VT102_ATTR_BG_SHIFT, cmd_params[i] - 40);
+				break;
+			case 48:
+				i += parse_extended_color(cmd_params + i + 1, nr_params - i - 1, &t);
+				if (t != -1)
+					set_color(tdata, VT102_ATTR_BG_SHIFT, t);
 				break;
 			case 49:
-				tdata->cur_bg_gc_idx = 0;
+				set_color(tdata, VT102_ATTR_BG_SHIFT, 0);
+				break;
+			case 90 ... 97:
+				set_color(tdata, VT102_ATTR_FG_SHIFT, cmd_params[i] - 90 + 8);
+				break;
+			case 100 ... 107:
+				set_color(tdata, VT102_ATTR_BG_SHIFT, cmd_params[i] - 100 + 8);
 				break;
-                        case 7:
-                                /* negative image */
-                                t = tdata->cur_bg_gc_idx;
-                                tdata->cur_bg_gc_idx = tdata->cur_fg_gc_idx;
-                                tdata->cur_fg_gc_idx = t;
                         default:
-                                fprintf(stderr, "sgr: %i\n", cmd_params[i]);
+				VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_UNHANDLED_SGR,
+						cmd_params[i], 0, 0, 0);
 		}
 	}
 }
@@ -711,9 +1707,11 @@ int i, t;
 static void destroy_vt102_generic_backend(struct term_data * tdata)
 {
         /* just deallocate memory buffers malloc()-ed... */
-        free(tdata->chbuf);
-        free(tdata->grbuf);
-        free(tdata->must_refresh_line_buf);
+        free(tdata->arena);
+        free(tdata->spare_arena);
+        if (tdata->scrollback)
+                vt102_scrollback_destroy(tdata->scrollback);
+        free(tdata);
 }
 
 /*
@@ -735,6 +1733,7 @@ struct vt102_state * init_vt102_generic_backend(int width, int height)
 struct vt102_backend_ops backend_ops =
 {
 	.display_char = display_char,
+	.display_string = display_string,
 	.move_cursor_relative = move_cursor_relative,
 	.move_cursor_absolute = move_cursor_absolute,
         .move_cursor_column_absolute = move_cursor_column_absolute,
@@ -749,6 +1748,7 @@ struct vt102_backend_ops backend_ops =
 	.handle_linefeed = handle_linefeed,
 	.handle_carriage_return = handle_carriage_return,
 	.set_top_and_bottom_margins = set_top_and_bottom_margins,
+	.set_synchronized_update = set_synchronized_update,
 	/* this routine must be provided by another module */
 	.query_terminal_id = 0,
 	.insert_lines_at_cursor = insert_lines_at_cursor,
@@ -760,6 +1760,7 @@ struct vt102_backend_ops backend_ops =
 };
 struct vt102_state * vtstate;
 struct term_data * tdata;
+void * arena;
 
 	/* sanity checks */
 	if (width < NR_MIN_VT102_SCREEN_COLUMNS)
@@ -773,31 +1774,23 @@ struct term_data * tdata;
 	/* initialize the main console variables */
 	tdata->con_width = width;
 	tdata->con_height = height;
-	if (!(tdata->chbuf = malloc(tdata->con_width * tdata->con_height)))
-	{
-		printf("no core\n");
-		exit(1);
-	}
-	if (!(tdata->grbuf = malloc(tdata->con_width * tdata->con_height)))
+	if (!(arena = malloc(arena_size(width * height, height))))
 	{
-		printf("no core\n");
-		exit(1);
-	}
-	if (!(tdata->must_refresh_line_buf = malloc(tdata->con_height * sizeof(bool))))
-	{
-		printf("no core\n");
-		exit(1);
+		free(tdata);
+		return 0;
 	}
+	set_arena(tdata, arena, width * height, height);
+	reset_row_offsets(tdata);
 	memset(tdata->chbuf, 'E', tdata->con_width * tdata->con_height);
-	memset(tdata->grbuf, 0, tdata->con_width * tdata->con_height);
+	memset(tdata->grbuf, 0, tdata->con_width * tdata->con_height * sizeof * tdata->grbuf);
+	memset(tdata->wrapped_line_buf, 0, tdata->con_height * sizeof * tdata->wrapped_line_buf);
 	/*! \todo	this is broken */
-	memset(tdata->must_refresh_line_buf, true, tdata->con_height * sizeof(bool));
+	mark_rows_dirty(tdata, 0, tdata->con_height);
 	tdata->cursor_x = tdata->cursor_y = 0;
 	tdata->margin_top = 0;
 	tdata->margin_bottom = tdata->con_height - 1;
 
-	tdata->cur_fg_gc_idx = 7;
-	tdata->cur_bg_gc_idx = 0;
+	tdata->cur_attr = VT102_ATTR_DEFAULT;
 	tdata->must_refresh = true;
 
 	/* initialize the vt102 emulator command parser state machine */
@@ -805,8 +1798,9 @@ struct term_data * tdata;
 	vtstate = init_vt102(&backend_ops);
 	if (!vtstate)
 	{
-		printf("no core\n");
-		exit(1);
+		free(arena);
+		free(tdata);
+		return 0;
 	}
 	return vtstate;
 
@@ -832,19 +1826,38 @@ struct term_data * vt102_generic_backend_get_data(struct vt102_state * state)
 
 
 /*!
- *	\fn	void vt102_generic_backend_resize_buffers(struct vt102_state * state, int new_width, int new_height);
+ *	\fn	bool vt102_generic_backend_resize_buffers(struct vt102_state * state, int new_width, int new_height);
  *	\brief	changes the screen dimensions (number of rows and columns) of a vt102 terminal screen
  *
+ *	when the screen width changes, the logical lines on the
+ *	screen (see the wrapped_line_buf field of struct term_data)
+ *	are reflowed to the new width, along with the logical line
+ *	continuing from the scrollback history buffer onto the top of
+ *	the screen (if any); the rows that no longer fit at the top of
+ *	the screen are pushed to the scrollback history buffer, and
+ *	when there is room left - lines are pulled back from it, so
+ *	that (in the common case of a shell session) the screen stays
+ *	filled, and the cursor stays at the same character; e.g. the
+ *	lines pushed to the history when narrowing the screen are
+ *	pulled back when widening it again
+ *
+ *	when only the screen height changes, the screen buffers are
+ *	reused if the new dimensions fit within their capacity (see
+ *	the arena field of struct term_data); rows at the top of the
+ *	screen are pushed to the scrollback history buffer if the cursor
+ *	would not fit otherwise, and lines are pulled back from it when
+ *	the screen gets higher
+ *
  *	\param	state	the state variable of the vt102
  *			terminal emulator command parser
  *	\param	new_width	the new width of the vt102 terminal screen
  *	\param	new_height	the new height of the vt102 terminal screen
- *	\return	none */
-void vt102_generic_backend_resize_buffers(struct vt102_state * state, int new_width, int new_height)
+ *	\return	true on success, false on failure (out of memory) - in
+ *		which case the screen is left unchanged */
+bool vt102_generic_backend_resize_buffers(struct vt102_state * state, int new_width, int new_height)
 {
 struct term_data * tdata;
-char * chbuf, * grbuf;
-int i, w, h;
+int h;
 
 	/* sanity checks */
 	if (new_width < NR_MIN_VT102_SCREEN_COLUMNS)
@@ -853,54 +1866,161 @@ int i, w, h;
 		new_height = NR_MIN_VT102_SCREEN_ROWS;
 
 	tdata = vt102_generic_backend_get_data(state);
-
-	if (!(chbuf = malloc(new_width * new_height * sizeof * chbuf)))
-	{
-		printf("no core\n");
-		exit(1);
-	}
-	if (!(grbuf = malloc(new_width * new_height * sizeof * grbuf)))
+	if (new_width != tdata->con_width || tdata->cursor_y >= new_height
+			|| (new_height > tdata->con_height && tdata->scrollback
+				&& vt102_scrollback_get_nr_lines(tdata->scrollback)))
 	{
-		printf("no core\n");
-		exit(1);
+		if (!reflow_screen(tdata, new_width, new_height))
+			return false;
 	}
-	if (!(tdata->must_refresh_line_buf = realloc(tdata->must_refresh_line_buf, new_height * sizeof(bool))))
-	{
-		printf("no core\n");
-		exit(1);
-	}
-	memset(chbuf, ' ', new_width * new_height);
-	memset(grbuf, 0, new_width * new_height);
-
-	/* this below is a (sorry) attempt to retain the previous
-	 * console window contents... */
-	w = (tdata->con_width > new_width) ? new_width : tdata->con_width;
-	h = (tdata->con_height > new_height) ? new_height : tdata->con_height;
-
-	for (i = 0; i < h; i++)
+	else
 	{
-		memcpy(chbuf + i * new_width, tdata->chbuf + i * tdata->con_width, w);
-		memcpy(grbuf + i * new_width, tdata->grbuf + i * tdata->con_width, w);
+		/* the part of the screen contents retained */
+		h = (tdata->con_height > new_height) ? new_height : tdata->con_height;
+		if (new_width * new_height <= tdata->cell_capacity && new_height <= tdata->row_capacity)
+			/* the new screen fits - just store the rows in order */
+			sort_rows(tdata);
+		else if (!grow_arena(tdata, new_width, new_height, h))
+			return false;
+		tdata->con_height = new_height;
+		reset_row_offsets(tdata);
+		/* clear the rows not retained */
+		clear_rows(tdata, h, new_height - h);
 	}
+	tdata->stats.nr_resizes ++;
 
-	free(tdata->chbuf);
-	free(tdata->grbuf);
-
-	tdata->chbuf = chbuf;
-	tdata->grbuf = grbuf;
+	tdata->must_refresh = true;
+	mark_rows_dirty(tdata, 0, tdata->con_height);
+	/* any scroll operations queued are meaningless now */
+	tdata->nr_scroll_ops = 0;
+	tdata->margin_top = 0;
+	tdata->margin_bottom = tdata->con_height - 1;
+	if (tdata->scrollback)
+		vt102_scrollback_set_view_width(tdata->scrollback, tdata->con_width);
+	return true;
+}
 
-	memset(tdata->must_refresh_line_buf, true, new_height * sizeof(bool));
+/*!
+ *	\fn	bool vt102_generic_backend_reset_screen(struct vt102_state * state, int new_width, int new_height)
+ *	\brief	changes the screen dimensions of a vt102 terminal screen, discarding the screen contents
+ *
+ *	unlike vt102_generic_backend_resize_buffers(), the screen
+ *	contents are not reflowed, and the scrollback history buffer
+ *	is left alone - the screen is cleared, and the cursor is moved
+ *	to the top left corner; this is meant for restoring a screen
+ *	state saved elsewhere (e.g. a keyframe of a session recording,
+ *	see vt102-record.h), which is to overwrite the whole screen
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\param	new_width	the new width of the vt102 terminal screen
+ *	\param	new_height	the new height of the vt102 terminal screen
+ *	\return	true on success, false on failure (out of memory) - in
+ *		which case the screen is left unchanged */
+bool vt102_generic_backend_reset_screen(struct vt102_state * state, int new_width, int new_height)
+{
+struct term_data * tdata;
 
-	tdata->must_refresh = true;
+	/* sanity checks */
+	if (new_width < NR_MIN_VT102_SCREEN_COLUMNS)
+		new_width = NR_MIN_VT102_SCREEN_COLUMNS;
+	if (new_height < NR_MIN_VT102_SCREEN_ROWS)
+		new_height = NR_MIN_VT102_SCREEN_ROWS;
 
+	tdata = vt102_generic_backend_get_data(state);
+	if ((new_width * new_height > tdata->cell_capacity || new_height > tdata->row_capacity)
+			&& !grow_arena(tdata, new_width, new_height, 0))
+		return false;
 	tdata->con_width = new_width;
 	tdata->con_height = new_height;
+	reset_row_offsets(tdata);
+	clear_rows(tdata, 0, new_height);
+	tdata->cursor_x = tdata->cursor_y = 0;
+	tdata->stats.nr_resizes ++;
 
-	//tdata->cursor_x = tdata->cursor_y = 0;
-	if (tdata->cursor_x >= tdata->con_width)
-		tdata->cursor_x = tdata->con_width - 1;
-	if (tdata->cursor_y >= tdata->con_height)
-		tdata->cursor_y = tdata->con_height - 1;
+	tdata->must_refresh = true;
+	mark_rows_dirty(tdata, 0, tdata->con_height);
+	tdata->nr_scroll_ops = 0;
 	tdata->margin_top = 0;
 	tdata->margin_bottom = tdata->con_height - 1;
+	if (tdata->scrollback)
+		vt102_scrollback_set_view_width(tdata->scrollback, tdata->con_width);
+	return true;
 }
+
+/*!
+ *	\fn	bool vt102_generic_backend_set_scrollback(struct vt102_state * state, int nr_hot_lines, int max_nr_lines)
+ *	\brief	sets up the scrollback history buffer of a vt102 terminal screen
+ *
+ *	any lines already in the scrollback history are discarded
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\param	nr_hot_lines	the number of most recent lines to keep
+ *				uncompressed (see vt102_scrollback_create())
+ *	\param	max_nr_lines	the maximum number of lines to keep in the
+ *				scrollback history; if zero, the scrollback
+ *				history is disabled
+ *	\return	true on success, false on failure (out of memory) */
+bool vt102_generic_backend_set_scrollback(struct vt102_state * state, int nr_hot_lines, int max_nr_lines)
+{
+struct term_data * tdata;
+
+	tdata = vt102_generic_backend_get_data(state);
+	if (tdata->scrollback)
+		vt102_scrollback_destroy(tdata->scrollback);
+	tdata->scrollback = 0;
+	if (max_nr_lines <= 0)
+		return true;
+	if (!(tdata->scrollback = vt102_scrollback_create(nr_hot_lines, max_nr_lines)))
+		return false;
+	vt102_scrollback_set_view_width(tdata->scrollback, tdata->con_width);
+	return true;
+}
+
+/*!
+ *	\fn	void vt102_generic_backend_mark_dirty(struct term_data * tdata, int row, int x0, int x1)
+ *	\brief	schedules a span of characters in a screen row for refreshing
+ *
+ *	this is meant for code modifying the screen contents
+ *	directly, instead of by means of the command parser
+ *
+ *	\param	tdata	a pointer to the term_data
+ *			structure holding the vt102 screen state
+ *	\param	row	the screen row containing the characters
+ *	\param	x0	the first column of the span
+ *	\param	x1	the column past the last column of the span
+ *	\return	none */
+void vt102_generic_backend_mark_dirty(struct term_data * tdata, int row, int x0, int x1)
+{
+	mark_dirty(tdata, row, x0, x1);
+	tdata->must_refresh = true;
+}
+
+/*!
+ *	\fn	void vt102_generic_backend_print_stats(struct vt102_state * state, FILE * f)
+ *	\brief	prints the counters of a generic vt102 terminal emulator backend
+ *
+ *	\note	the counters are not synchronized in any way -
+ *		if the command parser is run in a thread of its
+ *		own, this must be called from that thread
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\param	f	the stream to print the counters to
+ *	\return	none */
+void vt102_generic_backend_print_stats(struct vt102_state * state, FILE * f)
+{
+struct vt102_backend_stats * s;
+
+	s = &vt102_generic_backend_get_data(state)->stats;
+	fprintf(f, "backend: %llu characters written, %llu bytes moved, %llu bytes cleared, %lu resizes (%lu reallocating), "
+			"%lu synchronized updates\n",
+			s->nr_chars_written, s->nr_bytes_moved, s->nr_bytes_cleared, s->nr_resizes, s->nr_resize_allocs,
+			s->nr_sync_updates);
+	fprintf(f, "scrolling: %lu scrolls by %llu rows in total, %lu scroll operations recorded, "
+			"%lu scroll operation queue overflows\n",
+			s->nr_scrolls, s->nr_rows_scrolled, s->nr_scroll_ops_recorded,
+			s->nr_scroll_op_overflows);
+}
+
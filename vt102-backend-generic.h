@@ -20,7 +20,7 @@
  *		- the screen character data contents - including
  *			both character codes and character graphic
  *			rendition attributes (foreground and background
- *			color)
+ *			color, bold, underline, etc.)
  *		- flags denoting which lines should be refreshed by
  *			a renderer utilizing this module - note that
  *			these flags must be reset by the rendering
@@ -39,7 +39,10 @@
  * include section follows
  *
  */
+#include <stdint.h>
+
 #include "vt102.h"
+#include "vt102-scrollback.h"
 
 /*
  *
@@ -56,12 +59,138 @@ enum
         NR_MIN_VT102_SCREEN_ROWS	=	2,
 };
 
+/*! graphics rendition attribute word layout
+ *
+ * the graphics rendition attributes of each character on
+ * the screen are held in a 32 bit word, having the following
+ * format:
+ *	- bits [0:7] - character foreground color palette index
+ *	- bits [8:15] - character background color palette index
+ *	- bits [16:19] - attribute flags (VT102_ATTR_xxx below)
+ *	- bits [20:31] - bits [8:19] of the character code - see below
+ *
+ * the character codes are unicode code points; the low 8 bits of
+ * the code of each character are held in the chbuf buffer of struct
+ * term_data, and the rest of the bits - in the attribute word of
+ * the character (use vt102_cell_char() for retrieving the code of
+ * a character); this way, the characters in the range 0 - 255 (which
+ * include ascii) take no more memory than before unicode was supported,
+ * and all of the code that moves characters around (scrolling, the
+ * scrollback history, resizing the screen...) handles all of the
+ * characters alike; code points past U+FFFFF (i.e. the ones in the
+ * supplementary private use area-b) do not fit, and are stored as
+ * the replacement character (U+FFFD) instead
+ *
+ * the palette indices are the ones of the xterm 256 color
+ * palette - indices 0 - 7 are the ansi colors (see the comments
+ * for struct term_data below), 8 - 15 are their bright
+ * variants, 16 - 231 are a 6x6x6 color cube, and 232 - 255
+ * are a grayscale ramp; 24 bit (rgb) colors are mapped to the
+ * nearest color in the color cube
+ *
+ * the attribute word of a cell that has been erased is zero;
+ * two cells have the same rendition if, and only if, their
+ * attribute words with the character code bits masked off
+ * (see VT102_ATTR_RENDITION_MASK) are equal, so that renderers
+ * can detect runs of characters with the same rendition by
+ * comparing integers - comparing the attribute words as they
+ * are also splits the runs where the character code bits change,
+ * which is convenient for renderers only having glyphs for the
+ * characters in the range 0 - 255 */
+enum
+{
+	/*! the bit position of the foreground color palette index */
+	VT102_ATTR_FG_SHIFT		=	0,
+	/*! the bit position of the background color palette index */
+	VT102_ATTR_BG_SHIFT		=	8,
+	/*! the mask of a color palette index, after shifting */
+	VT102_ATTR_COLOR_MASK		=	0xff,
+	/*! bold (increased intensity) */
+	VT102_ATTR_BOLD			=	1 << 16,
+	/*! underlined */
+	VT102_ATTR_UNDERLINE		=	1 << 17,
+	/*! blinking */
+	VT102_ATTR_BLINK		=	1 << 18,
+	/*! negative image - the foreground and background colors are swapped when rendering */
+	VT102_ATTR_REVERSE		=	1 << 19,
+	/*! the mask of the rendition (i.e. all but the character code) bits of an attribute word */
+	VT102_ATTR_RENDITION_MASK	=	0xfffff,
+	/*! the bit position of bits [8:19] of the character code */
+	VT102_ATTR_CHAR_SHIFT		=	20,
+	/*! the largest character code that can be stored */
+	VT102_MAX_CELL_CHAR		=	0xfffff,
+	/*! the attributes selected on reset - white on black, no flags */
+	VT102_ATTR_DEFAULT		=	7 << VT102_ATTR_FG_SHIFT,
+	/*! the number of colors in the palette */
+	VT102_NR_PALETTE_COLORS		=	256,
+};
+
+/*! the maximum number of scroll operations queued for a rendering module */
+enum
+{
+	VT102_MAX_SCROLL_OPS		=	16,
+};
+
 /*
  *
  * exported data types follow
  *
  */
 
+/*! generic vt102 backend counters
+ *
+ * these are cumulative, since the backend has
+ * been initialized */
+struct vt102_backend_stats
+{
+	/*! the number of characters written to the screen */
+	unsigned long long nr_chars_written;
+	/*! the number of times a range of rows has been scrolled */
+	unsigned long nr_scrolls;
+	/*! the total number of rows scrolled by */
+	unsigned long long nr_rows_scrolled;
+	/*! the number of scroll operations recorded for the rendering module (after merging) */
+	unsigned long nr_scroll_ops_recorded;
+	/*! the number of times the scroll operation queue has overflowed, and the whole screen had to be refreshed instead */
+	unsigned long nr_scroll_op_overflows;
+	/*! the number of bytes of screen contents moved around (by memmove()/memcpy()) */
+	unsigned long long nr_bytes_moved;
+	/*! the number of bytes of screen contents cleared */
+	unsigned long long nr_bytes_cleared;
+	/*! the number of times the screen has been resized */
+	unsigned long nr_resizes;
+	/*! the number of resizes which have needed a new memory block (see the arena field of struct term_data) */
+	unsigned long nr_resize_allocs;
+	/*! the number of synchronized updates completed (see the sync_update field of struct term_data) */
+	unsigned long nr_sync_updates;
+};
+
+/*! a span of characters in a screen row that must be refreshed */
+struct vt102_dirty_span
+{
+	/*! the first column of the span */
+	int x0;
+	/*! the column past the last column of the span */
+	int x1;
+};
+
+/*! a scroll operation, for rendering modules that move the terminal window contents instead of redrawing them */
+struct vt102_scroll_op
+{
+	/*! the first row of the range scrolled */
+	int top;
+	/*! the last row (inclusive) of the range scrolled */
+	int bottom;
+	/*! the number of rows the range was scrolled by
+	 *
+	 * positive values mean that the contents of the
+	 * range were moved up, negative values - down;
+	 * the magnitude may exceed the number of rows
+	 * in the range, in which case nothing is left
+	 * to be moved */
+	int delta;
+};
+
 /*! the data structure holding the generic backend state
  *
  *
@@ -90,10 +219,8 @@ struct term_data
          * this table, so this generic pointer is used for passing the
          * otherwise unavailable 'this' pointer to these static c++ functions */
         void * generic_ptr;
-	/*! currently selected foreground graphic rendition color index */
-	int cur_fg_gc_idx;
-	/*! currently selected background graphic rendition color index */
-	int cur_bg_gc_idx;
+	/*! currently selected graphics rendition attributes, in the format of the grbuf buffer below */
+	uint32_t cur_attr;
 	/*! console window width */
 	int con_width;
 	/*! console window height */
@@ -102,7 +229,15 @@ struct term_data
 	 * 
 	 * this must be of size
 	 * con_width * con_height bytes (holds all
-	 * characters on the screen) */
+	 * characters on the screen - in fact, the low 8 bits of
+	 * the character codes, see the comments about the graphics
+	 * rendition attribute word layout above)
+	 *
+	 * \note	the screen rows are not necessarily stored
+	 *		in order in this buffer - see the row_offsets
+	 *		field below, and use the vt102_generic_backend_chrow()
+	 *		routine for accessing the characters in a
+	 *		screen row */
 	unsigned char * chbuf;
 	/*! the terminal character graphics rendition buffer
 	 *
@@ -111,11 +246,32 @@ struct term_data
 	 * it holds, for each character,
 	 * its associated graphics rendition attributes
 	 *
-	 * the bytes stored in this buffer have the
-	 * following format:
-	 *	- bits [0:3] - character foreground color index (see above)
-	 *	- bits [4:7] - character background color index (see above) */
-	unsigned char * grbuf;
+	 * the words stored in this buffer are graphics
+	 * rendition attribute words, see VT102_ATTR_xxx
+	 * above
+	 *
+	 * the character codes and the attributes are kept
+	 * in separate buffers, so that renderers looking
+	 * for runs of characters with the same attributes
+	 * only touch the attributes, and copying text only
+	 * touches the character codes
+	 *
+	 * \note	the screen rows are stored in the same order as in
+	 *		the chbuf buffer above - use the vt102_generic_backend_grrow()
+	 *		routine for accessing the attributes in a screen row */
+	uint32_t * grbuf;
+	/*! screen row offsets
+	 *
+	 * a buffer, holding - for each screen row, the offset
+	 * (in number of characters) of the start of the row
+	 * in the chbuf and grbuf buffers above; this buffer has
+	 * con_height number of entries
+	 *
+	 * scrolling the screen (or a part of it) is done by
+	 * rotating the entries of this buffer, and clearing
+	 * the rows that get scrolled in, so that no screen
+	 * contents need to be moved around when scrolling */
+	int * row_offsets;
 	/*! cursor column (x) position - counting from 0 */
 	int cursor_x;
 	/*! cursor roy (y) position - counting from 0 */
@@ -142,13 +298,154 @@ struct term_data
 	 * these must be reset by the external rendering
 	 * module when done with the rendering the text */
 	bool * must_refresh_line_buf;
+	/*! spans of characters to refresh, for each row
+	 *
+	 * a buffer, holding - for each line, the span of
+	 * columns that must be refreshed in the terminal
+	 * window when updating the terminal window; this
+	 * buffer has con_height number of entries; an entry
+	 * is only meaningful when the corresponding flag in
+	 * must_refresh_line_buf is set - once a rendering module
+	 * resets that flag, the next change to the row starts
+	 * a new span, so rendering modules need not reset these */
+	struct vt102_dirty_span * dirty_spans;
+	/*! row auto-wrap flags
+	 *
+	 * a buffer, holding - for each line, if the cursor has
+	 * auto-wrapped from the end of the line onto the next line,
+	 * i.e. if the two lines are parts of the same logical line;
+	 * this buffer has con_height number of entries; the flag
+	 * of a line is reset when the line is erased, and is stored
+	 * along with the line in the scrollback history buffer -
+	 * when the screen width changes, the logical lines are
+	 * reflowed to the new width (see vt102_generic_backend_resize_buffers()) */
+	bool * wrapped_line_buf;
+	/*! the single memory block holding the chbuf, grbuf, row_offsets,
+	 * must_refresh_line_buf, dirty_spans and wrapped_line_buf buffers above
+	 *
+	 * the block has room for cell_capacity character cells and
+	 * row_capacity rows, which may exceed the screen dimensions;
+	 * changing the screen height within the capacity reuses the
+	 * block, only growing past it allocates a new one (with some
+	 * room to spare) - so that e.g. dragging the edge of the terminal
+	 * window neither churns nor fragments the heap; changing the
+	 * screen width reflows the screen contents to another block,
+	 * and keeps this one as a spare (see spare_arena below); the
+	 * blocks are never shrunk */
+	void * arena;
+	/*! the number of character cells the arena has room for */
+	int cell_capacity;
+	/*! the number of screen rows the arena has room for */
+	int row_capacity;
+	/*! a spare memory block for the screen buffers, null if there is none
+	 *
+	 * this is the block the screen was held in before the last width
+	 * change (or the last resize past the capacity of the arena);
+	 * changing the screen width reflows the screen contents into it,
+	 * if the new dimensions fit within its capacity, and the two blocks
+	 * are then swapped - so that e.g. dragging the edge of the terminal
+	 * window sideways neither allocates nor frees memory, once both
+	 * blocks have grown large enough */
+	void * spare_arena;
+	/*! the number of character cells the spare arena has room for */
+	int spare_cell_capacity;
+	/*! the number of screen rows the spare arena has room for */
+	int spare_row_capacity;
+	/*! the scrollback history buffer
+	 *
+	 * if not null, the lines scrolled off the top of the
+	 * screen (when the top margin is at the top of the screen)
+	 * are stored here; renderers can retrieve them by calling
+	 * vt102_scrollback_get_line(), or - reflowed to the current
+	 * screen width - vt102_scrollback_get_row(); set with
+	 * vt102_generic_backend_set_scrollback(), by default
+	 * there is no scrollback history */
+	struct vt102_scrollback * scrollback;
+	/*! scroll operation recording flag
+	 *
+	 * set by a rendering module which is able to move
+	 * (e.g. blit) the contents of the terminal window; if
+	 * set, scrolling the screen only schedules the rows
+	 * scrolled in for refreshing, and records the scroll
+	 * operation in scroll_ops below - the rendering module
+	 * must then apply the scroll operations queued, in
+	 * order, before refreshing the rows; false by default */
+	bool record_scroll_ops;
+	/*! the number of scroll operations in scroll_ops
+	 *
+	 * this must be reset by the external rendering
+	 * module when done with applying the scroll operations */
+	int nr_scroll_ops;
+	/*! the queue of scroll operations, recorded when record_scroll_ops is set
+	 *
+	 * should the queue overflow, it is discarded, and the
+	 * whole screen is scheduled for refreshing instead */
+	struct vt102_scroll_op scroll_ops[VT102_MAX_SCROLL_OPS];
+	/*! synchronized update flag
+	 *
+	 * set while the remote host is in the middle of a
+	 * synchronized update (between the BSU and ESU commands,
+	 * see set_synchronized_update() in vt102.h); the screen
+	 * may then hold a partially drawn frame of the application,
+	 * so rendering modules should hold off refreshing the
+	 * terminal window until this gets reset - the changes keep
+	 * accumulating in the refresh-needed flags meanwhile; the
+	 * remote host may never end the update (e.g. when killed),
+	 * so this must only be honoured for a limited time - see
+	 * vt102_frame_sched_note_sync_update() in vt102-frame-sched.h;
+	 * the stats.nr_sync_updates counter tells rendering modules
+	 * that an update has been completed, should another one have
+	 * begun before they got to look at this flag */
+	bool sync_update;
+	/*! the backend counters */
+	struct vt102_backend_stats stats;
 };
 
+/*
+ *
+ * exported inline functions follow
+ *
+ */
+
+/*! returns a pointer to the characters of screen row 'row' (counting from zero) in the chbuf buffer */
+static inline unsigned char * vt102_generic_backend_chrow(struct term_data * tdata, int row)
+{
+	return tdata->chbuf + tdata->row_offsets[row];
+}
+
+/*! returns a pointer to the graphics rendition attributes of screen row 'row' (counting from zero) in the grbuf buffer */
+static inline uint32_t * vt102_generic_backend_grrow(struct term_data * tdata, int row)
+{
+	return tdata->grbuf + tdata->row_offsets[row];
+}
+
+/*! returns the character code (unicode code point) of a cell, given the byte in the chbuf buffer 'ch', and the attribute word 'attr' of the cell */
+static inline unsigned int vt102_cell_char(unsigned char ch, uint32_t attr)
+{
+	return ch | (attr >> VT102_ATTR_CHAR_SHIFT) << 8;
+}
+
+/*! returns the foreground color palette index to render a character having the attribute word 'attr' with */
+static inline int vt102_attr_fg(uint32_t attr)
+{
+	return (attr >> ((attr & VT102_ATTR_REVERSE) ? VT102_ATTR_BG_SHIFT : VT102_ATTR_FG_SHIFT)) & VT102_ATTR_COLOR_MASK;
+}
+
+/*! returns the background color palette index to render a character having the attribute word 'attr' with */
+static inline int vt102_attr_bg(uint32_t attr)
+{
+	return (attr >> ((attr & VT102_ATTR_REVERSE) ? VT102_ATTR_FG_SHIFT : VT102_ATTR_BG_SHIFT)) & VT102_ATTR_COLOR_MASK;
+}
+
 /*
  *
  * exported function prototypes follow
  *
  */ 
 struct term_data * vt102_generic_backend_get_data(struct vt102_state * state);
-void vt102_generic_backend_resize_buffers(struct vt102_state * state, int new_width, int new_height);
+bool vt102_generic_backend_resize_buffers(struct vt102_state * state, int new_width, int new_height);
+bool vt102_generic_backend_reset_screen(struct vt102_state * state, int new_width, int new_height);
+bool vt102_generic_backend_set_scrollback(struct vt102_state * state, int nr_hot_lines, int max_nr_lines);
+void vt102_generic_backend_mark_dirty(struct term_data * tdata, int row, int x0, int x1);
+void vt102_generic_backend_print_stats(struct vt102_state * state, FILE * f);
 struct vt102_state * init_vt102_generic_backend(int width, int height);
@@ -0,0 +1,346 @@
+/*!
+ *	\file	vt102-batch-replay.c
+ *	\brief	a parallel offline replay tool for vt102 terminal emulator session recordings
+ *	\author	shopov
+ *
+ *	this replays session recordings (see vt102-record.h, e.g. the
+ *	term-log.rec files written by the terminal front-ends when
+ *	RECORD_FILE_NAME is defined in them) on all of the processors
+ *	available (see vt102-batch.h), and writes out the screen changes
+ *	of each recording - in order - to the standard output, as either:
+ *		- text lines (the default), one for each scroll operation
+ *		  ('TIME scroll TOP BOTTOM DELTA', see struct vt102_scroll_op
+ *		  in vt102-backend-generic.h), and one for each screen row
+ *		  changed ('TIME row ROW TEXT', with the text utf-8 encoded,
+ *		  and the trailing blanks removed), after each record; TIME
+ *		  is in seconds since the recording was started
+ *		- binary screen diffs (see vt102-diff.h), one after each
+ *		  record changing the screen, each preceded by the time of
+ *		  the record (in microseconds since the recording was started,
+ *		  8 bytes), and the size of the diff (4 bytes), both in little
+ *		  endian byte order
+ *
+ *	the whole screen is written out at the start of each segment
+ *	of a recording, i.e. at each keyframe; otherwise the output does
+ *	not depend on the number of worker threads used, and can be
+ *	compared between runs
+ *
+ *	options:
+ *		-j N		use N worker threads, one per processor by default
+ *		-d		write out binary screen diffs, instead of text
+ *
+ *	the time taken to replay each recording, and the throughput
+ *	achieved, are printed to the standard error stream
+ *
+ *	build with something like:
+ *
+ *		cc -O2 -o vt102-batch-replay vt102-batch-replay.c vt102-batch.c vt102-record.c \
+ *			vt102-log.c vt102-diff.c vt102-text.c vt102.c vt102-backend-generic.c \
+ *			vt102-scan.c vt102-scrollback.c vt102-trace.c -pthread
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-record.h"
+#include "vt102-diff.h"
+#include "vt102-text.h"
+#include "vt102-batch.h"
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! the per-worker data */
+struct worker_data
+{
+	/*! the screen state last written out as a diff, null in text mode */
+	struct vt102_state * shadow;
+	/*! set when the next diff must be encoded from no screen state at all */
+	bool full;
+	/*! the diff buffer */
+	struct vt102_diff diff;
+	/*! the buffer the text of a screen row is encoded in */
+	char * line;
+	/*! the size of the line buffer */
+	size_t line_size;
+};
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! set when binary screen diffs are requested */
+static bool diff_mode;
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+int dtrace(char * msg, int line)
+{
+	return 0;
+}
+
+/*!
+ *	\fn	static void query_terminal_id(void * param)
+ *	\brief	a null terminal identification query handler, there is no remote host to answer to
+ *
+ *	\param	param	not used
+ *	\return	none */
+static void query_terminal_id(void * param)
+{
+}
+
+/*!
+ *	\fn	static double now(void)
+ *	\brief	returns the current value of a monotonic clock, in seconds
+ *
+ *	\return	the current value of the clock */
+static double now(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*!
+ *	\fn	static void put_le(FILE * out, unsigned long long x, int nr_bytes)
+ *	\brief	writes out a number in little endian byte order
+ *
+ *	\param	out	the stream to write to
+ *	\param	x	the number to write
+ *	\param	nr_bytes	the number of bytes to write
+ *	\return	none */
+static void put_le(FILE * out, unsigned long long x, int nr_bytes)
+{
+	for (; nr_bytes; nr_bytes --, x >>= 8)
+		putc(x & 0xff, out);
+}
+
+/*!
+ *	\fn	static void * worker_started(void * user_data)
+ *	\brief	allocates the per-worker data
+ *
+ *	\param	user_data	not used
+ *	\return	the per-worker data, null on failure (out of memory) */
+static void * worker_started(void * user_data)
+{
+struct worker_data * w;
+
+	if (!(w = calloc(1, sizeof * w)))
+		return 0;
+	if (diff_mode)
+	{
+		if (!(w->shadow = init_vt102_generic_backend(80, 24)))
+		{
+			free(w);
+			return 0;
+		}
+		vt102_get_backend_ops(w->shadow)->query_terminal_id = query_terminal_id;
+	}
+	return w;
+}
+
+/*!
+ *	\fn	static void worker_stopped(void * worker_data)
+ *	\brief	releases the per-worker data
+ *
+ *	\param	worker_data	the per-worker data, may be null
+ *	\return	none */
+static void worker_stopped(void * worker_data)
+{
+struct worker_data * w;
+
+	if (!(w = (struct worker_data *) worker_data))
+		return;
+	if (w->shadow)
+		destroy_vt102(w->shadow);
+	vt102_diff_free(&w->diff);
+	free(w->line);
+	free(w);
+}
+
+/*!
+ *	\fn	static void segment_started(void * worker_data, struct vt102_state * state, int segment, FILE * out)
+ *	\brief	prepares for replaying a segment
+ *
+ *	\param	worker_data	the per-worker data
+ *	\param	state	the emulator the segment is replayed into
+ *	\param	segment	not used
+ *	\param	out	not used
+ *	\return	none */
+static void segment_started(void * worker_data, struct vt102_state * state, int segment, FILE * out)
+{
+struct worker_data * w;
+
+	w = (struct worker_data *) worker_data;
+	/* in text mode, the scroll operations are written out,
+	 * instead of all of the rows scrolled */
+	vt102_generic_backend_get_data(state)->record_scroll_ops = !diff_mode;
+	if (w)
+		w->full = true;
+}
+
+/*!
+ *	\fn	static void put_text(struct worker_data * w, struct term_data * tdata, uint64_t time, FILE * out)
+ *	\brief	writes out the scroll operations and the screen rows changed, as text
+ *
+ *	\param	w	the per-worker data
+ *	\param	tdata	the backend data holding the screen
+ *	\param	time	the time of the record replayed
+ *	\param	out	the stream to write to
+ *	\return	none */
+static void put_text(struct worker_data * w, struct term_data * tdata, uint64_t time, FILE * out)
+{
+struct vt102_scroll_op * op;
+char * p;
+size_t size;
+int i, n;
+
+	for (i = 0; i < tdata->nr_scroll_ops; i++)
+	{
+		op = tdata->scroll_ops + i;
+		fprintf(out, "%llu.%06llu scroll %d %d %d\n",
+				(unsigned long long) time / 1000000, (unsigned long long) time % 1000000,
+				op->top, op->bottom, op->delta);
+	}
+	size = tdata->con_width * VT102_TEXT_MAX_CHAR_BYTES + 1;
+	if (size > w->line_size)
+	{
+		if (!(p = realloc(w->line, size)))
+			return;
+		w->line = p;
+		w->line_size = size;
+	}
+	for (i = 0; i < tdata->con_height; i++)
+	{
+		if (!tdata->must_refresh_line_buf[i])
+			continue;
+		if ((n = vt102_text_get_span(tdata, i, 0, INT_MAX, w->line, w->line_size)) == -1)
+			continue;
+		fprintf(out, "%llu.%06llu row %d ",
+				(unsigned long long) time / 1000000, (unsigned long long) time % 1000000, i);
+		fwrite(w->line, 1, n, out);
+		putc('\n', out);
+	}
+}
+
+/*!
+ *	\fn	static void record_replayed(void * worker_data, struct vt102_state * state, uint64_t time, FILE * out)
+ *	\brief	writes out the screen changes made by a record
+ *
+ *	\param	worker_data	the per-worker data
+ *	\param	state	the emulator the record has been replayed into
+ *	\param	time	the time of the record
+ *	\param	out	the stream to write to
+ *	\return	none */
+static void record_replayed(void * worker_data, struct vt102_state * state, uint64_t time, FILE * out)
+{
+struct worker_data * w;
+struct term_data * tdata;
+
+	w = (struct worker_data *) worker_data;
+	tdata = vt102_generic_backend_get_data(state);
+	if (!tdata->must_refresh)
+		return;
+	if (w && !diff_mode)
+		put_text(w, tdata, time, out);
+	else if (w && vt102_diff_encode(w->full ? 0 : vt102_generic_backend_get_data(w->shadow), tdata, &w->diff)
+			&& vt102_diff_apply(w->shadow, w->diff.data, w->diff.size))
+	{
+		w->full = false;
+		put_le(out, time, 8);
+		put_le(out, w->diff.size, 4);
+		fwrite(w->diff.data, 1, w->diff.size, out);
+	}
+	else
+		/* out of memory - make the output incomplete */
+		fputs("*** out of memory ***\n", out);
+	/* consume the changes, the way a renderer does */
+	memset(tdata->must_refresh_line_buf, 0, tdata->con_height * sizeof * tdata->must_refresh_line_buf);
+	tdata->nr_scroll_ops = 0;
+	tdata->must_refresh = false;
+}
+
+int main(int argc, char ** argv)
+{
+static const struct vt102_batch_ops ops =
+{
+	.worker_started = worker_started,
+	.worker_stopped = worker_stopped,
+	.segment_started = segment_started,
+	.record_replayed = record_replayed,
+};
+struct vt102_replay * rp;
+struct vt102_batch_stats stats;
+struct stat st;
+double t;
+int i, nr_workers;
+bool failed;
+
+	nr_workers = 0;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp(argv[i], "-d"))
+			diff_mode = true;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc
+				&& (nr_workers = atoi(argv[i + 1])) > 0)
+			i++;
+		else
+		{
+			fprintf(stderr, "usage: %s [-j N] [-d] file...\n", argv[0]);
+			return 1;
+		}
+	}
+	failed = false;
+	for (; i < argc; i++)
+	{
+		if (stat(argv[i], &st) || !(rp = vt102_replay_open(argv[i])))
+		{
+			fprintf(stderr, "%s: cannot open session recording\n", argv[i]);
+			failed = true;
+			continue;
+		}
+		t = now();
+		if (!vt102_batch_replay(rp, nr_workers, &ops, 0, stdout, &stats))
+		{
+			fprintf(stderr, "%s: malformed session recording, or out of memory\n", argv[i]);
+			failed = true;
+		}
+		else
+		{
+			t = now() - t;
+			fprintf(stderr, "%s: %d segments, %d workers, %.1f MB in %.3f s (%.1f MB/s), "
+					"%llu bytes written, %lu output stalls\n",
+					argv[i], stats.nr_segments, stats.nr_workers,
+					st.st_size / 1e6, t, st.st_size / t / 1e6,
+					stats.nr_output_bytes, stats.nr_output_stalls);
+		}
+		vt102_replay_close(rp);
+	}
+	if (fflush(stdout))
+		failed = true;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+/*!
+ *	\file	vt102-batch.c
+ *	\brief	vt102 terminal emulator parallel session recording replay
+ *	\author	shopov
+ *
+ *	see the comments in vt102-batch.h
+ *
+ *	the segments are handed out to the workers in order, by means
+ *	of a counter protected by a mutex; each worker replays a segment
+ *	capturing the output of the callbacks in a memory stream, and
+ *	then posts the output in the slot of the segment, from where the
+ *	calling thread writes it out, in order
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-record.h"
+#include "vt102-batch.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the screen width of the emulators created by the workers, keyframes set the actual screen size */
+	INITIAL_WIDTH		=	80,
+	/*! the screen height of the emulators created by the workers */
+	INITIAL_HEIGHT		=	24,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! a segment slot */
+struct segment
+{
+	/*! set when the segment has been replayed */
+	bool done;
+	/*! set when replaying the segment has failed */
+	bool failed;
+	/*! the output produced while replaying the segment */
+	char * output;
+	/*! the size of the output */
+	size_t size;
+};
+
+/*! the parallel replay data structure */
+struct batch
+{
+	/*! the session replay */
+	struct vt102_replay * rp;
+	/*! the replay callbacks */
+	const struct vt102_batch_ops * ops;
+	/*! passed to the worker_started() callback */
+	void * user_data;
+	/*! the number of workers started */
+	int nr_workers;
+	/*! the number of segments in the recording */
+	int nr_segments;
+	/*! the segment slots, of size nr_segments */
+	struct segment * segments;
+	/*! the number of the next segment to hand out to a worker */
+	int next_segment;
+	/*! the number of segments written out */
+	int nr_written;
+	/*! set when the replay has failed, or is being abandoned */
+	bool failed;
+	/*! protects all of the fields of this structure which are modified after the workers are started */
+	pthread_mutex_t lock;
+	/*! signalled when a segment has been replayed */
+	pthread_cond_t segment_done;
+	/*! signalled when a segment has been written out */
+	pthread_cond_t segment_written;
+};
+
+/*! the data passed to the record_replayed() callback by replay_segment() */
+struct replay_arg
+{
+	/*! the replay callbacks */
+	const struct vt102_batch_ops * ops;
+	/*! the data returned by the worker_started() callback */
+	void * worker_data;
+	/*! the stream capturing the output for the segment */
+	FILE * out;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static void query_terminal_id(void * param)
+ *	\brief	a null terminal identification query handler, there is no remote host to answer to
+ *
+ *	\param	param	not used
+ *	\return	none */
+static void query_terminal_id(void * param)
+{
+}
+
+/*!
+ *	\fn	static struct vt102_state * create_emulator(void)
+ *	\brief	creates an emulator to replay segments into
+ *
+ *	\return	the emulator created, or null on error */
+static struct vt102_state * create_emulator(void)
+{
+struct vt102_state * state;
+
+	if (!(state = init_vt102_generic_backend(INITIAL_WIDTH, INITIAL_HEIGHT)))
+		return 0;
+	vt102_get_backend_ops(state)->query_terminal_id = query_terminal_id;
+	return state;
+}
+
+/*!
+ *	\fn	static void record_replayed(void * arg, struct vt102_state * state, uint64_t time)
+ *	\brief	invokes the record_replayed() callback, for vt102_replay_segment()
+ *
+ *	\param	arg	the replay_arg data structure
+ *	\param	state	the emulator the record has been replayed into
+ *	\param	time	the time of the record
+ *	\return	none */
+static void record_replayed(void * arg, struct vt102_state * state, uint64_t time)
+{
+struct replay_arg * r;
+
+	r = (struct replay_arg *) arg;
+	r->ops->record_replayed(r->worker_data, state, time, r->out);
+}
+
+/*!
+ *	\fn	static bool replay_segment(struct batch * b, int segment, struct vt102_state * state, void * worker_data)
+ *	\brief	replays a segment, and posts its output
+ *
+ *	\param	b	the parallel replay data structure
+ *	\param	segment	the number of the segment to replay
+ *	\param	state	the emulator to replay the segment into; a new
+ *			emulator is used for the first segment
+ *	\param	worker_data	the data returned by the worker_started()
+ *				callback
+ *	\return	true on success, false on failure */
+static bool replay_segment(struct batch * b, int segment, struct vt102_state * state, void * worker_data)
+{
+struct replay_arg r;
+struct segment * s;
+char * output;
+size_t size;
+bool ok;
+
+	output = 0;
+	size = 0;
+	r.ops = b->ops;
+	r.worker_data = worker_data;
+	ok = false;
+	if ((r.out = open_memstream(&output, &size)))
+	{
+		/* the first segment does not start at a keyframe */
+		if (!segment && !(state = create_emulator()))
+			fclose(r.out);
+		else
+		{
+			if (b->ops->segment_started)
+				b->ops->segment_started(worker_data, state, segment, r.out);
+			ok = vt102_replay_segment(b->rp, segment, state,
+					b->ops->record_replayed ? record_replayed : 0, &r);
+			if (!segment)
+				destroy_vt102(state);
+			if (fclose(r.out))
+				ok = false;
+		}
+	}
+	pthread_mutex_lock(&b->lock);
+	s = b->segments + segment;
+	s->done = true;
+	s->failed = !ok;
+	s->output = output;
+	s->size = size;
+	if (!ok)
+		b->failed = true;
+	pthread_cond_broadcast(&b->segment_done);
+	pthread_mutex_unlock(&b->lock);
+	return ok;
+}
+
+/*!
+ *	\fn	static void * worker_thread(void * arg)
+ *	\brief	a worker thread, replaying segments until there are none left
+ *
+ *	\param	arg	the parallel replay data structure
+ *	\return	none */
+static void * worker_thread(void * arg)
+{
+struct batch * b;
+struct vt102_state * state;
+void * worker_data;
+int segment;
+
+	b = (struct batch *) arg;
+	worker_data = b->ops->worker_started ? b->ops->worker_started(b->user_data) : 0;
+	if (!(state = create_emulator()))
+	{
+		pthread_mutex_lock(&b->lock);
+		b->failed = true;
+		pthread_cond_broadcast(&b->segment_done);
+		pthread_mutex_unlock(&b->lock);
+	}
+	else
+	{
+		pthread_mutex_lock(&b->lock);
+		while (!b->failed && b->next_segment < b->nr_segments)
+		{
+			if (b->next_segment >= b->nr_written + b->nr_workers * VT102_BATCH_SEGMENTS_AHEAD)
+			{
+				/* too far ahead of the output written */
+				pthread_cond_wait(&b->segment_written, &b->lock);
+				continue;
+			}
+			segment = b->next_segment ++;
+			pthread_mutex_unlock(&b->lock);
+			replay_segment(b, segment, state, worker_data);
+			pthread_mutex_lock(&b->lock);
+		}
+		pthread_mutex_unlock(&b->lock);
+		destroy_vt102(state);
+	}
+	if (b->ops->worker_stopped)
+		b->ops->worker_stopped(worker_data);
+	return 0;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	bool vt102_batch_replay(struct vt102_replay * rp, int nr_workers, const struct vt102_batch_ops * ops, void * user_data, FILE * out, struct vt102_batch_stats * stats)
+ *	\brief	replays a session recording in parallel
+ *
+ *	this returns when the whole recording has been replayed,
+ *	and all of the output has been written
+ *
+ *	\param	rp	the session replay; vt102_replay_seek() must
+ *			not be called for it while this is running
+ *	\param	nr_workers	the number of worker threads to start;
+ *				if zero or negative, one worker per
+ *				processor online is started
+ *	\param	ops	the replay callbacks
+ *	\param	user_data	passed to the worker_started() callback
+ *	\param	out	the stream to write the output of the callbacks
+ *			to, in segment order
+ *	\param	stats	if not null, the replay counters are stored here
+ *	\return	true on success, false if the recording is malformed,
+ *		or on failure (out of memory, or an error writing the
+ *		output) - the output written is then incomplete */
+bool vt102_batch_replay(struct vt102_replay * rp, int nr_workers, const struct vt102_batch_ops * ops, void * user_data, FILE * out, struct vt102_batch_stats * stats)
+{
+struct batch b;
+struct segment * s;
+pthread_t * threads;
+unsigned long long nr_output_bytes;
+unsigned long nr_output_stalls;
+int i, nr_started;
+bool ok;
+
+	if (nr_workers <= 0 && (nr_workers = sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+		nr_workers = 1;
+	memset(&b, 0, sizeof b);
+	b.rp = rp;
+	b.ops = ops;
+	b.user_data = user_data;
+	b.nr_segments = vt102_replay_get_nr_segments(rp);
+	/* there is no point in more workers than segments */
+	if (nr_workers > b.nr_segments)
+		nr_workers = b.nr_segments;
+	b.nr_workers = nr_workers;
+	if (!(b.segments = calloc(b.nr_segments, sizeof * b.segments)))
+		return false;
+	if (!(threads = calloc(nr_workers, sizeof * threads)))
+	{
+		free(b.segments);
+		return false;
+	}
+	pthread_mutex_init(&b.lock, 0);
+	pthread_cond_init(&b.segment_done, 0);
+	pthread_cond_init(&b.segment_written, 0);
+
+	for (nr_started = 0; nr_started < nr_workers; nr_started ++)
+		if (pthread_create(threads + nr_started, 0, worker_thread, &b))
+			break;
+	ok = nr_started > 0;
+	nr_output_bytes = 0;
+	nr_output_stalls = 0;
+	/* write out the output of the segments, in order */
+	pthread_mutex_lock(&b.lock);
+	for (i = 0; ok && i < b.nr_segments; i++)
+	{
+		s = b.segments + i;
+		if (!s->done && !b.failed)
+			nr_output_stalls ++;
+		while (!s->done && !b.failed)
+			pthread_cond_wait(&b.segment_done, &b.lock);
+		if (!s->done || s->failed)
+		{
+			ok = false;
+			break;
+		}
+		pthread_mutex_unlock(&b.lock);
+		if (s->size && fwrite(s->output, 1, s->size, out) != s->size)
+			ok = false;
+		nr_output_bytes += s->size;
+		free(s->output);
+		s->output = 0;
+		pthread_mutex_lock(&b.lock);
+		b.nr_written ++;
+		pthread_cond_broadcast(&b.segment_written);
+	}
+	/* stop the workers, should the replay have failed */
+	if (!ok)
+		b.failed = true;
+	pthread_cond_broadcast(&b.segment_written);
+	pthread_mutex_unlock(&b.lock);
+	for (i = 0; i < nr_started; i++)
+		pthread_join(threads[i], 0);
+
+	for (i = 0; i < b.nr_segments; i++)
+		free(b.segments[i].output);
+	pthread_mutex_destroy(&b.lock);
+	pthread_cond_destroy(&b.segment_done);
+	pthread_cond_destroy(&b.segment_written);
+	free(threads);
+	free(b.segments);
+	if (stats)
+	{
+		stats->nr_segments = b.nr_segments;
+		stats->nr_workers = nr_started;
+		stats->nr_output_bytes = nr_output_bytes;
+		stats->nr_output_stalls = nr_output_stalls;
+	}
+	return ok;
+}
@@ -0,0 +1,120 @@
+/*!
+ *	\file	vt102-batch.h
+ *	\brief	vt102 terminal emulator parallel session recording replay header file
+ *	\author	shopov
+ *
+ *	this module replays session recordings (see vt102-record.h)
+ *	offline, using all of the processors available - so that
+ *	large archives of recordings can be processed (e.g. audited,
+ *	or converted to text or screen diffs) in a fraction of the
+ *	time a single vt102 command parser takes
+ *
+ *	a recording is divided in segments at its keyframes (see
+ *	vt102_replay_get_nr_segments()), which are replayed by a pool of
+ *	worker threads - each worker has its own emulator (a generic vt102
+ *	backend), which is brought to the screen state recorded in the
+ *	keyframe a segment starts at, and then fed the records of the
+ *	segment; for each record replayed, the record_replayed() callback
+ *	is invoked by the worker, and the output the callback produces
+ *	(written to the stream passed to it) is collected per segment,
+ *	and written to the output stream of the caller in segment order
+ *	- so that the output is the same as if the whole recording had
+ *	been replayed by a single thread, regardless of the number of
+ *	workers
+ *
+ *	to bound the memory used for collecting the output, workers
+ *	only run ahead of the oldest segment not yet written out by
+ *	VT102_BATCH_SEGMENTS_AHEAD segments each
+ *
+ *	\note	as the screen state at the start of a segment comes from
+ *		a keyframe, the callbacks must not depend on the screen
+ *		states of earlier segments - e.g. the whole screen is
+ *		scheduled for refreshing after loading a keyframe, and
+ *		diffs should be encoded from no screen state at all
+ *		at the start of each segment (see vt102-diff.h)
+ *
+ *	\note	programs using this module must be linked with
+ *		the posix threads library (-lpthread)
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the number of segments each worker may run ahead of the output written */
+	VT102_BATCH_SEGMENTS_AHEAD	=	4,
+};
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+/* defined in vt102.h */
+struct vt102_state;
+/* defined in vt102-record.h */
+struct vt102_replay;
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! the replay callbacks, invoked by the worker threads */
+struct vt102_batch_ops
+{
+	/*! a worker has been started
+	 *
+	 * returns the data to pass to the other callbacks invoked by
+	 * the worker, e.g. for holding per-worker state; may be null */
+	void * (*worker_started)(void * user_data);
+	/*! a worker is being stopped; may be null */
+	void (*worker_stopped)(void * worker_data);
+	/*! a segment is about to be replayed into the emulator 'state'; may be null */
+	void (*segment_started)(void * worker_data, struct vt102_state * state, int segment, FILE * out);
+	/*! a record has been replayed into the emulator 'state'
+	 *
+	 * 'time' is the time of the record, in microseconds since the
+	 * recording was started; the callback should consume the screen
+	 * changes (e.g. reset the row refresh-needed flags) */
+	void (*record_replayed)(void * worker_data, struct vt102_state * state, uint64_t time, FILE * out);
+};
+
+/*! parallel replay counters */
+struct vt102_batch_stats
+{
+	/*! the number of segments replayed */
+	int nr_segments;
+	/*! the number of worker threads used */
+	int nr_workers;
+	/*! the number of bytes of output written */
+	unsigned long long nr_output_bytes;
+	/*! the number of times the writing of the output had to wait for a segment to be replayed */
+	unsigned long nr_output_stalls;
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+bool vt102_batch_replay(struct vt102_replay * rp, int nr_workers, const struct vt102_batch_ops * ops, void * user_data, FILE * out, struct vt102_batch_stats * stats);
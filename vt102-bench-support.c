@@ -0,0 +1,369 @@
+/*!
+ *	\file	vt102-bench-support.c
+ *	\brief	vt102 terminal emulator benchmark support
+ *	\author	shopov
+ *
+ *	see the comments in vt102-bench-support.h
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "vt102-bench-support.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the height of the screen the full screen editor corpus is drawn for */
+	SCREEN_HEIGHT		=	24,
+	/*! the random seed the corpora are generated from */
+	CORPUS_SEED		=	1,
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static size_t append(unsigned char * buf, size_t len, size_t i, const char * s)
+ *	\brief	appends a string to a corpus buffer, truncating it at the end of the buffer
+ *
+ *	\param	buf	the corpus buffer
+ *	\param	len	the size of the corpus buffer
+ *	\param	i	the offset in the buffer to append the string at
+ *	\param	s	the string to append
+ *	\return	the offset in the buffer past the string appended */
+static size_t append(unsigned char * buf, size_t len, size_t i, const char * s)
+{
+size_t n;
+
+	n = strlen(s);
+	if (n > len - i)
+		n = len - i;
+	memcpy(buf + i, s, n);
+	return i + n;
+}
+
+/*!
+ *	\fn	static void make_plain_corpus(unsigned char * buf, size_t len)
+ *	\brief	fills a buffer with plain text - build log-like lines
+ *
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+static void make_plain_corpus(unsigned char * buf, size_t len)
+{
+static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789 ./-_:()=";
+char line[200];
+size_t i;
+int j, n;
+
+	for (i = 0; i < len; )
+	{
+		n = 20 + rand() % 120;
+		for (j = 0; j < n; j++)
+			line[j] = chars[rand() % (sizeof chars - 1)];
+		strcpy(line + n, "\r\n");
+		i = append(buf, len, i, line);
+	}
+}
+
+/*!
+ *	\fn	static void make_utf8_corpus(unsigned char * buf, size_t len)
+ *	\brief	fills a buffer with utf-8 encoded text - lines of words in several scripts, separated by ascii spaces
+ *
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+static void make_utf8_corpus(unsigned char * buf, size_t len)
+{
+static const char * words[] =
+{
+	"\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82",	/* cyrillic */
+	"\xce\xba\xce\xb1\xce\xbb\xce\xb7\xce\xbc\xce\xad\xcf\x81\xce\xb1",	/* greek */
+	"\xe4\xb8\xad\xe6\x96\x87",	/* cjk */
+	"\xe2\x94\x80\xe2\x94\x80\xe2\x94\xbc",	/* box drawing */
+	"\xf0\x9f\x98\x80",	/* emoji */
+	"caf\xc3\xa9",	/* latin-1 */
+	"ascii",
+};
+size_t i;
+int j, n;
+
+	for (i = 0; i < len; )
+	{
+		n = 3 + rand() % 12;
+		for (j = 0; j < n; j++)
+		{
+			i = append(buf, len, i, words[rand() % (sizeof words / sizeof * words)]);
+			i = append(buf, len, i, " ");
+		}
+		i = append(buf, len, i, "\r\n");
+	}
+}
+
+/*!
+ *	\fn	static void make_ls_color_corpus(unsigned char * buf, size_t len)
+ *	\brief	fills a buffer with 'ls --color'-like output - short runs of text between sgr sequences
+ *
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+static void make_ls_color_corpus(unsigned char * buf, size_t len)
+{
+static const char * sgr[] = { "\033[0m", "\033[01;34m", "\033[01;32m", "\033[01;36m", "\033[40;33;01m", };
+char item[64];
+size_t i;
+int nr_items;
+
+	for (i = nr_items = 0; i < len; )
+	{
+		snprintf(item, sizeof item, "%sfile-%d.c\033[0m  %s",
+				sgr[rand() % (sizeof sgr / sizeof * sgr)],
+				rand() % 100000,
+				(++ nr_items % 6) ? "" : "\r\n");
+		i = append(buf, len, i, item);
+	}
+}
+
+/*!
+ *	\fn	static void make_full_screen_corpus(unsigned char * buf, size_t len)
+ *	\brief	fills a buffer with full screen editor (vim/htop)-like output
+ *
+ *	this is a sequence of screen updates, each either a full
+ *	screen redraw, or a few rows redrawn in place - with cursor
+ *	positioning, erasing to the end of the line, and highlighting
+ *	some text in reverse video - followed by a status line update
+ *
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+static void make_full_screen_corpus(unsigned char * buf, size_t len)
+{
+static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789 {}();=+*";
+char s[160];
+size_t i;
+int row, nr_rows, j, n;
+
+	for (i = 0; i < len; )
+	{
+		if (!(rand() % 16))
+		{
+			/* full screen redraw */
+			i = append(buf, len, i, "\033[H\033[2J");
+			nr_rows = SCREEN_HEIGHT - 1;
+		}
+		else
+			nr_rows = 1 + rand() % 4;
+		for (row = 0; row < nr_rows; row++)
+		{
+			snprintf(s, sizeof s, "\033[%d;1H", nr_rows == SCREEN_HEIGHT - 1 ? row + 1 : 1 + rand() % (SCREEN_HEIGHT - 1));
+			i = append(buf, len, i, s);
+			n = rand() % 70;
+			for (j = 0; j < n; j++)
+				s[j] = chars[rand() % (sizeof chars - 1)];
+			s[n] = 0;
+			i = append(buf, len, i, s);
+			if (!(rand() % 4))
+				i = append(buf, len, i, "\033[7m match \033[m");
+			i = append(buf, len, i, "\033[K");
+		}
+		snprintf(s, sizeof s, "\033[%d;1H\033[7m-- INSERT --  %d,%d  %d%%\033[m\033[K\033[%d;%dH",
+				SCREEN_HEIGHT, rand() % 1000, rand() % 80, rand() % 100,
+				1 + rand() % (SCREEN_HEIGHT - 1), 1 + rand() % 80);
+		i = append(buf, len, i, s);
+	}
+}
+
+/*!
+ *	\fn	static void make_sgr_storm_corpus(unsigned char * buf, size_t len)
+ *	\brief	fills a buffer with an sgr storm - most characters with their own graphic rendition
+ *
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+static void make_sgr_storm_corpus(unsigned char * buf, size_t len)
+{
+char s[64];
+size_t i;
+int nr_chars;
+
+	for (i = nr_chars = 0; i < len; )
+	{
+		switch (rand() % 4)
+		{
+			case 0:
+				snprintf(s, sizeof s, "\033[3%dm%c", rand() % 8, 'a' + rand() % 26);
+				break;
+			case 1:
+				snprintf(s, sizeof s, "\033[4%d;3%dm%c", rand() % 8, rand() % 8, 'a' + rand() % 26);
+				break;
+			case 2:
+				snprintf(s, sizeof s, "\033[0;1;4%d;3%dm%c", rand() % 8, rand() % 8, 'a' + rand() % 26);
+				break;
+			default:
+				snprintf(s, sizeof s, "\033[m%c", 'a' + rand() % 26);
+				break;
+		}
+		i = append(buf, len, i, s);
+		if (!(++ nr_chars % 78))
+			i = append(buf, len, i, "\r\n");
+	}
+}
+
+/*!
+ *	\fn	static void make_scroll_region_corpus(unsigned char * buf, size_t len)
+ *	\brief	fills a buffer with scrolling region churn
+ *
+ *	this sets up a scrolling region, and then scrolls it up -
+ *	by writing lines at its bottom - and down - by reverse
+ *	indexing at its top, or inserting and deleting lines
+ *
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+static void make_scroll_region_corpus(unsigned char * buf, size_t len)
+{
+char s[160];
+size_t i;
+int top, bottom, j;
+
+	for (i = 0; i < len; )
+	{
+		top = 1 + rand() % 8;
+		bottom = top + 4 + rand() % (SCREEN_HEIGHT - top - 4);
+		snprintf(s, sizeof s, "\033[%d;%dr\033[%d;1H", top, bottom, bottom);
+		i = append(buf, len, i, s);
+		for (j = rand() % 20; j; j--)
+		{
+			snprintf(s, sizeof s, "line %d of the scrolling region\r\n", rand());
+			i = append(buf, len, i, s);
+		}
+		snprintf(s, sizeof s, "\033[%d;1H", top);
+		i = append(buf, len, i, s);
+		for (j = rand() % 8; j; j--)
+			i = append(buf, len, i, "\033Mreverse index\r");
+		snprintf(s, sizeof s, "\033[%d;1H\033[%dL\033[%dM", top + rand() % 4, 1 + rand() % 3, 1 + rand() % 3);
+		i = append(buf, len, i, s);
+		i = append(buf, len, i, "\033[1;24r");
+	}
+}
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! the built-in synthetic corpora, indexed by enum vt102_bench_corpus */
+static const struct
+{
+	const char * name;
+	void (* make_corpus)(unsigned char * buf, size_t len);
+}
+corpora[VT102_BENCH_NR_CORPORA] =
+{
+	[VT102_BENCH_CORPUS_PLAIN] = { "plain text", make_plain_corpus, },
+	[VT102_BENCH_CORPUS_UTF8] = { "utf-8 text", make_utf8_corpus, },
+	[VT102_BENCH_CORPUS_LS_COLOR] = { "ls --color", make_ls_color_corpus, },
+	[VT102_BENCH_CORPUS_FULL_SCREEN] = { "full screen editor", make_full_screen_corpus, },
+	[VT102_BENCH_CORPUS_SGR_STORM] = { "sgr storm", make_sgr_storm_corpus, },
+	[VT102_BENCH_CORPUS_SCROLL_REGION] = { "scroll region churn", make_scroll_region_corpus, },
+};
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	const char * vt102_bench_corpus_name(enum vt102_bench_corpus corpus)
+ *	\brief	returns the name of a built-in synthetic corpus, for printing
+ *
+ *	\param	corpus	the corpus
+ *	\return	the name of the corpus */
+const char * vt102_bench_corpus_name(enum vt102_bench_corpus corpus)
+{
+	return corpora[corpus].name;
+}
+
+/*!
+ *	\fn	void vt102_bench_make_corpus(enum vt102_bench_corpus corpus, unsigned char * buf, size_t len)
+ *	\brief	generates a built-in synthetic corpus
+ *
+ *	the random number generator is reseeded first, so that the
+ *	corpus generated is always the same for a given size
+ *
+ *	\param	corpus	the corpus to generate
+ *	\param	buf	the buffer to fill
+ *	\param	len	the size of the buffer
+ *	\return	none */
+void vt102_bench_make_corpus(enum vt102_bench_corpus corpus, unsigned char * buf, size_t len)
+{
+	srand(CORPUS_SEED);
+	corpora[corpus].make_corpus(buf, len);
+}
+
+/*!
+ *	\fn	unsigned char * vt102_bench_read_file(const char * file_name, size_t * len)
+ *	\brief	reads a whole file in memory
+ *
+ *	\param	file_name	the name of the file to read
+ *	\param	len	the number of bytes read is stored here
+ *	\return	a pointer to a buffer holding the file contents, null on error */
+unsigned char * vt102_bench_read_file(const char * file_name, size_t * len)
+{
+FILE * f;
+unsigned char * buf;
+long size;
+
+	if (!(f = fopen(file_name, "rb")))
+		return 0;
+	buf = 0;
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET))
+		goto out;
+	if (!(buf = malloc(size)))
+		goto out;
+	if (fread(buf, 1, size, f) != (size_t) size)
+	{
+		free(buf);
+		buf = 0;
+		goto out;
+	}
+	* len = size;
+out:
+	fclose(f);
+	return buf;
+}
+
+/*!
+ *	\fn	double vt102_bench_now(void)
+ *	\brief	returns the current value of a monotonic clock, in seconds
+ *
+ *	\return	the current value of the clock */
+double vt102_bench_now(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
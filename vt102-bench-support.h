@@ -0,0 +1,66 @@
+/*!
+ *	\file	vt102-bench-support.h
+ *	\brief	vt102 terminal emulator benchmark support header file
+ *	\author	shopov
+ *
+ *	this module holds the code shared by the benchmarks
+ *	(vt102-scan-bench.c, vt102-parser-bench.c and vt102-replay-bench.c) -
+ *	the generators of the built-in synthetic corpora, and the file
+ *	reading and timing helpers; the corpora are generated from a fixed
+ *	random seed, so that all of the benchmarks see the very same input,
+ *	and their results can be compared with each other and between runs
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the size of each synthetic corpus normally generated, in bytes */
+	VT102_BENCH_CORPUS_SIZE	=	4 * 1024 * 1024,
+};
+
+/*! the built-in synthetic corpora */
+enum vt102_bench_corpus
+{
+	/*! plain text - build log-like lines */
+	VT102_BENCH_CORPUS_PLAIN	=	0,
+	/*! utf-8 encoded text - lines of words in several scripts */
+	VT102_BENCH_CORPUS_UTF8,
+	/*! 'ls --color'-like output - short runs of text between sgr sequences */
+	VT102_BENCH_CORPUS_LS_COLOR,
+	/*! full screen editor (vim/htop)-like output, for an 80x24 screen */
+	VT102_BENCH_CORPUS_FULL_SCREEN,
+	/*! an sgr storm - most characters with their own graphic rendition */
+	VT102_BENCH_CORPUS_SGR_STORM,
+	/*! scrolling region churn - scrolling inside margins, reverse index, inserting and deleting lines */
+	VT102_BENCH_CORPUS_SCROLL_REGION,
+	/*! the number of corpora */
+	VT102_BENCH_NR_CORPORA,
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+const char * vt102_bench_corpus_name(enum vt102_bench_corpus corpus);
+void vt102_bench_make_corpus(enum vt102_bench_corpus corpus, unsigned char * buf, size_t len);
+unsigned char * vt102_bench_read_file(const char * file_name, size_t * len);
+double vt102_bench_now(void);
+
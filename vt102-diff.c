@@ -0,0 +1,393 @@
+/*!
+ *	\file	vt102-diff.c
+ *	\brief	vt102 terminal emulator screen diff
+ *	\author	shopov
+ *
+ *	see the comments in vt102-diff.h
+ *
+ *	all multibyte fields of a diff are stored least significant
+ *	byte first; a diff has the following format:
+ *		- a header:
+ *			- one byte - the diff format version (DIFF_VERSION)
+ *			- two bytes each - the screen width and height,
+ *				the cursor column and row, the top and
+ *				bottom scrolling margins
+ *			- four bytes - the graphics rendition attributes
+ *				currently selected
+ *			- one byte - flags (DIFF_FLAG_SYNC_UPDATE)
+ *		- the line wrap flags of the screen rows (see the
+ *		  wrapped_line_buf field of struct term_data) - a bit
+ *		  per row, row 0 in the least significant bit of the
+ *		  first byte, the height of the screen rounded up to
+ *		  a multiple of eight bits
+ *		- a sequence of runs of character cells changed, each
+ *		  stored as:
+ *			- two bytes each - the screen row, the first
+ *				column and the number of cells of the run
+ *			- the character codes of the cells of the run
+ *			- two bytes - the number of attribute runs that
+ *				follow, each one stored as two bytes - the
+ *				number of cells in the attribute run, and
+ *				four bytes - the attribute word of the cells
+ *		- two bytes - the end marker (DIFF_END_OF_RUNS)
+ *
+ *	unchanged cells in between changed ones are included in
+ *	a run, if the gap is short enough - storing them costs less
+ *	than starting a new run
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-diff.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the diff format version */
+	DIFF_VERSION		=	2,
+	/*! the size of the diff header, in bytes */
+	DIFF_HEADER_SIZE	=	1 + 6 * 2 + 4 + 1,
+	/*! diff header flag - a synchronized update is in progress (see the sync_update field of struct term_data) */
+	DIFF_FLAG_SYNC_UPDATE	=	1 << 0,
+	/*! the size of the header of a run of cells, in bytes */
+	DIFF_RUN_HEADER_SIZE	=	3 * 2,
+	/*! the size of an attribute run, in bytes */
+	DIFF_ATTR_RUN_SIZE	=	2 + 4,
+	/*! the row number marking the end of the runs of cells */
+	DIFF_END_OF_RUNS	=	0xffff,
+	/*! the longest gap of unchanged cells included in a run of changed cells */
+	DIFF_MAX_GAP		=	8,
+	/*! the maximum screen dimension supported (the dimensions are stored in two bytes) */
+	DIFF_MAX_DIMENSION	=	0xfffe,
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static bool reserve(struct vt102_diff * diff, size_t n)
+ *	\brief	makes sure a number of bytes can be appended to a diff buffer
+ *
+ *	\param	diff	the diff buffer
+ *	\param	n	the number of bytes to make room for
+ *	\return	true on success, false on failure (out of memory) */
+static bool reserve(struct vt102_diff * diff, size_t n)
+{
+unsigned char * p;
+size_t capacity;
+
+	if (diff->size + n <= diff->capacity)
+		return true;
+	capacity = diff->capacity ? 2 * diff->capacity : 4096;
+	while (capacity < diff->size + n)
+		capacity *= 2;
+	if (!(p = realloc(diff->data, capacity)))
+		return false;
+	diff->data = p;
+	diff->capacity = capacity;
+	return true;
+}
+
+/*! appends a two byte field to a diff buffer, which must have enough room for it */
+static inline void put16(struct vt102_diff * diff, unsigned int x)
+{
+	diff->data[diff->size ++] = x;
+	diff->data[diff->size ++] = x >> 8;
+}
+
+/*! appends a four byte field to a diff buffer, which must have enough room for it */
+static inline void put32(struct vt102_diff * diff, uint32_t x)
+{
+	put16(diff, x);
+	put16(diff, x >> 16);
+}
+
+/*! reads a two byte field */
+static inline unsigned int get16(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/*! reads a four byte field */
+static inline uint32_t get32(const unsigned char * p)
+{
+	return get16(p) | ((uint32_t) get16(p + 2) << 16);
+}
+
+/*! returns the number of bytes the line wrap flags of a screen take up in a diff */
+static inline size_t wrap_flags_size(int height)
+{
+	return (height + 7) / 8;
+}
+
+/*!
+ *	\fn	static bool put_run(struct vt102_diff * diff, int row, int x, int len, const unsigned char * chrow, const uint32_t * grrow)
+ *	\brief	appends a run of character cells to a diff buffer
+ *
+ *	\param	diff	the diff buffer
+ *	\param	row	the screen row of the run
+ *	\param	x	the first column of the run
+ *	\param	len	the number of cells in the run
+ *	\param	chrow	the character codes of the screen row
+ *	\param	grrow	the graphics rendition attributes of the screen row
+ *	\return	true on success, false on failure (out of memory) */
+static bool put_run(struct vt102_diff * diff, int row, int x, int len, const unsigned char * chrow, const uint32_t * grrow)
+{
+size_t nr_attr_runs_pos;
+int i, j, nr_attr_runs;
+
+	if (!reserve(diff, DIFF_RUN_HEADER_SIZE + len + 2 + len * DIFF_ATTR_RUN_SIZE))
+		return false;
+	put16(diff, row);
+	put16(diff, x);
+	put16(diff, len);
+	memcpy(diff->data + diff->size, chrow + x, len);
+	diff->size += len;
+	/* the number of attribute runs is filled in below */
+	nr_attr_runs_pos = diff->size;
+	diff->size += 2;
+	for (nr_attr_runs = 0, i = x; i < x + len; i = j, nr_attr_runs ++)
+	{
+		for (j = i + 1; j < x + len; j++)
+			if (grrow[j] != grrow[i])
+				break;
+		put16(diff, j - i);
+		put32(diff, grrow[i]);
+	}
+	diff->data[nr_attr_runs_pos] = nr_attr_runs;
+	diff->data[nr_attr_runs_pos + 1] = nr_attr_runs >> 8;
+	return true;
+}
+
+/*! returns true, if the character cell in column 'x' differs in the two rows given */
+static inline bool cell_changed(const unsigned char * ch0, const uint32_t * gr0, const unsigned char * ch1, const uint32_t * gr1, int x)
+{
+	return ch0[x] != ch1[x] || gr0[x] != gr1[x];
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	bool vt102_diff_encode(struct term_data * from, struct term_data * to, struct vt102_diff * diff)
+ *	\brief	encodes the diff between two screen states
+ *
+ *	\param	from	the screen state to compute the diff from; if null,
+ *			or if its dimensions differ from the ones of the
+ *			'to' screen, the diff holds all of the cells of the
+ *			'to' screen
+ *	\param	to	the screen state to compute the diff to
+ *	\param	diff	the diff buffer where to store the encoded diff;
+ *			any previous contents are discarded, the buffer
+ *			is enlarged as needed; the buffer must be
+ *			zero-initialized before first use
+ *	\return	true on success, false on failure (out of memory, or
+ *		screen dimensions too large) */
+bool vt102_diff_encode(struct term_data * from, struct term_data * to, struct vt102_diff * diff)
+{
+const unsigned char * ch0, * ch1;
+const uint32_t * gr0, * gr1;
+unsigned char * wrap_flags;
+bool full;
+int x, y, w, end, i;
+
+	diff->size = 0;
+	w = to->con_width;
+	if (w > DIFF_MAX_DIMENSION || to->con_height > DIFF_MAX_DIMENSION)
+		return false;
+	full = !from || from->con_width != w || from->con_height != to->con_height;
+	if (!reserve(diff, DIFF_HEADER_SIZE + wrap_flags_size(to->con_height) + 2))
+		return false;
+	diff->data[diff->size ++] = DIFF_VERSION;
+	put16(diff, w);
+	put16(diff, to->con_height);
+	put16(diff, to->cursor_x);
+	put16(diff, to->cursor_y);
+	put16(diff, to->margin_top);
+	put16(diff, to->margin_bottom);
+	put32(diff, to->cur_attr);
+	diff->data[diff->size ++] = to->sync_update ? DIFF_FLAG_SYNC_UPDATE : 0;
+	wrap_flags = diff->data + diff->size;
+	memset(wrap_flags, 0, wrap_flags_size(to->con_height));
+	for (y = 0; y < to->con_height; y++)
+		if (to->wrapped_line_buf[y])
+			wrap_flags[y / 8] |= 1 << (y % 8);
+	diff->size += wrap_flags_size(to->con_height);
+
+	for (y = 0; y < to->con_height; y++)
+	{
+		ch1 = vt102_generic_backend_chrow(to, y);
+		gr1 = vt102_generic_backend_grrow(to, y);
+		if (full)
+		{
+			if (!put_run(diff, y, 0, w, ch1, gr1))
+				return false;
+			continue;
+		}
+		ch0 = vt102_generic_backend_chrow(from, y);
+		gr0 = vt102_generic_backend_grrow(from, y);
+		/* most rows do not change */
+		if (!memcmp(ch0, ch1, w) && !memcmp(gr0, gr1, w * sizeof * gr1))
+			continue;
+		for (x = 0; ; x = end)
+		{
+			/* find the start of the next run... */
+			while (x < w && !cell_changed(ch0, gr0, ch1, gr1, x))
+				x++;
+			if (x == w)
+				break;
+			/* ...and its end, bridging short gaps */
+			for (end = x + 1, i = end; i < w && i - end < DIFF_MAX_GAP; i++)
+				if (cell_changed(ch0, gr0, ch1, gr1, i))
+					end = i + 1;
+			if (!put_run(diff, y, x, end - x, ch1, gr1))
+				return false;
+		}
+	}
+	if (!reserve(diff, 2))
+		return false;
+	put16(diff, DIFF_END_OF_RUNS);
+	return true;
+}
+
+/*!
+ *	\fn	bool vt102_diff_apply(struct vt102_state * state, const unsigned char * data, size_t size)
+ *	\brief	applies an encoded diff to the screen of a generic vt102 backend
+ *
+ *	the screen is resized if its dimensions differ from the
+ *	ones in the diff, and the cells changed are scheduled for
+ *	refreshing
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\param	data	the encoded diff
+ *	\param	size	the size of the encoded diff, in bytes
+ *	\return	true on success, false if the diff is malformed, or
+ *		was encoded for a screen with dimensions the backend
+ *		does not support; on failure, the screen may have been
+ *		partially updated */
+bool vt102_diff_apply(struct vt102_state * state, const unsigned char * data, size_t size)
+{
+struct term_data * tdata;
+struct vt102_backend_ops * ops;
+const unsigned char * p, * end, * wrap_flags;
+unsigned char * chrow;
+uint32_t * grrow, attr, cur_attr;
+int w, h, cursor_x, cursor_y, margin_top, margin_bottom;
+bool sync_update;
+int row, x, len, nr_attr_runs, n, i;
+
+	if (size < DIFF_HEADER_SIZE || data[0] != DIFF_VERSION)
+		return false;
+	p = data + 1;
+	end = data + size;
+	w = get16(p);
+	h = get16(p + 2);
+	cursor_x = get16(p + 4);
+	cursor_y = get16(p + 6);
+	margin_top = get16(p + 8);
+	margin_bottom = get16(p + 10);
+	cur_attr = get32(p + 12);
+	sync_update = p[16] & DIFF_FLAG_SYNC_UPDATE;
+	p += DIFF_HEADER_SIZE - 1;
+	if (cursor_x >= w || cursor_y >= h || margin_top > margin_bottom || margin_bottom >= h
+			|| (size_t) (end - p) < wrap_flags_size(h))
+		return false;
+	wrap_flags = p;
+	p += wrap_flags_size(h);
+	tdata = vt102_generic_backend_get_data(state);
+	if (w != tdata->con_width || h != tdata->con_height)
+	{
+		if (!vt102_generic_backend_resize_buffers(state, w, h)
+				|| w != tdata->con_width || h != tdata->con_height)
+			return false;
+	}
+
+	while (1)
+	{
+		if (end - p < 2)
+			return false;
+		if ((row = get16(p)) == DIFF_END_OF_RUNS)
+			break;
+		if (end - p < DIFF_RUN_HEADER_SIZE)
+			return false;
+		x = get16(p + 2);
+		len = get16(p + 4);
+		p += DIFF_RUN_HEADER_SIZE;
+		if (row >= h || !len || x + len > w || end - p < len + 2)
+			return false;
+		chrow = vt102_generic_backend_chrow(tdata, row);
+		grrow = vt102_generic_backend_grrow(tdata, row);
+		memcpy(chrow + x, p, len);
+		p += len;
+		nr_attr_runs = get16(p);
+		p += 2;
+		if (end - p < nr_attr_runs * DIFF_ATTR_RUN_SIZE)
+			return false;
+		for (i = x; nr_attr_runs --; p += DIFF_ATTR_RUN_SIZE)
+		{
+			n = get16(p);
+			if (n > x + len - i)
+				return false;
+			for (attr = get32(p + 2); n --; i++)
+				grrow[i] = attr;
+		}
+		if (i != x + len)
+			return false;
+		vt102_generic_backend_mark_dirty(tdata, row, x, x + len);
+	}
+
+	for (i = 0; i < h; i++)
+		tdata->wrapped_line_buf[i] = wrap_flags[i / 8] & (1 << (i % 8));
+	tdata->cursor_x = cursor_x;
+	tdata->cursor_y = cursor_y;
+	tdata->margin_top = margin_top;
+	tdata->margin_bottom = margin_bottom;
+	tdata->cur_attr = cur_attr;
+	/* go through the backend function, so that ending an update
+	 * in progress is accounted for */
+	ops = vt102_get_backend_ops(state);
+	if (sync_update != tdata->sync_update && ops->set_synchronized_update)
+		ops->set_synchronized_update(ops->param, sync_update);
+	/* the cursor may have moved */
+	tdata->must_refresh = true;
+	return true;
+}
+
+/*!
+ *	\fn	void vt102_diff_free(struct vt102_diff * diff)
+ *	\brief	releases the memory used by a diff buffer
+ *
+ *	the buffer is left empty, and may be reused
+ *
+ *	\param	diff	the diff buffer
+ *	\return	none */
+void vt102_diff_free(struct vt102_diff * diff)
+{
+	free(diff->data);
+	diff->data = 0;
+	diff->size = diff->capacity = 0;
+}
+
@@ -0,0 +1,91 @@
+/*!
+ *	\file	vt102-diff.h
+ *	\brief	vt102 terminal emulator screen diff header file
+ *	\author	shopov
+ *
+ *	this module produces compact binary diffs between two screen
+ *	states of the generic vt102 backend (see vt102-backend-generic.h),
+ *	and applies such diffs to other screens - so that a screen can
+ *	be mirrored (e.g. to many viewers, over a network, or to a
+ *	recording) without running the byte stream received from the
+ *	remote host through a vt102 command parser for each mirror
+ *
+ *	a diff holds the screen dimensions, the cursor position, the
+ *	scrolling margins, the graphics rendition attributes currently
+ *	selected, whether a synchronized update is in progress (so that
+ *	the mirrors hold their frames the same way), the line wrap flags
+ *	of the screen rows (so that the mirrors see the same logical
+ *	lines, e.g. when extracting text, or reflowing the screen), and
+ *	the runs of character cells whose character code or attributes
+ *	have changed; a diff from no screen state at all
+ *	holds all of the character cells, so that new mirrors can be
+ *	brought up to date
+ *
+ *	a producer mirroring a screen keeps a copy of the screen state
+ *	last sent to the mirrors, and - for each update - encodes the
+ *	diff from that copy to the current screen, applies the diff to
+ *	the copy, and sends the diff to the mirrors unchanged:
+ *
+ *		vt102_diff_encode(shadow_tdata, tdata, &diff);
+ *		vt102_diff_apply(shadow_state, diff.data, diff.size);
+ *		(send diff.data to each mirror, which applies it
+ *		 to its own screen with vt102_diff_apply())
+ *
+ *	the screens compared are only read - in particular, their row
+ *	refresh-needed flags are left alone, so that diffs can be
+ *	produced alongside with rendering the screen; applying a diff
+ *	schedules the cells changed for refreshing, so that the screens
+ *	of the mirrors can be rendered in the usual way
+ *
+ *	the diff format is independent of the host byte order
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+/* defined in vt102-backend-generic.h */
+struct term_data;
+/* defined in vt102.h */
+struct vt102_state;
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! a buffer holding an encoded diff */
+struct vt102_diff
+{
+	/*! the encoded diff, null if the buffer has not been allocated yet */
+	unsigned char * data;
+	/*! the size of the encoded diff, in bytes */
+	size_t size;
+	/*! the size of the buffer pointed to by 'data' */
+	size_t capacity;
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+bool vt102_diff_encode(struct term_data * from, struct term_data * to, struct vt102_diff * diff);
+bool vt102_diff_apply(struct vt102_state * state, const unsigned char * data, size_t size);
+void vt102_diff_free(struct vt102_diff * diff);
+
@@ -0,0 +1,412 @@
+/*!
+ *	\file	vt102-frame-sched.c
+ *	\brief	vt102 terminal emulator frame scheduler
+ *	\author	shopov
+ *
+ *	see the comments in vt102-frame-sched.h
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <string.h>
+#include <time.h>
+
+#include "vt102-frame-sched.h"
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static unsigned long long now_us(void)
+ *	\brief	returns the current value of a monotonic clock, in microseconds
+ *
+ *	\return	the current value of the clock */
+static unsigned long long now_us(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*!
+ *	\fn	static void note_change(struct vt102_frame_sched * fs, unsigned long long now)
+ *	\brief	records the time the screen first changed after the last frame, if not already recorded
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	now	the current time
+ *	\return	none */
+static void note_change(struct vt102_frame_sched * fs, unsigned long long now)
+{
+	if (!fs->first_change_us)
+		fs->first_change_us = now;
+}
+
+/*!
+ *	\fn	static unsigned long long sync_hold(struct vt102_frame_sched * fs, unsigned long long now)
+ *	\brief	tells for how long rendering must still be held off, because of a synchronized update in progress
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	now	the current time
+ *	\return	the time rendering must be held off for, in
+ *		microseconds, zero if it need not be held off */
+static unsigned long long sync_hold(struct vt102_frame_sched * fs, unsigned long long now)
+{
+	if (!fs->sync_start_us || fs->sync_timed_out)
+		return 0;
+	if (now >= fs->sync_start_us + fs->sync_timeout_us)
+	{
+		/* give up waiting - the remote host may have been
+		 * killed in the middle of the update, or may not
+		 * be ending it at all */
+		fs->sync_timed_out = true;
+		fs->stats.nr_sync_timeouts ++;
+		return 0;
+	}
+	return fs->sync_start_us + fs->sync_timeout_us - now;
+}
+
+/*!
+ *	\fn	static void account_histogram(unsigned long * histogram, unsigned long long t)
+ *	\brief	accounts a time in a latency or rendering time histogram
+ *
+ *	\param	histogram	the histogram
+ *	\param	t	the time to account, in microseconds
+ *	\return	none */
+static void account_histogram(unsigned long * histogram, unsigned long long t)
+{
+int i;
+
+	for (i = 0; t > 1 && i < VT102_FRAME_SCHED_NR_HISTOGRAM_BUCKETS - 1; t >>= 1)
+		i++;
+	histogram[i] ++;
+}
+
+/*!
+ *	\fn	static void print_histogram(FILE * f, const char * name, const unsigned long * histogram)
+ *	\brief	prints the nonempty buckets of a latency or rendering time histogram
+ *
+ *	\param	f	the stream to print the histogram to
+ *	\param	name	the name of the histogram
+ *	\param	histogram	the histogram
+ *	\return	none */
+static void print_histogram(FILE * f, const char * name, const unsigned long * histogram)
+{
+int i;
+
+	fprintf(f, "%s histogram (us):", name);
+	for (i = 0; i < VT102_FRAME_SCHED_NR_HISTOGRAM_BUCKETS; i++)
+		if (histogram[i])
+		{
+			if (i == VT102_FRAME_SCHED_NR_HISTOGRAM_BUCKETS - 1)
+				fprintf(f, " >=%lu:%lu", 1UL << i, histogram[i]);
+			else
+				fprintf(f, " <%lu:%lu", 2UL << i, histogram[i]);
+		}
+	fprintf(f, "\n");
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	void vt102_frame_sched_init(struct vt102_frame_sched * fs, int frame_rate)
+ *	\brief	initializes a frame scheduler
+ *
+ *	\param	fs	the frame scheduler state to initialize
+ *	\param	frame_rate	the maximum number of frames to render
+ *			per second; if not positive, a default rate
+ *			(VT102_FRAME_SCHED_DEFAULT_FRAME_RATE) is used
+ *	\return	none */
+void vt102_frame_sched_init(struct vt102_frame_sched * fs, int frame_rate)
+{
+	memset(fs, 0, sizeof * fs);
+	if (frame_rate <= 0)
+		frame_rate = VT102_FRAME_SCHED_DEFAULT_FRAME_RATE;
+	fs->frame_budget_us = 1000000 / frame_rate;
+	fs->idle_delay_us = VT102_FRAME_SCHED_IDLE_DELAY_US;
+	fs->small_nr_rows = VT102_FRAME_SCHED_SMALL_NR_ROWS;
+	fs->sync_timeout_us = VT102_FRAME_SCHED_SYNC_TIMEOUT_US;
+	fs->start_us = now_us();
+}
+
+/*!
+ *	\fn	void vt102_frame_sched_note_input(struct vt102_frame_sched * fs, size_t nr_bytes, bool screen_changed)
+ *	\brief	records the processing of a chunk of input
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	nr_bytes	the size of the input chunk processed
+ *	\param	screen_changed	true, if the screen needs refreshing
+ *				after processing the input
+ *	\return	none */
+void vt102_frame_sched_note_input(struct vt102_frame_sched * fs, size_t nr_bytes, bool screen_changed)
+{
+unsigned long long now;
+
+	now = now_us();
+	fs->last_input_us = now;
+	if (screen_changed)
+		note_change(fs, now);
+	fs->stats.nr_input_chunks ++;
+	fs->stats.nr_input_bytes += nr_bytes;
+}
+
+/*!
+ *	\fn	void vt102_frame_sched_note_sync_update(struct vt102_frame_sched * fs, bool in_progress, unsigned long nr_completed)
+ *	\brief	records the state of the synchronized updates of the remote host
+ *
+ *	this should be called after each chunk of input processed,
+ *	with the values of the 'sync_update' field and of the
+ *	'stats.nr_sync_updates' field of struct term_data (see
+ *	vt102-backend-generic.h); a rendering module which has already
+ *	held off the screen contents while an update was in progress
+ *	(e.g. the one receiving the screen from a command parser running
+ *	in a thread of its own, see vt102-snapshot.h) should pass false
+ *	for 'in_progress', so that the frames of the updates completed
+ *	are still rendered without waiting for the input to pause
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	in_progress	true, if a synchronized update is in progress
+ *	\param	nr_completed	the number of synchronized updates completed
+ *				so far
+ *	\return	none */
+void vt102_frame_sched_note_sync_update(struct vt102_frame_sched * fs, bool in_progress, unsigned long nr_completed)
+{
+	if (nr_completed != fs->nr_sync_updates)
+	{
+		/* an update has completed - and another one
+		 * may have begun since, wait for it anew */
+		fs->nr_sync_updates = nr_completed;
+		fs->sync_update_done = true;
+		fs->sync_start_us = 0;
+	}
+	if (!in_progress)
+		fs->sync_start_us = 0;
+	else if (!fs->sync_start_us)
+	{
+		fs->sync_start_us = now_us();
+		fs->sync_timed_out = false;
+	}
+}
+
+/*!
+ *	\fn	bool vt102_frame_sched_sync_hold(struct vt102_frame_sched * fs, struct timeval * timeout)
+ *	\brief	tells if rendering must be held off, because a synchronized update is in progress
+ *
+ *	vt102_frame_sched_get_timeout() and vt102_frame_sched_frame_due()
+ *	already take the synchronized updates into account; this is for
+ *	code which does not render the screen through the scheduler, but
+ *	must still hold off e.g. handing the screen over for rendering
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	timeout	if not null, and rendering must be held off,
+ *			the time until the hold times out is stored here
+ *	\return	true, if rendering must be held off, false otherwise */
+bool vt102_frame_sched_sync_hold(struct vt102_frame_sched * fs, struct timeval * timeout)
+{
+unsigned long long t;
+
+	if (!(t = sync_hold(fs, now_us())))
+		return false;
+	if (timeout)
+	{
+		timeout->tv_sec = t / 1000000;
+		timeout->tv_usec = t % 1000000;
+	}
+	return true;
+}
+
+/*!
+ *	\fn	struct timeval * vt102_frame_sched_get_timeout(struct vt102_frame_sched * fs, int nr_changed_rows, struct timeval * timeout)
+ *	\brief	computes the time to wait for more input for, before rendering a frame
+ *
+ *	this must only be called when the screen needs refreshing
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	nr_changed_rows	the number of screen rows which need refreshing
+ *	\param	timeout	the time to wait for is stored here
+ *	\return	the value of the 'timeout' parameter, suitable
+ *		for passing to select() */
+struct timeval * vt102_frame_sched_get_timeout(struct vt102_frame_sched * fs, int nr_changed_rows, struct timeval * timeout)
+{
+unsigned long long now, deadline, held;
+
+	now = now_us();
+	note_change(fs, now);
+	held = sync_hold(fs, now);
+	/* render small updates (and the frames of the synchronized
+	 * updates completed) as soon as the input pauses, give
+	 * the input a little time to complete larger ones */
+	if (fs->sync_update_done || nr_changed_rows <= fs->small_nr_rows)
+		deadline = now;
+	else
+		deadline = fs->last_input_us + fs->idle_delay_us;
+	/* but do not defer the update for longer than a frame... */
+	if (deadline > fs->first_change_us + fs->frame_budget_us)
+		deadline = fs->first_change_us + fs->frame_budget_us;
+	/* ...and do not render more than a frame per frame budget */
+	if (deadline < fs->last_frame_us + fs->frame_budget_us)
+		deadline = fs->last_frame_us + fs->frame_budget_us;
+	/* wait for the synchronized update in progress to complete */
+	if (deadline < now + held)
+		deadline = now + held;
+	deadline = deadline > now ? deadline - now : 0;
+	timeout->tv_sec = deadline / 1000000;
+	timeout->tv_usec = deadline % 1000000;
+	return timeout;
+}
+
+/*!
+ *	\fn	bool vt102_frame_sched_frame_due(struct vt102_frame_sched * fs, int nr_changed_rows, bool input_idle)
+ *	\brief	tells if a frame should be rendered now
+ *
+ *	this must only be called when the screen needs refreshing
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	nr_changed_rows	the number of screen rows which need refreshing
+ *	\param	input_idle	true, if there is no input pending
+ *	\return	true, if a frame should be rendered now, false otherwise */
+bool vt102_frame_sched_frame_due(struct vt102_frame_sched * fs, int nr_changed_rows, bool input_idle)
+{
+unsigned long long now;
+
+	now = now_us();
+	note_change(fs, now);
+	if (sync_hold(fs, now))
+		return false;
+	if (now < fs->last_frame_us + fs->frame_budget_us)
+		return false;
+	if (fs->sync_update_done && input_idle)
+		/* the application has completed drawing a frame */
+		return true;
+	if (now >= fs->first_change_us + fs->frame_budget_us)
+	{
+		/* the update cannot be deferred any more */
+		if (!input_idle)
+			fs->stats.nr_forced_frames ++;
+		return true;
+	}
+	if (!input_idle)
+		return false;
+	if (nr_changed_rows <= fs->small_nr_rows)
+		return true;
+	return now >= fs->last_input_us + fs->idle_delay_us;
+}
+
+/*!
+ *	\fn	void vt102_frame_sched_frame_begin(struct vt102_frame_sched * fs)
+ *	\brief	records the start of rendering a frame
+ *
+ *	\param	fs	the frame scheduler state
+ *	\return	none */
+void vt102_frame_sched_frame_begin(struct vt102_frame_sched * fs)
+{
+	fs->frame_begin_us = now_us();
+}
+
+/*!
+ *	\fn	void vt102_frame_sched_note_render(struct vt102_frame_sched * fs, int nr_rows, int nr_cells, int nr_draw_requests)
+ *	\brief	accounts the amount of drawing done for the frame being rendered
+ *
+ *	this is optional; if called, it should be called once
+ *	for each frame, before vt102_frame_sched_frame_end()
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	nr_rows	the number of rows drawn
+ *	\param	nr_cells	the number of character cells drawn
+ *	\param	nr_draw_requests	the number of drawing requests made
+ *				(e.g. x server requests)
+ *	\return	none */
+void vt102_frame_sched_note_render(struct vt102_frame_sched * fs, int nr_rows, int nr_cells, int nr_draw_requests)
+{
+	fs->stats.nr_rows_drawn += nr_rows;
+	fs->stats.nr_cells_drawn += nr_cells;
+	fs->stats.nr_draw_requests += nr_draw_requests;
+	if ((unsigned long) nr_cells > fs->stats.max_cells_drawn)
+		fs->stats.max_cells_drawn = nr_cells;
+}
+
+/*!
+ *	\fn	void vt102_frame_sched_frame_end(struct vt102_frame_sched * fs)
+ *	\brief	records the end of rendering a frame, and updates the counters
+ *
+ *	\param	fs	the frame scheduler state
+ *	\return	none */
+void vt102_frame_sched_frame_end(struct vt102_frame_sched * fs)
+{
+unsigned long long now, t;
+
+	now = now_us();
+	fs->stats.nr_frames ++;
+	t = now - fs->frame_begin_us;
+	fs->stats.total_render_us += t;
+	if (t > fs->stats.max_render_us)
+		fs->stats.max_render_us = t;
+	account_histogram(fs->stats.render_histogram, t);
+	if (fs->first_change_us)
+	{
+		t = now - fs->first_change_us;
+		fs->stats.total_latency_us += t;
+		if (t > fs->stats.max_latency_us)
+			fs->stats.max_latency_us = t;
+		account_histogram(fs->stats.latency_histogram, t);
+	}
+	/* pace the frames by the time they were started at */
+	fs->last_frame_us = fs->frame_begin_us;
+	fs->first_change_us = 0;
+	if (fs->sync_update_done)
+	{
+		fs->stats.nr_sync_frames ++;
+		fs->sync_update_done = false;
+	}
+}
+
+/*!
+ *	\fn	void vt102_frame_sched_print_stats(struct vt102_frame_sched * fs, FILE * f)
+ *	\brief	prints the frame scheduler counters
+ *
+ *	\param	fs	the frame scheduler state
+ *	\param	f	the stream to print the counters to
+ *	\return	none */
+void vt102_frame_sched_print_stats(struct vt102_frame_sched * fs, FILE * f)
+{
+struct vt102_frame_stats * s;
+double t;
+
+	s = &fs->stats;
+	t = (now_us() - fs->start_us) / 1e6;
+	fprintf(f, "frames: %lu (%lu forced while input was arriving), %.1f frames/s\n",
+			s->nr_frames, s->nr_forced_frames, s->nr_frames / t);
+	fprintf(f, "input: %llu bytes in %lu chunks, %.3f MB/s\n",
+			s->nr_input_bytes, s->nr_input_chunks, s->nr_input_bytes / t / 1e6);
+	if (s->nr_sync_frames || s->nr_sync_timeouts)
+		fprintf(f, "synchronized updates: %lu frames rendered on completion, %lu timed out\n",
+				s->nr_sync_frames, s->nr_sync_timeouts);
+	if (!s->nr_frames)
+		return;
+	fprintf(f, "latency: average %llu us, maximum %llu us\n",
+			s->total_latency_us / s->nr_frames, s->max_latency_us);
+	fprintf(f, "rendering time: average %llu us, maximum %llu us\n",
+			s->total_render_us / s->nr_frames, s->max_render_us);
+	print_histogram(f, "latency", s->latency_histogram);
+	print_histogram(f, "rendering time", s->render_histogram);
+	fprintf(f, "drawing: %.1f rows, %.1f cells (maximum %lu), %.1f draw requests per frame\n",
+			(double) s->nr_rows_drawn / s->nr_frames,
+			(double) s->nr_cells_drawn / s->nr_frames,
+			s->max_cells_drawn,
+			(double) s->nr_draw_requests / s->nr_frames);
+}
+
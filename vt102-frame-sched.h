@@ -0,0 +1,185 @@
+/*!
+ *	\file	vt102-frame-sched.h
+ *	\brief	vt102 terminal emulator frame scheduler header file
+ *	\author	shopov
+ *
+ *	this module decides when a rendering module should refresh
+ *	the terminal window; the terminal window is refreshed at most
+ *	once per frame budget (the inverse of the frame rate requested),
+ *	no matter how much input arrives - but not later than a frame
+ *	budget after the screen first changed; small updates (e.g. the
+ *	echo of a keystroke) are rendered as soon as the input pauses,
+ *	larger updates are deferred for a short while, in the hope that
+ *	more input completes them
+ *
+ *	while the remote host is in the middle of a synchronized update
+ *	(see the comments about the 'sync_update' field of struct term_data
+ *	in vt102-backend-generic.h), no frames are rendered - until the
+ *	update completes, or until it has been in progress for too long
+ *	(VT102_FRAME_SCHED_SYNC_TIMEOUT_US), whichever happens first; the
+ *	frame of a completed update is rendered without waiting for the
+ *	input to pause, so that each frame the application draws in a
+ *	synchronized update is displayed once, and as a whole - see
+ *	vt102_frame_sched_note_sync_update()
+ *
+ *	the module also maintains latency and throughput counters,
+ *	retrievable from the 'stats' field of struct vt102_frame_sched;
+ *	rendering modules may also account the amount of drawing done
+ *	for each frame, by calling vt102_frame_sched_note_render()
+ *
+ *	a typical main loop using the scheduler looks like this:
+ *
+ *		if (screen changed)
+ *			timeout = vt102_frame_sched_get_timeout(...);
+ *		select(... timeout);
+ *		if (screen changed && vt102_frame_sched_frame_due(...))
+ *		{
+ *			vt102_frame_sched_frame_begin(...);
+ *			render...
+ *			vt102_frame_sched_note_render(...);
+ *			vt102_frame_sched_frame_end(...);
+ *		}
+ *		if (input available)
+ *		{
+ *			read and parse the input...
+ *			vt102_frame_sched_note_input(...);
+ *			vt102_frame_sched_note_sync_update(...);
+ *		}
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! a default frame rate, in frames per second */
+	VT102_FRAME_SCHED_DEFAULT_FRAME_RATE	=	60,
+	/*! the time the input must pause for before rendering a large update, in microseconds */
+	VT102_FRAME_SCHED_IDLE_DELAY_US		=	2000,
+	/*! updates touching at most this number of rows are considered small */
+	VT102_FRAME_SCHED_SMALL_NR_ROWS		=	2,
+	/*! the maximum time to hold off rendering for, while a synchronized update is in progress, in microseconds */
+	VT102_FRAME_SCHED_SYNC_TIMEOUT_US	=	150000,
+	/*! the number of buckets in the latency and rendering time histograms
+	 *
+	 * bucket 'i' counts the frames taking from 2 ^ i up to
+	 * 2 ^ (i + 1) microseconds (bucket 0 also counts the
+	 * frames taking less than 1 microsecond), the last bucket
+	 * counts all of the frames taking longer */
+	VT102_FRAME_SCHED_NR_HISTOGRAM_BUCKETS	=	20,
+};
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! frame scheduler latency and throughput counters */
+struct vt102_frame_stats
+{
+	/*! the number of frames rendered */
+	unsigned long nr_frames;
+	/*! the number of frames rendered because they could not be deferred any more, while input was still arriving */
+	unsigned long nr_forced_frames;
+	/*! the number of input chunks processed */
+	unsigned long nr_input_chunks;
+	/*! the number of input bytes processed */
+	unsigned long long nr_input_bytes;
+	/*! the sum of the latencies of all frames, in microseconds
+	 *
+	 * the latency of a frame is the time from the
+	 * first change of the screen after the previous
+	 * frame, until the frame has been rendered */
+	unsigned long long total_latency_us;
+	/*! the maximum latency of a frame, in microseconds */
+	unsigned long long max_latency_us;
+	/*! the sum of the times spent rendering frames, in microseconds */
+	unsigned long long total_render_us;
+	/*! the maximum time spent rendering a frame, in microseconds */
+	unsigned long long max_render_us;
+	/*! the histogram of the latencies of the frames */
+	unsigned long latency_histogram[VT102_FRAME_SCHED_NR_HISTOGRAM_BUCKETS];
+	/*! the histogram of the times spent rendering frames */
+	unsigned long render_histogram[VT102_FRAME_SCHED_NR_HISTOGRAM_BUCKETS];
+	/*! the number of rows drawn, as accounted by vt102_frame_sched_note_render() */
+	unsigned long long nr_rows_drawn;
+	/*! the number of character cells drawn, as accounted by vt102_frame_sched_note_render() */
+	unsigned long long nr_cells_drawn;
+	/*! the number of drawing requests made (e.g. x server requests), as accounted by vt102_frame_sched_note_render() */
+	unsigned long long nr_draw_requests;
+	/*! the maximum number of character cells drawn for a frame */
+	unsigned long max_cells_drawn;
+	/*! the number of frames rendered on the completion of a synchronized update */
+	unsigned long nr_sync_frames;
+	/*! the number of synchronized updates which have not completed in time, and have been rendered unfinished */
+	unsigned long nr_sync_timeouts;
+};
+
+/*! the frame scheduler state */
+struct vt102_frame_sched
+{
+	/*! the minimum time between frames, in microseconds */
+	unsigned long long frame_budget_us;
+	/*! the time the input must pause for before rendering a large update, in microseconds */
+	unsigned long long idle_delay_us;
+	/*! the maximum number of changed rows for an update to be considered small */
+	int small_nr_rows;
+	/*! the time the scheduler was initialized at */
+	unsigned long long start_us;
+	/*! the time the last frame was rendered at */
+	unsigned long long last_frame_us;
+	/*! the time the last input chunk was processed at */
+	unsigned long long last_input_us;
+	/*! the time the screen first changed after the last frame, zero if it has not changed */
+	unsigned long long first_change_us;
+	/*! the time rendering of the current frame started at */
+	unsigned long long frame_begin_us;
+	/*! the maximum time to hold off rendering for, while a synchronized update is in progress, in microseconds */
+	unsigned long long sync_timeout_us;
+	/*! the time the synchronized update in progress was first noted at, zero if none is in progress */
+	unsigned long long sync_start_us;
+	/*! set when the synchronized update in progress has not completed in time - rendering is not held off any more */
+	bool sync_timed_out;
+	/*! set when a synchronized update has completed since the last frame */
+	bool sync_update_done;
+	/*! the number of synchronized updates completed, as last noted */
+	unsigned long nr_sync_updates;
+	/*! latency and throughput counters */
+	struct vt102_frame_stats stats;
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+void vt102_frame_sched_init(struct vt102_frame_sched * fs, int frame_rate);
+void vt102_frame_sched_note_input(struct vt102_frame_sched * fs, size_t nr_bytes, bool screen_changed);
+void vt102_frame_sched_note_sync_update(struct vt102_frame_sched * fs, bool in_progress, unsigned long nr_completed);
+bool vt102_frame_sched_sync_hold(struct vt102_frame_sched * fs, struct timeval * timeout);
+struct timeval * vt102_frame_sched_get_timeout(struct vt102_frame_sched * fs, int nr_changed_rows, struct timeval * timeout);
+bool vt102_frame_sched_frame_due(struct vt102_frame_sched * fs, int nr_changed_rows, bool input_idle);
+void vt102_frame_sched_frame_begin(struct vt102_frame_sched * fs);
+void vt102_frame_sched_note_render(struct vt102_frame_sched * fs, int nr_rows, int nr_cells, int nr_draw_requests);
+void vt102_frame_sched_frame_end(struct vt102_frame_sched * fs);
+void vt102_frame_sched_print_stats(struct vt102_frame_sched * fs, FILE * f);
+
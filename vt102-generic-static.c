@@ -0,0 +1,53 @@
+/*!
+ *	\file	vt102-generic-static.c
+ *	\brief	the vt102 command parser, specialized for the generic vt102 terminal emulator backend
+ *	\author	shopov
+ *
+ *	this builds the vt102 command parser (vt102.c) and the generic
+ *	vt102 backend (vt102-backend-generic.c) as a single translation
+ *	unit, with the generic backend compiled in as a compile time
+ *	parameter of the parser (see VT102_BACKEND_CALL() in vt102.h);
+ *	the backend functions invoked by the parser - and the ones the
+ *	backend itself invokes through the vt102_backend_ops function
+ *	pointer table, such as handle_linefeed() when wrapping the
+ *	cursor - are then called directly, and can be inlined, instead
+ *	of being called through the table for every displayable character
+ *	and control character processed
+ *
+ *	the vt102_backend_ops function pointer table is still used as a
+ *	fallback - functions overridden in it (e.g. query_terminal_id(),
+ *	which the front-ends provide, or the hooks of c++ code, see the
+ *	comments about 'generic_ptr' in vt102-backend-generic.h) get
+ *	invoked as usual; the cost of this is a compare and a well
+ *	predicted branch per backend call
+ *
+ *	this is a drop-in replacement for vt102.c and vt102-backend-generic.c,
+ *	i.e. build with something like:
+ *
+ *		cc -O2 -c vt102-generic-static.c
+ *
+ *	and link the resulting object file instead of the ones of
+ *	the two modules it includes
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+/*! the generic backend implements each vt102_backend_ops member it provides in a function of the same name */
+#define VT102_STATIC_BACKEND(op)	op
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include "vt102-backend-generic.c"
+#include "vt102.c"
+
@@ -0,0 +1,229 @@
+/*!
+ *	\file	vt102-input.c
+ *	\brief	vt102 terminal emulator input reading
+ *	\author	shopov
+ *
+ *	see the comments in vt102-input.h
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "vt102.h"
+#include "vt102-log.h"
+#include "vt102-record.h"
+#include "vt102-input.h"
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! the input reading data structure */
+struct vt102_input
+{
+	/*! the file descriptor of the connection to the remote host */
+	int comm_fd;
+	/*! the session logger, null if no logging is requested */
+	struct vt102_log * log;
+	/*! the session recorder, null if no recording is requested */
+	struct vt102_recorder * rec;
+	/*! the input buffer, of size VT102_INPUT_BUF_SIZE */
+	unsigned char * buf;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static bool data_available(int fd)
+ *	\brief	tells if data can be read from a file descriptor without blocking
+ *
+ *	\param	fd	the file descriptor to check
+ *	\return	true, if reading from the file descriptor will not
+ *		block, false otherwise */
+static bool data_available(int fd)
+{
+struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return poll(&pfd, 1, 0) > 0;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_input * vt102_input_create(int comm_fd, struct vt102_log * log)
+ *	\brief	creates an input reading data structure
+ *
+ *	\param	comm_fd	the file descriptor of the connection to the
+ *			remote host
+ *	\param	log	the session logger to log all of the data
+ *			read with, null if no logging is needed
+ *	\return	a pointer to the new input reading data structure,
+ *		or null on error */
+struct vt102_input * vt102_input_create(int comm_fd, struct vt102_log * log)
+{
+struct vt102_input * in;
+
+	if (!(in = malloc(sizeof * in)))
+		return 0;
+	if (!(in->buf = malloc(VT102_INPUT_BUF_SIZE)))
+	{
+		free(in);
+		return 0;
+	}
+	in->comm_fd = comm_fd;
+	in->log = log;
+	in->rec = 0;
+	return in;
+}
+
+/*!
+ *	\fn	void vt102_input_destroy(struct vt102_input * in)
+ *	\brief	destroys an input reading data structure, releasing all memory used by it
+ *
+ *	\note	the file descriptors are not closed
+ *
+ *	\param	in	the input reading data structure to destroy
+ *	\return	none */
+void vt102_input_destroy(struct vt102_input * in)
+{
+	free(in->buf);
+	free(in);
+}
+
+/*!
+ *	\fn	void vt102_input_attach(struct vt102_input * in, int comm_fd, struct vt102_log * log)
+ *	\brief	attaches an input reading data structure to another connection
+ *
+ *	this allows a single input buffer to be shared by many
+ *	connections which are never drained at the same time, e.g.
+ *	by all of the sessions served by a thread
+ *
+ *	\param	in	the input reading data structure
+ *	\param	comm_fd	the file descriptor of the connection to the
+ *			remote host
+ *	\param	log	the session logger to log the data read with,
+ *			null if no logging is needed
+ *	\return	none */
+void vt102_input_attach(struct vt102_input * in, int comm_fd, struct vt102_log * log)
+{
+	in->comm_fd = comm_fd;
+	in->log = log;
+}
+
+/*!
+ *	\fn	void vt102_input_set_recorder(struct vt102_input * in, struct vt102_recorder * rec)
+ *	\brief	requests the data read to be recorded, along with the time it was read at (see vt102-record.h)
+ *
+ *	\note	vt102_input_attach() does not change the recorder
+ *
+ *	\param	in	the input reading data structure
+ *	\param	rec	the session recorder to record the data read
+ *			with, null if no recording is needed
+ *	\return	none */
+void vt102_input_set_recorder(struct vt102_input * in, struct vt102_recorder * rec)
+{
+	in->rec = rec;
+}
+
+/*!
+ *	\fn	ssize_t vt102_input_drain(struct vt102_input * in, struct vt102_state * state)
+ *	\brief	reads and processes the data available from the remote host
+ *
+ *	the data is read in chunks filling the input buffer, for as
+ *	long as data is available (but not more than VT102_INPUT_MAX_DRAIN
+ *	bytes in total); each chunk is then logged, run through
+ *	the vt102 command parser, and recorded
+ *
+ *	the connection file descriptor need not be in non-blocking
+ *	mode - the first read is done unconditionally (so this should
+ *	be called when select() or poll() report the descriptor as
+ *	readable), and later reads are only done if poll() reports
+ *	that more data is available; this way, the descriptor can be
+ *	left in blocking mode, and writing to it (e.g. the keys pressed)
+ *	is not affected
+ *
+ *	\param	in	the input reading data structure
+ *	\param	state	the vt102 emulator state to run the data through
+ *	\return	the number of bytes processed (zero, if there was
+ *		no data available), or -1 if no data was processed,
+ *		and either the remote host has closed the connection,
+ *		or an error occurred (errno is zero in the first case,
+ *		and indicates the error in the second case) */
+ssize_t vt102_input_drain(struct vt102_input * in, struct vt102_state * state)
+{
+ssize_t nr_bytes, total;
+ssize_t len;
+
+	for (total = 0; total < VT102_INPUT_MAX_DRAIN; total += len)
+	{
+		/* fill the buffer, as far as data is available */
+		for (len = 0; len < VT102_INPUT_BUF_SIZE; len += nr_bytes)
+		{
+			if ((total || len) && !data_available(in->comm_fd))
+			{
+				nr_bytes = -1;
+				errno = EAGAIN;
+				break;
+			}
+			if ((nr_bytes = read(in->comm_fd, in->buf + len, VT102_INPUT_BUF_SIZE - len)) <= 0)
+			{
+				if (nr_bytes == -1 && errno == EINTR)
+				{
+					nr_bytes = 0;
+					continue;
+				}
+				break;
+			}
+		}
+		if (len)
+		{
+			if (in->log)
+				vt102_log_write(in->log, in->buf, len);
+			vt102_command_input_parser_buf(state, in->buf, len);
+			/* keyframes are recorded after parsing */
+			if (in->rec)
+				vt102_record_input(in->rec, state, in->buf, len);
+		}
+		if (len < VT102_INPUT_BUF_SIZE)
+		{
+			/* no more data available, see why */
+			if ((total += len))
+				return total;
+			if (nr_bytes == 0)
+			{
+				/* the connection has been closed */
+				errno = 0;
+				return -1;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return -1;
+		}
+	}
+	return total;
+}
+
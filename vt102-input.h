@@ -0,0 +1,71 @@
+/*!
+ *	\file	vt102-input.h
+ *	\brief	vt102 terminal emulator input reading header file
+ *	\author	shopov
+ *
+ *	this module reads the data sent by the remote host (e.g.
+ *	a shell process on a pseudoterminal, or a network peer) in
+ *	large chunks, into a buffer allocated once and reused, logs
+ *	it (if requested - see vt102-log.h), runs it through the vt102
+ *	command parser - one chunk at a time, with a single call to
+ *	vt102_command_input_parser_buf() per chunk - and records it (if
+ *	requested - see vt102-record.h)
+ *
+ *	vt102_input_drain() reads from the file descriptor of the
+ *	connection to the remote host until no more data is available
+ *	(or until a limit on the data processed per call is reached,
+ *	so that the caller still gets the chance to e.g. refresh the
+ *	terminal window while the remote host is flooding the terminal)
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the size of the input buffer */
+	VT102_INPUT_BUF_SIZE	=	64 * 1024,
+	/*! the maximum number of bytes processed by a single call to vt102_input_drain() */
+	VT102_INPUT_MAX_DRAIN	=	4 * VT102_INPUT_BUF_SIZE,
+};
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_input;
+/* defined in vt102.h */
+struct vt102_state;
+/* defined in vt102-log.h */
+struct vt102_log;
+/* defined in vt102-record.h */
+struct vt102_recorder;
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_input * vt102_input_create(int comm_fd, struct vt102_log * log);
+void vt102_input_destroy(struct vt102_input * in);
+void vt102_input_attach(struct vt102_input * in, int comm_fd, struct vt102_log * log);
+void vt102_input_set_recorder(struct vt102_input * in, struct vt102_recorder * rec);
+ssize_t vt102_input_drain(struct vt102_input * in, struct vt102_state * state);
+
@@ -0,0 +1,390 @@
+/*!
+ *	\file	vt102-log.c
+ *	\brief	vt102 terminal emulator session logger
+ *	\author	shopov
+ *
+ *	see the comments in vt102-log.h
+ *
+ *	the ring buffer is shared by the caller (the producer) and
+ *	the background writer thread (the consumer), and is protected
+ *	by a mutex; the mutex is only held while copying data into the
+ *	ring buffer, and while updating the ring buffer indices - never
+ *	while writing to the log file
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef VT102_LOG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "vt102-log.h"
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! the session logger data structure */
+struct vt102_log
+{
+	/*! the log file descriptor */
+	int fd;
+#ifdef VT102_LOG_HAVE_ZLIB
+	/*! the compressed log file, null if the log file is not compressed */
+	gzFile gz;
+#endif
+	/*! the policy to apply when the ring buffer is full */
+	enum vt102_log_policy policy;
+	/*! the ring buffer */
+	unsigned char * buf;
+	/*! the size of the ring buffer */
+	size_t size;
+	/*! the total number of bytes ever stored in the ring buffer */
+	unsigned long long head;
+	/*! the total number of bytes ever removed from the ring buffer */
+	unsigned long long tail;
+	/*! set when the logger is being destroyed */
+	bool closing;
+	/*! set when the caller is waiting for room in the ring buffer */
+	bool flush;
+	/*! set when writing to the log file has failed */
+	bool failed;
+	/*! the mutex protecting all of the fields of this structure */
+	pthread_mutex_t lock;
+	/*! signalled when data has been stored in the ring buffer */
+	pthread_cond_t data_available;
+	/*! signalled when data has been removed from the ring buffer */
+	pthread_cond_t room_available;
+	/*! the background writer thread */
+	pthread_t writer;
+	/*! the logger counters */
+	struct vt102_log_stats stats;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static bool write_out(struct vt102_log * log, const unsigned char * data, size_t len)
+ *	\brief	writes data to the log file
+ *
+ *	\param	log	the session logger
+ *	\param	data	the data to write
+ *	\param	len	the number of bytes to write
+ *	\return	true on success, false on failure */
+static bool write_out(struct vt102_log * log, const unsigned char * data, size_t len)
+{
+ssize_t n;
+
+#ifdef VT102_LOG_HAVE_ZLIB
+	if (log->gz)
+		return gzwrite(log->gz, data, len) == (int) len;
+#endif
+	while (len)
+	{
+		if ((n = write(log->fd, data, len)) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+/*!
+ *	\fn	static void * writer_thread(void * arg)
+ *	\brief	the background writer thread, writing the contents of the ring buffer to the log file
+ *
+ *	\param	arg	the session logger
+ *	\return	none */
+static void * writer_thread(void * arg)
+{
+struct vt102_log * log;
+struct timespec ts;
+size_t n, offset;
+bool ok;
+
+	log = (struct vt102_log *) arg;
+	pthread_mutex_lock(&log->lock);
+	while (1)
+	{
+		/* wait for data to arrive... */
+		while (!log->closing && log->head == log->tail)
+			pthread_cond_wait(&log->data_available, &log->lock);
+		/* ...then for enough data to accumulate, to make
+		 * the writes large - but not for too long */
+		if (!log->closing && !log->flush && log->head - log->tail < VT102_LOG_BATCH_SIZE)
+		{
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += VT102_LOG_FLUSH_INTERVAL_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			while (!log->closing && !log->flush && log->head - log->tail < VT102_LOG_BATCH_SIZE)
+				if (pthread_cond_timedwait(&log->data_available, &log->lock, &ts) == ETIMEDOUT)
+					break;
+		}
+		if (log->head == log->tail)
+			/* closing, and all data written out */
+			break;
+		log->flush = false;
+		/* write out the data contiguous in the ring buffer;
+		 * only the writer thread removes data from the ring
+		 * buffer, so it can be accessed without the lock held */
+		offset = log->tail % log->size;
+		n = log->head - log->tail;
+		if (n > log->size - offset)
+			n = log->size - offset;
+		pthread_mutex_unlock(&log->lock);
+		ok = !log->failed && write_out(log, log->buf + offset, n);
+		pthread_mutex_lock(&log->lock);
+		if (ok)
+		{
+			log->stats.nr_writes ++;
+			log->stats.nr_bytes_written += n;
+		}
+		else if (!log->failed)
+		{
+			log->failed = true;
+			log->stats.nr_errors ++;
+		}
+		log->tail += n;
+		pthread_cond_signal(&log->room_available);
+	}
+	pthread_mutex_unlock(&log->lock);
+	return 0;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_log * vt102_log_create(const char * file_name, size_t buf_size, enum vt102_log_policy policy)
+ *	\brief	creates a session logger, and starts its background writer thread
+ *
+ *	\param	file_name	the name of the log file; the file is
+ *				created, or truncated if it exists
+ *	\param	buf_size	the size of the ring buffer, in bytes; if
+ *				zero, a default size (VT102_LOG_DEFAULT_BUF_SIZE)
+ *				is used
+ *	\param	policy	what to do when the ring buffer is full
+ *	\return	a pointer to the new session logger, or null on error */
+struct vt102_log * vt102_log_create(const char * file_name, size_t buf_size, enum vt102_log_policy policy)
+{
+struct vt102_log * log;
+size_t len;
+
+	if (!buf_size)
+		buf_size = VT102_LOG_DEFAULT_BUF_SIZE;
+	if (!(log = calloc(1, sizeof * log)))
+		return 0;
+	if (!(log->buf = malloc(buf_size)))
+	{
+		free(log);
+		return 0;
+	}
+	log->size = buf_size;
+	log->policy = policy;
+	if ((log->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, S_IREAD | S_IWRITE)) == -1)
+		goto error;
+	len = strlen(file_name);
+	if (len > 3 && !strcmp(file_name + len - 3, ".gz"))
+	{
+#ifdef VT102_LOG_HAVE_ZLIB
+		if (!(log->gz = gzdopen(log->fd, "wb")))
+			goto error;
+#else
+		/* compression support has not been compiled in */
+		goto error;
+#endif
+	}
+	pthread_mutex_init(&log->lock, 0);
+	pthread_cond_init(&log->data_available, 0);
+	pthread_cond_init(&log->room_available, 0);
+	if (pthread_create(&log->writer, 0, writer_thread, log))
+	{
+		pthread_mutex_destroy(&log->lock);
+		pthread_cond_destroy(&log->data_available);
+		pthread_cond_destroy(&log->room_available);
+		goto error;
+	}
+	return log;
+
+error:
+#ifdef VT102_LOG_HAVE_ZLIB
+	if (log->gz)
+		gzclose(log->gz);
+	else
+#endif
+	if (log->fd != -1)
+		close(log->fd);
+	free(log->buf);
+	free(log);
+	return 0;
+}
+
+/*!
+ *	\fn	void vt102_log_destroy(struct vt102_log * log)
+ *	\brief	destroys a session logger, writing out any data pending, and closing the log file
+ *
+ *	\param	log	the session logger to destroy
+ *	\return	none */
+void vt102_log_destroy(struct vt102_log * log)
+{
+	pthread_mutex_lock(&log->lock);
+	log->closing = true;
+	pthread_cond_signal(&log->data_available);
+	pthread_mutex_unlock(&log->lock);
+	pthread_join(log->writer, 0);
+#ifdef VT102_LOG_HAVE_ZLIB
+	if (log->gz)
+		gzclose(log->gz);
+	else
+#endif
+	close(log->fd);
+	pthread_mutex_destroy(&log->lock);
+	pthread_cond_destroy(&log->data_available);
+	pthread_cond_destroy(&log->room_available);
+	free(log->buf);
+	free(log);
+}
+
+/*!
+ *	\fn	bool vt102_log_write(struct vt102_log * log, const void * data, size_t len)
+ *	\brief	logs data
+ *
+ *	the data is copied to the ring buffer, and written to the
+ *	log file later, by the background writer thread; if there
+ *	is not enough room in the ring buffer, the data is either
+ *	dropped, or this waits for room to become available -
+ *	depending on the logger policy
+ *
+ *	\param	log	the session logger
+ *	\param	data	the data to log
+ *	\param	len	the number of bytes to log
+ *	\return	true, if the data has been accepted for logging,
+ *		false if it has been dropped */
+bool vt102_log_write(struct vt102_log * log, const void * data, size_t len)
+{
+struct iovec iov;
+
+	iov.iov_base = (void *) data;
+	iov.iov_len = len;
+	return vt102_log_writev(log, &iov, 1);
+}
+
+/*!
+ *	\fn	bool vt102_log_writev(struct vt102_log * log, const struct iovec * iov, int iovcnt)
+ *	\brief	logs data gathered from several buffers
+ *
+ *	this is the same as vt102_log_write(), but the data is
+ *	gathered from the buffers given, in order; either all of
+ *	the data is logged, or none of it is - so that e.g. the
+ *	records of a structured log file are never dropped partially
+ *
+ *	\param	log	the session logger
+ *	\param	iov	the buffers holding the data to log
+ *	\param	iovcnt	the number of buffers in iov
+ *	\return	true, if the data has been accepted for logging,
+ *		false if it has been dropped */
+bool vt102_log_writev(struct vt102_log * log, const struct iovec * iov, int iovcnt)
+{
+const unsigned char * p;
+size_t n, offset, len;
+bool was_empty;
+int i;
+
+	for (len = i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	pthread_mutex_lock(&log->lock);
+	was_empty = false;
+	if (log->policy == VT102_LOG_DROP && len > log->size - (log->head - log->tail))
+	{
+		/* drop all of the data, so that the log file
+		 * only misses whole chunks of data */
+		log->stats.nr_bytes_dropped += len;
+		pthread_mutex_unlock(&log->lock);
+		return false;
+	}
+	log->stats.nr_bytes_logged += len;
+	for (i = 0; i < iovcnt; i++)
+	{
+		p = (const unsigned char *) iov[i].iov_base;
+		len = iov[i].iov_len;
+		while (len)
+		{
+			if (log->head - log->tail == log->size)
+			{
+				/* have the writer thread write out the data
+				 * right away, instead of waiting for a batch */
+				log->stats.nr_stalls ++;
+				log->flush = true;
+				pthread_cond_signal(&log->data_available);
+				do
+					pthread_cond_wait(&log->room_available, &log->lock);
+				while (log->head - log->tail == log->size);
+			}
+			if (log->head == log->tail)
+				was_empty = true;
+			offset = log->head % log->size;
+			n = log->size - (log->head - log->tail);
+			if (n > log->size - offset)
+				n = log->size - offset;
+			if (n > len)
+				n = len;
+			memcpy(log->buf + offset, p, n);
+			log->head += n;
+			p += n;
+			len -= n;
+			if (log->head - log->tail > log->stats.max_pending)
+				log->stats.max_pending = log->head - log->tail;
+		}
+	}
+	/* the writer thread waits for the first data to
+	 * arrive, and then for a batch to accumulate */
+	if (was_empty || log->head - log->tail >= VT102_LOG_BATCH_SIZE)
+		pthread_cond_signal(&log->data_available);
+	pthread_mutex_unlock(&log->lock);
+	return true;
+}
+
+/*!
+ *	\fn	void vt102_log_get_stats(struct vt102_log * log, struct vt102_log_stats * stats)
+ *	\brief	retrieves the session logger counters
+ *
+ *	\param	log	the session logger
+ *	\param	stats	the counters are stored here
+ *	\return	none */
+void vt102_log_get_stats(struct vt102_log * log, struct vt102_log_stats * stats)
+{
+	pthread_mutex_lock(&log->lock);
+	* stats = log->stats;
+	pthread_mutex_unlock(&log->lock);
+}
+
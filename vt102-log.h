@@ -0,0 +1,102 @@
+/*!
+ *	\file	vt102-log.h
+ *	\brief	vt102 terminal emulator session logger header file
+ *	\author	shopov
+ *
+ *	this module logs the data received from the remote host to a
+ *	file, without ever making the caller wait for the disk: the data
+ *	logged is copied to a ring buffer in memory, and a background
+ *	thread writes the contents of the ring buffer to the file, in
+ *	large writes; when the ring buffer fills up (e.g. because the disk
+ *	has stalled), the data logged is either dropped, or the caller is
+ *	made to wait for room in the ring buffer - depending on the policy
+ *	requested; the amounts of data logged and dropped, and the number
+ *	of times the caller has had to wait are available as counters
+ *
+ *	if the log file name ends in ".gz", and zlib support is compiled
+ *	in (by defining VT102_LOG_HAVE_ZLIB, and linking with -lz), the
+ *	log file is gzip-compressed
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! a default ring buffer size, in bytes */
+	VT102_LOG_DEFAULT_BUF_SIZE	=	4 * 1024 * 1024,
+	/*! the background thread waits for this much data to accumulate before writing it... */
+	VT102_LOG_BATCH_SIZE		=	64 * 1024,
+	/*! ...but for not longer than this many milliseconds */
+	VT102_LOG_FLUSH_INTERVAL_MS	=	100,
+};
+
+/*! what to do when the ring buffer is full */
+enum vt102_log_policy
+{
+	/*! drop the data being logged, and count it in the dropped bytes counter */
+	VT102_LOG_DROP		=	0,
+	/*! wait for room in the ring buffer, and count the wait in the stalls counter */
+	VT102_LOG_BLOCK,
+};
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! session logger counters */
+struct vt102_log_stats
+{
+	/*! the number of bytes accepted for logging */
+	unsigned long long nr_bytes_logged;
+	/*! the number of bytes dropped, because the ring buffer was full */
+	unsigned long long nr_bytes_dropped;
+	/*! the number of bytes written to the log file */
+	unsigned long long nr_bytes_written;
+	/*! the number of writes made to the log file */
+	unsigned long nr_writes;
+	/*! the number of times the caller had to wait for room in the ring buffer */
+	unsigned long nr_stalls;
+	/*! the maximum number of bytes pending in the ring buffer */
+	size_t max_pending;
+	/*! the number of errors writing to the log file; logging stops on the first error */
+	unsigned long nr_errors;
+};
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_log;
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_log * vt102_log_create(const char * file_name, size_t buf_size, enum vt102_log_policy policy);
+void vt102_log_destroy(struct vt102_log * log);
+bool vt102_log_write(struct vt102_log * log, const void * data, size_t len);
+bool vt102_log_writev(struct vt102_log * log, const struct iovec * iov, int iovcnt);
+void vt102_log_get_stats(struct vt102_log * log, struct vt102_log_stats * stats);
+
@@ -0,0 +1,570 @@
+/*!
+ *	\file	vt102-mux.c
+ *	\brief	vt102 terminal emulator session multiplexer
+ *	\author	shopov
+ *
+ *	see the comments in vt102-mux.h
+ *
+ *	the sessions live in a table of slots allocated when the
+ *	multiplexer is created; the epoll events of a session carry
+ *	the index of its slot, along with a generation number which
+ *	is incremented whenever a session is destroyed - so that an
+ *	event already retrieved by a worker for a session which is
+ *	then destroyed (and whose slot may even be reused by another
+ *	session) is recognized as stale and dropped, and the slot
+ *	memory is never freed while a worker may still be looking at it
+ *
+ *	the workers are stopped by means of an eventfd registered
+ *	(level-triggered) in the epoll instance, which is signalled
+ *	and never reset, so that all workers see it
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-input.h"
+#include "vt102-mux.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the slot index carried by the worker stop event */
+	STOP_EVENT_INDEX	=	UINT32_MAX,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! a session slot */
+struct vt102_mux_session
+{
+	/*! serializes the processing of the session by the workers, and the access to it by other threads */
+	pthread_mutex_t lock;
+	/*! the multiplexer this session belongs to */
+	struct vt102_mux * mux;
+	/*! the index of this slot in the session table */
+	uint32_t index;
+	/*! the generation number of this slot, incremented when the session is destroyed */
+	uint32_t generation;
+	/*! the vt102 emulator state of the session, null if the slot is free */
+	struct vt102_state * vtstate;
+	/*! the file descriptor of the connection to the remote host */
+	int comm_fd;
+	/*! the session logger, null if logging is disabled */
+	struct vt102_log * log;
+	/*! the caller data passed to the callbacks */
+	void * user_data;
+	/*! set when the session has been paused */
+	bool paused;
+	/*! set when the connection is armed in the epoll instance, or a worker is processing the session */
+	bool armed;
+	/*! the next free slot in the free slot list */
+	struct vt102_mux_session * next_free;
+};
+
+/*! the data of a worker thread */
+struct worker
+{
+	/*! the multiplexer served by the worker */
+	struct vt102_mux * mux;
+	/*! the worker thread */
+	pthread_t thread;
+	/*! the input reading data structure (and buffer) shared by all sessions processed by the worker */
+	struct vt102_input * input;
+};
+
+/*! the multiplexer data structure */
+struct vt102_mux
+{
+	/*! the session event callbacks */
+	struct vt102_mux_ops ops;
+	/*! the epoll instance shared by the workers */
+	int epoll_fd;
+	/*! the eventfd signalled to stop the workers */
+	int stop_fd;
+	/*! the number of workers started */
+	int nr_workers;
+	/*! the worker thread data, of size nr_workers */
+	struct worker * workers;
+	/*! the number of session slots */
+	int max_nr_sessions;
+	/*! the session slots, of size max_nr_sessions */
+	struct vt102_mux_session * sessions;
+	/*! the list of free session slots */
+	struct vt102_mux_session * free_sessions;
+	/*! protects the free slot list */
+	pthread_mutex_t free_sessions_lock;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static void query_terminal_id(void * param)
+ *	\brief	answers a terminal identification request of a session
+ *
+ *	\note	this function is invoked by the vt102 terminal
+ *		emulator command parser module
+ *
+ *	\param	param	a pointer to the term_data structure holding
+ *			the screen state of the session
+ *	\return	none */
+static void query_terminal_id(void * param)
+{
+static const char vt102_id_str[] = "\x1b[?6c";
+struct vt102_mux_session * session;
+
+	session = ((struct term_data *) param)->generic_ptr;
+	if (write(session->comm_fd, vt102_id_str, sizeof vt102_id_str - 1) != sizeof vt102_id_str - 1)
+		/* the remote host will find out about any connection
+		 * problems on its own, nothing else to do here */
+		;
+}
+
+/*!
+ *	\fn	static bool arm_session(struct vt102_mux_session * session, int op)
+ *	\brief	(re)arms the connection of a session in the epoll instance
+ *
+ *	\param	session	the session, which must be locked
+ *	\param	op	EPOLL_CTL_ADD, or EPOLL_CTL_MOD
+ *	\return	true on success, false on failure */
+static bool arm_session(struct vt102_mux_session * session, int op)
+{
+struct epoll_event ev;
+
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = ((uint64_t) session->generation << 32) | session->index;
+	if (epoll_ctl(session->mux->epoll_fd, op, session->comm_fd, &ev))
+		return false;
+	session->armed = true;
+	return true;
+}
+
+/*!
+ *	\fn	static void release_session(struct vt102_mux_session * session)
+ *	\brief	destroys a session, and returns its slot to the free slot list
+ *
+ *	\param	session	the session, which must be locked; it is
+ *			unlocked on return
+ *	\return	none */
+static void release_session(struct vt102_mux_session * session)
+{
+struct vt102_mux * mux;
+
+	mux = session->mux;
+	epoll_ctl(mux->epoll_fd, EPOLL_CTL_DEL, session->comm_fd, 0);
+	destroy_vt102(session->vtstate);
+	session->vtstate = 0;
+	session->generation ++;
+	pthread_mutex_unlock(&session->lock);
+
+	pthread_mutex_lock(&mux->free_sessions_lock);
+	session->next_free = mux->free_sessions;
+	mux->free_sessions = session;
+	pthread_mutex_unlock(&mux->free_sessions_lock);
+}
+
+/*!
+ *	\fn	static void process_session(struct worker * w, struct vt102_mux_session * session, uint32_t generation)
+ *	\brief	processes the data available from the remote host of a session
+ *
+ *	\param	w	the worker processing the session
+ *	\param	session	the session slot the epoll event was reported for
+ *	\param	generation	the slot generation number the event was armed for
+ *	\return	none */
+static void process_session(struct worker * w, struct vt102_mux_session * session, uint32_t generation)
+{
+struct vt102_mux * mux;
+struct term_data * tdata;
+
+	mux = w->mux;
+	pthread_mutex_lock(&session->lock);
+	if (!session->vtstate || session->generation != generation)
+	{
+		/* a stale event - the session has been destroyed */
+		pthread_mutex_unlock(&session->lock);
+		return;
+	}
+	session->armed = false;
+	if (session->paused)
+	{
+		/* the event was retrieved before pausing the session,
+		 * leave the connection disarmed */
+		pthread_mutex_unlock(&session->lock);
+		return;
+	}
+	vt102_input_attach(w->input, session->comm_fd, session->log);
+	if (vt102_input_drain(w->input, session->vtstate) < 0)
+	{
+		if (mux->ops.session_closed)
+			mux->ops.session_closed(session, errno, session->user_data);
+		release_session(session);
+		return;
+	}
+	tdata = vt102_generic_backend_get_data(session->vtstate);
+	if (tdata->must_refresh && mux->ops.session_updated
+			&& !mux->ops.session_updated(session, tdata, session->user_data))
+		session->paused = true;
+	if (!session->paused && !arm_session(session, EPOLL_CTL_MOD))
+	{
+		if (mux->ops.session_closed)
+			mux->ops.session_closed(session, errno, session->user_data);
+		release_session(session);
+		return;
+	}
+	pthread_mutex_unlock(&session->lock);
+}
+
+/*! the worker thread */
+static void * worker_thread(void * arg)
+{
+struct worker * w;
+struct epoll_event ev;
+uint32_t index;
+int n;
+
+	w = (struct worker *) arg;
+	while (1)
+	{
+		/* only take a single session at a time, so that
+		 * the other sessions ready go to the idle workers */
+		if ((n = epoll_wait(w->mux->epoll_fd, &ev, 1, -1)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (!n)
+			continue;
+		if ((index = (uint32_t) ev.data.u64) == STOP_EVENT_INDEX)
+			break;
+		process_session(w, w->mux->sessions + index, ev.data.u64 >> 32);
+	}
+	return 0;
+}
+
+/*!
+ *	\fn	static void stop_workers(struct vt102_mux * mux)
+ *	\brief	stops all worker threads started, and waits for them to terminate
+ *
+ *	\param	mux	the multiplexer
+ *	\return	none */
+static void stop_workers(struct vt102_mux * mux)
+{
+uint64_t x;
+int i;
+
+	x = 1;
+	if (write(mux->stop_fd, &x, sizeof x) != sizeof x)
+		/* the eventfd counter cannot overflow here */
+		;
+	for (i = 0; i < mux->nr_workers; i++)
+		pthread_join(mux->workers[i].thread, 0);
+	mux->nr_workers = 0;
+}
+
+/*!
+ *	\fn	static void free_mux(struct vt102_mux * mux, int nr_inputs)
+ *	\brief	releases the resources of a multiplexer, after its workers have been stopped
+ *
+ *	\param	mux	the multiplexer
+ *	\param	nr_inputs	the number of worker input reading
+ *				data structures created
+ *	\return	none */
+static void free_mux(struct vt102_mux * mux, int nr_inputs)
+{
+int i;
+
+	for (i = 0; i < nr_inputs; i++)
+		vt102_input_destroy(mux->workers[i].input);
+	if (mux->sessions)
+		for (i = 0; i < mux->max_nr_sessions; i++)
+			pthread_mutex_destroy(&mux->sessions[i].lock);
+	pthread_mutex_destroy(&mux->free_sessions_lock);
+	if (mux->stop_fd != -1)
+		close(mux->stop_fd);
+	if (mux->epoll_fd != -1)
+		close(mux->epoll_fd);
+	free(mux->sessions);
+	free(mux->workers);
+	free(mux);
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_mux * vt102_mux_create(int nr_workers, int max_nr_sessions, const struct vt102_mux_ops * ops)
+ *	\brief	creates a session multiplexer, and starts its worker threads
+ *
+ *	\param	nr_workers	the number of worker threads to start;
+ *				if not positive, one worker per online
+ *				processor is started
+ *	\param	max_nr_sessions	the maximum number of sessions served
+ *				at the same time
+ *	\param	ops	the session event callbacks; the structure is copied
+ *	\return	a pointer to the new multiplexer, or null on error */
+struct vt102_mux * vt102_mux_create(int nr_workers, int max_nr_sessions, const struct vt102_mux_ops * ops)
+{
+struct vt102_mux * mux;
+struct epoll_event ev;
+int i, nr_inputs;
+
+	if (nr_workers <= 0 && (nr_workers = sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+		nr_workers = 1;
+	if (max_nr_sessions <= 0 || !(mux = calloc(1, sizeof * mux)))
+		return 0;
+	mux->ops = * ops;
+	mux->max_nr_sessions = max_nr_sessions;
+	mux->stop_fd = -1;
+	pthread_mutex_init(&mux->free_sessions_lock, 0);
+	nr_inputs = 0;
+	if ((mux->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1
+			|| (mux->stop_fd = eventfd(0, EFD_CLOEXEC)) == -1
+			|| !(mux->workers = calloc(nr_workers, sizeof * mux->workers))
+			|| !(mux->sessions = calloc(max_nr_sessions, sizeof * mux->sessions)))
+		goto error;
+	for (i = max_nr_sessions - 1; i >= 0; i--)
+	{
+		pthread_mutex_init(&mux->sessions[i].lock, 0);
+		mux->sessions[i].mux = mux;
+		mux->sessions[i].index = i;
+		mux->sessions[i].next_free = mux->free_sessions;
+		mux->free_sessions = mux->sessions + i;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u64 = STOP_EVENT_INDEX;
+	if (epoll_ctl(mux->epoll_fd, EPOLL_CTL_ADD, mux->stop_fd, &ev))
+		goto error;
+	for (nr_inputs = 0; nr_inputs < nr_workers; nr_inputs++)
+	{
+		mux->workers[nr_inputs].mux = mux;
+		if (!(mux->workers[nr_inputs].input = vt102_input_create(-1, 0)))
+			goto error;
+	}
+	for (mux->nr_workers = 0; mux->nr_workers < nr_workers; mux->nr_workers ++)
+		if (pthread_create(&mux->workers[mux->nr_workers].thread, 0, worker_thread, mux->workers + mux->nr_workers))
+			goto error;
+	return mux;
+
+error:
+	stop_workers(mux);
+	free_mux(mux, nr_inputs);
+	return 0;
+}
+
+/*!
+ *	\fn	void vt102_mux_destroy(struct vt102_mux * mux)
+ *	\brief	stops the worker threads of a multiplexer, destroys all of its sessions, and the multiplexer itself
+ *
+ *	the session_closed() callback is invoked (from the calling
+ *	thread) for each session still open, with an error of ECANCELED
+ *
+ *	\param	mux	the multiplexer to destroy
+ *	\return	none */
+void vt102_mux_destroy(struct vt102_mux * mux)
+{
+struct vt102_mux_session * session;
+int i, nr_inputs;
+
+	nr_inputs = mux->nr_workers;
+	stop_workers(mux);
+	for (i = 0; i < mux->max_nr_sessions; i++)
+	{
+		session = mux->sessions + i;
+		pthread_mutex_lock(&session->lock);
+		if (!session->vtstate)
+		{
+			pthread_mutex_unlock(&session->lock);
+			continue;
+		}
+		if (mux->ops.session_closed)
+			mux->ops.session_closed(session, ECANCELED, session->user_data);
+		release_session(session);
+	}
+	free_mux(mux, nr_inputs);
+}
+
+/*!
+ *	\fn	struct vt102_mux_session * vt102_mux_session_create(struct vt102_mux * mux, int comm_fd, int width, int height, struct vt102_log * log, void * user_data)
+ *	\brief	creates a new session, and starts serving it
+ *
+ *	\param	mux	the multiplexer to serve the session
+ *	\param	comm_fd	the file descriptor of the connection to the
+ *			remote host of the session
+ *	\param	width	the screen width of the session
+ *	\param	height	the screen height of the session
+ *	\param	log	the session logger to log all of the data read
+ *			from the remote host with, null if no logging
+ *			is needed
+ *	\param	user_data	the caller data to pass to the callbacks
+ *	\return	a pointer to the new session, or null on error (in
+ *		particular, if the maximum number of sessions are
+ *		already being served) */
+struct vt102_mux_session * vt102_mux_session_create(struct vt102_mux * mux, int comm_fd, int width, int height, struct vt102_log * log, void * user_data)
+{
+struct vt102_mux_session * session;
+struct term_data * tdata;
+
+	pthread_mutex_lock(&mux->free_sessions_lock);
+	if ((session = mux->free_sessions))
+		mux->free_sessions = session->next_free;
+	pthread_mutex_unlock(&mux->free_sessions_lock);
+	if (!session)
+		return 0;
+
+	pthread_mutex_lock(&session->lock);
+	if (!(session->vtstate = init_vt102_generic_backend(width, height)))
+		goto error;
+	tdata = vt102_generic_backend_get_data(session->vtstate);
+	tdata->generic_ptr = session;
+	vt102_get_backend_ops(session->vtstate)->query_terminal_id = query_terminal_id;
+	session->comm_fd = comm_fd;
+	session->log = log;
+	session->user_data = user_data;
+	session->paused = false;
+	if (!arm_session(session, EPOLL_CTL_ADD))
+	{
+		destroy_vt102(session->vtstate);
+		session->vtstate = 0;
+		goto error;
+	}
+	pthread_mutex_unlock(&session->lock);
+	return session;
+
+error:
+	pthread_mutex_unlock(&session->lock);
+	pthread_mutex_lock(&mux->free_sessions_lock);
+	session->next_free = mux->free_sessions;
+	mux->free_sessions = session;
+	pthread_mutex_unlock(&mux->free_sessions_lock);
+	return 0;
+}
+
+/*!
+ *	\fn	void vt102_mux_session_destroy(struct vt102_mux_session * session)
+ *	\brief	stops serving a session, and destroys it
+ *
+ *	the session_closed() callback is not invoked
+ *
+ *	\param	session	the session to destroy
+ *	\return	none */
+void vt102_mux_session_destroy(struct vt102_mux_session * session)
+{
+	pthread_mutex_lock(&session->lock);
+	release_session(session);
+}
+
+/*!
+ *	\fn	void vt102_mux_session_pause(struct vt102_mux_session * session)
+ *	\brief	stops reading the connection of a session, until vt102_mux_session_resume() is called
+ *
+ *	\param	session	the session to pause
+ *	\return	none */
+void vt102_mux_session_pause(struct vt102_mux_session * session)
+{
+	pthread_mutex_lock(&session->lock);
+	session->paused = true;
+	pthread_mutex_unlock(&session->lock);
+}
+
+/*!
+ *	\fn	void vt102_mux_session_resume(struct vt102_mux_session * session)
+ *	\brief	resumes reading the connection of a paused session
+ *
+ *	\param	session	the session to resume
+ *	\return	none */
+void vt102_mux_session_resume(struct vt102_mux_session * session)
+{
+	pthread_mutex_lock(&session->lock);
+	session->paused = false;
+	if (!session->armed)
+		/* should re-arming fail, the session is left
+		 * paused - there is no worker to report the
+		 * failure to the session_closed() callback */
+		if (!arm_session(session, EPOLL_CTL_MOD))
+			session->paused = true;
+	pthread_mutex_unlock(&session->lock);
+}
+
+/*!
+ *	\fn	bool vt102_mux_session_resize(struct vt102_mux_session * session, int width, int height)
+ *	\brief	resizes the screen of a session
+ *
+ *	\note	the remote host is not notified, this is up to the
+ *		caller (e.g. by means of the TIOCSWINSZ ioctl() on a
+ *		pseudoterminal), which should first resize the screen,
+ *		so that any data sent by the remote host after being
+ *		notified is processed after resizing
+ *
+ *	\param	session	the session to resize
+ *	\param	width	the new screen width
+ *	\param	height	the new screen height
+ *	\return	true on success, false on failure (out of memory) - in
+ *		which case the screen is left unchanged */
+bool vt102_mux_session_resize(struct vt102_mux_session * session, int width, int height)
+{
+bool result;
+
+	pthread_mutex_lock(&session->lock);
+	result = vt102_generic_backend_resize_buffers(session->vtstate, width, height);
+	pthread_mutex_unlock(&session->lock);
+	return result;
+}
+
+/*!
+ *	\fn	struct term_data * vt102_mux_session_lock(struct vt102_mux_session * session)
+ *	\brief	locks a session, so that its screen can be accessed
+ *
+ *	the session is not served while locked, so it should be
+ *	unlocked as soon as possible, with vt102_mux_session_unlock()
+ *
+ *	\param	session	the session to lock
+ *	\return	a pointer to the screen state of the session */
+struct term_data * vt102_mux_session_lock(struct vt102_mux_session * session)
+{
+	pthread_mutex_lock(&session->lock);
+	return vt102_generic_backend_get_data(session->vtstate);
+}
+
+/*!
+ *	\fn	void vt102_mux_session_unlock(struct vt102_mux_session * session)
+ *	\brief	unlocks a session locked with vt102_mux_session_lock()
+ *
+ *	\param	session	the session to unlock
+ *	\return	none */
+void vt102_mux_session_unlock(struct vt102_mux_session * session)
+{
+	pthread_mutex_unlock(&session->lock);
+}
+
@@ -0,0 +1,111 @@
+/*!
+ *	\file	vt102-mux.h
+ *	\brief	vt102 terminal emulator session multiplexer header file
+ *	\author	shopov
+ *
+ *	this module runs many headless terminal sessions (e.g. for
+ *	automation or screen scraping) - each one being a generic
+ *	vt102 backend (see vt102-backend-generic.h) screen fed with
+ *	the data read from the connection to its remote host - on a
+ *	pool of worker threads
+ *
+ *	the workers share a single epoll instance, in which the
+ *	connections of all sessions are registered in one-shot mode;
+ *	each worker waits for a single session to become readable,
+ *	drains it (see vt102_input_drain() in vt102-input.h - at most
+ *	VT102_INPUT_MAX_DRAIN bytes are processed at a time), and then
+ *	re-arms the connection of the session - so a session is never
+ *	processed by two workers at the same time, any idle worker may
+ *	pick up any session (busy sessions migrate between the workers
+ *	as needed), and the sessions flooded by their remote hosts take
+ *	turns with all other sessions ready, instead of blocking them
+ *
+ *	after each batch of data that has changed the screen of a
+ *	session (i.e. tdata->must_refresh is set), the session_updated()
+ *	callback is invoked by the worker; the callback should consume
+ *	the screen changes (e.g. render them, encode a diff - see
+ *	vt102-diff.h, or just reset the refresh-needed flags), and
+ *	returns false to apply back-pressure - the session is then
+ *	paused (its connection is no longer read, so that the remote
+ *	host eventually blocks when writing) until vt102_mux_session_resume()
+ *	is called; sessions can be paused explicitly as well
+ *
+ *	when the remote host closes the connection, or reading from
+ *	it fails, the session_closed() callback is invoked by the worker,
+ *	and the session is destroyed afterwards
+ *
+ *	the callbacks are invoked with the session locked; besides
+ *	the callbacks, other threads may only access the screen of a
+ *	session between calls to vt102_mux_session_lock() and
+ *	vt102_mux_session_unlock(), and must not call any of the
+ *	vt102_mux_session_xxx() routines on a session from within
+ *	a callback invoked for it
+ *
+ *	the connection file descriptors are never closed by this
+ *	module, they belong to the caller
+ *
+ *	\note	programs using this module must be linked with
+ *		the posix threads library (-lpthread)
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdbool.h>
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_mux;
+struct vt102_mux_session;
+/* defined in vt102-backend-generic.h */
+struct term_data;
+/* defined in vt102-log.h */
+struct vt102_log;
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! the session event callbacks, invoked by the worker threads */
+struct vt102_mux_ops
+{
+	/*! the screen of a session has changed
+	 *
+	 * returns true if the session should continue to be served, false
+	 * if the session should be paused until vt102_mux_session_resume()
+	 * is called for it; may be null */
+	bool (*session_updated)(struct vt102_mux_session * session, struct term_data * tdata, void * user_data);
+	/*! the connection of a session has been closed by the remote host
+	 * (error is zero), reading from it has failed (error holds the errno
+	 * value), or the multiplexer is being destroyed (error is ECANCELED);
+	 * the session is destroyed after this returns; may be null */
+	void (*session_closed)(struct vt102_mux_session * session, int error, void * user_data);
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_mux * vt102_mux_create(int nr_workers, int max_nr_sessions, const struct vt102_mux_ops * ops);
+void vt102_mux_destroy(struct vt102_mux * mux);
+struct vt102_mux_session * vt102_mux_session_create(struct vt102_mux * mux, int comm_fd, int width, int height, struct vt102_log * log, void * user_data);
+void vt102_mux_session_destroy(struct vt102_mux_session * session);
+void vt102_mux_session_pause(struct vt102_mux_session * session);
+void vt102_mux_session_resume(struct vt102_mux_session * session);
+bool vt102_mux_session_resize(struct vt102_mux_session * session, int width, int height);
+struct term_data * vt102_mux_session_lock(struct vt102_mux_session * session);
+void vt102_mux_session_unlock(struct vt102_mux_session * session);
+
@@ -0,0 +1,367 @@
+/*!
+ *	\file	vt102-parser-bench.c
+ *	\brief	a microbenchmark for the vt102 terminal emulator command parser state machine
+ *	\author	shopov
+ *
+ *	this compares the table-driven command parser state machine in
+ *	vt102.c against the switch-based state machine it replaced
+ *	(a copy of which is kept here, in switch_parser()), on recorded
+ *	session traffic - e.g. a log file written by one of the terminal
+ *	front-ends when LOG_FILE_NAME is defined in them; if no file is
+ *	given on the command line, two of the synthetic corpora of
+ *	vt102-bench-support.h - short runs of text interspersed with
+ *	escape sequences, such as the output of 'ls --color' and of full
+ *	screen editors - are used instead
+ *
+ *	all of the input is fed to the state machines one character at
+ *	a time (that is, without the printable character scanning that
+ *	vt102_command_input_parser_buf() does), and the backend is a
+ *	null one, which only computes a checksum of the backend calls
+ *	made, so that what is measured is the cost of the state machines
+ *	themselves, and so that the results of the two state machines can
+ *	be cross-checked; the throughput of vt102_command_input_parser_buf()
+ *	on the same input is also printed, for reference
+ *
+ *	this includes vt102.c, in order to get at its internals; build
+ *	with something like:
+ *
+ *		cc -O2 -o vt102-parser-bench vt102-parser-bench.c vt102-scan.c vt102-trace.c \
+ *			vt102-bench-support.c
+ *
+ *	and run as:
+ *
+ *		./vt102-parser-bench [term-log.txt]
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "vt102.c"
+#include "vt102-bench-support.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+/*! the minimum number of bytes processed when benchmarking a state machine */
+#define MIN_BENCH_BYTES		(256 * 1024 * 1024)
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! the checksum of the backend calls made */
+static unsigned long checksum;
+/*! the number of backend calls made */
+static unsigned long nr_backend_calls;
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+int dtrace(char * msg, int line)
+{
+	return 0;
+}
+
+/*!
+ *	\fn	static void mix(int tag, int a, int b)
+ *	\brief	accounts a backend call in the backend call checksum
+ *
+ *	\param	tag	identifies the type of the backend call
+ *	\param	a	the first argument of the backend call
+ *	\param	b	the second argument of the backend call
+ *	\return	none */
+static void mix(int tag, int a, int b)
+{
+	checksum = (checksum * 31 + tag) * 131 + (unsigned) a * 7 + (unsigned) b;
+	nr_backend_calls ++;
+}
+
+/*! null backend routines, one for each backend routine signature */
+static void null_char(void * param, unsigned int ch, struct vt102_state * state) { mix(1, ch, 0); }
+static void null_string(void * param, const unsigned char * s, int n, struct vt102_state * state) { while (n--) mix(1, * s ++, 0); }
+static void null_sgr(void * param, unsigned int * cmd_params, int nr_params) { while (nr_params--) mix(2, * cmd_params ++, 0); }
+static void null_void(void * param) { mix(3, 0, 0); }
+static void null_int(void * param, int a) { mix(4, a, 0); }
+static void null_int_int(void * param, int a, int b) { mix(5, a, b); }
+static void null_state(void * param, struct vt102_state * state) { mix(6, 0, 0); }
+static void null_destroy(struct vt102_state * state) { }
+
+/*!
+ *	\fn	static void switch_parser(struct vt102_state * state, unsigned int input_char)
+ *	\brief	the switch-based vt102 command parser state machine, as it was before being made table-driven
+ *
+ *	this is only kept here for benchmarking and cross-checking
+ *	the table-driven state machine; the only changes made are that
+ *	an escape character discards any ansi command string read so far,
+ *	that the ansi command parameters are accumulated as they are
+ *	received, as the table-driven state machine does, and that the
+ *	bytes of multibyte utf-8 sequences are passed to the utf-8 decoder
+ *	in front of the table-driven state machine (instead of having their
+ *	eighth bit stripped)
+ *
+ *	\param	state		the state machine state variable
+ *	\param	input_char	the input character to process
+ *	\return	none */
+static void switch_parser(struct vt102_state * state, unsigned int input_char)
+{
+	if (input_char >= 0x80 || state->utf8_nr_pending)
+	{
+		decode_utf8(state, input_char);
+		return;
+	}
+	if (input_char == 27)
+	{
+		state->state = VT102_STATE_NORMAL_INPUT;
+		clear_ansi_cmd(state);
+	}
+	switch (state->state)
+	{
+		case VT102_STATE_INVALID:
+			panic("");
+			break;
+		case VT102_STATE_NORMAL_INPUT:
+			if (input_char > 0x1f)
+				state->backend_ops->display_char(state->backend_ops->param, input_char, state);
+			else if (input_char == ANSI_ESC)
+				state->state = VT102_STATE_ESCAPE_SEQUENCE_STARTED;
+			else
+				handle_control_char(state, input_char);
+			break;
+		case VT102_STATE_ESCAPE_SEQUENCE_STARTED:
+			switch (input_char)
+			{
+				case '[':
+					state->state = VT102_STATE_ANSI_CMD_READ;
+					break;
+				case '(':
+				case 'D':
+					break;
+				case 'N':
+				case 'O':
+				case 'E':
+				case '7':
+				case '8':
+				case 'H':
+				case '#':
+				case 'Z':
+				case 'c':
+					panic("");
+					break;
+				case 'M':
+					state->backend_ops->cursor_reverse_index(state->backend_ops->param);
+					state->state = VT102_STATE_NORMAL_INPUT;
+					break;
+				case '=':
+				case '>':
+					state->state = VT102_STATE_NORMAL_INPUT;
+					break;
+				default:
+					state->state = VT102_STATE_NORMAL_INPUT;
+			}
+			break;
+		case VT102_STATE_ANSI_CMD_READ:
+		case VT102_STATE_ANSI_CMD_PARAM:
+			if (('0' <= input_char && input_char <= '9') || input_char == ';')
+			{
+				put_param_char(state, input_char);
+				state->state = VT102_STATE_ANSI_CMD_PARAM;
+			}
+			else if (0x3c <= input_char && input_char <= 0x3f
+					&& state->state == VT102_STATE_ANSI_CMD_READ)
+			{
+				state->is_private_param = true;
+				state->state = VT102_STATE_ANSI_CMD_PARAM;
+			}
+			else if (0x20 <= input_char && input_char <= 0x3f)
+				state->state = VT102_STATE_ANSI_CMD_IGNORE;
+			else if (0x40 <= input_char && input_char <= 0x7e)
+			{
+				process_ansi_cmd(state, input_char);
+				clear_ansi_cmd(state);
+				state->state = VT102_STATE_NORMAL_INPUT;
+			}
+			break;
+		case VT102_STATE_ANSI_CMD_IGNORE:
+			if (0x40 <= input_char && input_char <= 0x7e)
+			{
+				clear_ansi_cmd(state);
+				state->state = VT102_STATE_NORMAL_INPUT;
+			}
+			break;
+		default:
+			panic("");
+	}
+}
+
+/*!
+ *	\fn	static struct vt102_state * create_parser(void)
+ *	\brief	creates a vt102 command parser instance with a null backend
+ *
+ *	\return	the new vt102 command parser instance */
+static struct vt102_state * create_parser(void)
+{
+struct vt102_backend_ops ops;
+
+	memset(&ops, 0, sizeof ops);
+	ops.display_char = null_char;
+	ops.display_string = null_string;
+	ops.select_graphic_rendition = null_sgr;
+	ops.move_cursor_relative = null_int_int;
+	ops.move_cursor_absolute = null_int_int;
+	ops.move_cursor_column_absolute = null_int;
+	ops.cursor_reverse_index = null_void;
+	ops.erase_line_at_cursor = null_void;
+	ops.erase_line_from_beginning_to_cursor = null_void;
+	ops.erase_line_from_cursor_to_end = null_void;
+	ops.erase_display = null_void;
+	ops.erase_display_from_beginning_to_cursor = null_void;
+	ops.erase_display_from_cursor_to_end = null_void;
+	ops.insert_lines_at_cursor = null_int;
+	ops.delete_lines_at_cursor = null_int;
+	ops.delete_characters_at_cursor = null_int;
+	ops.handle_backspace = null_void;
+	ops.handle_horiz_tab = null_state;
+	ops.handle_linefeed = null_void;
+	ops.handle_carriage_return = null_void;
+	ops.set_top_and_bottom_margins = null_int_int;
+	ops.query_terminal_id = null_void;
+	ops.destroy_vt102_generic_backend = null_destroy;
+	return init_vt102(&ops);
+}
+
+/*!
+ *	\fn	static void bench(const char * name, int variant, const unsigned char * buf, size_t len, unsigned long * sum)
+ *	\brief	benchmarks a state machine on a buffer, and prints the results
+ *
+ *	\param	name	the name of the state machine, for printing
+ *	\param	variant	selects the state machine to benchmark: 0 - the
+ *			switch-based one, 1 - the table-driven one, fed one
+ *			character at a time, 2 - the table-driven one, fed
+ *			by vt102_command_input_parser_buf()
+ *	\param	buf	the input buffer
+ *	\param	len	the size of the input buffer
+ *	\param	sum	the checksum of the backend calls made during the
+ *			first pass over the input is stored here, for
+ *			cross-checking the different state machines
+ *	\return	none */
+static void bench(const char * name, int variant, const unsigned char * buf, size_t len, unsigned long * sum)
+{
+struct vt102_state * state;
+double t;
+size_t i;
+int pass, nr_passes;
+
+	nr_passes = MIN_BENCH_BYTES / len + 1;
+	state = create_parser();
+	t = vt102_bench_now();
+	for (pass = 0; pass < nr_passes; pass++)
+	{
+		checksum = nr_backend_calls = 0;
+		switch (variant)
+		{
+			case 0:
+				for (i = 0; i < len; i++)
+					switch_parser(state, buf[i]);
+				break;
+			case 1:
+				for (i = 0; i < len; i++)
+					parse_input_char(state, buf[i]);
+				break;
+			default:
+				vt102_command_input_parser_buf(state, buf, len);
+				break;
+		}
+		if (!pass)
+			* sum = checksum;
+	}
+	t = vt102_bench_now() - t;
+	printf("\t%-16s %10.1f MB/s %8.3f ns/byte (%lu backend calls)\n",
+			name,
+			(double) len * nr_passes / t / 1e6,
+			t * 1e9 / ((double) len * nr_passes),
+			nr_backend_calls);
+	free(state->backend_ops);
+	free(state);
+}
+
+/*!
+ *	\fn	static bool bench_all(const char * name, const unsigned char * buf, size_t len)
+ *	\brief	benchmarks all of the state machines on a buffer, and cross-checks their results
+ *
+ *	\param	name	the name of the input, for printing
+ *	\param	buf	the input buffer
+ *	\param	len	the size of the input buffer
+ *	\return	true if the backend calls made by all of the state
+ *		machines are the same, false otherwise */
+static bool bench_all(const char * name, const unsigned char * buf, size_t len)
+{
+unsigned long sum_switch, sum_table, sum_buf;
+
+	printf("%s (%lu bytes):\n", name, (unsigned long) len);
+	bench("switch", 0, buf, len, &sum_switch);
+	bench("table", 1, buf, len, &sum_table);
+	bench("table, buffered", 2, buf, len, &sum_buf);
+	return sum_switch == sum_table && sum_switch == sum_buf;
+}
+
+int main(int argc, char ** argv)
+{
+static const enum vt102_bench_corpus corpora[] =
+{
+	VT102_BENCH_CORPUS_LS_COLOR,
+	VT102_BENCH_CORPUS_FULL_SCREEN,
+};
+unsigned char * buf;
+size_t i, len;
+bool ok;
+
+	if (argc > 1)
+	{
+		if (!(buf = vt102_bench_read_file(argv[1], &len)))
+		{
+			printf("error: cannot read %s\n", argv[1]);
+			return 1;
+		}
+		ok = bench_all(argv[1], buf, len);
+	}
+	else
+	{
+		len = VT102_BENCH_CORPUS_SIZE;
+		if (!(buf = malloc(len)))
+		{
+			printf("no core\n");
+			exit(1);
+		}
+		ok = true;
+		for (i = 0; i < sizeof corpora / sizeof * corpora; i++)
+		{
+			vt102_bench_make_corpus(corpora[i], buf, len);
+			if (!bench_all(vt102_bench_corpus_name(corpora[i]), buf, len))
+				ok = false;
+		}
+	}
+	free(buf);
+	if (!ok)
+	{
+		printf("error: backend calls differ between state machines\n");
+		return 1;
+	}
+	return 0;
+}
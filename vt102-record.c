@@ -0,0 +1,793 @@
+/*!
+ *	\file	vt102-record.c
+ *	\brief	vt102 terminal emulator session recording and indexed replay
+ *	\author	shopov
+ *
+ *	see the comments in vt102-record.h
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-log.h"
+#include "vt102-record.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+/*! the recording file header magic */
+static const char file_magic[8] = "vt102rec";
+/*! the recording file trailer magic */
+static const char trailer_magic[8] = "vt102idx";
+/*! the padding appended to record payloads */
+static const unsigned char padding[8];
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! the session recorder data structure */
+struct vt102_recorder
+{
+	/*! the session logger the records are written with */
+	struct vt102_log * log;
+	/*! the offset in the file of the next record to write, i.e. the number of bytes accepted by the session logger */
+	uint64_t offset;
+	/*! the time the recording was started at, on the monotonic clock, in microseconds */
+	unsigned long long start_us;
+	/*! the time of the last record written */
+	uint64_t time;
+	/*! the number of bytes of data recorded since the last keyframe */
+	unsigned long long nr_bytes_since_keyframe;
+	/*! set when a keyframe must be recorded as soon as possible */
+	bool keyframe_due;
+	/*! set when a record has been dropped since the last keyframe */
+	bool resync;
+	/*! the buffer the keyframes are assembled in */
+	unsigned char * keyframe_buf;
+	/*! the size of the keyframe buffer */
+	size_t keyframe_buf_size;
+	/*! the keyframe index */
+	struct vt102_record_index_entry * index;
+	/*! the number of entries in the keyframe index */
+	int nr_keyframes;
+	/*! the number of entries the keyframe index has room for */
+	int index_capacity;
+	/*! the recorder counters */
+	struct vt102_record_stats stats;
+};
+
+/*! the session replay data structure */
+struct vt102_replay
+{
+	/*! the recording file, mapped in memory */
+	const unsigned char * map;
+	/*! the size of the recording file */
+	size_t size;
+	/*! the offset of the end of the last record to replay */
+	size_t records_end;
+	/*! the keyframe index - either in the file mapping, or in index_buf below */
+	const struct vt102_record_index_entry * index;
+	/*! the keyframe index rebuilt when opening the recording, null if the index in the file is used */
+	struct vt102_record_index_entry * index_buf;
+	/*! the number of entries in the keyframe index */
+	int nr_keyframes;
+	/*! the time of the last record */
+	uint64_t duration;
+	/*! the emulator the recording was last replayed into, null if it is unknown what state it is in */
+	struct vt102_state * state;
+	/*! the offset of the next record to replay into the emulator above */
+	size_t pos;
+	/*! the time the emulator above has been brought to */
+	uint64_t time;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static unsigned long long now_us(void)
+ *	\brief	returns the current value of a monotonic clock, in microseconds
+ *
+ *	\return	the current value of the clock */
+static unsigned long long now_us(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*!
+ *	\fn	static size_t padded_len(size_t len)
+ *	\brief	returns the size of a record payload, along with the padding following it
+ *
+ *	\param	len	the size of the record payload
+ *	\return	the size of the payload, rounded up to a multiple of 8 */
+static size_t padded_len(size_t len)
+{
+	return (len + sizeof padding - 1) & ~ (sizeof padding - 1);
+}
+
+/*!
+ *	\fn	static bool put_record(struct vt102_recorder * rec, enum vt102_record_type type, const void * payload, size_t len)
+ *	\brief	writes a record to the recording file
+ *
+ *	\param	rec	the session recorder
+ *	\param	type	the record type
+ *	\param	payload	the record payload
+ *	\param	len	the size of the payload
+ *	\return	true, if the record has been written, false if it
+ *		has been dropped by the session logger */
+static bool put_record(struct vt102_recorder * rec, enum vt102_record_type type, const void * payload, size_t len)
+{
+struct vt102_record_header rh;
+struct iovec iov[3];
+
+	rh.type = type;
+	rh.len = len;
+	rh.time = now_us() - rec->start_us;
+	rec->time = rh.time;
+	iov[0].iov_base = &rh;
+	iov[0].iov_len = sizeof rh;
+	iov[1].iov_base = (void *) payload;
+	iov[1].iov_len = len;
+	iov[2].iov_base = (void *) padding;
+	iov[2].iov_len = padded_len(len) - len;
+	if (!vt102_log_writev(rec->log, iov, 3))
+	{
+		/* the screen state can no longer be reproduced
+		 * from the records - until the next keyframe */
+		rec->stats.nr_records_dropped ++;
+		rec->resync = rec->keyframe_due = true;
+		return false;
+	}
+	rec->offset += sizeof rh + padded_len(len);
+	return true;
+}
+
+/*!
+ *	\fn	static void put_keyframe(struct vt102_recorder * rec, struct term_data * tdata)
+ *	\brief	records a keyframe, and adds it to the keyframe index
+ *
+ *	\param	rec	the session recorder
+ *	\param	tdata	the backend data holding the screen to record
+ *	\return	none */
+static void put_keyframe(struct vt102_recorder * rec, struct term_data * tdata)
+{
+struct vt102_record_keyframe * kf;
+struct vt102_record_index_entry * e;
+unsigned char * p;
+size_t len;
+uint64_t offset;
+int i, w, h;
+
+	w = tdata->con_width;
+	h = tdata->con_height;
+	len = sizeof * kf + w * h * (sizeof * tdata->grbuf + 1) + h;
+	if (len > rec->keyframe_buf_size)
+	{
+		if (!(p = realloc(rec->keyframe_buf, len)))
+			/* retry with the next data recorded */
+			return;
+		rec->keyframe_buf = p;
+		rec->keyframe_buf_size = len;
+	}
+	kf = (struct vt102_record_keyframe *) rec->keyframe_buf;
+	kf->width = w;
+	kf->height = h;
+	kf->cursor_x = tdata->cursor_x;
+	kf->cursor_y = tdata->cursor_y;
+	kf->margin_top = tdata->margin_top;
+	kf->margin_bottom = tdata->margin_bottom;
+	kf->cur_attr = tdata->cur_attr;
+	kf->flags = rec->resync ? VT102_RECORD_KEYFRAME_RESYNC : 0;
+	if (tdata->sync_update)
+		kf->flags |= VT102_RECORD_KEYFRAME_SYNC_UPDATE;
+	p = (unsigned char *) (kf + 1);
+	for (i = 0; i < h; i++, p += w * sizeof * tdata->grbuf)
+		memcpy(p, vt102_generic_backend_grrow(tdata, i), w * sizeof * tdata->grbuf);
+	for (i = 0; i < h; i++, p += w)
+		memcpy(p, vt102_generic_backend_chrow(tdata, i), w);
+	memcpy(p, tdata->wrapped_line_buf, h);
+
+	offset = rec->offset;
+	if (!put_record(rec, VT102_RECORD_KEYFRAME, kf, len))
+		return;
+	rec->keyframe_due = rec->resync = false;
+	rec->nr_bytes_since_keyframe = 0;
+	rec->stats.nr_keyframes ++;
+	rec->stats.nr_keyframe_bytes += len;
+	if (rec->nr_keyframes == rec->index_capacity)
+	{
+		if (!(e = realloc(rec->index, (rec->index_capacity * 2 + 16) * sizeof * e)))
+			/* the keyframe is still usable when the
+			 * index is rebuilt, or replaying past it */
+			return;
+		rec->index = e;
+		rec->index_capacity = rec->index_capacity * 2 + 16;
+	}
+	e = rec->index + rec->nr_keyframes ++;
+	e->time = rec->time;
+	e->offset = offset;
+}
+
+/*!
+ *	\fn	static const struct vt102_record_header * get_record(struct vt102_replay * rp, size_t pos)
+ *	\brief	retrieves a record of a recording
+ *
+ *	\param	rp	the session replay
+ *	\param	pos	the offset of the record in the file
+ *	\return	a pointer to the record header, in the file mapping,
+ *		or null if there is no complete record at the offset
+ *		given */
+static const struct vt102_record_header * get_record(struct vt102_replay * rp, size_t pos)
+{
+const struct vt102_record_header * rh;
+
+	if (pos < sizeof(struct vt102_record_file_header) || pos % sizeof padding
+			|| rp->records_end - pos < sizeof * rh)
+		return 0;
+	rh = (const struct vt102_record_header *) (rp->map + pos);
+	if (rp->records_end - pos - sizeof * rh < padded_len(rh->len))
+		return 0;
+	return rh;
+}
+
+/*!
+ *	\fn	static bool load_index(struct vt102_replay * rp)
+ *	\brief	locates the keyframe index of a recording, or rebuilds it if it is missing
+ *
+ *	\param	rp	the session replay
+ *	\return	true on success, false on failure (out of memory) */
+static bool load_index(struct vt102_replay * rp)
+{
+const struct vt102_record_trailer * t;
+const struct vt102_record_header * rh;
+struct vt102_record_index_entry * e;
+size_t pos;
+int capacity;
+
+	if (rp->size >= sizeof(struct vt102_record_file_header) + sizeof * t
+			&& !(rp->size % sizeof padding))
+	{
+		t = (const struct vt102_record_trailer *) (rp->map + rp->size - sizeof * t);
+		rp->records_end = rp->size - sizeof * t;
+		if (!memcmp(t->magic, trailer_magic, sizeof trailer_magic)
+				&& t->index_offset <= rp->records_end
+				&& (rh = get_record(rp, t->index_offset))
+				&& rh->type == VT102_RECORD_INDEX
+				&& !(rh->len % sizeof * e))
+		{
+			rp->index = (const struct vt102_record_index_entry *) (rh + 1);
+			rp->nr_keyframes = rh->len / sizeof * e;
+			/* the index is recorded last */
+			rp->duration = rh->time;
+			rp->records_end = t->index_offset;
+			return true;
+		}
+	}
+	/* no index, scan the records */
+	rp->records_end = rp->size;
+	capacity = 0;
+	for (pos = sizeof(struct vt102_record_file_header);
+			(rh = get_record(rp, pos)) && rh->type != VT102_RECORD_INDEX;
+			pos += sizeof * rh + padded_len(rh->len))
+	{
+		rp->duration = rh->time;
+		if (rh->type != VT102_RECORD_KEYFRAME)
+			continue;
+		if (rp->nr_keyframes == capacity)
+		{
+			if (!(e = realloc(rp->index_buf, (capacity * 2 + 16) * sizeof * e)))
+				return false;
+			rp->index_buf = e;
+			capacity = capacity * 2 + 16;
+		}
+		e = rp->index_buf + rp->nr_keyframes ++;
+		e->time = rh->time;
+		e->offset = pos;
+	}
+	rp->index = rp->index_buf;
+	/* ignore a partially written record at the end */
+	rp->records_end = pos;
+	return true;
+}
+
+/*!
+ *	\fn	static bool load_keyframe(struct vt102_state * state, const struct vt102_record_header * rh)
+ *	\brief	restores the screen state recorded in a keyframe
+ *
+ *	\param	state	the emulator to restore the screen state of
+ *	\param	rh	the keyframe record
+ *	\return	true on success, false if the keyframe is malformed,
+ *		or on failure (out of memory) */
+static bool load_keyframe(struct vt102_state * state, const struct vt102_record_header * rh)
+{
+const struct vt102_record_keyframe * kf;
+const unsigned char * p;
+struct term_data * tdata;
+struct vt102_backend_ops * ops;
+bool sync_update;
+int i, w, h;
+
+	kf = (const struct vt102_record_keyframe *) (rh + 1);
+	if (rh->len < sizeof * kf)
+		return false;
+	w = kf->width;
+	h = kf->height;
+	if (w <= 0 || h <= 0 || w > 0xffff || h > 0xffff
+			|| rh->len != sizeof * kf + (size_t) w * h * (sizeof * tdata->grbuf + 1) + h
+			|| kf->cursor_x < 0 || kf->cursor_x >= w
+			|| kf->cursor_y < 0 || kf->cursor_y >= h
+			|| kf->margin_top < 0 || kf->margin_top > kf->margin_bottom
+			|| kf->margin_bottom >= h)
+		return false;
+	tdata = vt102_generic_backend_get_data(state);
+	/* the whole screen is overwritten below - the screen contents
+	 * must not be reflowed, or pushed to the scrollback history */
+	if ((w != tdata->con_width || h != tdata->con_height)
+			&& (!vt102_generic_backend_reset_screen(state, w, h)
+				|| w != tdata->con_width || h != tdata->con_height))
+		return false;
+	p = (const unsigned char *) (kf + 1);
+	for (i = 0; i < h; i++, p += w * sizeof * tdata->grbuf)
+		memcpy(vt102_generic_backend_grrow(tdata, i), p, w * sizeof * tdata->grbuf);
+	for (i = 0; i < h; i++, p += w)
+		memcpy(vt102_generic_backend_chrow(tdata, i), p, w);
+	for (i = 0; i < h; i++)
+		tdata->wrapped_line_buf[i] = p[i];
+	tdata->cursor_x = kf->cursor_x;
+	tdata->cursor_y = kf->cursor_y;
+	tdata->margin_top = kf->margin_top;
+	tdata->margin_bottom = kf->margin_bottom;
+	tdata->cur_attr = kf->cur_attr;
+	/* go through the backend function, so that ending an update
+	 * in progress is accounted for, as when replaying the data */
+	sync_update = kf->flags & VT102_RECORD_KEYFRAME_SYNC_UPDATE;
+	ops = vt102_get_backend_ops(state);
+	if (sync_update != tdata->sync_update && ops->set_synchronized_update)
+		ops->set_synchronized_update(ops->param, sync_update);
+	/* the whole screen has changed */
+	tdata->nr_scroll_ops = 0;
+	for (i = 0; i < h; i++)
+		vt102_generic_backend_mark_dirty(tdata, i, 0, w);
+	vt102_parser_reset(state);
+	return true;
+}
+
+/*!
+ *	\fn	static bool apply_record(struct vt102_state * state, const struct vt102_record_header * rh)
+ *	\brief	replays a record into an emulator
+ *
+ *	\param	state	the emulator to replay the record into
+ *	\param	rh	the record to replay
+ *	\return	true on success, false if the record is malformed,
+ *		or on failure (out of memory) */
+static bool apply_record(struct vt102_state * state, const struct vt102_record_header * rh)
+{
+const struct vt102_record_resize * r;
+
+	switch (rh->type)
+	{
+		case VT102_RECORD_DATA:
+			vt102_command_input_parser_buf(state, (const unsigned char *) (rh + 1), rh->len);
+			break;
+		case VT102_RECORD_RESIZE:
+			r = (const struct vt102_record_resize *) (rh + 1);
+			if (rh->len != sizeof * r || r->width <= 0 || r->height <= 0
+					|| r->width > 0xffff || r->height > 0xffff
+					|| !vt102_generic_backend_resize_buffers(state, r->width, r->height))
+				return false;
+			break;
+		case VT102_RECORD_KEYFRAME:
+			/* keyframes are only needed when replaying past
+			 * data dropped while recording */
+			if (rh->len >= sizeof(struct vt102_record_keyframe)
+					&& (((const struct vt102_record_keyframe *) (rh + 1))->flags & VT102_RECORD_KEYFRAME_RESYNC)
+					&& !load_keyframe(state, rh))
+				return false;
+			break;
+	}
+	return true;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_recorder * vt102_record_create(struct vt102_log * log, struct vt102_state * state)
+ *	\brief	creates a session recorder
+ *
+ *	the file header is written, followed by a keyframe of the
+ *	screen state of the emulator given, if its command parser is
+ *	in between commands (otherwise, the keyframe is recorded as
+ *	soon as it is)
+ *
+ *	\param	log	the session logger to write the records with; it
+ *			must have just been created, must not be used for
+ *			logging anything else, and must be destroyed after
+ *			the session recorder is
+ *	\param	state	the emulator whose input is to be recorded, it
+ *			must be using the generic vt102 backend
+ *	\return	a pointer to the new session recorder, or null on error */
+struct vt102_recorder * vt102_record_create(struct vt102_log * log, struct vt102_state * state)
+{
+struct vt102_recorder * rec;
+struct vt102_record_file_header fh;
+struct timespec ts;
+
+	if (!(rec = calloc(1, sizeof * rec)))
+		return 0;
+	rec->log = log;
+	rec->start_us = now_us();
+	clock_gettime(CLOCK_REALTIME, &ts);
+	memset(&fh, 0, sizeof fh);
+	memcpy(fh.magic, file_magic, sizeof fh.magic);
+	fh.version = VT102_RECORD_VERSION;
+	fh.byte_order = VT102_RECORD_BYTE_ORDER_MARK;
+	fh.start_time = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+	if (!vt102_log_write(log, &fh, sizeof fh))
+	{
+		free(rec);
+		return 0;
+	}
+	rec->offset = sizeof fh;
+	rec->keyframe_due = true;
+	if (vt102_parser_is_idle(state))
+		put_keyframe(rec, vt102_generic_backend_get_data(state));
+	return rec;
+}
+
+/*!
+ *	\fn	void vt102_record_destroy(struct vt102_recorder * rec)
+ *	\brief	destroys a session recorder, writing out the keyframe index
+ *
+ *	\note	the session logger is not destroyed
+ *
+ *	\param	rec	the session recorder to destroy
+ *	\return	none */
+void vt102_record_destroy(struct vt102_recorder * rec)
+{
+struct vt102_record_trailer t;
+
+	t.index_offset = rec->offset;
+	memcpy(t.magic, trailer_magic, sizeof t.magic);
+	if (put_record(rec, VT102_RECORD_INDEX, rec->index, rec->nr_keyframes * sizeof * rec->index))
+		vt102_log_write(rec->log, &t, sizeof t);
+	free(rec->keyframe_buf);
+	free(rec->index);
+	free(rec);
+}
+
+/*!
+ *	\fn	void vt102_record_input(struct vt102_recorder * rec, struct vt102_state * state, const void * data, size_t len)
+ *	\brief	records data received from the remote host
+ *
+ *	this must be called after the data has been run through
+ *	the vt102 command parser; a keyframe is recorded after the
+ *	data, if one is due
+ *
+ *	\param	rec	the session recorder
+ *	\param	state	the emulator the data has been run through
+ *	\param	data	the data to record
+ *	\param	len	the number of bytes to record
+ *	\return	none */
+void vt102_record_input(struct vt102_recorder * rec, struct vt102_state * state, const void * data, size_t len)
+{
+	if (put_record(rec, VT102_RECORD_DATA, data, len))
+	{
+		rec->nr_bytes_since_keyframe += len;
+		rec->stats.nr_data_records ++;
+		rec->stats.nr_data_bytes += len;
+	}
+	if ((rec->keyframe_due || rec->nr_bytes_since_keyframe >= VT102_RECORD_KEYFRAME_INTERVAL)
+			&& vt102_parser_is_idle(state))
+		put_keyframe(rec, vt102_generic_backend_get_data(state));
+}
+
+/*!
+ *	\fn	void vt102_record_resize(struct vt102_recorder * rec, struct vt102_state * state)
+ *	\brief	records a screen size change
+ *
+ *	this must be called after the backend data buffers have
+ *	been resized (see vt102_generic_backend_resize_buffers());
+ *	the screen size recorded is the one in effect
+ *
+ *	\param	rec	the session recorder
+ *	\param	state	the emulator which has been resized
+ *	\return	none */
+void vt102_record_resize(struct vt102_recorder * rec, struct vt102_state * state)
+{
+struct vt102_record_resize r;
+struct term_data * tdata;
+
+	tdata = vt102_generic_backend_get_data(state);
+	r.width = tdata->con_width;
+	r.height = tdata->con_height;
+	put_record(rec, VT102_RECORD_RESIZE, &r, sizeof r);
+}
+
+/*!
+ *	\fn	void vt102_record_get_stats(struct vt102_recorder * rec, struct vt102_record_stats * stats)
+ *	\brief	retrieves the session recorder counters
+ *
+ *	\param	rec	the session recorder
+ *	\param	stats	the counters are stored here
+ *	\return	none */
+void vt102_record_get_stats(struct vt102_recorder * rec, struct vt102_record_stats * stats)
+{
+	* stats = rec->stats;
+}
+
+/*!
+ *	\fn	void vt102_record_print_stats(struct vt102_recorder * rec, FILE * f)
+ *	\brief	prints the session recorder counters
+ *
+ *	\param	rec	the session recorder
+ *	\param	f	the stream to print the counters to
+ *	\return	none */
+void vt102_record_print_stats(struct vt102_recorder * rec, FILE * f)
+{
+	fprintf(f, "session recording: %lu data records (%llu bytes), "
+			"%lu keyframes (%llu bytes), %lu records dropped\n",
+			rec->stats.nr_data_records, rec->stats.nr_data_bytes,
+			rec->stats.nr_keyframes, rec->stats.nr_keyframe_bytes,
+			rec->stats.nr_records_dropped);
+}
+
+/*!
+ *	\fn	struct vt102_replay * vt102_replay_open(const char * file_name)
+ *	\brief	opens a recording for replaying, by mapping it in memory
+ *
+ *	\param	file_name	the name of the recording file
+ *	\return	a pointer to the new session replay, or null on error
+ *		(including the file not being a recording, or having been
+ *		recorded on a machine of a different byte order) */
+struct vt102_replay * vt102_replay_open(const char * file_name)
+{
+struct vt102_replay * rp;
+const struct vt102_record_file_header * fh;
+struct stat st;
+void * map;
+int fd;
+
+	if ((fd = open(file_name, O_RDONLY)) == -1)
+		return 0;
+	if (fstat(fd, &st) || st.st_size < (off_t) sizeof * fh
+			|| (map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		close(fd);
+		return 0;
+	}
+	/* the mapping stays valid after the file is closed */
+	close(fd);
+	fh = (const struct vt102_record_file_header *) map;
+	if (memcmp(fh->magic, file_magic, sizeof file_magic)
+			|| fh->version != VT102_RECORD_VERSION
+			|| fh->byte_order != VT102_RECORD_BYTE_ORDER_MARK
+			|| !(rp = calloc(1, sizeof * rp)))
+	{
+		munmap(map, st.st_size);
+		return 0;
+	}
+	rp->map = (const unsigned char *) map;
+	rp->size = st.st_size;
+	if (!load_index(rp))
+	{
+		vt102_replay_close(rp);
+		return 0;
+	}
+	return rp;
+}
+
+/*!
+ *	\fn	void vt102_replay_close(struct vt102_replay * rp)
+ *	\brief	closes a session replay, unmapping the recording file
+ *
+ *	\param	rp	the session replay to close
+ *	\return	none */
+void vt102_replay_close(struct vt102_replay * rp)
+{
+	munmap((void *) rp->map, rp->size);
+	free(rp->index_buf);
+	free(rp);
+}
+
+/*!
+ *	\fn	uint64_t vt102_replay_get_duration(struct vt102_replay * rp)
+ *	\brief	returns the duration of a recording
+ *
+ *	\param	rp	the session replay
+ *	\return	the time of the last record, in microseconds since
+ *		the recording was started */
+uint64_t vt102_replay_get_duration(struct vt102_replay * rp)
+{
+	return rp->duration;
+}
+
+/*!
+ *	\fn	int vt102_replay_get_nr_keyframes(struct vt102_replay * rp)
+ *	\brief	returns the number of keyframes in a recording
+ *
+ *	\param	rp	the session replay
+ *	\return	the number of keyframes in the recording */
+int vt102_replay_get_nr_keyframes(struct vt102_replay * rp)
+{
+	return rp->nr_keyframes;
+}
+
+/*!
+ *	\fn	uint64_t vt102_replay_get_time(struct vt102_replay * rp)
+ *	\brief	returns the time a recording was last seeked to
+ *
+ *	\param	rp	the session replay
+ *	\return	the time passed to the last successful call to
+ *		vt102_replay_seek(), zero if there has been none */
+uint64_t vt102_replay_get_time(struct vt102_replay * rp)
+{
+	return rp->time;
+}
+
+/*!
+ *	\fn	bool vt102_replay_seek(struct vt102_replay * rp, struct vt102_state * state, uint64_t time)
+ *	\brief	brings the screen state of an emulator to the one at a point in time of a recording
+ *
+ *	the last keyframe recorded before the time requested is
+ *	loaded, and the data recorded after it up to that time is
+ *	run through the vt102 command parser - unless the emulator was
+ *	brought to an earlier time by the previous call, and there is
+ *	no keyframe in between, in which case replaying simply goes on
+ *	from there (so that playing a recording back by seeking forward
+ *	in small steps runs every record through the parser only once);
+ *	if there is no keyframe before the time requested, the recording
+ *	is replayed from its start, into the emulator as it is
+ *
+ *	the rows changed are scheduled for refreshing, in the
+ *	usual way (see struct term_data in vt102-backend-generic.h)
+ *
+ *	\param	rp	the session replay
+ *	\param	state	the emulator to replay the recording into, it
+ *			must be using the generic vt102 backend
+ *	\param	time	the time to seek to, in microseconds since
+ *			the recording was started
+ *	\return	true on success, false if the recording is
+ *		malformed, or on failure (out of memory) - the
+ *		screen state of the emulator is then undefined */
+bool vt102_replay_seek(struct vt102_replay * rp, struct vt102_state * state, uint64_t time)
+{
+const struct vt102_record_header * rh;
+int lo, hi, mid;
+
+	/* find the last keyframe not past the time requested */
+	for (lo = 0, hi = rp->nr_keyframes; lo < hi; )
+	{
+		mid = (lo + hi) / 2;
+		if (rp->index[mid].time <= time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (state != rp->state || time < rp->time || (lo && rp->index[lo - 1].offset >= rp->pos))
+	{
+		rp->state = 0;
+		if (lo)
+		{
+			if (!(rh = get_record(rp, rp->index[lo - 1].offset))
+					|| rh->type != VT102_RECORD_KEYFRAME
+					|| !load_keyframe(state, rh))
+				return false;
+			rp->pos = rp->index[lo - 1].offset + sizeof * rh + padded_len(rh->len);
+		}
+		else
+			rp->pos = sizeof(struct vt102_record_file_header);
+	}
+	rp->state = 0;
+	for (; (rh = get_record(rp, rp->pos)) && rh->time <= time; rp->pos += sizeof * rh + padded_len(rh->len))
+		if (!apply_record(state, rh))
+			return false;
+	rp->state = state;
+	rp->time = time;
+	return true;
+}
+
+/*!
+ *	\fn	int vt102_replay_get_nr_segments(struct vt102_replay * rp)
+ *	\brief	returns the number of segments of a recording
+ *
+ *	a recording is divided in segments at its keyframes - the
+ *	first segment holds the records before the first keyframe
+ *	(normally none), and each of the other segments starts at
+ *	a keyframe, and holds the records up to the next keyframe;
+ *	as the screen state at the start of a segment is recorded
+ *	in its keyframe, segments can be replayed independently of
+ *	each other, e.g. in parallel (see vt102_replay_segment())
+ *
+ *	\param	rp	the session replay
+ *	\return	the number of segments in the recording */
+int vt102_replay_get_nr_segments(struct vt102_replay * rp)
+{
+	return rp->nr_keyframes + 1;
+}
+
+/*!
+ *	\fn	bool vt102_replay_segment(struct vt102_replay * rp, int segment, struct vt102_state * state, void (* replayed)(void * arg, struct vt102_state * state, uint64_t time), void * arg)
+ *	\brief	replays a segment of a recording into an emulator
+ *
+ *	the keyframe the segment starts at is loaded, and the records
+ *	of the segment are replayed; the first segment is replayed into
+ *	the emulator as it is - the emulator should then be a newly
+ *	created one
+ *
+ *	this neither uses, nor changes the position vt102_replay_seek()
+ *	keeps, so any number of threads may replay segments of the same
+ *	recording at the same time, into emulators of their own
+ *
+ *	\param	rp	the session replay
+ *	\param	segment	the number of the segment to replay, counting
+ *			from zero, see vt102_replay_get_nr_segments()
+ *	\param	state	the emulator to replay the segment into, it
+ *			must be using the generic vt102 backend
+ *	\param	replayed	if not null, called after the keyframe the
+ *				segment starts at has been loaded, and after
+ *				each record of the segment has been replayed,
+ *				with the time of the record
+ *	\param	arg	passed to the function above
+ *	\return	true on success, false if the recording is
+ *		malformed, or on failure (out of memory) */
+bool vt102_replay_segment(struct vt102_replay * rp, int segment, struct vt102_state * state,
+		void (* replayed)(void * arg, struct vt102_state * state, uint64_t time), void * arg)
+{
+const struct vt102_record_header * rh;
+size_t pos, end;
+
+	end = segment < rp->nr_keyframes ? rp->index[segment].offset : rp->records_end;
+	if (!segment)
+		pos = sizeof(struct vt102_record_file_header);
+	else
+	{
+		pos = rp->index[segment - 1].offset;
+		if (!(rh = get_record(rp, pos))
+				|| rh->type != VT102_RECORD_KEYFRAME
+				|| !load_keyframe(state, rh))
+			return false;
+		if (replayed)
+			replayed(arg, state, rh->time);
+		pos += sizeof * rh + padded_len(rh->len);
+	}
+	for (; pos < end && (rh = get_record(rp, pos)); pos += sizeof * rh + padded_len(rh->len))
+	{
+		if (!apply_record(state, rh))
+			return false;
+		if (replayed)
+			replayed(arg, state, rh->time);
+	}
+	return true;
+}
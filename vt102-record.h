@@ -0,0 +1,232 @@
+/*!
+ *	\file	vt102-record.h
+ *	\brief	vt102 terminal emulator session recording and indexed replay header file
+ *	\author	shopov
+ *
+ *	this module records the data received from the remote host
+ *	to a file, along with the time each chunk of data was received
+ *	at, the screen size changes, and periodic keyframes - full copies
+ *	of the screen state of the generic vt102 backend; a recording can
+ *	then be replayed by mapping the file in memory, and seeking to any
+ *	point in time of the session, by loading the last keyframe before
+ *	that time, and only running the data recorded after the keyframe
+ *	through the vt102 command parser - so that scrubbing through a long
+ *	session does not need replaying it from the start, every time
+ *
+ *	recording is done through a session logger (see vt102-log.h), so
+ *	that the caller never waits for the disk - the logger is created
+ *	by the caller, for the recording alone; each record is logged
+ *	with a single vt102_log_writev() call, so that - if the logger
+ *	drops data - only whole records are ever missing from the file;
+ *	the next keyframe recorded after data has been dropped is flagged
+ *	(VT102_RECORD_KEYFRAME_RESYNC), and is always loaded when replaying,
+ *	so that a replay gets back in sync with the session
+ *
+ *	the file layout is:
+ *		- a file header (struct vt102_record_file_header)
+ *		- records, each being a record header (struct vt102_record_header)
+ *		  followed by the record payload, padded to a multiple of 8 bytes
+ *		- when recording ends normally, an index record listing the
+ *		  keyframes, followed by a trailer (struct vt102_record_trailer)
+ *		  pointing at the index record
+ *
+ *	if the index is missing (e.g. the recording was not closed properly),
+ *	the records are scanned when opening the recording for replay, up to
+ *	the last complete record, and the index is rebuilt in memory
+ *
+ *	keyframes are only recorded when the vt102 command parser is in
+ *	between commands (see vt102_parser_is_idle()), so that the state of
+ *	the emulator is fully described by the backend data; the scrollback
+ *	history is not part of the keyframes, i.e. it is not restored when
+ *	seeking - and loading a keyframe leaves the scrollback history of
+ *	the emulator replayed into alone (the screen is not reflowed into
+ *	it, see vt102_generic_backend_reset_screen())
+ *
+ *	the file is in the native byte order and data type sizes
+ *	of the machine that recorded it; recordings must not be
+ *	compressed (i.e. the name of the log file must not end in
+ *	".gz"), as they are replayed by mapping them in memory
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the version of the recording file format */
+	VT102_RECORD_VERSION			=	1,
+	/*! stored in the file header, for detecting recordings made on a machine of a different byte order */
+	VT102_RECORD_BYTE_ORDER_MARK		=	0x01020304,
+	/*! a keyframe is recorded when this many bytes of data have been recorded since the last keyframe
+	 *
+	 * this bounds the amount of data to run through the
+	 * command parser when seeking - at the usual parser
+	 * throughput, to a few milliseconds */
+	VT102_RECORD_KEYFRAME_INTERVAL		=	1024 * 1024,
+	/*! keyframe flag - data has been dropped before the keyframe, it must be loaded when replaying past it */
+	VT102_RECORD_KEYFRAME_RESYNC		=	1 << 0,
+	/*! keyframe flag - a synchronized update is in progress (see the sync_update field of struct term_data) */
+	VT102_RECORD_KEYFRAME_SYNC_UPDATE	=	1 << 1,
+};
+
+/*! record types */
+enum vt102_record_type
+{
+	/*! data received from the remote host; the payload is the data */
+	VT102_RECORD_DATA		=	1,
+	/*! a screen size change; the payload is a struct vt102_record_resize */
+	VT102_RECORD_RESIZE,
+	/*! a keyframe; the payload is a struct vt102_record_keyframe, followed by the screen contents */
+	VT102_RECORD_KEYFRAME,
+	/*! the keyframe index; the payload is an array of struct vt102_record_index_entry */
+	VT102_RECORD_INDEX,
+};
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! the recording file header */
+struct vt102_record_file_header
+{
+	/*! "vt102rec" */
+	char magic[8];
+	/*! VT102_RECORD_VERSION */
+	uint32_t version;
+	/*! VT102_RECORD_BYTE_ORDER_MARK */
+	uint32_t byte_order;
+	/*! the time the recording was started at, in microseconds since the epoch */
+	uint64_t start_time;
+};
+
+/*! a record header */
+struct vt102_record_header
+{
+	/*! the record type, see enum vt102_record_type */
+	uint32_t type;
+	/*! the size of the record payload, in bytes, not including the padding following it */
+	uint32_t len;
+	/*! the time of the record, in microseconds since the recording was started */
+	uint64_t time;
+};
+
+/*! the payload of a screen size change record */
+struct vt102_record_resize
+{
+	/*! the new screen width */
+	int32_t width;
+	/*! the new screen height */
+	int32_t height;
+};
+
+/*! the header of the payload of a keyframe record
+ *
+ * this is followed by the graphics rendition attributes of
+ * the screen rows (width * height words), then by the characters
+ * of the screen rows (width * height bytes), and then by the row
+ * auto-wrap flags (height bytes) - all of them with the rows in
+ * order, see struct term_data in vt102-backend-generic.h */
+struct vt102_record_keyframe
+{
+	/*! the screen width */
+	int32_t width;
+	/*! the screen height */
+	int32_t height;
+	/*! cursor column position */
+	int32_t cursor_x;
+	/*! cursor row position */
+	int32_t cursor_y;
+	/*! top screen row margin */
+	int32_t margin_top;
+	/*! bottom screen row margin */
+	int32_t margin_bottom;
+	/*! currently selected graphics rendition attributes */
+	uint32_t cur_attr;
+	/*! keyframe flags, see VT102_RECORD_KEYFRAME_RESYNC and VT102_RECORD_KEYFRAME_SYNC_UPDATE */
+	uint32_t flags;
+};
+
+/*! a keyframe index entry */
+struct vt102_record_index_entry
+{
+	/*! the time of the keyframe */
+	uint64_t time;
+	/*! the offset of the keyframe record in the file */
+	uint64_t offset;
+};
+
+/*! the recording file trailer */
+struct vt102_record_trailer
+{
+	/*! the offset of the index record in the file */
+	uint64_t index_offset;
+	/*! "vt102idx" */
+	char magic[8];
+};
+
+/*! session recorder counters */
+struct vt102_record_stats
+{
+	/*! the number of data records written */
+	unsigned long nr_data_records;
+	/*! the number of keyframes written */
+	unsigned long nr_keyframes;
+	/*! the number of records dropped by the session logger */
+	unsigned long nr_records_dropped;
+	/*! the number of bytes of data recorded */
+	unsigned long long nr_data_bytes;
+	/*! the number of bytes of keyframes recorded */
+	unsigned long long nr_keyframe_bytes;
+};
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_recorder;
+struct vt102_replay;
+/* defined in vt102.h */
+struct vt102_state;
+/* defined in vt102-log.h */
+struct vt102_log;
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_recorder * vt102_record_create(struct vt102_log * log, struct vt102_state * state);
+void vt102_record_destroy(struct vt102_recorder * rec);
+void vt102_record_input(struct vt102_recorder * rec, struct vt102_state * state, const void * data, size_t len);
+void vt102_record_resize(struct vt102_recorder * rec, struct vt102_state * state);
+void vt102_record_get_stats(struct vt102_recorder * rec, struct vt102_record_stats * stats);
+void vt102_record_print_stats(struct vt102_recorder * rec, FILE * f);
+
+struct vt102_replay * vt102_replay_open(const char * file_name);
+void vt102_replay_close(struct vt102_replay * rp);
+uint64_t vt102_replay_get_duration(struct vt102_replay * rp);
+int vt102_replay_get_nr_keyframes(struct vt102_replay * rp);
+uint64_t vt102_replay_get_time(struct vt102_replay * rp);
+bool vt102_replay_seek(struct vt102_replay * rp, struct vt102_state * state, uint64_t time);
+int vt102_replay_get_nr_segments(struct vt102_replay * rp);
+bool vt102_replay_segment(struct vt102_replay * rp, int segment, struct vt102_state * state, void (* replayed)(void * arg, struct vt102_state * state, uint64_t time), void * arg);
@@ -0,0 +1,391 @@
+/*!
+ *	\file	vt102-replay-bench.c
+ *	\brief	a headless throughput benchmark and session replay harness for the vt102 terminal emulator
+ *	\author	shopov
+ *
+ *	this replays terminal output through the vt102 command parser
+ *	and the generic vt102 backend - without any rendering - and
+ *	reports, for each input replayed, the throughput (in MB/s and
+ *	ns/byte), the number of memory allocations made while replaying
+ *	it, and a checksum of the resulting screen contents (which should
+ *	only change when the emulation behavior is changed on purpose),
+ *	so that it can be used for catching performance and behavior
+ *	regressions alike
+ *
+ *	the input replayed is either the files given on the command
+ *	line - e.g. the session logs (term-log.txt) written by the terminal
+ *	front-ends when LOG_FILE_NAME is defined in them, which hold the
+ *	raw data received from the remote host - or, if no files are given,
+ *	the built-in set of synthetic corpora (see vt102-bench-support.h):
+ *		- plain text, such as found in build logs
+ *		- utf-8 encoded text, in several scripts
+ *		- 'ls --color' output
+ *		- a full screen editor (vim/htop-like) session
+ *		- an sgr (select graphic rendition) storm
+ *		- scrolling region churn (scrolling inside margins,
+ *		  reverse index, inserting and deleting lines)
+ *
+ *	files given which are session recordings (see vt102-record.h,
+ *	e.g. term-log.rec, written by the terminal front-ends when
+ *	RECORD_FILE_NAME is defined in them) are instead seeked in, to
+ *	random points in time, and the time taken by each seek is reported,
+ *	along with a checksum of the screen contents at the end of the
+ *	recording
+ *
+ *	the input is fed to vt102_command_input_parser_buf() in chunks
+ *	the size of the reads the front-ends make; after each chunk, the
+ *	screen changes are consumed the way a renderer does (resetting the
+ *	rows refresh-needed flags and the scroll operations queued), so that
+ *	what is measured is the cost of emulation alone; with the -c option,
+ *	the input is fed one character at a time to vt102_command_input_parser()
+ *	instead
+ *
+ *	options:
+ *		-c		feed the input one character at a time
+ *		-g WxH		the screen size, 80x24 by default
+ *		-b N		enable a scrollback history of N lines
+ *
+ *	build with something like:
+ *
+ *		cc -O2 -o vt102-replay-bench vt102-replay-bench.c vt102.c vt102-backend-generic.c \
+ *			vt102-scan.c vt102-scrollback.c vt102-trace.c vt102-record.c vt102-log.c \
+ *			vt102-bench-support.c -pthread -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ *
+ *	(vt102-generic-static.c can be given in place of vt102.c and
+ *	vt102-backend-generic.c, for measuring the command parser
+ *	specialized for the generic backend)
+ *
+ *	the --wrap linker options route the memory allocations made
+ *	by the emulator through the counting wrappers below; they are
+ *	required (this relies on the gnu linker, or one compatible with it)
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-record.h"
+#include "vt102-bench-support.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the minimum number of bytes replayed for each input, the input is replayed as many times as needed */
+	MIN_REPLAY_BYTES	=	64 * 1024 * 1024,
+	/*! the size of the chunks the input is fed in, the size of the reads the front-ends make */
+	CHUNK_SIZE		=	4096,
+	/*! the default screen width */
+	DEFAULT_WIDTH		=	80,
+	/*! the default screen height */
+	DEFAULT_HEIGHT		=	24,
+	/*! the number of random seeks made in each session recording */
+	NR_SEEKS		=	256,
+};
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! the number of memory allocations made */
+static unsigned long nr_allocs;
+/*! the number of bytes of memory allocated */
+static unsigned long long nr_bytes_allocated;
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t nmemb, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+/*! counting memory allocation wrappers, see the linker options above */
+void * __wrap_malloc(size_t size)
+{
+	nr_allocs ++;
+	nr_bytes_allocated += size;
+	return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t nmemb, size_t size)
+{
+	nr_allocs ++;
+	nr_bytes_allocated += nmemb * size;
+	return __real_calloc(nmemb, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+	nr_allocs ++;
+	nr_bytes_allocated += size;
+	return __real_realloc(ptr, size);
+}
+
+int dtrace(char * msg, int line)
+{
+	return 0;
+}
+
+/*!
+ *	\fn	static void query_terminal_id(void * param)
+ *	\brief	a null terminal identification query handler, there is no remote host to answer to
+ *
+ *	\param	param	not used
+ *	\return	none */
+static void query_terminal_id(void * param)
+{
+}
+
+/*!
+ *	\fn	static unsigned long screen_checksum(struct term_data * tdata)
+ *	\brief	computes a checksum of the screen contents and cursor position
+ *
+ *	\param	tdata	the backend data holding the screen
+ *	\return	the checksum computed */
+static unsigned long screen_checksum(struct term_data * tdata)
+{
+unsigned long sum;
+unsigned char * ch;
+uint32_t * gr;
+int x, y;
+
+	sum = 0;
+	for (y = 0; y < tdata->con_height; y++)
+	{
+		ch = vt102_generic_backend_chrow(tdata, y);
+		gr = vt102_generic_backend_grrow(tdata, y);
+		for (x = 0; x < tdata->con_width; x++)
+			sum = sum * 31 + ch[x] * 7 + gr[x];
+	}
+	return (sum * 131 + tdata->cursor_x) * 131 + tdata->cursor_y;
+}
+
+/*!
+ *	\fn	static void consume_changes(struct term_data * tdata)
+ *	\brief	consumes the screen changes made, the way a renderer does after refreshing the screen
+ *
+ *	\param	tdata	the backend data holding the screen
+ *	\return	none */
+static void consume_changes(struct term_data * tdata)
+{
+	memset(tdata->must_refresh_line_buf, 0, tdata->con_height * sizeof * tdata->must_refresh_line_buf);
+	tdata->nr_scroll_ops = 0;
+	tdata->must_refresh = false;
+}
+
+/*!
+ *	\fn	static bool replay(const char * name, const unsigned char * buf, size_t len, int width, int height, int nr_scrollback_lines, bool per_char)
+ *	\brief	replays an input, and prints the results
+ *
+ *	\param	name	the name of the input, for printing
+ *	\param	buf	the input buffer
+ *	\param	len	the size of the input buffer
+ *	\param	width	the screen width
+ *	\param	height	the screen height
+ *	\param	nr_scrollback_lines	the number of lines of scrollback
+ *			history to keep, zero for none
+ *	\param	per_char	if true, feed the input one character at a time
+ *	\return	true on success, false on failure (out of memory) */
+static bool replay(const char * name, const unsigned char * buf, size_t len,
+		int width, int height, int nr_scrollback_lines, bool per_char)
+{
+struct vt102_state * state;
+struct term_data * tdata;
+unsigned long allocs;
+unsigned long long bytes_allocated;
+double t;
+size_t i, n, k;
+int pass, nr_passes;
+
+	if (!(state = init_vt102_generic_backend(width, height)))
+		return false;
+	tdata = vt102_generic_backend_get_data(state);
+	tdata->record_scroll_ops = true;
+	vt102_get_backend_ops(state)->query_terminal_id = query_terminal_id;
+	if (nr_scrollback_lines
+			&& !vt102_generic_backend_set_scrollback(state, height, nr_scrollback_lines))
+		return false;
+	nr_passes = MIN_REPLAY_BYTES / len + 1;
+	allocs = nr_allocs;
+	bytes_allocated = nr_bytes_allocated;
+	t = vt102_bench_now();
+	for (pass = 0; pass < nr_passes; pass++)
+		for (i = 0; i < len; i += n)
+		{
+			n = len - i < CHUNK_SIZE ? len - i : CHUNK_SIZE;
+			if (per_char)
+				for (k = 0; k < n; k++)
+					vt102_command_input_parser(state, buf[i + k]);
+			else
+				vt102_command_input_parser_buf(state, buf + i, n);
+			consume_changes(tdata);
+		}
+	t = vt102_bench_now() - t;
+	allocs = nr_allocs - allocs;
+	bytes_allocated = nr_bytes_allocated - bytes_allocated;
+	printf("\t%-24s %10.1f MB/s %8.3f ns/byte %8.1f allocs/MB (%llu bytes)  checksum %08lx\n",
+			name,
+			(double) len * nr_passes / t / 1e6,
+			t * 1e9 / ((double) len * nr_passes),
+			allocs / ((double) len * nr_passes / 1e6),
+			bytes_allocated,
+			screen_checksum(tdata) & 0xffffffffUL);
+	destroy_vt102(state);
+	return true;
+}
+
+/*!
+ *	\fn	static bool replay_recording(const char * name, struct vt102_replay * rp, int width, int height, int nr_scrollback_lines)
+ *	\brief	seeks in a session recording, to random points in time, and prints the results
+ *
+ *	\param	name	the name of the recording, for printing
+ *	\param	rp	the session replay
+ *	\param	width	the initial screen width
+ *	\param	height	the initial screen height
+ *	\param	nr_scrollback_lines	the number of lines of scrollback
+ *			history to keep, zero for none
+ *	\return	true on success, false on failure (out of memory,
+ *		or a malformed recording) */
+static bool replay_recording(const char * name, struct vt102_replay * rp,
+		int width, int height, int nr_scrollback_lines)
+{
+struct vt102_state * state;
+struct term_data * tdata;
+uint64_t duration;
+double t, total, max;
+int i;
+bool ok;
+
+	if (!(state = init_vt102_generic_backend(width, height)))
+		return false;
+	tdata = vt102_generic_backend_get_data(state);
+	tdata->record_scroll_ops = true;
+	vt102_get_backend_ops(state)->query_terminal_id = query_terminal_id;
+	if (nr_scrollback_lines
+			&& !vt102_generic_backend_set_scrollback(state, height, nr_scrollback_lines))
+		return false;
+	duration = vt102_replay_get_duration(rp);
+	srand(1);
+	total = max = 0;
+	ok = true;
+	for (i = 0; ok && i < NR_SEEKS; i++)
+	{
+		t = vt102_bench_now();
+		ok = vt102_replay_seek(rp, state, duration * (rand() / (RAND_MAX + 1.0)));
+		t = vt102_bench_now() - t;
+		consume_changes(tdata);
+		total += t;
+		if (t > max)
+			max = t;
+	}
+	if (ok)
+		ok = vt102_replay_seek(rp, state, duration);
+	if (!ok)
+		printf("\t%-24s malformed session recording\n", name);
+	else
+		printf("\t%-24s %10.1f s recorded, %d keyframes, %d seeks: %8.3f ms mean, %8.3f ms max  checksum %08lx\n",
+				name,
+				duration / 1e6,
+				vt102_replay_get_nr_keyframes(rp),
+				NR_SEEKS,
+				total * 1e3 / NR_SEEKS,
+				max * 1e3,
+				screen_checksum(tdata) & 0xffffffffUL);
+	destroy_vt102(state);
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+unsigned char * buf;
+struct vt102_replay * rp;
+size_t len;
+int i, width, height, nr_scrollback_lines;
+bool per_char, failed;
+
+	width = DEFAULT_WIDTH;
+	height = DEFAULT_HEIGHT;
+	nr_scrollback_lines = 0;
+	per_char = false;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp(argv[i], "-c"))
+			per_char = true;
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc
+				&& sscanf(argv[i + 1], "%dx%d", &width, &height) == 2
+				&& width > 0 && height > 2)
+			i++;
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc
+				&& (nr_scrollback_lines = atoi(argv[i + 1])) > 0)
+			i++;
+		else
+		{
+			printf("usage: %s [-c] [-g WxH] [-b N] [file...]\n", argv[0]);
+			return 1;
+		}
+	}
+	printf("%dx%d screen, %s, %d lines of scrollback:\n", width, height,
+			per_char ? "fed one character at a time" : "fed in chunks",
+			nr_scrollback_lines);
+	failed = false;
+	if (i == argc)
+	{
+		/* replay the built-in corpora */
+		if (!(buf = malloc(VT102_BENCH_CORPUS_SIZE)))
+		{
+			printf("no core\n");
+			exit(1);
+		}
+		for (i = 0; i < VT102_BENCH_NR_CORPORA; i++)
+		{
+			vt102_bench_make_corpus(i, buf, VT102_BENCH_CORPUS_SIZE);
+			if (!replay(vt102_bench_corpus_name(i), buf, VT102_BENCH_CORPUS_SIZE,
+					width, height, nr_scrollback_lines, per_char))
+				failed = true;
+		}
+		free(buf);
+	}
+	else
+		/* replay the files given */
+		for (; i < argc; i++)
+		{
+			if ((rp = vt102_replay_open(argv[i])))
+			{
+				if (!replay_recording(argv[i], rp, width, height, nr_scrollback_lines))
+					failed = true;
+				vt102_replay_close(rp);
+				continue;
+			}
+			if (!(buf = vt102_bench_read_file(argv[i], &len)))
+			{
+				printf("\t%-24s cannot read file\n", argv[i]);
+				failed = true;
+				continue;
+			}
+			if (!replay(argv[i], buf, len, width, height, nr_scrollback_lines, per_char))
+				failed = true;
+			free(buf);
+		}
+	return failed ? 1 : 0;
+}
+
@@ -0,0 +1,194 @@
+/*!
+ *	\file	vt102-resize-sched.c
+ *	\brief	vt102 terminal emulator resize scheduler
+ *	\author	shopov
+ *
+ *	see the comments in vt102-resize-sched.h
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <string.h>
+#include <time.h>
+
+#include "vt102-resize-sched.h"
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static unsigned long long now_us(void)
+ *	\brief	returns the current value of a monotonic clock, in microseconds
+ *
+ *	\return	the current value of the clock */
+static unsigned long long now_us(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*!
+ *	\fn	static unsigned long long get_deadline(struct vt102_resize_sched * rs)
+ *	\brief	returns the time the pending size change is due at
+ *
+ *	\param	rs	the resize scheduler state; a size change must be pending
+ *	\return	the time the pending size change should be applied at */
+static unsigned long long get_deadline(struct vt102_resize_sched * rs)
+{
+unsigned long long deadline;
+
+	deadline = rs->last_request_us + VT102_RESIZE_SCHED_QUIET_PERIOD_US;
+	if (deadline > rs->first_request_us + VT102_RESIZE_SCHED_MAX_DELAY_US)
+		deadline = rs->first_request_us + VT102_RESIZE_SCHED_MAX_DELAY_US;
+	return deadline;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	void vt102_resize_sched_init(struct vt102_resize_sched * rs, int width, int height)
+ *	\brief	initializes a resize scheduler
+ *
+ *	\param	rs	the resize scheduler state to initialize
+ *	\param	width	the screen width in effect
+ *	\param	height	the screen height in effect
+ *	\return	none */
+void vt102_resize_sched_init(struct vt102_resize_sched * rs, int width, int height)
+{
+	memset(rs, 0, sizeof * rs);
+	rs->width = width;
+	rs->height = height;
+}
+
+/*!
+ *	\fn	void vt102_resize_sched_request(struct vt102_resize_sched * rs, int width, int height)
+ *	\brief	records a size change request (e.g. a ConfigureNotify event for the terminal window)
+ *
+ *	\param	rs	the resize scheduler state
+ *	\param	width	the screen width requested
+ *	\param	height	the screen height requested
+ *	\return	none */
+void vt102_resize_sched_request(struct vt102_resize_sched * rs, int width, int height)
+{
+unsigned long long now;
+
+	rs->stats.nr_requests ++;
+	if (width == rs->width && height == rs->height)
+	{
+		/* nothing to change - or the size has been changed back */
+		rs->pending = false;
+		return;
+	}
+	if (rs->pending && width == rs->pending_width && height == rs->pending_height)
+		/* e.g. the window has only been moved - do not extend the quiet period */
+		return;
+	now = now_us();
+	if (!rs->pending)
+		rs->first_request_us = now;
+	rs->last_request_us = now;
+	rs->pending_width = width;
+	rs->pending_height = height;
+	rs->pending = true;
+}
+
+/*!
+ *	\fn	bool vt102_resize_sched_due(struct vt102_resize_sched * rs, int * width, int * height)
+ *	\brief	tells if the size change pending should be applied now
+ *
+ *	if so, the size requested is taken to be in effect; should
+ *	applying it fail, the caller should record the size actually
+ *	in effect by calling vt102_resize_sched_set_size()
+ *
+ *	\param	rs	the resize scheduler state
+ *	\param	width	where to store the screen width to apply
+ *	\param	height	where to store the screen height to apply
+ *	\return	true, if the size stored should be applied now,
+ *		false otherwise */
+bool vt102_resize_sched_due(struct vt102_resize_sched * rs, int * width, int * height)
+{
+unsigned long long now;
+
+	if (!rs->pending)
+		return false;
+	now = now_us();
+	if (now < get_deadline(rs))
+		return false;
+	if (now < rs->last_request_us + VT102_RESIZE_SCHED_QUIET_PERIOD_US)
+		rs->stats.nr_forced_resizes ++;
+	rs->stats.nr_resizes ++;
+	rs->pending = false;
+	* width = rs->width = rs->pending_width;
+	* height = rs->height = rs->pending_height;
+	return true;
+}
+
+/*!
+ *	\fn	void vt102_resize_sched_set_size(struct vt102_resize_sched * rs, int width, int height)
+ *	\brief	records the screen size in effect
+ *
+ *	\param	rs	the resize scheduler state
+ *	\param	width	the screen width in effect
+ *	\param	height	the screen height in effect
+ *	\return	none */
+void vt102_resize_sched_set_size(struct vt102_resize_sched * rs, int width, int height)
+{
+	rs->width = width;
+	rs->height = height;
+}
+
+/*!
+ *	\fn	struct timeval * vt102_resize_sched_get_timeout(struct vt102_resize_sched * rs, struct timeval * timeout, struct timeval * ptimeout)
+ *	\brief	limits the time to wait for events for, so that the size change pending is applied in time
+ *
+ *	\param	rs	the resize scheduler state
+ *	\param	timeout	where to store the time until the size change
+ *			pending is due, if needed
+ *	\param	ptimeout	the time to wait for otherwise, suitable for
+ *				passing to select() (i.e. null for no limit)
+ *	\return	the earlier one of the two timeouts, suitable for
+ *		passing to select() */
+struct timeval * vt102_resize_sched_get_timeout(struct vt102_resize_sched * rs, struct timeval * timeout, struct timeval * ptimeout)
+{
+unsigned long long now, deadline;
+
+	if (!rs->pending)
+		return ptimeout;
+	now = now_us();
+	deadline = get_deadline(rs);
+	deadline = deadline > now ? deadline - now : 0;
+	if (ptimeout && ptimeout->tv_sec * 1000000ULL + ptimeout->tv_usec <= deadline)
+		return ptimeout;
+	timeout->tv_sec = deadline / 1000000;
+	timeout->tv_usec = deadline % 1000000;
+	return timeout;
+}
+
+/*!
+ *	\fn	void vt102_resize_sched_print_stats(struct vt102_resize_sched * rs, FILE * f)
+ *	\brief	prints the resize scheduler counters
+ *
+ *	\param	rs	the resize scheduler state
+ *	\param	f	the stream to print the counters to
+ *	\return	none */
+void vt102_resize_sched_print_stats(struct vt102_resize_sched * rs, FILE * f)
+{
+	fprintf(f, "resizes: %lu requested, %lu applied (%lu forced while requests were arriving)\n",
+			rs->stats.nr_requests, rs->stats.nr_resizes, rs->stats.nr_forced_resizes);
+}
+
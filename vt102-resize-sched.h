@@ -0,0 +1,108 @@
+/*!
+ *	\file	vt102-resize-sched.h
+ *	\brief	vt102 terminal emulator resize scheduler header file
+ *	\author	shopov
+ *
+ *	this module decides when a front-end should apply a change of
+ *	the terminal window size - resize the screen buffers (see
+ *	vt102_generic_backend_resize_buffers()), and notify the remote
+ *	host of the new size; window managers send a stream of window
+ *	size changes while the user drags the window edge (or while
+ *	windows are being tiled), and applying each one of them makes
+ *	the remote host repaint its screen for a size which is stale by
+ *	the time the repaint arrives - which costs a lot of bandwidth
+ *	over slow links
+ *
+ *	the size changes requested are coalesced - only the most recent
+ *	size requested is applied, once the requests have paused for
+ *	a short while (the quiet period), but not later than a maximum
+ *	delay after the first request, so that the screen still follows
+ *	the window while it is being dragged; requests which do not
+ *	change the size in effect (e.g. the ones for window moves) are
+ *	dropped, and so are requests which get reverted before being
+ *	applied
+ *
+ *	a typical main loop using the scheduler looks like this:
+ *
+ *		for (each window size change event)
+ *			vt102_resize_sched_request(...);
+ *		if (vt102_resize_sched_due(..., &width, &height))
+ *			resize the screen, notify the remote host...
+ *		timeout = vt102_resize_sched_get_timeout(..., timeout);
+ *		select(... timeout);
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the time the size change requests must pause for before applying the size requested, in microseconds */
+	VT102_RESIZE_SCHED_QUIET_PERIOD_US	=	50000,
+	/*! the maximum time a size change requested is deferred for, in microseconds */
+	VT102_RESIZE_SCHED_MAX_DELAY_US		=	250000,
+};
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! resize scheduler counters */
+struct vt102_resize_stats
+{
+	/*! the number of size changes requested */
+	unsigned long nr_requests;
+	/*! the number of size changes applied */
+	unsigned long nr_resizes;
+	/*! the number of size changes applied because they could not be deferred any more, while requests were still arriving */
+	unsigned long nr_forced_resizes;
+};
+
+/*! the resize scheduler state */
+struct vt102_resize_sched
+{
+	/*! the size in effect */
+	int width, height;
+	/*! the size requested, meaningful only if a size change is pending */
+	int pending_width, pending_height;
+	/*! set if a size change is pending */
+	bool pending;
+	/*! the time the pending size change was first requested at */
+	unsigned long long first_request_us;
+	/*! the time the last size change was requested at */
+	unsigned long long last_request_us;
+	/*! the counters */
+	struct vt102_resize_stats stats;
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+void vt102_resize_sched_init(struct vt102_resize_sched * rs, int width, int height);
+void vt102_resize_sched_request(struct vt102_resize_sched * rs, int width, int height);
+bool vt102_resize_sched_due(struct vt102_resize_sched * rs, int * width, int * height);
+void vt102_resize_sched_set_size(struct vt102_resize_sched * rs, int width, int height);
+struct timeval * vt102_resize_sched_get_timeout(struct vt102_resize_sched * rs, struct timeval * timeout, struct timeval * ptimeout);
+void vt102_resize_sched_print_stats(struct vt102_resize_sched * rs, FILE * f);
+
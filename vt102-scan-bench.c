@@ -0,0 +1,173 @@
+/*!
+ *	\file	vt102-scan-bench.c
+ *	\brief	a microbenchmark for the vt102 terminal emulator input scanning routines
+ *	\author	shopov
+ *
+ *	this compares the scanning routines in vt102-scan.c - the
+ *	one selected at runtime, and each of the individual
+ *	implementations the cpu supports - against the per-character
+ *	test that the vt102 command parser used to do for each
+ *	input character (the one in is_displayable()); two of the
+ *	synthetic corpora of vt102-bench-support.h are used - lines of
+ *	plain text, such as found in build logs, and short runs of text
+ *	interspersed with escape sequences, such as the output of
+ *	'ls --color'
+ *
+ *	build with something like:
+ *
+ *		cc -O2 -o vt102-scan-bench vt102-scan-bench.c vt102-scan.c vt102-bench-support.c
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vt102-scan.h"
+#include "vt102-bench-support.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+/*! the number of passes made over each input buffer */
+#define NR_BENCH_PASSES		20
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static size_t scan_per_char(const unsigned char * buf, size_t len)
+ *	\brief	scans for plain characters one character at a time, the way the vt102 parser used to
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters at the start of the buffer */
+static size_t scan_per_char(const unsigned char * buf, size_t len)
+{
+size_t i;
+
+	for (i = 0; i < len; i++)
+		if (!(buf[i] > 0x1f && buf[i] != 0x7f && !(buf[i] & 0x80)))
+			break;
+	return i;
+}
+
+/*!
+ *	\fn	static void bench(const char * name, size_t (* scan)(const unsigned char * buf, size_t len), const unsigned char * buf, size_t len, size_t * nr_runs)
+ *	\brief	benchmarks a scanning routine on a buffer, and prints the results
+ *
+ *	the buffer is processed the way the vt102 parser processes
+ *	it - a run of plain characters is skipped, then the next
+ *	character is skipped (as if handled by the parser state machine),
+ *	and so on until the end of the buffer
+ *
+ *	\param	name	the name of the routine, for printing
+ *	\param	scan	the scanning routine to benchmark
+ *	\param	buf	the input buffer
+ *	\param	len	the size of the input buffer
+ *	\param	nr_runs	the number of plain character runs found is stored
+ *			here, for cross-checking the different routines
+ *	\return	none */
+static void bench(const char * name, size_t (* scan)(const unsigned char * buf, size_t len),
+		const unsigned char * buf, size_t len, size_t * nr_runs)
+{
+double t;
+size_t i, n;
+int pass;
+
+	t = vt102_bench_now();
+	for (pass = 0; pass < NR_BENCH_PASSES; pass++)
+		for (i = 0, * nr_runs = 0; i < len; i++)
+		{
+			n = scan(buf + i, len - i);
+			if (n)
+				(* nr_runs) ++;
+			i += n;
+		}
+	t = vt102_bench_now() - t;
+	printf("\t%-12s %10.1f MB/s %8.3f ns/byte (%lu runs)\n",
+			name,
+			(double) len * NR_BENCH_PASSES / t / 1e6,
+			t * 1e9 / ((double) len * NR_BENCH_PASSES),
+			(unsigned long) * nr_runs);
+}
+
+int main(void)
+{
+static const struct
+{
+	const char * name;
+	size_t (* scan)(const unsigned char * buf, size_t len);
+}
+variants[] =
+{
+	{ "scalar", vt102_scan_printable_scalar, },
+#if VT102_SCAN_HAVE_SSE2
+	{ "sse2", vt102_scan_printable_sse2, },
+#endif
+#if VT102_SCAN_HAVE_AVX2
+	{ "avx2", vt102_scan_printable_avx2, },
+#endif
+#if VT102_SCAN_HAVE_NEON
+	{ "neon", vt102_scan_printable_neon, },
+#endif
+};
+static const enum vt102_bench_corpus inputs[] =
+{
+	VT102_BENCH_CORPUS_PLAIN,
+	VT102_BENCH_CORPUS_LS_COLOR,
+};
+unsigned char * buf;
+size_t i, j, nr_runs, nr_runs_ref;
+bool failed;
+
+	if (!(buf = malloc(VT102_BENCH_CORPUS_SIZE)))
+	{
+		printf("no core\n");
+		exit(1);
+	}
+	failed = false;
+	for (i = 0; i < sizeof inputs / sizeof * inputs; i++)
+	{
+		vt102_bench_make_corpus(inputs[i], buf, VT102_BENCH_CORPUS_SIZE);
+		printf("%s:\n", vt102_bench_corpus_name(inputs[i]));
+		bench("per-char", scan_per_char, buf, VT102_BENCH_CORPUS_SIZE, &nr_runs_ref);
+		bench("dispatched", vt102_scan_printable, buf, VT102_BENCH_CORPUS_SIZE, &nr_runs);
+		if (nr_runs != nr_runs_ref)
+			failed = true;
+		for (j = 0; j < sizeof variants / sizeof * variants; j++)
+		{
+			if (!vt102_scan_cpu_supports(variants[j].name))
+			{
+				printf("\t%-12s (not supported by this cpu)\n", variants[j].name);
+				continue;
+			}
+			bench(variants[j].name, variants[j].scan, buf, VT102_BENCH_CORPUS_SIZE, &nr_runs);
+			if (nr_runs != nr_runs_ref)
+				failed = true;
+		}
+	}
+	free(buf);
+	if (failed)
+	{
+		printf("error: scanning results differ between implementations\n");
+		return 1;
+	}
+	return 0;
+}
+
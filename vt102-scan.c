@@ -0,0 +1,280 @@
+/*!
+ *	\file	vt102-scan.c
+ *	\brief	vt102 terminal emulator input scanning routines
+ *	\author	shopov
+ *
+ *	the routines here find the first character in a buffer that
+ *	is not a plain displayable character (i.e. that is outside the
+ *	range 0x20 - 0x7e), and are used by the vt102 command parser
+ *	for skipping over runs of plain text in the normal input state
+ *
+ *	there is a simple scalar implementation here, and vectorized
+ *	implementations for some cpus - a sse2 and an avx2 one for
+ *	x86 cpus, and a neon one for aarch64 cpus; the implementation
+ *	to use is selected at runtime, on the first invocation of
+ *	vt102_scan_printable(), depending on the features of the cpu
+ *	the code is running on
+ *
+ *	all of the vectorized implementations use the same trick -
+ *	subtracting 0x20 from a character maps the range of plain
+ *	characters 0x20 - 0x7e to the range 0x00 - 0x5e, and all other
+ *	characters (wrapping around) above 0x5e, so a single unsigned
+ *	comparison per character tells if the character is plain
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "vt102-scan.h"
+
+/*
+ *
+ * local function prototypes follow
+ *
+ */
+static size_t scan_printable_select(const unsigned char * buf, size_t len);
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! the scanning routine in effect
+ *
+ * this initially points to a routine which selects the
+ * best implementation available, stores it here, and
+ * then invokes it; as all threads select the same
+ * implementation, no locking is needed for this - the
+ * pointer is only accessed atomically (relaxed), so that
+ * many threads may run vt102 command parsers at once */
+static size_t (* scan_printable)(const unsigned char * buf, size_t len) = scan_printable_select;
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static inline bool is_plain(unsigned char c)
+ *	\brief	tells if a character is a plain displayable character (in the range 0x20 - 0x7e)
+ *
+ *	\param	c	the character to test
+ *	\return	true, if the character is in the range 0x20 - 0x7e, false otherwise */
+static inline bool is_plain(unsigned char c)
+{
+	return (unsigned char) (c - 0x20) <= 0x5e;
+}
+
+/*!
+ *	\fn	static size_t scan_printable_select(const unsigned char * buf, size_t len)
+ *	\brief	selects the best scanning routine for the cpu in use, and invokes it
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters at the start of the buffer */
+static size_t scan_printable_select(const unsigned char * buf, size_t len)
+{
+size_t (* scan)(const unsigned char * buf, size_t len);
+
+	scan = vt102_scan_printable_scalar;
+#if VT102_SCAN_HAVE_SSE2
+	if (vt102_scan_cpu_supports("sse2"))
+		scan = vt102_scan_printable_sse2;
+#endif
+#if VT102_SCAN_HAVE_AVX2
+	if (vt102_scan_cpu_supports("avx2"))
+		scan = vt102_scan_printable_avx2;
+#endif
+#if VT102_SCAN_HAVE_NEON
+	if (vt102_scan_cpu_supports("neon"))
+		scan = vt102_scan_printable_neon;
+#endif
+	__atomic_store_n(&scan_printable, scan, __ATOMIC_RELAXED);
+	return scan(buf, len);
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	size_t vt102_scan_printable_scalar(const unsigned char * buf, size_t len)
+ *	\brief	returns the number of plain characters at the start of a buffer - scalar implementation
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters (in the range 0x20 - 0x7e)
+ *		at the start of the buffer; this equals 'len' if all
+ *		of the characters in the buffer are plain characters */
+size_t vt102_scan_printable_scalar(const unsigned char * buf, size_t len)
+{
+size_t i;
+
+	for (i = 0; i < len; i++)
+		if (!is_plain(buf[i]))
+			break;
+	return i;
+}
+
+#if VT102_SCAN_HAVE_SSE2
+/*!
+ *	\fn	size_t vt102_scan_printable_sse2(const unsigned char * buf, size_t len)
+ *	\brief	returns the number of plain characters at the start of a buffer - sse2 implementation
+ *
+ *	\note	the cpu must support the sse2 instruction set
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters (in the range 0x20 - 0x7e)
+ *		at the start of the buffer; this equals 'len' if all
+ *		of the characters in the buffer are plain characters */
+__attribute__((target("sse2")))
+size_t vt102_scan_printable_sse2(const unsigned char * buf, size_t len)
+{
+size_t i;
+__m128i bias, limit, v;
+unsigned int mask;
+
+	bias = _mm_set1_epi8(0x20);
+	limit = _mm_set1_epi8(0x5e);
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		v = _mm_sub_epi8(_mm_loadu_si128((const __m128i *) (buf + i)), bias);
+		/* a character is plain if min(v, 0x5e) == v */
+		mask = ~ _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, limit), v)) & 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + vt102_scan_printable_scalar(buf + i, len - i);
+}
+#endif /* VT102_SCAN_HAVE_SSE2 */
+
+#if VT102_SCAN_HAVE_AVX2
+/*!
+ *	\fn	size_t vt102_scan_printable_avx2(const unsigned char * buf, size_t len)
+ *	\brief	returns the number of plain characters at the start of a buffer - avx2 implementation
+ *
+ *	\note	the cpu must support the avx2 instruction set
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters (in the range 0x20 - 0x7e)
+ *		at the start of the buffer; this equals 'len' if all
+ *		of the characters in the buffer are plain characters */
+__attribute__((target("avx2")))
+size_t vt102_scan_printable_avx2(const unsigned char * buf, size_t len)
+{
+size_t i;
+__m256i bias, limit, v;
+unsigned int mask;
+
+	bias = _mm256_set1_epi8(0x20);
+	limit = _mm256_set1_epi8(0x5e);
+	for (i = 0; i + 32 <= len; i += 32)
+	{
+		v = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i *) (buf + i)), bias);
+		/* a character is plain if min(v, 0x5e) == v */
+		mask = ~ (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + vt102_scan_printable_sse2(buf + i, len - i);
+}
+#endif /* VT102_SCAN_HAVE_AVX2 */
+
+#if VT102_SCAN_HAVE_NEON
+/*!
+ *	\fn	size_t vt102_scan_printable_neon(const unsigned char * buf, size_t len)
+ *	\brief	returns the number of plain characters at the start of a buffer - neon implementation
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters (in the range 0x20 - 0x7e)
+ *		at the start of the buffer; this equals 'len' if all
+ *		of the characters in the buffer are plain characters */
+size_t vt102_scan_printable_neon(const unsigned char * buf, size_t len)
+{
+size_t i;
+uint8x16_t bias, limit, stop;
+uint64_t mask;
+
+	bias = vdupq_n_u8(0x20);
+	limit = vdupq_n_u8(0x5e);
+	for (i = 0; i + 16 <= len; i += 16)
+	{
+		stop = vcgtq_u8(vsubq_u8(vld1q_u8(buf + i), bias), limit);
+		if (vmaxvq_u8(stop))
+		{
+			/* narrow the comparison result to four bits per character */
+			mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+			return i + (__builtin_ctzll(mask) >> 2);
+		}
+	}
+	return i + vt102_scan_printable_scalar(buf + i, len - i);
+}
+#endif /* VT102_SCAN_HAVE_NEON */
+
+/*!
+ *	\fn	bool vt102_scan_cpu_supports(const char * variant)
+ *	\brief	tells if a scanning routine variant can be used on the cpu in use
+ *
+ *	\param	variant	the name of the variant - one of "scalar",
+ *			"sse2", "avx2", "neon"
+ *	\return	true, if the variant is available and the cpu
+ *		supports it, false otherwise */
+bool vt102_scan_cpu_supports(const char * variant)
+{
+	if (!strcmp(variant, "scalar"))
+		return true;
+#if VT102_SCAN_HAVE_SSE2
+	if (!strcmp(variant, "sse2"))
+		return __builtin_cpu_supports("sse2");
+	if (!strcmp(variant, "avx2"))
+		return __builtin_cpu_supports("avx2");
+#endif
+#if VT102_SCAN_HAVE_NEON
+	/* neon is mandatory on aarch64 */
+	if (!strcmp(variant, "neon"))
+		return true;
+#endif
+	return false;
+}
+
+/*!
+ *	\fn	size_t vt102_scan_printable(const unsigned char * buf, size_t len)
+ *	\brief	returns the number of plain characters at the start of a buffer
+ *
+ *	this invokes the fastest implementation available
+ *	for the cpu the code is running on
+ *
+ *	\param	buf	the buffer to scan
+ *	\param	len	the number of characters in the buffer
+ *	\return	the number of plain characters (in the range 0x20 - 0x7e)
+ *		at the start of the buffer; this equals 'len' if all
+ *		of the characters in the buffer are plain characters */
+size_t vt102_scan_printable(const unsigned char * buf, size_t len)
+{
+	return __atomic_load_n(&scan_printable, __ATOMIC_RELAXED)(buf, len);
+}
+
@@ -0,0 +1,50 @@
+/*!
+ *	\file	vt102-scan.h
+ *	\brief	vt102 terminal emulator input scanning routines header file
+ *	\author	shopov
+ *
+ *	the routines here are used by the vt102 command parser for
+ *	quickly skipping over runs of plain displayable characters
+ *	in the input while in the normal input state; a 'plain'
+ *	character here is one in the range 0x20 - 0x7e - anything
+ *	else (control characters - including ESC, DEL and characters
+ *	with bit 7 set) must be processed by the parser state machine
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+size_t vt102_scan_printable(const unsigned char * buf, size_t len);
+
+/* the individual implementations below are exported only for
+ * testing and benchmarking purposes - normally, the
+ * vt102_scan_printable() routine above should be used, which
+ * selects the best implementation for the cpu it is running on */
+size_t vt102_scan_printable_scalar(const unsigned char * buf, size_t len);
+#if defined(__i386__) || defined(__x86_64__)
+#define VT102_SCAN_HAVE_SSE2	1
+#define VT102_SCAN_HAVE_AVX2	1
+size_t vt102_scan_printable_sse2(const unsigned char * buf, size_t len);
+size_t vt102_scan_printable_avx2(const unsigned char * buf, size_t len);
+#endif
+#if defined(__aarch64__)
+#define VT102_SCAN_HAVE_NEON	1
+size_t vt102_scan_printable_neon(const unsigned char * buf, size_t len);
+#endif
+bool vt102_scan_cpu_supports(const char * variant);
+
@@ -0,0 +1,1520 @@
+/*!
+ *	\file	vt102-scrollback.c
+ *	\brief	vt102 terminal emulator scrollback history buffer
+ *	\author	shopov
+ *
+ *	this module maintains a history of the lines that have
+ *	been scrolled off the top of a vt102 terminal screen - see
+ *	the comments in vt102-scrollback.h for an overview
+ *
+ *	lines are stored with trailing blanks (space characters with
+ *	the default - zero - graphics rendition attributes) removed,
+ *	and are padded back with blanks when retrieved; lines which
+ *	wrap onto the next line (see the wrapped_line_buf field of
+ *	struct term_data in vt102-backend-generic.h) are stored as is,
+ *	so that the logical lines they are part of can be reassembled
+ *
+ *	the width of each line is stored along with a flag telling if
+ *	the line wraps onto the next one (LINE_WRAPPED); a view of the
+ *	history reflowed to a given width is maintained by means of an
+ *	index of the rows the logical lines take at that width - each
+ *	row referring to the stored line it starts in, and its offset
+ *	in that line; the index is built with a single pass over the
+ *	line widths (no line contents are touched) the first time it is
+ *	needed after changing the width, and is extended as lines are
+ *	stored; lines are numbered independently of their position in
+ *	the history for this purpose (see nr_lines_pushed below)
+ *
+ *	the lines in the compressed (cold) tier are stored in blocks,
+ *	each block holding up to VT102_SCROLLBACK_BLOCK_LINES lines;
+ *	each line in a block is stored as:
+ *		- two bytes - the line width and the LINE_WRAPPED flag,
+ *			least significant byte first
+ *		- the run-length encoded character codes of the line
+ *		- the run-length encoded graphics rendition attributes
+ *			of the line
+ *
+ *	the run-length encoding used is a variant of the 'packbits'
+ *	scheme - the encoded data is a sequence of packets, each packet
+ *	starting with a control byte 'c', so that:
+ *		- if c is in the range 0 - 127, c + 1 literal bytes follow
+ *		- if c is in the range 128 - 255, a single byte follows,
+ *			which must be repeated c - 125 times (3 to 130 times)
+ *
+ *	the graphics rendition attributes are encoded the same way,
+ *	except that the literals and the repeated values are whole
+ *	(32 bit) attribute words, stored in host byte order
+ *
+ *	this works well both for text (at most one byte of overhead for
+ *	every 128 bytes of text) and for graphics rendition attributes,
+ *	which usually come in long runs
+ *
+ *	the newest block of the cold tier (the open block) is compressed
+ *	into a buffer owned by the scrollback buffer (see open_data below),
+ *	kept large enough for the worst case encoding of a whole block of
+ *	lines; when the block fills up, its contents are copied out to a
+ *	buffer of about their size - the buffer of the block discarded last
+ *	is reused for this if it is large enough, and not too large, and so
+ *	is the block structure itself (see spare_block below); the buffers
+ *	allocated have some room to spare, so that the blocks closed later
+ *	fit in them more often - so that, once the history is full, storing
+ *	lines rarely makes memory allocations (about one per block closed,
+ *	when the compressed sizes of the blocks vary widely, e.g. when the
+ *	output switches between plain text and colored text)
+ *
+ *	for searching the history without decompressing all of it, a
+ *	summary is kept for each line of the hot tier, and for each block
+ *	of the cold tier - a bloom filter style bit set, with a bit set for
+ *	the hash of each trigram (three consecutive character code bytes,
+ *	with the ascii letters folded to lower case) occurring in the lines;
+ *	the trigrams spanning the boundary of a line which another line wraps
+ *	onto are accounted for in the summary of the line wrapped onto - the
+ *	last two character code bytes of the logical line before a line are
+ *	kept along with each line of the hot tier for this (see hot_tails
+ *	below); a text that does not have all of its trigrams in a summary
+ *	does not occur in the lines summarized, so that whole blocks can be
+ *	skipped by vt102_scrollback_find_candidate(); summaries are only ever
+ *	added to, so that lines removed by vt102_scrollback_pop_line() may
+ *	leave bits set (this only makes a summary less selective)
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vt102-scrollback.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the maximum number of literal bytes in a run-length encoding packet */
+	RLE_MAX_LITERALS	=	128,
+	/*! the minimum number of repeated bytes encoded as a run in a run-length encoding packet */
+	RLE_MIN_RUN		=	3,
+	/*! the maximum number of repeated bytes encoded as a run in a run-length encoding packet */
+	RLE_MAX_RUN		=	130,
+	/*! the maximum line width supported (the line width is stored in two bytes, along with the LINE_WRAPPED flag) */
+	MAX_LINE_WIDTH		=	0x7fff,
+	/*! the flag, stored along with the width of a line, telling if the line wraps onto the next line */
+	LINE_WRAPPED		=	0x8000,
+	/*! the number of bits of the summary of a line in the hot tier */
+	HOT_SUMMARY_BITS	=	256,
+	/*! the number of high-order bits of a trigram hash selecting a bit of the summary of a line in the hot tier */
+	HOT_SUMMARY_HASH_BITS	=	8,
+	/*! the number of bits of the summary of a block in the cold tier */
+	COLD_SUMMARY_BITS	=	4096,
+	/*! the number of high-order bits of a trigram hash selecting a bit of the summary of a block in the cold tier */
+	COLD_SUMMARY_HASH_BITS	=	12,
+	/*! the number of words of the summary of a line in the hot tier */
+	HOT_SUMMARY_WORDS	=	HOT_SUMMARY_BITS / 64,
+	/*! the number of words of the summary of a block in the cold tier */
+	COLD_SUMMARY_WORDS	=	COLD_SUMMARY_BITS / 64,
+	/*! the bit position, in a packed line tail (see hot_tails in struct vt102_scrollback), of the number of bytes in the tail */
+	TAIL_COUNT_SHIFT	=	16,
+	/*! the multiplier of the trigram hash function (2^32 divided by the golden ratio) */
+	TRIGRAM_HASH_MULTIPLIER	=	0x9e3779b1,
+	/*! the buffer of the block discarded last is reused for a block being closed if it is at most this many times as large as the block contents */
+	SPARE_MAX_OVERSIZE	=	2,
+	/*! the buffers allocated for blocks being closed have room for 1 / 2 ^ BLOCK_HEADROOM_SHIFT more than the block contents */
+	BLOCK_HEADROOM_SHIFT	=	3,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! a block of compressed lines in the cold tier */
+struct scrollback_block
+{
+	/*! the number of lines stored in this block */
+	int nr_lines;
+	/*! the number of bytes used in the data buffer below */
+	int size;
+	/*! the size of the data buffer below, if it is not the open_data buffer of struct vt102_scrollback */
+	int capacity;
+	/*! the offsets of the lines in this block in the data buffer below */
+	int line_offsets[VT102_SCROLLBACK_BLOCK_LINES];
+	/*! the trigram summary of the lines in this block */
+	uint64_t summary[COLD_SUMMARY_WORDS];
+	/*! the compressed line data; for the open block (the newest block, while
+	 * it is not full), this is the open_data buffer of struct vt102_scrollback */
+	unsigned char * data;
+};
+
+/*! a row of the history reflowed to the view width */
+struct scrollback_row
+{
+	/*! the number (see nr_lines_pushed in struct vt102_scrollback) of the line the row starts in */
+	uint32_t line_seq;
+	/*! the offset of the start of the row in that line */
+	int offset;
+};
+
+/*! the scrollback history buffer data structure */
+struct vt102_scrollback
+{
+	/*! the maximum number of lines to keep in the history
+	 *
+	 * \note	this is not an exact limit - as lines are
+	 *		discarded one block at a time, up to
+	 *		VT102_SCROLLBACK_BLOCK_LINES - 1 more lines
+	 *		may be retained */
+	int max_nr_lines;
+
+	/*
+	 * the uncompressed (hot) tier
+	 */
+	/*! the capacity of the hot tier ring, in lines */
+	int nr_hot_slots;
+	/*! the width of a line slot in the hot tier ring, in characters */
+	int hot_slot_width;
+	/*! the index of the slot in the hot tier ring where the next line will be stored */
+	int hot_head;
+	/*! the number of lines currently stored in the hot tier */
+	int nr_hot_lines;
+	/*! the character codes of the lines in the hot tier ring, hot_slot_width bytes per line */
+	unsigned char * hot_chbuf;
+	/*! the graphics rendition attributes of the lines in the hot tier ring, hot_slot_width words per line */
+	uint32_t * hot_grbuf;
+	/*! the widths of the (trimmed) lines in the hot tier ring, along with their LINE_WRAPPED flags */
+	int * hot_widths;
+	/*! the trigram summaries of the lines in the hot tier ring, HOT_SUMMARY_WORDS words per line */
+	uint64_t * hot_summaries;
+	/*! the tails of the lines in the hot tier ring
+	 *
+	 * for each line, the last (up to) two character code bytes
+	 * of the logical line before the line, if the line continues a
+	 * logical line, packed as: bits [0:7] - the last byte, bits [8:15] -
+	 * the byte before it, bits [16:17] the number of bytes (zero to two,
+	 * see TAIL_COUNT_SHIFT); the bytes are folded with fold_char() */
+	int * hot_tails;
+
+	/*
+	 * the compressed (cold) tier
+	 */
+	/*! a circular buffer of pointers to the cold tier blocks, oldest block first */
+	struct scrollback_block ** blocks;
+	/*! the size of the blocks buffer above */
+	int blocks_capacity;
+	/*! the index in the blocks buffer above of the oldest block */
+	int first_block;
+	/*! the number of blocks in the cold tier */
+	int nr_blocks;
+	/*! the number of lines currently stored in the cold tier */
+	int nr_cold_lines;
+	/*! the buffer the lines of the open block are compressed into, see the comments at the start of this file */
+	unsigned char * open_data;
+	/*! the size of the open_data buffer above */
+	int open_capacity;
+	/*! the block discarded last, along with its data buffer (which may be
+	 * null), kept for reuse when the open block is closed; null if none */
+	struct scrollback_block * spare_block;
+
+	/*! scratch buffers, used when decompressing lines, for the character codes and for the attributes of a line */
+	unsigned char * scratch_chbuf;
+	uint32_t * scratch_grbuf;
+	/*! the width of the lines the scratch buffers above can hold */
+	int scratch_size;
+
+	/*
+	 * the view of the history reflowed to a given width
+	 */
+	/*! the number of lines ever stored (modulo 2^32), less the ones removed by
+	 * vt102_scrollback_pop_line() - so that line number zero was numbered
+	 * nr_lines_pushed - 1, line number one - nr_lines_pushed - 2, and so on */
+	uint32_t nr_lines_pushed;
+	/*! the width the history is reflowed to, zero if no view width has been set */
+	int view_width;
+	/*! set when the row index below is up to date */
+	bool view_valid;
+	/*! the offset in its logical line of the start of the next line to be stored;
+	 * zero if the line starts a new logical line */
+	int view_pos;
+	/*! a circular buffer holding the rows of the reflowed history, oldest row first */
+	struct scrollback_row * rows;
+	/*! the size of the rows buffer above */
+	int rows_capacity;
+	/*! the index in the rows buffer above of the oldest row */
+	int first_row;
+	/*! the number of rows in the reflowed history */
+	int nr_rows;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static int trimmed_width(const unsigned char * chrow, const uint32_t * grrow, int width)
+ *	\brief	returns the width of a line, with the trailing blank characters removed
+ *
+ *	\param	chrow	the character codes of the line
+ *	\param	grrow	the graphics rendition attributes of the line
+ *	\param	width	the width of the line
+ *	\return	the width of the line, not counting any trailing
+ *		spaces with default graphics rendition attributes */
+static int trimmed_width(const unsigned char * chrow, const uint32_t * grrow, int width)
+{
+	while (width > 0 && chrow[width - 1] == ' ' && grrow[width - 1] == 0)
+		width--;
+	return width;
+}
+
+/*!
+ *	\fn	static inline unsigned char fold_char(unsigned char c)
+ *	\brief	folds ascii letters to lower case, for computing trigram hashes
+ *
+ *	\param	c	a character code byte
+ *	\return	the byte folded */
+static inline unsigned char fold_char(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + 'a' - 'A' : c;
+}
+
+/*!
+ *	\fn	static void summarize(int tail, const unsigned char * chrow, int width, uint64_t * summary, int nr_hash_bits)
+ *	\brief	adds the trigrams of a line to a summary
+ *
+ *	\param	tail	the tail of the logical line before the line
+ *			(see hot_tails in struct vt102_scrollback)
+ *	\param	chrow	the character codes of the line
+ *	\param	width	the width of the line
+ *	\param	summary	the summary to add the trigrams to
+ *	\param	nr_hash_bits	the number of bits of the trigram hashes
+ *				selecting a bit of the summary
+ *	\return	none */
+static void summarize(int tail, const unsigned char * chrow, int width, uint64_t * summary, int nr_hash_bits)
+{
+uint32_t v, h;
+int x, n;
+
+	n = tail >> TAIL_COUNT_SHIFT;
+	v = tail;
+	for (x = 0; x < width; x++)
+	{
+		v = v << 8 | fold_char(chrow[x]);
+		if (++ n >= 3)
+		{
+			h = (v & 0xffffff) * TRIGRAM_HASH_MULTIPLIER >> (32 - nr_hash_bits);
+			summary[h / 64] |= 1ull << h % 64;
+		}
+	}
+}
+
+/*!
+ *	\fn	static int rle_encode(const unsigned char * src, int n, unsigned char * dst)
+ *	\brief	run-length encodes a buffer
+ *
+ *	\param	src	the data to encode
+ *	\param	n	the number of bytes to encode
+ *	\param	dst	the buffer where to store the encoded data; this must
+ *			be at least n + n / RLE_MAX_LITERALS + 1 bytes large
+ *	\return	the number of bytes stored in the dst buffer */
+static int rle_encode(const unsigned char * src, int n, unsigned char * dst)
+{
+int i, o, run, start;
+
+	for (i = o = 0; i < n; )
+	{
+		for (run = 1; i + run < n && src[i + run] == src[i] && run < RLE_MAX_RUN; run++)
+			;
+		if (run >= RLE_MIN_RUN)
+		{
+			dst[o++] = run + 125;
+			dst[o++] = src[i];
+			i += run;
+			continue;
+		}
+		/* gather literal bytes, until the start of a run */
+		for (start = i; i < n && i - start < RLE_MAX_LITERALS; i++)
+		{
+			for (run = 1; i + run < n && src[i + run] == src[i] && run < RLE_MIN_RUN; run++)
+				;
+			if (run >= RLE_MIN_RUN)
+				break;
+		}
+		dst[o++] = i - start - 1;
+		memcpy(dst + o, src + start, i - start);
+		o += i - start;
+	}
+	return o;
+}
+
+/*!
+ *	\fn	static const unsigned char * rle_decode(const unsigned char * src, unsigned char * dst, int n)
+ *	\brief	decodes run-length encoded data
+ *
+ *	\param	src	the encoded data
+ *	\param	dst	the buffer where to store the decoded data
+ *	\param	n	the number of bytes to decode
+ *	\return	a pointer to the first byte in the src buffer past
+ *		the encoded data processed */
+static const unsigned char * rle_decode(const unsigned char * src, unsigned char * dst, int n)
+{
+int o, len;
+unsigned char c;
+
+	for (o = 0; o < n; o += len)
+	{
+		c = * src ++;
+		if (c < 128)
+		{
+			len = c + 1;
+			memcpy(dst + o, src, len);
+			src += len;
+		}
+		else
+		{
+			len = c - 125;
+			memset(dst + o, * src ++, len);
+		}
+	}
+	return src;
+}
+
+/*!
+ *	\fn	static int rle_encode_attrs(const uint32_t * src, int n, unsigned char * dst)
+ *	\brief	run-length encodes a buffer of graphics rendition attribute words
+ *
+ *	\param	src	the attribute words to encode
+ *	\param	n	the number of attribute words to encode
+ *	\param	dst	the buffer where to store the encoded data; this must
+ *			be at least n * sizeof * src + n / RLE_MAX_LITERALS + 1
+ *			bytes large
+ *	\return	the number of bytes stored in the dst buffer */
+static int rle_encode_attrs(const uint32_t * src, int n, unsigned char * dst)
+{
+int i, o, run, start;
+
+	for (i = o = 0; i < n; )
+	{
+		for (run = 1; i + run < n && src[i + run] == src[i] && run < RLE_MAX_RUN; run++)
+			;
+		if (run >= RLE_MIN_RUN)
+		{
+			dst[o++] = run + 125;
+			memcpy(dst + o, src + i, sizeof * src);
+			o += sizeof * src;
+			i += run;
+			continue;
+		}
+		/* gather literal words, until the start of a run */
+		for (start = i; i < n && i - start < RLE_MAX_LITERALS; i++)
+		{
+			for (run = 1; i + run < n && src[i + run] == src[i] && run < RLE_MIN_RUN; run++)
+				;
+			if (run >= RLE_MIN_RUN)
+				break;
+		}
+		dst[o++] = i - start - 1;
+		memcpy(dst + o, src + start, (i - start) * sizeof * src);
+		o += (i - start) * sizeof * src;
+	}
+	return o;
+}
+
+/*!
+ *	\fn	static const unsigned char * rle_decode_attrs(const unsigned char * src, uint32_t * dst, int n)
+ *	\brief	decodes run-length encoded graphics rendition attribute words
+ *
+ *	\param	src	the encoded data
+ *	\param	dst	the buffer where to store the decoded attribute words
+ *	\param	n	the number of attribute words to decode
+ *	\return	a pointer to the first byte in the src buffer past
+ *		the encoded data processed */
+static const unsigned char * rle_decode_attrs(const unsigned char * src, uint32_t * dst, int n)
+{
+int o, len, i;
+unsigned char c;
+uint32_t attr;
+
+	for (o = 0; o < n; o += len)
+	{
+		c = * src ++;
+		if (c < 128)
+		{
+			len = c + 1;
+			memcpy(dst + o, src, len * sizeof * dst);
+			src += len * sizeof * dst;
+		}
+		else
+		{
+			len = c - 125;
+			memcpy(&attr, src, sizeof attr);
+			src += sizeof attr;
+			for (i = 0; i < len; i++)
+				dst[o + i] = attr;
+		}
+	}
+	return src;
+}
+
+/*!
+ *	\fn	static bool grow_hot_slots(struct vt102_scrollback * sb, int width)
+ *	\brief	enlarges the line slots in the hot tier ring, so that lines of the width requested fit in them
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	width	the new line slot width
+ *	\return	true on success, false on failure (out of memory) */
+static bool grow_hot_slots(struct vt102_scrollback * sb, int width)
+{
+unsigned char * chbuf;
+uint32_t * grbuf;
+int i;
+
+	chbuf = malloc(sb->nr_hot_slots * width);
+	grbuf = malloc(sb->nr_hot_slots * width * sizeof * grbuf);
+	if (!chbuf || !grbuf)
+	{
+		free(chbuf);
+		free(grbuf);
+		return false;
+	}
+	for (i = 0; sb->hot_slot_width && i < sb->nr_hot_slots; i++)
+	{
+		memcpy(chbuf + i * width, sb->hot_chbuf + i * sb->hot_slot_width, sb->hot_slot_width);
+		memcpy(grbuf + i * width, sb->hot_grbuf + i * sb->hot_slot_width, sb->hot_slot_width * sizeof * grbuf);
+	}
+	free(sb->hot_chbuf);
+	free(sb->hot_grbuf);
+	sb->hot_chbuf = chbuf;
+	sb->hot_grbuf = grbuf;
+	sb->hot_slot_width = width;
+	return true;
+}
+
+/*!
+ *	\fn	static bool grow_scratch(struct vt102_scrollback * sb, int width)
+ *	\brief	enlarges the scratch buffers, if necessary, so that lines of the width requested fit in them
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	width	the line width needed
+ *	\return	true on success, false on failure (out of memory) */
+static bool grow_scratch(struct vt102_scrollback * sb, int width)
+{
+void * p;
+
+	/* the buffers are allocated even for blank lines, so that
+	 * the lines fetched into them are never null pointers */
+	if (!width)
+		width = 1;
+	if (width <= sb->scratch_size)
+		return true;
+	if (!(p = realloc(sb->scratch_chbuf, width)))
+		return false;
+	sb->scratch_chbuf = p;
+	if (!(p = realloc(sb->scratch_grbuf, width * sizeof * sb->scratch_grbuf)))
+		return false;
+	sb->scratch_grbuf = p;
+	sb->scratch_size = width;
+	return true;
+}
+
+/*!
+ *	\fn	static struct scrollback_block * get_block(struct vt102_scrollback * sb, int idx)
+ *	\brief	returns a block of the cold tier
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	idx	the number of the block to return, the oldest
+ *			block being block number zero
+ *	\return	a pointer to the block requested */
+static struct scrollback_block * get_block(struct vt102_scrollback * sb, int idx)
+{
+	return sb->blocks[(sb->first_block + idx) % sb->blocks_capacity];
+}
+
+/*!
+ *	\fn	static void release_block(struct vt102_scrollback * sb, struct scrollback_block * b)
+ *	\brief	releases a block removed from the cold tier, keeping it for reuse if there is no spare block yet
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	b	the block to release
+ *	\return	none */
+static void release_block(struct vt102_scrollback * sb, struct scrollback_block * b)
+{
+	if (b->data == sb->open_data)
+	{
+		/* the open_data buffer is not owned by the block */
+		b->data = 0;
+		b->capacity = 0;
+	}
+	if (!sb->spare_block)
+		sb->spare_block = b;
+	else
+	{
+		free(b->data);
+		free(b);
+	}
+}
+
+/*!
+ *	\fn	static bool grow_open_data(struct vt102_scrollback * sb, struct scrollback_block * b, int size)
+ *	\brief	makes sure the open_data buffer is at least of a given size
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	b	the open block, its data pointer is updated
+ *	\param	size	the size requested
+ *	\return	true on success, false on failure (out of memory) */
+static bool grow_open_data(struct vt102_scrollback * sb, struct scrollback_block * b, int size)
+{
+unsigned char * p;
+int capacity;
+
+	if (size <= sb->open_capacity)
+		return true;
+	capacity = sb->open_capacity ? 2 * sb->open_capacity : 1024;
+	while (capacity < size)
+		capacity *= 2;
+	if (!(p = realloc(sb->open_data, capacity)))
+		return false;
+	sb->open_data = b->data = p;
+	sb->open_capacity = capacity;
+	return true;
+}
+
+/*!
+ *	\fn	static bool close_block(struct vt102_scrollback * sb, struct scrollback_block * b)
+ *	\brief	copies the contents of the open block out of the open_data buffer, to a buffer of their own
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	b	the block to close; nothing is done if it
+ *			is not the open block
+ *	\return	true on success, false on failure (out of memory) */
+static bool close_block(struct vt102_scrollback * sb, struct scrollback_block * b)
+{
+struct scrollback_block * spare;
+unsigned char * p;
+int capacity;
+
+	if (b->data != sb->open_data)
+		return true;
+	spare = sb->spare_block;
+	if (spare && spare->data && spare->capacity >= b->size
+			&& spare->capacity <= b->size * SPARE_MAX_OVERSIZE)
+	{
+		p = spare->data;
+		capacity = spare->capacity;
+	}
+	else
+	{
+		capacity = b->size + (b->size >> BLOCK_HEADROOM_SHIFT);
+		if (!(p = realloc(spare ? spare->data : 0, capacity)))
+			return false;
+	}
+	if (spare)
+	{
+		spare->data = 0;
+		spare->capacity = 0;
+	}
+	memcpy(p, b->data, b->size);
+	b->data = p;
+	b->capacity = capacity;
+	return true;
+}
+
+/*!
+ *	\fn	static void drop_oldest_block(struct vt102_scrollback * sb)
+ *	\brief	discards the oldest block of the cold tier
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	none */
+static void drop_oldest_block(struct vt102_scrollback * sb)
+{
+struct scrollback_block * b;
+
+	b = get_block(sb, 0);
+	sb->nr_cold_lines -= b->nr_lines;
+	release_block(sb, b);
+	sb->first_block = (sb->first_block + 1) % sb->blocks_capacity;
+	sb->nr_blocks--;
+}
+
+/*!
+ *	\fn	static struct scrollback_block * get_open_block(struct vt102_scrollback * sb)
+ *	\brief	returns the newest block in the cold tier, creating a new one if the newest block is full
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	a pointer to a block which has room for at least
+ *		one more line, and whose data buffer is the open_data
+ *		buffer, or null on failure (out of memory) */
+static struct scrollback_block * get_open_block(struct vt102_scrollback * sb)
+{
+struct scrollback_block * b, ** blocks;
+unsigned char * data;
+int i, capacity;
+
+	if (sb->nr_blocks && (b = get_block(sb, sb->nr_blocks - 1))->nr_lines < VT102_SCROLLBACK_BLOCK_LINES)
+	{
+		if (b->data == sb->open_data)
+			return b;
+		/* the block has been closed, and lines have been removed
+		 * from it since (see vt102_scrollback_pop_line()) - open
+		 * it again, handing its data buffer over for reuse */
+		data = b->data;
+		if (!grow_open_data(sb, b, b->size))
+			return 0;
+		memcpy(sb->open_data, data, b->size);
+		if (sb->spare_block && !sb->spare_block->data)
+		{
+			sb->spare_block->data = data;
+			sb->spare_block->capacity = b->capacity;
+		}
+		else
+			free(data);
+		b->data = sb->open_data;
+		return b;
+	}
+	/* the newest block is full - close it */
+	if (sb->nr_blocks && !close_block(sb, get_block(sb, sb->nr_blocks - 1)))
+		return 0;
+	if (sb->nr_blocks == sb->blocks_capacity)
+	{
+		/* grow the block pointer buffer, unwrapping it */
+		capacity = sb->blocks_capacity ? 2 * sb->blocks_capacity : 16;
+		if (!(blocks = malloc(capacity * sizeof * blocks)))
+			return 0;
+		for (i = 0; i < sb->nr_blocks; i++)
+			blocks[i] = get_block(sb, i);
+		free(sb->blocks);
+		sb->blocks = blocks;
+		sb->blocks_capacity = capacity;
+		sb->first_block = 0;
+	}
+	if ((b = sb->spare_block))
+	{
+		sb->spare_block = 0;
+		free(b->data);
+		memset(b, 0, sizeof * b);
+	}
+	else if (!(b = calloc(1, sizeof * b)))
+		return 0;
+	b->data = sb->open_data;
+	sb->blocks[(sb->first_block + sb->nr_blocks) % sb->blocks_capacity] = b;
+	sb->nr_blocks++;
+	return b;
+}
+
+/*!
+ *	\fn	static bool compress_line(struct vt102_scrollback * sb, const unsigned char * chrow, const uint32_t * grrow, int info, int tail)
+ *	\brief	compresses a line and appends it to the cold tier
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	chrow	the character codes of the line
+ *	\param	grrow	the graphics rendition attributes of the line
+ *	\param	info	the (trimmed) width of the line, along with
+ *			its LINE_WRAPPED flag
+ *	\param	tail	the tail of the logical line before the line
+ *			(see hot_tails in struct vt102_scrollback)
+ *	\return	true on success, false on failure (out of memory) */
+static bool compress_line(struct vt102_scrollback * sb, const unsigned char * chrow, const uint32_t * grrow, int info, int tail)
+{
+struct scrollback_block * b;
+unsigned char * p;
+int n, width;
+
+	width = info & MAX_LINE_WIDTH;
+	if (!(b = get_open_block(sb)))
+		return false;
+	/* make sure the worst case encoding fits in the block - and
+	 * that of the lines still to come, if they are as wide */
+	n = 2 + (width + width / RLE_MAX_LITERALS + 1)
+		+ (width * sizeof * grrow + width / RLE_MAX_LITERALS + 1);
+	if (!grow_open_data(sb, b, b->size + n * (VT102_SCROLLBACK_BLOCK_LINES - b->nr_lines)))
+		return false;
+	p = b->data + b->size;
+	b->line_offsets[b->nr_lines] = b->size;
+	* p ++ = info;
+	* p ++ = info >> 8;
+	p += rle_encode(chrow, width, p);
+	p += rle_encode_attrs(grrow, width, p);
+	b->size = p - b->data;
+	b->nr_lines++;
+	summarize(tail, chrow, width, b->summary, COLD_SUMMARY_HASH_BITS);
+	sb->nr_cold_lines++;
+
+	/* discard the oldest lines, if there are too many lines */
+	while (sb->nr_blocks > 1 && sb->nr_hot_lines + sb->nr_cold_lines - get_block(sb, 0)->nr_lines >= sb->max_nr_lines)
+		drop_oldest_block(sb);
+	return true;
+}
+
+/*!
+ *	\fn	static const unsigned char * get_cold_line(struct vt102_scrollback * sb, int line_nr)
+ *	\brief	locates a line of the cold tier
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line in the history (see
+ *			vt102_scrollback_get_line()), which must be a
+ *			line of the cold tier
+ *	\return	a pointer to the stored line */
+static const unsigned char * get_cold_line(struct vt102_scrollback * sb, int line_nr)
+{
+struct scrollback_block * b;
+
+	/* convert to a line number in the cold tier, counting from the oldest line */
+	line_nr = sb->nr_cold_lines - 1 - (line_nr - sb->nr_hot_lines);
+	/* all blocks, except the newest one, are full */
+	b = get_block(sb, line_nr / VT102_SCROLLBACK_BLOCK_LINES);
+	return b->data + b->line_offsets[line_nr % VT102_SCROLLBACK_BLOCK_LINES];
+}
+
+/*!
+ *	\fn	static int get_line_info(struct vt102_scrollback * sb, int line_nr)
+ *	\brief	returns the width, and the LINE_WRAPPED flag, of a line, without retrieving the line
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line (see vt102_scrollback_get_line()),
+ *			which must exist
+ *	\return	the (trimmed) width of the line, along with its
+ *		LINE_WRAPPED flag */
+static int get_line_info(struct vt102_scrollback * sb, int line_nr)
+{
+const unsigned char * src;
+
+	if (line_nr < sb->nr_hot_lines)
+		return sb->hot_widths[(sb->hot_head - 1 - line_nr + sb->nr_hot_slots) % sb->nr_hot_slots];
+	src = get_cold_line(sb, line_nr);
+	return src[0] | (src[1] << 8);
+}
+
+/*!
+ *	\fn	static int fetch_line(struct vt102_scrollback * sb, int line_nr, const unsigned char ** ch, const uint32_t ** gr)
+ *	\brief	retrieves a line, decompressing it if necessary
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line (see vt102_scrollback_get_line()),
+ *			which must exist
+ *	\param	ch	where to store a pointer to the character codes
+ *			of the line
+ *	\param	gr	where to store a pointer to the graphics rendition
+ *			attributes of the line; the buffers pointed to
+ *			are only valid until the next line is retrieved
+ *	\return	the (trimmed) width of the line, along with its
+ *		LINE_WRAPPED flag, or -1 on failure (out of memory) */
+static int fetch_line(struct vt102_scrollback * sb, int line_nr, const unsigned char ** ch, const uint32_t ** gr)
+{
+const unsigned char * src;
+int slot, info, w;
+
+	if (line_nr < sb->nr_hot_lines)
+	{
+		slot = (sb->hot_head - 1 - line_nr + sb->nr_hot_slots) % sb->nr_hot_slots;
+		* ch = sb->hot_chbuf + slot * sb->hot_slot_width;
+		* gr = sb->hot_grbuf + slot * sb->hot_slot_width;
+		return sb->hot_widths[slot];
+	}
+	src = get_cold_line(sb, line_nr);
+	info = src[0] | (src[1] << 8);
+	w = info & MAX_LINE_WIDTH;
+	if (!grow_scratch(sb, w))
+		return -1;
+	src = rle_decode(src + 2, sb->scratch_chbuf, w);
+	rle_decode_attrs(src, sb->scratch_grbuf, w);
+	* ch = sb->scratch_chbuf;
+	* gr = sb->scratch_grbuf;
+	return info;
+}
+
+/*!
+ *	\fn	static int get_tail(struct vt102_scrollback * sb)
+ *	\brief	returns the tail of the logical line the most recently stored line is part of, for a line about to be stored
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	the last (up to) two character code bytes of the logical
+ *		line which the next line to be stored continues, packed as
+ *		in hot_tails in struct vt102_scrollback; no bytes, if the
+ *		next line starts a new logical line */
+static int get_tail(struct vt102_scrollback * sb)
+{
+const unsigned char * ch;
+const uint32_t * gr;
+int line_nr, info, w, n, tail;
+
+	tail = n = 0;
+	/* lines are normally wrapped at the screen width, so that
+	 * this only ever looks at more than a single line if the
+	 * lines are less than two characters wide */
+	for (line_nr = 0; n < 2 && line_nr < sb->nr_hot_lines + sb->nr_cold_lines; line_nr++)
+	{
+		if (!(get_line_info(sb, line_nr) & LINE_WRAPPED)
+				|| (info = fetch_line(sb, line_nr, &ch, &gr)) == -1)
+			break;
+		for (w = info & MAX_LINE_WIDTH; n < 2 && w; n++)
+			tail |= fold_char(ch[-- w]) << 8 * n;
+	}
+	return tail | n << TAIL_COUNT_SHIFT;
+}
+
+/*!
+ *	\fn	static bool view_add_row(struct vt102_scrollback * sb, uint32_t line_seq, int offset)
+ *	\brief	appends a row to the reflowed history row index
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_seq	the number of the line the row starts in
+ *				(see nr_lines_pushed in struct vt102_scrollback)
+ *	\param	offset	the offset of the start of the row in that line
+ *	\return	true on success, false on failure (out of memory) */
+static inline bool view_add_row(struct vt102_scrollback * sb, uint32_t line_seq, int offset)
+{
+struct scrollback_row * rows;
+int i, capacity;
+
+	if (sb->nr_rows == sb->rows_capacity)
+	{
+		/* grow the row index, unwrapping it */
+		capacity = sb->rows_capacity ? 2 * sb->rows_capacity : 1024;
+		if (!(rows = malloc(capacity * sizeof * rows)))
+			return false;
+		for (i = 0; i < sb->nr_rows; i++)
+			rows[i] = sb->rows[(sb->first_row + i) % sb->rows_capacity];
+		free(sb->rows);
+		sb->rows = rows;
+		sb->rows_capacity = capacity;
+		sb->first_row = 0;
+	}
+	if ((i = sb->first_row + sb->nr_rows) >= sb->rows_capacity)
+		i -= sb->rows_capacity;
+	sb->rows[i].line_seq = line_seq;
+	sb->rows[i].offset = offset;
+	sb->nr_rows++;
+	return true;
+}
+
+/*!
+ *	\fn	static bool view_add_line(struct vt102_scrollback * sb, uint32_t line_seq, int info)
+ *	\brief	appends the rows starting in a line to the reflowed history row index
+ *
+ *	the rows start at the multiples of the view width, counting
+ *	from the start of the logical line the line is part of; an
+ *	empty logical line takes a single row
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_seq	the number of the line (see nr_lines_pushed
+ *				in struct vt102_scrollback)
+ *	\param	info	the width of the line, along with its LINE_WRAPPED flag
+ *	\return	true on success, false on failure (out of memory) */
+static bool view_add_line(struct vt102_scrollback * sb, uint32_t line_seq, int info)
+{
+int w, start;
+
+	w = info & MAX_LINE_WIDTH;
+	if (!sb->view_pos && !w && !view_add_row(sb, line_seq, 0))
+		return false;
+	for (start = (sb->view_pos + sb->view_width - 1) / sb->view_width * sb->view_width;
+			start < sb->view_pos + w; start += sb->view_width)
+		if (!view_add_row(sb, line_seq, start - sb->view_pos))
+			return false;
+	sb->view_pos = (info & LINE_WRAPPED) ? sb->view_pos + w : 0;
+	return true;
+}
+
+/*!
+ *	\fn	static void view_drop_discarded_rows(struct vt102_scrollback * sb)
+ *	\brief	removes the rows of the lines no longer in the history from the reflowed history row index
+ *
+ *	if the oldest line retained continues a logical line whose
+ *	start has been discarded, and the rows of the line do not
+ *	start at the start of the line, the row index is invalidated
+ *	instead - so that it is rebuilt (taking the oldest line to
+ *	start a logical line) when next needed
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	none */
+static void view_drop_discarded_rows(struct vt102_scrollback * sb)
+{
+uint32_t oldest_seq;
+
+	oldest_seq = sb->nr_lines_pushed - (sb->nr_hot_lines + sb->nr_cold_lines);
+	/* the line numbers wrap around, compare their difference instead */
+	while (sb->nr_rows && (int32_t) (sb->rows[sb->first_row].line_seq - oldest_seq) < 0)
+	{
+		sb->first_row = (sb->first_row + 1) % sb->rows_capacity;
+		sb->nr_rows--;
+	}
+	if (!sb->nr_rows || sb->rows[sb->first_row].line_seq != oldest_seq || sb->rows[sb->first_row].offset)
+		sb->view_valid = false;
+}
+
+/*!
+ *	\fn	static bool view_build(struct vt102_scrollback * sb)
+ *	\brief	builds the reflowed history row index, if it is not up to date
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	true on success, false on failure (out of memory, or
+ *		no view width has been set) */
+static bool view_build(struct vt102_scrollback * sb)
+{
+struct scrollback_block * b;
+const unsigned char * src;
+uint32_t line_seq;
+int i, j;
+
+	if (sb->view_valid)
+		return true;
+	if (sb->view_width <= 0)
+		return false;
+	sb->first_row = sb->nr_rows = sb->view_pos = 0;
+	/* a single pass over the line widths, oldest line first */
+	line_seq = sb->nr_lines_pushed - (sb->nr_hot_lines + sb->nr_cold_lines);
+	for (i = 0; i < sb->nr_blocks; i++)
+		for (b = get_block(sb, i), j = 0; j < b->nr_lines; j++, line_seq++)
+		{
+			src = b->data + b->line_offsets[j];
+			if (!view_add_line(sb, line_seq, src[0] | (src[1] << 8)))
+				return false;
+		}
+	for (i = sb->nr_hot_lines - 1; i >= 0; i--, line_seq++)
+		if (!view_add_line(sb, line_seq, get_line_info(sb, i)))
+			return false;
+	sb->view_valid = true;
+	return true;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_scrollback * vt102_scrollback_create(int nr_hot_lines, int max_nr_lines)
+ *	\brief	creates a new, empty, scrollback history buffer
+ *
+ *	\param	nr_hot_lines	the number of most recent lines to keep
+ *				uncompressed; if this is zero or negative,
+ *				VT102_SCROLLBACK_DEFAULT_HOT_LINES is used
+ *	\param	max_nr_lines	the (approximate) maximum number of lines
+ *				to keep in the history, including the
+ *				uncompressed ones; must be positive
+ *	\return	a pointer to the new scrollback buffer, or null on error */
+struct vt102_scrollback * vt102_scrollback_create(int nr_hot_lines, int max_nr_lines)
+{
+struct vt102_scrollback * sb;
+
+	if (max_nr_lines <= 0)
+		return 0;
+	if (nr_hot_lines <= 0)
+		nr_hot_lines = VT102_SCROLLBACK_DEFAULT_HOT_LINES;
+	if (nr_hot_lines > max_nr_lines)
+		nr_hot_lines = max_nr_lines;
+	if (!(sb = calloc(1, sizeof * sb)))
+		return 0;
+	sb->max_nr_lines = max_nr_lines;
+	sb->nr_hot_slots = nr_hot_lines;
+	sb->hot_widths = calloc(nr_hot_lines, sizeof * sb->hot_widths);
+	sb->hot_summaries = calloc(nr_hot_lines * HOT_SUMMARY_WORDS, sizeof * sb->hot_summaries);
+	sb->hot_tails = calloc(nr_hot_lines, sizeof * sb->hot_tails);
+	if (!sb->hot_widths || !sb->hot_summaries || !sb->hot_tails)
+	{
+		free(sb->hot_widths);
+		free(sb->hot_summaries);
+		free(sb->hot_tails);
+		free(sb);
+		return 0;
+	}
+	return sb;
+}
+
+/*!
+ *	\fn	void vt102_scrollback_destroy(struct vt102_scrollback * sb)
+ *	\brief	destroys a scrollback history buffer, releasing all memory used by it
+ *
+ *	\param	sb	the scrollback buffer to destroy
+ *	\return	none */
+void vt102_scrollback_destroy(struct vt102_scrollback * sb)
+{
+	while (sb->nr_blocks)
+		drop_oldest_block(sb);
+	if (sb->spare_block)
+	{
+		free(sb->spare_block->data);
+		free(sb->spare_block);
+	}
+	free(sb->open_data);
+	free(sb->blocks);
+	free(sb->hot_chbuf);
+	free(sb->hot_grbuf);
+	free(sb->hot_widths);
+	free(sb->hot_summaries);
+	free(sb->hot_tails);
+	free(sb->scratch_chbuf);
+	free(sb->scratch_grbuf);
+	free(sb->rows);
+	free(sb);
+}
+
+/*!
+ *	\fn	bool vt102_scrollback_push_line(struct vt102_scrollback * sb, const unsigned char * chrow, const uint32_t * grrow, int width, bool wrapped)
+ *	\brief	appends a line to a scrollback history buffer
+ *
+ *	the line becomes line number zero in the history; if the
+ *	uncompressed (hot) tier is full, its oldest line is compressed
+ *	and moved to the compressed (cold) tier
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	chrow	the character codes of the line
+ *	\param	grrow	the graphics rendition attributes of the line
+ *	\param	width	the width of the line; lines wider than
+ *			32767 characters are truncated
+ *	\param	wrapped	true if the line wraps onto the next line
+ *			stored, i.e. both are parts of the same logical
+ *			line; such lines are stored untrimmed
+ *	\return	true on success, false on failure (out of memory);
+ *		on failure, the line (or the oldest line, if it was
+ *		being moved to the cold tier) is lost */
+bool vt102_scrollback_push_line(struct vt102_scrollback * sb, const unsigned char * chrow, const uint32_t * grrow, int width, bool wrapped)
+{
+int slot, oldest, tail;
+bool result;
+
+	if (width > MAX_LINE_WIDTH)
+		width = MAX_LINE_WIDTH;
+	if (!wrapped)
+		width = trimmed_width(chrow, grrow, width);
+	/* the hot tier buffers are allocated with the first line
+	 * pushed - even if it is blank, so that they are never null */
+	if ((width > sb->hot_slot_width || !sb->hot_slot_width)
+			&& !grow_hot_slots(sb, width ? width : 1))
+	{
+		sb->view_valid = false;
+		return false;
+	}
+
+	result = true;
+	tail = get_tail(sb);
+	slot = sb->hot_head;
+	if (sb->nr_hot_lines == sb->nr_hot_slots)
+	{
+		/* the hot tier is full - move its oldest line (which
+		 * is in the slot about to be reused) to the cold tier;
+		 * if the hot tier can hold all of the lines requested,
+		 * the oldest line is simply discarded */
+		oldest = slot;
+		if (sb->max_nr_lines > sb->nr_hot_slots)
+			result = compress_line(sb, sb->hot_chbuf + oldest * sb->hot_slot_width,
+					sb->hot_grbuf + oldest * sb->hot_slot_width,
+					sb->hot_widths[oldest], sb->hot_tails[oldest]);
+	}
+	else
+		sb->nr_hot_lines++;
+
+	memcpy(sb->hot_chbuf + slot * sb->hot_slot_width, chrow, width);
+	memcpy(sb->hot_grbuf + slot * sb->hot_slot_width, grrow, width * sizeof * grrow);
+	sb->hot_widths[slot] = width | (wrapped ? LINE_WRAPPED : 0);
+	sb->hot_tails[slot] = tail;
+	memset(sb->hot_summaries + slot * HOT_SUMMARY_WORDS, 0, HOT_SUMMARY_WORDS * sizeof * sb->hot_summaries);
+	summarize(tail, chrow, width, sb->hot_summaries + slot * HOT_SUMMARY_WORDS, HOT_SUMMARY_HASH_BITS);
+	sb->hot_head = (slot + 1) % sb->nr_hot_slots;
+
+	sb->nr_lines_pushed++;
+	/* a line lost breaks the line numbering - rebuild the row index when next needed */
+	if (sb->view_valid && (!result || !view_add_line(sb, sb->nr_lines_pushed - 1, sb->hot_widths[slot])))
+		sb->view_valid = false;
+	if (sb->view_valid)
+		view_drop_discarded_rows(sb);
+	return result;
+}
+
+/*!
+ *	\fn	bool vt102_scrollback_pop_line(struct vt102_scrollback * sb)
+ *	\brief	removes the most recently stored line from a scrollback history buffer
+ *
+ *	this is used for moving lines from the history back to the
+ *	screen, e.g. when the screen is enlarged; the line should be
+ *	retrieved (with vt102_scrollback_get_line()) before removing it
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	true if a line was removed, false if the history is empty */
+bool vt102_scrollback_pop_line(struct vt102_scrollback * sb)
+{
+struct scrollback_block * b;
+
+	if (sb->nr_hot_lines)
+	{
+		sb->hot_head = (sb->hot_head - 1 + sb->nr_hot_slots) % sb->nr_hot_slots;
+		sb->nr_hot_lines--;
+	}
+	else if (sb->nr_cold_lines)
+	{
+		b = get_block(sb, sb->nr_blocks - 1);
+		b->size = b->line_offsets[-- b->nr_lines];
+		sb->nr_cold_lines--;
+		if (!b->nr_lines)
+		{
+			release_block(sb, b);
+			sb->nr_blocks--;
+		}
+	}
+	else
+		return false;
+	sb->nr_lines_pushed--;
+	sb->view_valid = false;
+	return true;
+}
+
+/*!
+ *	\fn	int vt102_scrollback_get_nr_lines(struct vt102_scrollback * sb)
+ *	\brief	returns the number of lines stored in a scrollback history buffer
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	the number of lines stored in the scrollback buffer */
+int vt102_scrollback_get_nr_lines(struct vt102_scrollback * sb)
+{
+	return sb->nr_hot_lines + sb->nr_cold_lines;
+}
+
+/*!
+ *	\fn	int vt102_scrollback_get_line(struct vt102_scrollback * sb, int line_nr, unsigned char * chrow, uint32_t * grrow, int width)
+ *	\brief	retrieves a line from a scrollback history buffer
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line to retrieve, line
+ *			number zero being the most recently stored line
+ *	\param	chrow	a buffer where to store the character codes of the line
+ *	\param	grrow	a buffer where to store the graphics rendition
+ *			attributes of the line
+ *	\param	width	the size of the chrow and grrow buffers; the line
+ *			is truncated, or padded with blanks, to this width
+ *	\return	the (trimmed) width of the line stored in the scrollback
+ *		buffer, or -1 if the line requested does not exist
+ *		(or on failure - out of memory) */
+int vt102_scrollback_get_line(struct vt102_scrollback * sb, int line_nr, unsigned char * chrow, uint32_t * grrow, int width)
+{
+const unsigned char * ch;
+const uint32_t * gr;
+int w;
+
+	if (line_nr < 0 || line_nr >= sb->nr_hot_lines + sb->nr_cold_lines)
+		return -1;
+	if ((w = fetch_line(sb, line_nr, &ch, &gr)) == -1)
+		return -1;
+	w &= MAX_LINE_WIDTH;
+	if (w < width)
+	{
+		memcpy(chrow, ch, w);
+		memcpy(grrow, gr, w * sizeof * grrow);
+		memset(chrow + w, ' ', width - w);
+		memset(grrow + w, 0, (width - w) * sizeof * grrow);
+	}
+	else
+	{
+		memcpy(chrow, ch, width);
+		memcpy(grrow, gr, width * sizeof * grrow);
+	}
+	return w;
+}
+
+/*!
+ *	\fn	int vt102_scrollback_get_line_info(struct vt102_scrollback * sb, int line_nr, bool * wrapped)
+ *	\brief	returns the width of a line in a scrollback history buffer, without retrieving the line
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line (see vt102_scrollback_get_line())
+ *	\param	wrapped	where to store if the line wraps onto the next
+ *			(more recent) line; may be null
+ *	\return	the (trimmed) width of the line, or -1 if the line
+ *		requested does not exist */
+int vt102_scrollback_get_line_info(struct vt102_scrollback * sb, int line_nr, bool * wrapped)
+{
+int info;
+
+	if (line_nr < 0 || line_nr >= sb->nr_hot_lines + sb->nr_cold_lines)
+		return -1;
+	info = get_line_info(sb, line_nr);
+	if (wrapped)
+		* wrapped = info & LINE_WRAPPED;
+	return info & MAX_LINE_WIDTH;
+}
+
+/*!
+ *	\fn	int vt102_scrollback_peek_line(struct vt102_scrollback * sb, int line_nr, const unsigned char ** chrow, const uint32_t ** grrow, bool * wrapped)
+ *	\brief	retrieves a line from a scrollback history buffer, without copying it
+ *
+ *	the lines of the hot tier are not copied at all, the lines of the
+ *	cold tier are decompressed into the scratch buffers of the scrollback
+ *	buffer - this is meant for code reading through the history, such as
+ *	text extraction and searching (see vt102-text.h)
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line (see vt102_scrollback_get_line())
+ *	\param	chrow	where to store a pointer to the character codes
+ *			of the line
+ *	\param	grrow	where to store a pointer to the graphics rendition
+ *			attributes of the line; the buffers pointed to are
+ *			only valid until the next line is retrieved, or the
+ *			scrollback buffer is modified, and must not be
+ *			written to
+ *	\param	wrapped	where to store if the line wraps onto the next
+ *			(more recent) line; may be null
+ *	\return	the (trimmed) width of the line, or -1 if the line
+ *		requested does not exist (or on failure - out of memory) */
+int vt102_scrollback_peek_line(struct vt102_scrollback * sb, int line_nr, const unsigned char ** chrow, const uint32_t ** grrow, bool * wrapped)
+{
+int info;
+
+	if (line_nr < 0 || line_nr >= sb->nr_hot_lines + sb->nr_cold_lines)
+		return -1;
+	if ((info = fetch_line(sb, line_nr, chrow, grrow)) == -1)
+		return -1;
+	if (wrapped)
+		* wrapped = info & LINE_WRAPPED;
+	return info & MAX_LINE_WIDTH;
+}
+
+/*!
+ *	\fn	void vt102_scrollback_make_filter(struct vt102_scrollback_filter * filter, const unsigned char * text, int len)
+ *	\brief	prepares a search filter for a text, for vt102_scrollback_find_candidate()
+ *
+ *	\param	filter	the filter to initialize
+ *	\param	text	the character code bytes of the text searched for
+ *			(i.e. the low 8 bits of the character codes, as in
+ *			the chrow buffers); the case of the ascii letters
+ *			is ignored by the filter
+ *	\param	len	the length of the text; texts shorter than three
+ *			characters cannot be filtered, all lines are then
+ *			candidates; only the first VT102_SCROLLBACK_FILTER_TRIGRAMS
+ *			trigrams of longer texts are used
+ *	\return	none */
+void vt102_scrollback_make_filter(struct vt102_scrollback_filter * filter, const unsigned char * text, int len)
+{
+uint32_t v;
+int i;
+
+	filter->nr_trigrams = 0;
+	for (v = i = 0; i < len && filter->nr_trigrams < VT102_SCROLLBACK_FILTER_TRIGRAMS; i++)
+	{
+		v = v << 8 | fold_char(text[i]);
+		if (i >= 2)
+			filter->hashes[filter->nr_trigrams ++] = (v & 0xffffff) * TRIGRAM_HASH_MULTIPLIER;
+	}
+}
+
+/*!
+ *	\fn	int vt102_scrollback_find_candidate(struct vt102_scrollback * sb, int line_nr, const struct vt102_scrollback_filter * filter)
+ *	\brief	finds the most recent logical line, not more recent than a given line, which may contain a text
+ *
+ *	only the summaries of the lines (for the hot tier) and of the blocks
+ *	(for the cold tier) are looked at - the logical lines spanning a run
+ *	of blocks (or of lines) are skipped if the union of their summaries
+ *	lacks any of the trigrams of the text; as runs of blocks are only
+ *	joined at the lines wrapping from one block to the next, the whole
+ *	cold tier is usually skipped by looking at a single summary for each
+ *	block - so that searching a long history for a text not found in it
+ *	takes a small fraction of the time needed for decompressing it
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	line_nr	the number of the line (see vt102_scrollback_get_line())
+ *			to start looking at; this must be the most recent
+ *			line of a logical line, i.e. the line number line_nr
+ *			- 1 must not continue the line - otherwise matches of
+ *			the text spanning the more recent lines may be missed
+ *	\param	filter	the search filter, see vt102_scrollback_make_filter()
+ *	\return	the number of the most recent line of the logical line
+ *		found - the logical line may still not contain the text, and
+ *		must be searched by the caller - or -1 if none of the
+ *		logical lines, starting with the one line_nr is part of, may
+ *		contain the text */
+int vt102_scrollback_find_candidate(struct vt102_scrollback * sb, int line_nr, const struct vt102_scrollback_filter * filter)
+{
+uint64_t hot[HOT_SUMMARY_WORDS], cold[COLD_SUMMARY_WORDS];
+const uint64_t * summary;
+struct scrollback_block * b;
+uint32_t hot_bit, cold_bit;
+int i, n, next, idx, nr_lines;
+bool cold_used;
+
+	nr_lines = sb->nr_hot_lines + sb->nr_cold_lines;
+	if (line_nr < 0)
+		return -1;
+	for (; line_nr < nr_lines; line_nr = next)
+	{
+		if (!filter->nr_trigrams)
+			return line_nr;
+		memset(hot, 0, sizeof hot);
+		cold_used = false;
+		/* gather the summaries of the lines and the blocks the
+		 * logical line ending at line_nr spans, and of the logical
+		 * lines joined to it at the block boundaries */
+		for (n = line_nr; ; n = next)
+		{
+			if (n < sb->nr_hot_lines)
+			{
+				summary = sb->hot_summaries + (sb->hot_head - 1 - n + sb->nr_hot_slots) % sb->nr_hot_slots * HOT_SUMMARY_WORDS;
+				for (i = 0; i < HOT_SUMMARY_WORDS; i++)
+					hot[i] |= summary[i];
+				next = n + 1;
+			}
+			else
+			{
+				/* all blocks, except the newest one, are full */
+				idx = (sb->nr_cold_lines - 1 - (n - sb->nr_hot_lines)) / VT102_SCROLLBACK_BLOCK_LINES;
+				b = get_block(sb, idx);
+				if (!cold_used)
+					memcpy(cold, b->summary, sizeof cold);
+				else
+					for (i = 0; i < COLD_SUMMARY_WORDS; i++)
+						cold[i] |= b->summary[i];
+				cold_used = true;
+				/* the line before the oldest line of the block */
+				next = nr_lines - idx * VT102_SCROLLBACK_BLOCK_LINES;
+			}
+			if (next >= nr_lines || !(get_line_info(sb, next) & LINE_WRAPPED))
+				break;
+		}
+		for (i = 0; i < filter->nr_trigrams; i++)
+		{
+			hot_bit = filter->hashes[i] >> (32 - HOT_SUMMARY_HASH_BITS);
+			cold_bit = filter->hashes[i] >> (32 - COLD_SUMMARY_HASH_BITS);
+			if (!(hot[hot_bit / 64] & 1ull << hot_bit % 64)
+					&& !(cold_used && (cold[cold_bit / 64] & 1ull << cold_bit % 64)))
+				break;
+		}
+		if (i == filter->nr_trigrams)
+			return line_nr;
+	}
+	return -1;
+}
+
+/*!
+ *	\fn	uint32_t vt102_scrollback_get_nr_lines_pushed(struct vt102_scrollback * sb)
+ *	\brief	returns the number of lines ever stored in a scrollback history buffer, less the ones removed
+ *
+ *	this only changes when lines are stored, or removed by
+ *	vt102_scrollback_pop_line() - not when the oldest lines are
+ *	discarded - so that callers can tell how many lines have been
+ *	stored since an earlier call, e.g. for only searching through
+ *	the lines which have scrolled into the history since then
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	the number of lines ever stored, modulo 2^32 */
+uint32_t vt102_scrollback_get_nr_lines_pushed(struct vt102_scrollback * sb)
+{
+	return sb->nr_lines_pushed;
+}
+
+/*!
+ *	\fn	void vt102_scrollback_set_view_width(struct vt102_scrollback * sb, int width)
+ *	\brief	sets the width the history is reflowed to, when retrieved by rows
+ *
+ *	the history is reflowed lazily - the row index is rebuilt
+ *	(with a single pass over the widths of the lines stored) the
+ *	next time rows are requested
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	width	the width of the rows, must be positive
+ *	\return	none */
+void vt102_scrollback_set_view_width(struct vt102_scrollback * sb, int width)
+{
+	if (width == sb->view_width)
+		return;
+	sb->view_width = width;
+	sb->view_valid = false;
+}
+
+/*!
+ *	\fn	int vt102_scrollback_get_nr_rows(struct vt102_scrollback * sb)
+ *	\brief	returns the number of rows the history takes, when reflowed to the view width
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	the number of rows of the reflowed history, or -1 on
+ *		failure (out of memory, or no view width has been set) */
+int vt102_scrollback_get_nr_rows(struct vt102_scrollback * sb)
+{
+	if (!view_build(sb))
+		return -1;
+	return sb->nr_rows;
+}
+
+/*!
+ *	\fn	int vt102_scrollback_get_row(struct vt102_scrollback * sb, int row_nr, unsigned char * chrow, uint32_t * grrow)
+ *	\brief	retrieves a row of the history, reflowed to the view width
+ *
+ *	\param	sb	the scrollback buffer
+ *	\param	row_nr	the number of the row to retrieve, row number
+ *			zero being the most recent row
+ *	\param	chrow	a buffer where to store the character codes of the row
+ *	\param	grrow	a buffer where to store the graphics rendition
+ *			attributes of the row; the buffers must be at least
+ *			the view width large, the row is padded with blanks
+ *			to the view width
+ *	\return	the number of characters of the row taken from the
+ *		history, or -1 if the row requested does not exist (or
+ *		on failure - out of memory) */
+int vt102_scrollback_get_row(struct vt102_scrollback * sb, int row_nr, unsigned char * chrow, uint32_t * grrow)
+{
+const struct scrollback_row * row;
+const unsigned char * ch;
+const uint32_t * gr;
+int line_nr, offset, info, n, x;
+
+	if (!view_build(sb) || row_nr < 0 || row_nr >= sb->nr_rows)
+		return -1;
+	row = sb->rows + (sb->first_row + sb->nr_rows - 1 - row_nr) % sb->rows_capacity;
+	line_nr = sb->nr_lines_pushed - 1 - row->line_seq;
+	offset = row->offset;
+	/* gather the row from the line it starts in, and the lines it wraps onto */
+	for (x = 0; x < sb->view_width; offset = 0)
+	{
+		if ((info = fetch_line(sb, line_nr, &ch, &gr)) == -1)
+			return -1;
+		n = (info & MAX_LINE_WIDTH) - offset;
+		if (n > sb->view_width - x)
+			n = sb->view_width - x;
+		if (n > 0)
+		{
+			memcpy(chrow + x, ch + offset, n);
+			memcpy(grrow + x, gr + offset, n * sizeof * grrow);
+			x += n;
+		}
+		if (!(info & LINE_WRAPPED) || !line_nr --)
+			break;
+	}
+	memset(chrow + x, ' ', sb->view_width - x);
+	memset(grrow + x, 0, (sb->view_width - x) * sizeof * grrow);
+	return x;
+}
+
+/*!
+ *	\fn	size_t vt102_scrollback_get_memory_usage(struct vt102_scrollback * sb)
+ *	\brief	returns the (approximate) amount of memory used by a scrollback history buffer
+ *
+ *	\param	sb	the scrollback buffer
+ *	\return	the number of bytes allocated for the scrollback buffer */
+size_t vt102_scrollback_get_memory_usage(struct vt102_scrollback * sb)
+{
+size_t n;
+int i;
+
+	n = sizeof * sb
+		+ sb->nr_hot_slots * (sb->hot_slot_width * (1 + sizeof * sb->hot_grbuf) + sizeof * sb->hot_widths
+				+ HOT_SUMMARY_WORDS * sizeof * sb->hot_summaries + sizeof * sb->hot_tails)
+		+ sb->blocks_capacity * sizeof * sb->blocks
+		+ sb->scratch_size * (1 + sizeof * sb->scratch_grbuf)
+		+ sb->rows_capacity * sizeof * sb->rows
+		+ sb->open_capacity;
+	for (i = 0; i < sb->nr_blocks; i++)
+		n += sizeof * get_block(sb, i)
+			+ (get_block(sb, i)->data == sb->open_data ? 0 : get_block(sb, i)->capacity);
+	if (sb->spare_block)
+		n += sizeof * sb->spare_block + sb->spare_block->capacity;
+	return n;
+}
+
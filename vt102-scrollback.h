@@ -0,0 +1,108 @@
+/*!
+ *	\file	vt102-scrollback.h
+ *	\brief	vt102 terminal emulator scrollback history buffer header file
+ *	\author	shopov
+ *
+ *	this module maintains a history of the lines that have
+ *	been scrolled off the top of a vt102 terminal screen; the
+ *	lines are stored in the same format as the screen rows of the
+ *	generic vt102 backend (one character code byte and one graphics
+ *	rendition attribute word - see the chbuf and grbuf fields
+ *	of struct term_data in vt102-backend-generic.h - per character)
+ *
+ *	the most recent lines are kept uncompressed, in a fixed-capacity
+ *	ring (the 'hot' tier); older lines are run-length compressed,
+ *	and stored in blocks of a fixed number of lines (the 'cold'
+ *	tier); when the total number of lines exceeds the maximum
+ *	number requested, the oldest blocks are discarded
+ *
+ *	each line stored is one screen row; rows which the cursor has
+ *	auto-wrapped from onto the next row are marked as such, so that
+ *	the history can also be retrieved reflowed to another width -
+ *	by rows of the view width (see vt102_scrollback_set_view_width())
+ *	rather than by the lines stored, and so that the screen of the
+ *	generic vt102 backend can pull the lines of a logical line back
+ *	when the screen width changes (see vt102_scrollback_pop_line())
+ *
+ *	a trigram summary of the lines is maintained as they are stored,
+ *	so that searching through the history can skip the lines (and the
+ *	compressed blocks) which cannot contain the text searched for,
+ *	without retrieving them (see vt102_scrollback_find_candidate())
+ *
+ *	\note	lines are numbered starting from zero, line number
+ *		zero being the most recently stored line
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_scrollback;
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the number of lines held in each compressed block of the cold tier */
+	VT102_SCROLLBACK_BLOCK_LINES	=	64,
+	/*! a default capacity for the uncompressed (hot) tier, in lines */
+	VT102_SCROLLBACK_DEFAULT_HOT_LINES	=	1024,
+	/*! the maximum number of trigrams of a text used by a search filter */
+	VT102_SCROLLBACK_FILTER_TRIGRAMS	=	32,
+};
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! a search filter, see vt102_scrollback_make_filter() */
+struct vt102_scrollback_filter
+{
+	/*! the number of trigrams in the hashes array below */
+	int nr_trigrams;
+	/*! the hashes of the trigrams of the text searched for */
+	uint32_t hashes[VT102_SCROLLBACK_FILTER_TRIGRAMS];
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_scrollback * vt102_scrollback_create(int nr_hot_lines, int max_nr_lines);
+void vt102_scrollback_destroy(struct vt102_scrollback * sb);
+bool vt102_scrollback_push_line(struct vt102_scrollback * sb, const unsigned char * chrow, const uint32_t * grrow, int width, bool wrapped);
+bool vt102_scrollback_pop_line(struct vt102_scrollback * sb);
+int vt102_scrollback_get_nr_lines(struct vt102_scrollback * sb);
+int vt102_scrollback_get_line(struct vt102_scrollback * sb, int line_nr, unsigned char * chrow, uint32_t * grrow, int width);
+int vt102_scrollback_get_line_info(struct vt102_scrollback * sb, int line_nr, bool * wrapped);
+int vt102_scrollback_peek_line(struct vt102_scrollback * sb, int line_nr, const unsigned char ** chrow, const uint32_t ** grrow, bool * wrapped);
+void vt102_scrollback_make_filter(struct vt102_scrollback_filter * filter, const unsigned char * text, int len);
+int vt102_scrollback_find_candidate(struct vt102_scrollback * sb, int line_nr, const struct vt102_scrollback_filter * filter);
+uint32_t vt102_scrollback_get_nr_lines_pushed(struct vt102_scrollback * sb);
+void vt102_scrollback_set_view_width(struct vt102_scrollback * sb, int width);
+int vt102_scrollback_get_nr_rows(struct vt102_scrollback * sb);
+int vt102_scrollback_get_row(struct vt102_scrollback * sb, int row_nr, unsigned char * chrow, uint32_t * grrow);
+size_t vt102_scrollback_get_memory_usage(struct vt102_scrollback * sb);
+
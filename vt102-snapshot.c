@@ -0,0 +1,283 @@
+/*!
+ *	\file	vt102-snapshot.c
+ *	\brief	vt102 terminal emulator screen snapshot handoff
+ *	\author	shopov
+ *
+ *	see the comments in vt102-snapshot.h
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-snapshot.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the number of snapshots maintained */
+	NR_SNAPSHOTS		=	3,
+	/*! flag set in the index of the snapshot in between the producer and the consumer, if it has not yet been taken by the consumer */
+	SNAPSHOT_FRESH		=	0x100,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! a screen snapshot */
+struct snapshot
+{
+	/*! the snapshot data, in the format of the generic vt102 backend */
+	struct term_data tdata;
+	/*! the number of characters the snapshot character and attribute buffers can hold */
+	int capacity;
+	/*! the number of rows the snapshot row buffers can hold */
+	int rows_capacity;
+};
+
+/*! the snapshot handoff data structure */
+struct vt102_snapshot_handoff
+{
+	/*! the snapshots */
+	struct snapshot snapshots[NR_SNAPSHOTS];
+	/*! the index of the snapshot being filled by the producer; only accessed by the producer */
+	int back;
+	/*! the index of the snapshot being rendered by the consumer; only accessed by the consumer */
+	int front;
+	/*! the index of the snapshot in between the producer and the consumer, possibly ored with SNAPSHOT_FRESH */
+	atomic_int middle;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static bool reserve(struct snapshot * s, int width, int height)
+ *	\brief	makes sure a snapshot can hold a screen of the dimensions requested
+ *
+ *	the snapshot contents are not preserved when
+ *	its buffers are enlarged
+ *
+ *	\param	s	the snapshot
+ *	\param	width	the screen width, in characters
+ *	\param	height	the screen height, in rows
+ *	\return	true on success, false on failure (out of memory) */
+static bool reserve(struct snapshot * s, int width, int height)
+{
+void * p;
+
+	if (width * height > s->capacity)
+	{
+		if (!(p = realloc(s->tdata.chbuf, width * height)))
+			return false;
+		s->tdata.chbuf = p;
+		if (!(p = realloc(s->tdata.grbuf, width * height * sizeof * s->tdata.grbuf)))
+			return false;
+		s->tdata.grbuf = p;
+		s->capacity = width * height;
+	}
+	if (height > s->rows_capacity)
+	{
+		if (!(p = realloc(s->tdata.row_offsets, height * sizeof * s->tdata.row_offsets)))
+			return false;
+		s->tdata.row_offsets = p;
+		if (!(p = realloc(s->tdata.must_refresh_line_buf, height * sizeof * s->tdata.must_refresh_line_buf)))
+			return false;
+		s->tdata.must_refresh_line_buf = p;
+		if (!(p = realloc(s->tdata.wrapped_line_buf, height * sizeof * s->tdata.wrapped_line_buf)))
+			return false;
+		s->tdata.wrapped_line_buf = p;
+		if (!(p = realloc(s->tdata.dirty_spans, height * sizeof * s->tdata.dirty_spans)))
+			return false;
+		s->tdata.dirty_spans = p;
+		s->rows_capacity = height;
+	}
+	return true;
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_snapshot_handoff * vt102_snapshot_handoff_create(void)
+ *	\brief	creates a snapshot handoff
+ *
+ *	\return	a pointer to the new snapshot handoff, or null on error */
+struct vt102_snapshot_handoff * vt102_snapshot_handoff_create(void)
+{
+struct vt102_snapshot_handoff * handoff;
+
+	if (!(handoff = calloc(1, sizeof * handoff)))
+		return 0;
+	handoff->back = 0;
+	atomic_init(&handoff->middle, 1);
+	handoff->front = 2;
+	return handoff;
+}
+
+/*!
+ *	\fn	void vt102_snapshot_handoff_destroy(struct vt102_snapshot_handoff * handoff)
+ *	\brief	destroys a snapshot handoff, releasing all memory used by it
+ *
+ *	\note	neither the producer, nor the consumer
+ *		may be using the handoff when calling this
+ *
+ *	\param	handoff	the snapshot handoff to destroy
+ *	\return	none */
+void vt102_snapshot_handoff_destroy(struct vt102_snapshot_handoff * handoff)
+{
+int i;
+
+	for (i = 0; i < NR_SNAPSHOTS; i++)
+	{
+		free(handoff->snapshots[i].tdata.chbuf);
+		free(handoff->snapshots[i].tdata.grbuf);
+		free(handoff->snapshots[i].tdata.row_offsets);
+		free(handoff->snapshots[i].tdata.must_refresh_line_buf);
+		free(handoff->snapshots[i].tdata.wrapped_line_buf);
+		free(handoff->snapshots[i].tdata.dirty_spans);
+	}
+	free(handoff);
+}
+
+/*!
+ *	\fn	bool vt102_snapshot_publish(struct vt102_snapshot_handoff * handoff, struct term_data * tdata)
+ *	\brief	publishes a snapshot of the screen of the generic vt102 backend for the consumer
+ *
+ *	this is called by the producer; if the previously published
+ *	snapshot has not yet been taken by the consumer, nothing is
+ *	done; otherwise, the screen is copied to a new snapshot, which
+ *	is then published, and the rows refresh-needed flags and scroll
+ *	operations of the backend are reset - they now belong to the
+ *	snapshot
+ *
+ *	this never blocks
+ *
+ *	\param	handoff	the snapshot handoff
+ *	\param	tdata	the backend data holding the screen to publish
+ *	\return	true, if a new snapshot was published, false if
+ *		the previous one has not been taken yet, or on failure
+ *		(out of memory) - in which case the backend data is
+ *		left intact, and publishing should be retried later */
+bool vt102_snapshot_publish(struct vt102_snapshot_handoff * handoff, struct term_data * tdata)
+{
+struct snapshot * s;
+struct term_data t;
+int i, w, h;
+
+	if (atomic_load_explicit(&handoff->middle, memory_order_acquire) & SNAPSHOT_FRESH)
+		return false;
+	s = handoff->snapshots + handoff->back;
+	w = tdata->con_width;
+	h = tdata->con_height;
+	if (!reserve(s, w, h))
+		return false;
+	/* copy the screen state, but keep the snapshot buffers */
+	t = s->tdata;
+	s->tdata = * tdata;
+	s->tdata.chbuf = t.chbuf;
+	s->tdata.grbuf = t.grbuf;
+	s->tdata.row_offsets = t.row_offsets;
+	s->tdata.must_refresh_line_buf = t.must_refresh_line_buf;
+	s->tdata.wrapped_line_buf = t.wrapped_line_buf;
+	s->tdata.dirty_spans = t.dirty_spans;
+	/* the screen buffer memory blocks and the scrollback
+	 * history belong to the backend */
+	s->tdata.arena = s->tdata.spare_arena = 0;
+	s->tdata.cell_capacity = s->tdata.row_capacity = 0;
+	s->tdata.spare_cell_capacity = s->tdata.spare_row_capacity = 0;
+	s->tdata.scrollback = 0;
+	for (i = 0; i < h; i++)
+	{
+		s->tdata.row_offsets[i] = i * w;
+		memcpy(s->tdata.chbuf + i * w, vt102_generic_backend_chrow(tdata, i), w);
+		memcpy(s->tdata.grbuf + i * w, vt102_generic_backend_grrow(tdata, i), w * sizeof * tdata->grbuf);
+	}
+	memcpy(s->tdata.must_refresh_line_buf, tdata->must_refresh_line_buf, h * sizeof * tdata->must_refresh_line_buf);
+	memcpy(s->tdata.wrapped_line_buf, tdata->wrapped_line_buf, h * sizeof * tdata->wrapped_line_buf);
+	memcpy(s->tdata.dirty_spans, tdata->dirty_spans, h * sizeof * tdata->dirty_spans);
+	/* the changes are now recorded in the snapshot */
+	memset(tdata->must_refresh_line_buf, 0, h * sizeof * tdata->must_refresh_line_buf);
+	tdata->nr_scroll_ops = 0;
+	tdata->must_refresh = false;
+	/* publish the snapshot; the snapshot given back
+	 * in exchange has already been taken by the
+	 * consumer, and is no longer in use by it */
+	handoff->back = atomic_exchange_explicit(&handoff->middle,
+			handoff->back | SNAPSHOT_FRESH, memory_order_acq_rel);
+	return true;
+}
+
+/*!
+ *	\fn	struct term_data * vt102_snapshot_peek(struct vt102_snapshot_handoff * handoff)
+ *	\brief	returns the latest snapshot published, without taking it
+ *
+ *	this is called by the consumer, e.g. for deciding when
+ *	to take the snapshot; the snapshot returned must not be
+ *	modified, and remains valid until it is taken
+ *
+ *	\param	handoff	the snapshot handoff
+ *	\return	the snapshot published by the producer since the last
+ *		one taken, or null if no new snapshot has been published */
+struct term_data * vt102_snapshot_peek(struct vt102_snapshot_handoff * handoff)
+{
+int middle;
+
+	middle = atomic_load_explicit(&handoff->middle, memory_order_acquire);
+	if (!(middle & SNAPSHOT_FRESH))
+		return 0;
+	return & handoff->snapshots[middle & ~ SNAPSHOT_FRESH].tdata;
+}
+
+/*!
+ *	\fn	struct term_data * vt102_snapshot_take(struct vt102_snapshot_handoff * handoff)
+ *	\brief	takes the latest snapshot published, for rendering
+ *
+ *	this is called by the consumer; the snapshot returned is
+ *	owned by the consumer (which may e.g. reset its refresh-needed
+ *	flags while rendering it) until the next call to this function;
+ *	once a snapshot has been taken, the producer may publish a new
+ *	one - if it is waiting for something else to happen, the
+ *	consumer should notify it of the snapshot taken
+ *
+ *	this never blocks
+ *
+ *	\param	handoff	the snapshot handoff
+ *	\return	the snapshot published by the producer since the last
+ *		one taken, or null if no new snapshot has been published */
+struct term_data * vt102_snapshot_take(struct vt102_snapshot_handoff * handoff)
+{
+	if (!(atomic_load_explicit(&handoff->middle, memory_order_acquire) & SNAPSHOT_FRESH))
+		return 0;
+	/* only the consumer clears the fresh flag, so the
+	 * snapshot is still fresh, and the producer will not
+	 * touch the snapshot in between until it is taken */
+	handoff->front = atomic_exchange_explicit(&handoff->middle,
+			handoff->front, memory_order_acq_rel) & ~ SNAPSHOT_FRESH;
+	return & handoff->snapshots[handoff->front].tdata;
+}
+
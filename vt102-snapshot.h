@@ -0,0 +1,61 @@
+/*!
+ *	\file	vt102-snapshot.h
+ *	\brief	vt102 terminal emulator screen snapshot handoff header file
+ *	\author	shopov
+ *
+ *	this module passes snapshots of the screen state of the
+ *	generic vt102 backend from the thread running the vt102
+ *	command parser (the producer) to a thread rendering the
+ *	screen (the consumer), without either thread ever blocking
+ *	the other
+ *
+ *	a snapshot is a struct term_data (see vt102-backend-generic.h)
+ *	holding a copy of the screen contents, cursor position, and
+ *	the rows, spans of characters and scroll operations that must
+ *	be refreshed - so rendering modules can render snapshots in the
+ *	same way they render the screen of the backend; the snapshot
+ *	row offsets are always in order, and snapshots have no
+ *	scrollback history
+ *
+ *	three snapshots are maintained - one being filled by the
+ *	producer, one being rendered by the consumer, and the most
+ *	recently published one in between, which the two threads swap
+ *	with their own snapshot using atomic operations; the producer
+ *	only publishes a new snapshot once the consumer has taken the
+ *	previous one, and until then keeps accumulating the changes to
+ *	the screen in the backend data, so that no changes are lost
+ *	for the consumer
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdbool.h>
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_snapshot_handoff;
+/* defined in vt102-backend-generic.h */
+struct term_data;
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_snapshot_handoff * vt102_snapshot_handoff_create(void);
+void vt102_snapshot_handoff_destroy(struct vt102_snapshot_handoff * handoff);
+bool vt102_snapshot_publish(struct vt102_snapshot_handoff * handoff, struct term_data * tdata);
+struct term_data * vt102_snapshot_peek(struct vt102_snapshot_handoff * handoff);
+struct term_data * vt102_snapshot_take(struct vt102_snapshot_handoff * handoff);
+
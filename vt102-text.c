@@ -0,0 +1,604 @@
+/*!
+ *	\file	vt102-text.c
+ *	\brief	vt102 terminal emulator screen and scrollback text extraction and searching
+ *	\author	shopov
+ *
+ *	see the comments in vt102-text.h
+ *
+ *	a search decodes the text searched for to character codes once,
+ *	and prepares a scrollback search filter from it; logical lines are
+ *	then loaded (as character codes) one at a time, starting from the
+ *	position the search starts at, and going towards the oldest line of
+ *	the history - the screen lines are always loaded, the history lines
+ *	only if their summaries tell that they may contain the text
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-text.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the character code that malformed utf-8 sequences in the text searched for are decoded as */
+	REPLACEMENT_CHAR	=	0xfffd,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! the search data structure */
+struct vt102_text_search
+{
+	/*! the search flags, see VT102_TEXT_IGNORE_CASE */
+	int flags;
+	/*! the character codes of the text searched for, folded to lower case if the case of the letters is ignored */
+	unsigned int * pattern;
+	/*! the number of characters in the pattern buffer above */
+	int pattern_len;
+	/*! the scrollback search filter for the text searched for */
+	struct vt102_scrollback_filter filter;
+	/*! the character codes of the logical line last loaded */
+	unsigned int * text;
+	/*! the number of characters in the text buffer above */
+	int text_len;
+	/*! the size of the text buffer above */
+	int text_capacity;
+	/*! the offsets in the text buffer above of the starts of the lines of the logical line last loaded */
+	int * line_starts;
+	/*! the size of the line_starts buffer above */
+	int line_starts_capacity;
+	/*! the search counters */
+	struct vt102_text_search_stats stats;
+};
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static inline unsigned int fold_char(unsigned int c)
+ *	\brief	folds ascii letters to lower case
+ *
+ *	\param	c	a character code
+ *	\return	the character code folded */
+static inline unsigned int fold_char(unsigned int c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + 'a' - 'A' : c;
+}
+
+/*!
+ *	\fn	static int get_line_info(struct term_data * tdata, int line, bool * wrapped)
+ *	\brief	returns the width of a line, and if it wraps onto the next line, without retrieving it
+ *
+ *	\param	tdata	the backend data
+ *	\param	line	the line, see the comments in vt102-text.h
+ *	\param	wrapped	where to store if the line wraps onto the next line
+ *	\return	the width of the line, or -1 if the line does not exist */
+static int get_line_info(struct term_data * tdata, int line, bool * wrapped)
+{
+	if (line >= 0)
+	{
+		if (line >= tdata->con_height)
+			return -1;
+		/* there is no line for the last screen row to wrap onto */
+		* wrapped = tdata->wrapped_line_buf[line] && line < tdata->con_height - 1;
+		return tdata->con_width;
+	}
+	if (!tdata->scrollback)
+		return -1;
+	return vt102_scrollback_get_line_info(tdata->scrollback, -1 - line, wrapped);
+}
+
+/*!
+ *	\fn	static int fetch_line(struct term_data * tdata, int line, const unsigned char ** ch, const uint32_t ** gr)
+ *	\brief	retrieves a line, without copying it
+ *
+ *	\param	tdata	the backend data
+ *	\param	line	the line, see the comments in vt102-text.h
+ *	\param	ch	where to store a pointer to the character codes of the line
+ *	\param	gr	where to store a pointer to the graphics rendition
+ *			attributes of the line; for history lines, these are
+ *			only valid until the next history line is retrieved
+ *	\return	the width of the line, or -1 if the line does not
+ *		exist (or on failure - out of memory) */
+static int fetch_line(struct term_data * tdata, int line, const unsigned char ** ch, const uint32_t ** gr)
+{
+	if (line >= 0)
+	{
+		if (line >= tdata->con_height)
+			return -1;
+		* ch = vt102_generic_backend_chrow(tdata, line);
+		* gr = vt102_generic_backend_grrow(tdata, line);
+		return tdata->con_width;
+	}
+	if (!tdata->scrollback)
+		return -1;
+	return vt102_scrollback_peek_line(tdata->scrollback, -1 - line, ch, gr, 0);
+}
+
+/*!
+ *	\fn	static bool get_logical_line_extent(struct term_data * tdata, int line, int * first_line, int * last_line)
+ *	\brief	finds the first and the last line of the logical line a line is part of
+ *
+ *	\param	tdata	the backend data
+ *	\param	line	the line, see the comments in vt102-text.h
+ *	\param	first_line	where to store the first line of the logical line
+ *	\param	last_line	where to store the last line of the logical line
+ *	\return	true on success, false if the line does not exist */
+static bool get_logical_line_extent(struct term_data * tdata, int line, int * first_line, int * last_line)
+{
+bool wrapped;
+int n;
+
+	if (get_line_info(tdata, line, &wrapped) == -1)
+		return false;
+	for (n = line; wrapped && get_line_info(tdata, n + 1, &wrapped) != -1; n++)
+		;
+	* last_line = n;
+	for (n = line; get_line_info(tdata, n - 1, &wrapped) != -1 && wrapped; n--)
+		;
+	* first_line = n;
+	return true;
+}
+
+/*!
+ *	\fn	static int trimmed_width(const unsigned char * ch, const uint32_t * gr, int width)
+ *	\brief	returns the width of a line, with the trailing blanks removed
+ *
+ *	\param	ch	the character codes of the line
+ *	\param	gr	the graphics rendition attributes of the line
+ *	\param	width	the width of the line
+ *	\return	the width of the line, not counting any trailing spaces,
+ *		regardless of their graphics rendition attributes */
+static int trimmed_width(const unsigned char * ch, const uint32_t * gr, int width)
+{
+	while (width > 0 && vt102_cell_char(ch[width - 1], gr[width - 1]) == ' ')
+		width--;
+	return width;
+}
+
+/*!
+ *	\fn	static size_t encode(const unsigned char * ch, const uint32_t * gr, int width, char * buf, size_t size)
+ *	\brief	encodes the characters of a line, or part of it, in utf-8
+ *
+ *	\param	ch	the character codes of the characters
+ *	\param	gr	the graphics rendition attributes of the characters
+ *	\param	width	the number of characters to encode
+ *	\param	buf	where to store the encoded characters
+ *	\param	size	the size of the buf buffer; encoding stops at
+ *			the first character which does not fit
+ *	\return	the number of bytes stored in the buf buffer */
+static size_t encode(const unsigned char * ch, const uint32_t * gr, int width, char * buf, size_t size)
+{
+unsigned int c;
+size_t n;
+int x;
+
+	for (n = x = 0; x < width; x++)
+	{
+		/* the bulk of the text is usually ascii, and takes a single byte */
+		if (!(gr[x] >> VT102_ATTR_CHAR_SHIFT) && ch[x] < 0x80)
+		{
+			if (n == size)
+				break;
+			buf[n ++] = ch[x];
+			continue;
+		}
+		c = vt102_cell_char(ch[x], gr[x]);
+		if (size - n < (c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4))
+			break;
+		if (c < 0x80)
+			buf[n ++] = c;
+		else if (c < 0x800)
+		{
+			buf[n ++] = 0xc0 | c >> 6;
+			buf[n ++] = 0x80 | (c & 0x3f);
+		}
+		else if (c < 0x10000)
+		{
+			buf[n ++] = 0xe0 | c >> 12;
+			buf[n ++] = 0x80 | (c >> 6 & 0x3f);
+			buf[n ++] = 0x80 | (c & 0x3f);
+		}
+		else
+		{
+			buf[n ++] = 0xf0 | c >> 18;
+			buf[n ++] = 0x80 | (c >> 12 & 0x3f);
+			buf[n ++] = 0x80 | (c >> 6 & 0x3f);
+			buf[n ++] = 0x80 | (c & 0x3f);
+		}
+	}
+	return n;
+}
+
+/*!
+ *	\fn	static const char * decode(const char * p, unsigned int * c)
+ *	\brief	decodes a utf-8 encoded character
+ *
+ *	\param	p	the encoded character, in a null terminated string
+ *	\param	c	where to store the character code; malformed
+ *			sequences are decoded as REPLACEMENT_CHAR, one
+ *			byte at a time
+ *	\return	the position past the encoded character */
+static const char * decode(const char * p, unsigned int * c)
+{
+const unsigned char * s;
+int i, n;
+
+	s = (const unsigned char *) p;
+	if (s[0] < 0x80)
+	{
+		* c = s[0];
+		return p + 1;
+	}
+	if (s[0] >= 0xc2 && s[0] < 0xe0)
+		n = 1, * c = s[0] & 0x1f;
+	else if (s[0] >= 0xe0 && s[0] < 0xf0)
+		n = 2, * c = s[0] & 0x0f;
+	else if (s[0] >= 0xf0 && s[0] < 0xf5)
+		n = 3, * c = s[0] & 0x07;
+	else
+		n = 0;
+	for (i = 1; n && i <= n; i++)
+	{
+		if ((s[i] & 0xc0) != 0x80)
+			break;
+		* c = * c << 6 | (s[i] & 0x3f);
+	}
+	if (!n || i <= n)
+	{
+		* c = REPLACEMENT_CHAR;
+		return p + 1;
+	}
+	return p + n + 1;
+}
+
+/*!
+ *	\fn	static bool load_logical_line(struct vt102_text_search * s, struct term_data * tdata, int first_line, int last_line)
+ *	\brief	loads the character codes of a logical line in the text buffer of a search
+ *
+ *	\param	s	the search data structure
+ *	\param	tdata	the backend data
+ *	\param	first_line	the first line of the logical line
+ *	\param	last_line	the last line of the logical line
+ *	\return	true on success, false on failure (out of memory) */
+static bool load_logical_line(struct vt102_text_search * s, struct term_data * tdata, int first_line, int last_line)
+{
+const unsigned char * ch;
+const uint32_t * gr;
+void * p;
+int line, w, x, capacity;
+
+	if (last_line - first_line + 1 > s->line_starts_capacity)
+	{
+		capacity = last_line - first_line + 1;
+		if (!(p = realloc(s->line_starts, capacity * sizeof * s->line_starts)))
+			return false;
+		s->line_starts = p;
+		s->line_starts_capacity = capacity;
+	}
+	s->text_len = 0;
+	for (line = first_line; line <= last_line; line++)
+	{
+		s->line_starts[line - first_line] = s->text_len;
+		if ((w = fetch_line(tdata, line, &ch, &gr)) == -1)
+			return false;
+		if (line == last_line)
+			w = trimmed_width(ch, gr, w);
+		if (s->text_len + w > s->text_capacity)
+		{
+			for (capacity = s->text_capacity ? s->text_capacity : 256; capacity < s->text_len + w; capacity *= 2)
+				;
+			if (!(p = realloc(s->text, capacity * sizeof * s->text)))
+				return false;
+			s->text = p;
+			s->text_capacity = capacity;
+		}
+		for (x = 0; x < w; x++)
+			s->text[s->text_len ++] = vt102_cell_char(ch[x], gr[x]);
+		s->stats.nr_lines_searched ++;
+	}
+	return true;
+}
+
+/*!
+ *	\fn	static bool matches(struct vt102_text_search * s, int offset)
+ *	\brief	compares the text searched for with the logical line loaded, at an offset
+ *
+ *	\param	s	the search data structure
+ *	\param	offset	the offset in the logical line; the text searched
+ *			for must fit in the logical line at that offset
+ *	\return	true if the text searched for is found at the offset */
+static bool matches(struct vt102_text_search * s, int offset)
+{
+const unsigned int * text;
+int i;
+
+	text = s->text + offset;
+	if (s->flags & VT102_TEXT_IGNORE_CASE)
+	{
+		for (i = 0; i < s->pattern_len; i++)
+			if (fold_char(text[i]) != s->pattern[i])
+				return false;
+	}
+	else
+	{
+		for (i = 0; i < s->pattern_len; i++)
+			if (text[i] != s->pattern[i])
+				return false;
+	}
+	return true;
+}
+
+/*!
+ *	\fn	static void get_position(struct vt102_text_search * s, int first_line, int last_line, int offset, struct vt102_text_pos * pos)
+ *	\brief	converts an offset in the logical line loaded to a text position
+ *
+ *	\param	s	the search data structure
+ *	\param	first_line	the first line of the logical line
+ *	\param	last_line	the last line of the logical line
+ *	\param	offset	the offset in the logical line
+ *	\param	pos	where to store the text position
+ *	\return	none */
+static void get_position(struct vt102_text_search * s, int first_line, int last_line, int offset, struct vt102_text_pos * pos)
+{
+int i;
+
+	for (i = last_line - first_line; i && s->line_starts[i] > offset; i--)
+		;
+	pos->line = first_line + i;
+	pos->column = offset - s->line_starts[i];
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	int vt102_text_get_span(struct term_data * tdata, int line, int x0, int x1, char * buf, size_t size)
+ *	\brief	retrieves the text of a span of columns of a line
+ *
+ *	\param	tdata	the backend data
+ *	\param	line	the line, see the comments in vt102-text.h
+ *	\param	x0	the first column of the span
+ *	\param	x1	the column past the last column of the span; the
+ *			span is clipped to the width of the line, so that
+ *			INT_MAX retrieves the rest of the line
+ *	\param	buf	where to store the text of the span, utf-8 encoded
+ *			and null terminated, with the trailing blanks removed
+ *	\param	size	the size of the buf buffer, must be positive; the
+ *			text is truncated, at a character boundary, to fit
+ *	\return	the number of bytes stored in the buf buffer, not counting
+ *		the terminating null byte, or -1 if the line does not exist
+ *		(or on failure - out of memory) */
+int vt102_text_get_span(struct term_data * tdata, int line, int x0, int x1, char * buf, size_t size)
+{
+const unsigned char * ch;
+const uint32_t * gr;
+size_t n;
+int w;
+
+	if (!size || (w = fetch_line(tdata, line, &ch, &gr)) == -1)
+		return -1;
+	if (x1 > w)
+		x1 = w;
+	if (x0 < 0)
+		x0 = 0;
+	n = x0 < x1 ? encode(ch + x0, gr + x0, trimmed_width(ch + x0, gr + x0, x1 - x0), buf, size - 1) : 0;
+	buf[n] = 0;
+	return n;
+}
+
+/*!
+ *	\fn	int vt102_text_get_logical_line(struct term_data * tdata, int line, char * buf, size_t size, int * first_line, int * last_line)
+ *	\brief	retrieves the text of the logical line a line is part of
+ *
+ *	the lines of the logical line are joined, only the trailing
+ *	blanks of the last line of the logical line are removed
+ *
+ *	\param	tdata	the backend data
+ *	\param	line	the line, see the comments in vt102-text.h
+ *	\param	buf	where to store the text of the logical line, utf-8
+ *			encoded and null terminated
+ *	\param	size	the size of the buf buffer, must be positive; the
+ *			text is truncated, at a character boundary, to fit
+ *	\param	first_line	where to store the first line of the logical
+ *				line; may be null
+ *	\param	last_line	where to store the last line of the logical
+ *				line; may be null
+ *	\return	the number of bytes stored in the buf buffer, not counting
+ *		the terminating null byte, or -1 if the line does not exist
+ *		(or on failure - out of memory) */
+int vt102_text_get_logical_line(struct term_data * tdata, int line, char * buf, size_t size, int * first_line, int * last_line)
+{
+const unsigned char * ch;
+const uint32_t * gr;
+size_t n;
+int first, last, w;
+
+	if (!size || !get_logical_line_extent(tdata, line, &first, &last))
+		return -1;
+	for (n = 0, line = first; line <= last; line++)
+	{
+		if ((w = fetch_line(tdata, line, &ch, &gr)) == -1)
+			return -1;
+		if (line == last)
+			w = trimmed_width(ch, gr, w);
+		n += encode(ch, gr, w, buf + n, size - 1 - n);
+	}
+	buf[n] = 0;
+	if (first_line)
+		* first_line = first;
+	if (last_line)
+		* last_line = last;
+	return n;
+}
+
+/*!
+ *	\fn	struct vt102_text_search * vt102_text_search_create(const char * text, int flags)
+ *	\brief	creates a search for a text
+ *
+ *	\param	text	the text to search for, utf-8 encoded and
+ *			null terminated; must not be empty
+ *	\param	flags	the search flags, see VT102_TEXT_IGNORE_CASE
+ *	\return	a pointer to the new search, or null on error */
+struct vt102_text_search * vt102_text_search_create(const char * text, int flags)
+{
+struct vt102_text_search * s;
+unsigned char * bytes;
+unsigned int c;
+int i;
+
+	if (!* text || !(s = calloc(1, sizeof * s)))
+		return 0;
+	s->flags = flags;
+	/* there are no more characters in the text than there are bytes */
+	s->pattern = malloc(strlen(text) * sizeof * s->pattern);
+	bytes = malloc(strlen(text));
+	if (!s->pattern || !bytes)
+	{
+		free(bytes);
+		vt102_text_search_destroy(s);
+		return 0;
+	}
+	for (; * text; s->pattern_len ++)
+	{
+		text = decode(text, &c);
+		s->pattern[s->pattern_len] = (flags & VT102_TEXT_IGNORE_CASE) ? fold_char(c) : c;
+	}
+	/* the history summaries are made of the low 8 bits of the character codes */
+	for (i = 0; i < s->pattern_len; i++)
+		bytes[i] = s->pattern[i];
+	vt102_scrollback_make_filter(&s->filter, bytes, s->pattern_len);
+	free(bytes);
+	return s;
+}
+
+/*!
+ *	\fn	void vt102_text_search_destroy(struct vt102_text_search * s)
+ *	\brief	destroys a search, releasing all memory used by it
+ *
+ *	\param	s	the search to destroy
+ *	\return	none */
+void vt102_text_search_destroy(struct vt102_text_search * s)
+{
+	free(s->pattern);
+	free(s->text);
+	free(s->line_starts);
+	free(s);
+}
+
+/*!
+ *	\fn	bool vt102_text_search(struct vt102_text_search * s, struct term_data * tdata, const struct vt102_text_pos * from, int oldest_line, struct vt102_text_match * match)
+ *	\brief	searches backwards through the text of the screen and of the scrollback history
+ *
+ *	the text found is the last one, in reading order, starting before
+ *	the position the search starts from - so that the next older text
+ *	can be found by passing the start of the text found as the position
+ *	to start from; the text may span several lines, if they are parts
+ *	of the same logical line
+ *
+ *	e.g. automation code waiting for a prompt may poll with 'from' set
+ *	to null, and 'oldest_line' set to zero, so that only the screen is
+ *	searched; to also search the lines having scrolled into the history
+ *	since the last poll, 'oldest_line' can be computed from the numbers
+ *	of lines stored in the history (see vt102_scrollback_get_nr_lines_pushed())
+ *
+ *	\param	s	the search data structure
+ *	\param	tdata	the backend data to search through
+ *	\param	from	the position to start searching from; null to search
+ *			from the end of the screen
+ *	\param	oldest_line	the oldest line to search through, e.g. zero
+ *				for only searching the screen, or INT_MIN for
+ *				searching the whole history as well
+ *	\param	match	where to store the position of the text found
+ *	\return	true if the text has been found, false if it has not been
+ *		found (or on failure - out of memory) */
+bool vt102_text_search(struct vt102_text_search * s, struct term_data * tdata, const struct vt102_text_pos * from, int oldest_line, struct vt102_text_match * match)
+{
+int line, first_line, last_line, oldest, candidate, limit, offset;
+bool first;
+
+	s->stats.nr_searches ++;
+	oldest = -(tdata->scrollback ? vt102_scrollback_get_nr_lines(tdata->scrollback) : 0);
+	if (oldest_line < oldest)
+		oldest_line = oldest;
+	line = (!from || from->line >= tdata->con_height) ? tdata->con_height - 1 : from->line;
+	for (first = true; line >= oldest_line; line = first_line - 1, first = false)
+	{
+		if (line < 0 && !first)
+		{
+			/* the line is the most recent line of a logical
+			 * line of the history - skip the logical lines
+			 * which cannot contain the text */
+			if ((candidate = vt102_scrollback_find_candidate(tdata->scrollback, -1 - line, &s->filter)) == -1)
+			{
+				s->stats.nr_lines_skipped += line - oldest_line + 1;
+				break;
+			}
+			s->stats.nr_lines_skipped += line - (-1 - candidate);
+			if ((line = -1 - candidate) < oldest_line)
+				break;
+		}
+		if (!get_logical_line_extent(tdata, line, &first_line, &last_line)
+				|| !load_logical_line(s, tdata, first_line, last_line))
+			return false;
+		limit = s->text_len;
+		if (first && from && from->line < tdata->con_height)
+		{
+			/* the text must start before the position searched from */
+			limit = s->line_starts[line - first_line] + from->column;
+			if (limit > s->text_len)
+				limit = s->text_len;
+		}
+		if (limit > s->text_len - s->pattern_len + 1)
+			limit = s->text_len - s->pattern_len + 1;
+		for (offset = limit - 1; offset >= 0; offset--)
+			if (matches(s, offset))
+			{
+				get_position(s, first_line, last_line, offset, &match->start);
+				if (match->start.line < oldest_line)
+					return false;
+				get_position(s, first_line, last_line, offset + s->pattern_len - 1, &match->end);
+				return true;
+			}
+	}
+	return false;
+}
+
+/*!
+ *	\fn	void vt102_text_search_get_stats(struct vt102_text_search * s, struct vt102_text_search_stats * stats)
+ *	\brief	retrieves the counters of a search
+ *
+ *	\param	s	the search data structure
+ *	\param	stats	where to store the counters
+ *	\return	none */
+void vt102_text_search_get_stats(struct vt102_text_search * s, struct vt102_text_search_stats * stats)
+{
+	* stats = s->stats;
+}
@@ -0,0 +1,117 @@
+/*!
+ *	\file	vt102-text.h
+ *	\brief	vt102 terminal emulator screen and scrollback text extraction and searching header file
+ *	\author	shopov
+ *
+ *	this module retrieves the text of the screen and of the scrollback
+ *	history of the generic vt102 backend (see vt102-backend-generic.h) as
+ *	utf-8 encoded strings, and searches through it - e.g. for implementing
+ *	copying text to the clipboard, find-in-scrollback, or for automation
+ *	code waiting for a prompt to appear on the screen
+ *
+ *	the text is taken straight from the chbuf buffer (and from the
+ *	scrollback buffer) - trailing blanks are removed, and the rows which
+ *	the cursor has auto-wrapped from onto the next row (see the
+ *	wrapped_line_buf field of struct term_data) can be joined into the
+ *	logical lines they are part of; searches match the text of logical
+ *	lines, so that texts wrapped at the edge of the screen are found
+ *
+ *	searching through the scrollback history uses the trigram summaries
+ *	the scrollback buffer maintains as lines are stored in it (see
+ *	vt102_scrollback_find_candidate()) - only the logical lines which may
+ *	contain the text searched for, judging by their summaries, are
+ *	retrieved and compared with the text, so that e.g. polling a large
+ *	number of sessions for a text that rarely appears does not rescan
+ *	the whole history of each session every time
+ *
+ *	text positions are given as lines and columns; the screen rows
+ *	are lines 0 to con_height - 1 (top to bottom), the lines of the
+ *	scrollback history are lines -1 (the most recent line), -2, and so
+ *	on - i.e. history line number n (see vt102_scrollback_get_line())
+ *	is line -1 - n; each character takes a single column
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! search flag - ignore the case of the ascii letters */
+	VT102_TEXT_IGNORE_CASE		=	1 << 0,
+	/*! the maximum number of bytes a character takes, when utf-8 encoded */
+	VT102_TEXT_MAX_CHAR_BYTES	=	4,
+};
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_text_search;
+/* defined in vt102-backend-generic.h */
+struct term_data;
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! a position in the text of the screen and the scrollback history */
+struct vt102_text_pos
+{
+	/*! the line, see the comments at the start of this file */
+	int line;
+	/*! the column */
+	int column;
+};
+
+/*! the position of a text found */
+struct vt102_text_match
+{
+	/*! the position of the first character of the text */
+	struct vt102_text_pos start;
+	/*! the position of the last character of the text */
+	struct vt102_text_pos end;
+};
+
+/*! search counters
+ *
+ * these are cumulative, since the search has been created */
+struct vt102_text_search_stats
+{
+	/*! the number of calls to vt102_text_search() */
+	unsigned long nr_searches;
+	/*! the number of lines retrieved and compared with the text */
+	unsigned long long nr_lines_searched;
+	/*! the number of scrollback history lines skipped, by looking at the summaries of the history only */
+	unsigned long long nr_lines_skipped;
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+int vt102_text_get_span(struct term_data * tdata, int line, int x0, int x1, char * buf, size_t size);
+int vt102_text_get_logical_line(struct term_data * tdata, int line, char * buf, size_t size, int * first_line, int * last_line);
+struct vt102_text_search * vt102_text_search_create(const char * text, int flags);
+void vt102_text_search_destroy(struct vt102_text_search * s);
+bool vt102_text_search(struct vt102_text_search * s, struct term_data * tdata, const struct vt102_text_pos * from, int oldest_line, struct vt102_text_match * match);
+void vt102_text_search_get_stats(struct vt102_text_search * s, struct vt102_text_search_stats * stats);
@@ -0,0 +1,148 @@
+/*!
+ *	\file	vt102-trace.c
+ *	\brief	vt102 terminal emulator tracing facility
+ *	\author	shopov
+ *
+ *	see the comments in vt102-trace.h
+ *
+ *	the trace event slots in the ring buffer are claimed by
+ *	atomically incrementing a sequence number; once a slot has
+ *	been filled in, the sequence number of the event is stored
+ *	in the slot, so that vt102_trace_dump() can tell complete
+ *	events from ones still being (or overwritten while being)
+ *	recorded, and skip the latter
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdatomic.h>
+
+#include "vt102-trace.h"
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! a trace event slot in the ring buffer */
+struct trace_slot
+{
+	/*! the sequence number of the event in this slot plus one, zero if the slot has not been filled in */
+	atomic_ulong seq;
+	/*! the trace level of the event */
+	int level;
+	/*! the trace event identifier */
+	enum vt102_trace_event event;
+	/*! the arguments of the event */
+	int args[VT102_TRACE_NR_ARGS];
+};
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! the trace event ring buffer */
+static struct trace_slot trace_ring[VT102_TRACE_RING_SIZE];
+/*! the sequence number of the next event to record */
+static atomic_ulong trace_next_seq;
+
+/*! the names of the trace events, for dumping */
+static const char * trace_event_names[VT102_NR_TRACE_EVENTS] =
+{
+	[VT102_TRACE_ANSI_CMD]		=	"ansi command",
+	[VT102_TRACE_ANSI_CMD_IGNORED]	=	"ansi command ignored",
+	[VT102_TRACE_UTF8_MALFORMED]	=	"malformed utf-8",
+	[VT102_TRACE_UNKNOWN_ESCAPE]	=	"unknown escape",
+	[VT102_TRACE_SET_MODE]		=	"set mode",
+	[VT102_TRACE_RESET_MODE]	=	"reset mode",
+	[VT102_TRACE_UNHANDLED_SGR]	=	"unhandled sgr",
+};
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	void vt102_trace_record(int level, enum vt102_trace_event event, int a0, int a1, int a2, int a3)
+ *	\brief	records a trace event in the ring buffer
+ *
+ *	this is normally invoked by the VT102_TRACE() macro
+ *
+ *	\param	level	the trace level of the event
+ *	\param	event	the trace event identifier
+ *	\param	a0	the first argument of the event
+ *	\param	a1	the second argument of the event
+ *	\param	a2	the third argument of the event
+ *	\param	a3	the fourth argument of the event
+ *	\return	none */
+void vt102_trace_record(int level, enum vt102_trace_event event, int a0, int a1, int a2, int a3)
+{
+unsigned long seq;
+struct trace_slot * slot;
+
+	seq = atomic_fetch_add_explicit(&trace_next_seq, 1, memory_order_relaxed);
+	slot = trace_ring + (seq & (VT102_TRACE_RING_SIZE - 1));
+	/* mark the slot as being filled in */
+	atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->level = level;
+	slot->event = event;
+	slot->args[0] = a0;
+	slot->args[1] = a1;
+	slot->args[2] = a2;
+	slot->args[3] = a3;
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+}
+
+/*!
+ *	\fn	void vt102_trace_dump(FILE * f)
+ *	\brief	prints the trace events in the ring buffer, oldest first
+ *
+ *	events being recorded while dumping may be missing
+ *	from the dump
+ *
+ *	\param	f	the stream to print the events to
+ *	\return	none */
+void vt102_trace_dump(FILE * f)
+{
+unsigned long seq, end, slot_seq;
+struct trace_slot * slot, t;
+int i;
+
+	end = atomic_load_explicit(&trace_next_seq, memory_order_acquire);
+	seq = end > VT102_TRACE_RING_SIZE ? end - VT102_TRACE_RING_SIZE : 0;
+	for (; seq < end; seq++)
+	{
+		slot = trace_ring + (seq & (VT102_TRACE_RING_SIZE - 1));
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq + 1)
+			continue;
+		t.level = slot->level;
+		t.event = slot->event;
+		for (i = 0; i < VT102_TRACE_NR_ARGS; i++)
+			t.args[i] = slot->args[i];
+		/* make sure the slot has not been overwritten meanwhile */
+		atomic_thread_fence(memory_order_acquire);
+		slot_seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+		if (slot_seq != seq + 1)
+			continue;
+		fprintf(f, "%lu: [%d] %s:", seq, t.level,
+				(unsigned) t.event < VT102_NR_TRACE_EVENTS ?
+				trace_event_names[t.event] : "?");
+		for (i = 0; i < VT102_TRACE_NR_ARGS; i++)
+			fprintf(f, " %d", t.args[i]);
+		fprintf(f, "\n");
+	}
+}
+
@@ -0,0 +1,129 @@
+/*!
+ *	\file	vt102-trace.h
+ *	\brief	vt102 terminal emulator tracing facility header file
+ *	\author	shopov
+ *
+ *	this is a lightweight tracing facility for the vt102 terminal
+ *	emulator modules; trace events are recorded - unformatted - in
+ *	an in-memory ring buffer, which holds the most recent
+ *	VT102_TRACE_RING_SIZE events, and can be dumped on demand by
+ *	calling vt102_trace_dump(); recording an event is lock-free,
+ *	and may be done from any thread
+ *
+ *	trace events are recorded with the VT102_TRACE() macro; each
+ *	event has a trace level, and events with a level above the one
+ *	selected at compile time (by defining VT102_TRACE_LEVEL, which
+ *	defaults to VT102_TRACE_LEVEL_NONE) are compiled out, so that
+ *	tracing has no cost at all by default
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdio.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+/*! trace levels */
+/*! no tracing */
+#define VT102_TRACE_LEVEL_NONE		0
+/*! unexpected conditions, that should be looked at */
+#define VT102_TRACE_LEVEL_ERROR		1
+/*! unsupported input, e.g. unhandled escape sequences */
+#define VT102_TRACE_LEVEL_WARNING	2
+/*! all of the commands processed */
+#define VT102_TRACE_LEVEL_DEBUG		3
+
+#ifndef VT102_TRACE_LEVEL
+/*! the trace level selected; trace events above this level are compiled out */
+#define VT102_TRACE_LEVEL		VT102_TRACE_LEVEL_NONE
+#endif
+
+enum
+{
+	/*! the number of trace events held in the ring buffer; must be a power of two */
+	VT102_TRACE_RING_SIZE	=	4096,
+	/*! the number of arguments recorded with a trace event */
+	VT102_TRACE_NR_ARGS	=	4,
+};
+
+/*! trace event identifiers */
+enum vt102_trace_event
+{
+	/*! an ansi control sequence has been processed
+	 *
+	 * arguments: the final character, the number of
+	 * parameters, the first two parameters */
+	VT102_TRACE_ANSI_CMD	=	0,
+	/*! an ansi control sequence with intermediate characters, or unsupported parameter characters, has been ignored
+	 *
+	 * arguments: the final character, the number of
+	 * parameters read before the control sequence was
+	 * found to be unsupported */
+	VT102_TRACE_ANSI_CMD_IGNORED,
+	/*! a malformed utf-8 sequence has been received
+	 *
+	 * arguments: the input character found to be out of place */
+	VT102_TRACE_UTF8_MALFORMED,
+	/*! an unknown escape sequence has been received
+	 *
+	 * arguments: the character following the escape character */
+	VT102_TRACE_UNKNOWN_ESCAPE,
+	/*! a set mode (SM) control sequence has been received
+	 *
+	 * arguments: the number of parameters, the first three parameters */
+	VT102_TRACE_SET_MODE,
+	/*! a reset mode (RM) control sequence has been received
+	 *
+	 * arguments: the number of parameters, the first three parameters */
+	VT102_TRACE_RESET_MODE,
+	/*! an unsupported select graphic rendition (SGR) parameter has been received
+	 *
+	 * arguments: the parameter */
+	VT102_TRACE_UNHANDLED_SGR,
+	/*! the number of trace event identifiers */
+	VT102_NR_TRACE_EVENTS,
+};
+
+/*
+ *
+ * exported macros follow
+ *
+ */
+
+/*! records a trace event, if the level of the event is enabled
+ *
+ * \param	level	the trace level of the event, one of the
+ *			VT102_TRACE_LEVEL_xxx constants
+ * \param	event	the trace event identifier
+ * \param	a0	the first argument of the event
+ * \param	a1	the second argument of the event
+ * \param	a2	the third argument of the event
+ * \param	a3	the fourth argument of the event */
+#define VT102_TRACE(level, event, a0, a1, a2, a3)				\
+	do									\
+	{									\
+		if ((level) <= VT102_TRACE_LEVEL)				\
+			vt102_trace_record((level), (event), (a0), (a1), (a2), (a3));	\
+	}									\
+	while (0)
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+void vt102_trace_record(int level, enum vt102_trace_event event, int a0, int a1, int a2, int a3);
+void vt102_trace_dump(FILE * f);
+
@@ -0,0 +1,583 @@
+/*!
+ *	\file	vt102-xshm.c
+ *	\brief	vt102 terminal emulator shared memory x renderer
+ *	\author	shopov
+ *
+ *	see the comments in vt102-xshm.h
+ *
+ *	the bitmap font cache holds, for each pixel of each glyph, a
+ *	mask word - all ones for a foreground pixel, zero for a
+ *	background pixel - so that a glyph is rendered into the
+ *	framebuffer with a branch-free loop, which the compiler
+ *	vectorizes (gcc does so at -O3)
+ *
+ *	the cursor is not rendered into the framebuffer - it is drawn
+ *	over the window after presenting the frame, and is erased by
+ *	presenting the row it was drawn on with the next frame; this
+ *	way, moving the framebuffer contents around when scrolling
+ *	never moves the cursor along
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include "vt102-backend-generic.h"
+#include "vt102-xshm.h"
+
+/*
+ *
+ * local constants follow
+ *
+ */
+
+enum
+{
+	/*! the number of glyphs in the bitmap font cache - one for each character code */
+	NR_GLYPHS		=	256,
+	/*! the number of ansi colors passed in by the front-end */
+	NR_ANSI_COLORS		=	8,
+};
+
+/*
+ *
+ * local data types follow
+ *
+ */
+
+/*! the shared memory x renderer data structure */
+struct vt102_xshm
+{
+	/*! the x server connection */
+	Display * disp;
+	/*! the window rendered to */
+	Window win;
+	/*! the graphics context used for presenting the frames, and for drawing the cursor */
+	GC gc;
+	/*! the character cell dimensions, in pixels */
+	int font_width, font_height;
+	/*! the offset of the character origin from the left side of a character cell */
+	int lbearing;
+	/*! the offset of the character baseline from the top side of a character cell */
+	int ascent;
+	/*! the bitmap font cache
+	 *
+	 * holds NR_GLYPHS glyphs, each one font_height rows of
+	 * font_width mask words, one for each pixel - all ones
+	 * for foreground pixels, zero for background pixels */
+	uint32_t * glyphs;
+	/*! the pixel values of the colors of the palette */
+	uint32_t palette[VT102_NR_PALETTE_COLORS];
+	/*! the shared memory segment data */
+	XShmSegmentInfo shminfo;
+	/*! the framebuffer image, null if it has not been allocated */
+	XImage * image;
+	/*! the framebuffer pixels - the image data in the shared memory segment */
+	uint32_t * fb;
+	/*! the number of pixels from the start of a framebuffer pixel row to the start of the next one */
+	int stride;
+	/*! the framebuffer dimensions, in character cells */
+	int width, height;
+	/*! the position where the cursor was drawn with the last frame, cursor_y is -1 if the cursor has not been drawn */
+	int cursor_x, cursor_y;
+};
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! set by attach_error_handler(), if attaching to the shared memory segment fails */
+static bool attach_failed;
+
+/*
+ *
+ * local functions follow
+ *
+ */
+
+/*!
+ *	\fn	static int attach_error_handler(Display * disp, XErrorEvent * err)
+ *	\brief	the x error handler installed while attaching the x server to a shared memory segment
+ *
+ *	the x server fails to attach if it does not run on the same
+ *	host as this process - even though it may well support the
+ *	shared memory extension
+ *
+ *	\param	disp	the x server connection
+ *	\param	err	the error
+ *	\return	ignored */
+static int attach_error_handler(Display * disp, XErrorEvent * err)
+{
+	attach_failed = true;
+	return 0;
+}
+
+/*!
+ *	\fn	static uint32_t rgb_to_pixel(Visual * visual, int red, int green, int blue)
+ *	\brief	returns the pixel value of a color, for a true color visual
+ *
+ *	\param	visual	the visual
+ *	\param	red	the red color component intensity, 0 - 255
+ *	\param	green	the green color component intensity, 0 - 255
+ *	\param	blue	the blue color component intensity, 0 - 255
+ *	\return	the pixel value of the color */
+static uint32_t rgb_to_pixel(Visual * visual, int red, int green, int blue)
+{
+unsigned long masks[3], mask, pixel;
+int intensities[3], i, shift;
+
+	masks[0] = visual->red_mask;
+	masks[1] = visual->green_mask;
+	masks[2] = visual->blue_mask;
+	intensities[0] = red;
+	intensities[1] = green;
+	intensities[2] = blue;
+	for (pixel = i = 0; i < 3; i++)
+	{
+		if (!(mask = masks[i]))
+			continue;
+		for (shift = 0; !(mask & 1); shift++)
+			mask >>= 1;
+		pixel |= ((intensities[i] * mask + 127) / 255) << shift;
+	}
+	return pixel;
+}
+
+/*!
+ *	\fn	static void build_palette(struct vt102_xshm * r, Visual * visual, const unsigned long * ansi_color_pixels)
+ *	\brief	computes the pixel values of the colors of the palette
+ *
+ *	the ansi colors are the ones of the front-end, the rest of
+ *	the colors are the ones of the xterm 256 color palette
+ *
+ *	\param	r	the renderer
+ *	\param	visual	the visual of the framebuffer
+ *	\param	ansi_color_pixels	the pixel values of the eight ansi colors
+ *	\return	none */
+static void build_palette(struct vt102_xshm * r, Visual * visual, const unsigned long * ansi_color_pixels)
+{
+static const unsigned char bright_colors[8][3] =
+{
+	{ 127, 127, 127, },
+	{ 255, 0, 0, },
+	{ 0, 255, 0, },
+	{ 255, 255, 0, },
+	{ 92, 92, 255, },
+	{ 255, 0, 255, },
+	{ 0, 255, 255, },
+	{ 255, 255, 255, },
+};
+static const unsigned char cube_levels[6] = { 0, 95, 135, 175, 215, 255, };
+int i;
+
+	for (i = 0; i < NR_ANSI_COLORS; i++)
+	{
+		r->palette[i] = ansi_color_pixels[i];
+		r->palette[i + 8] = rgb_to_pixel(visual, bright_colors[i][0], bright_colors[i][1], bright_colors[i][2]);
+	}
+	for (i = 0; i < 216; i++)
+		r->palette[16 + i] = rgb_to_pixel(visual, cube_levels[i / 36], cube_levels[i / 6 % 6], cube_levels[i % 6]);
+	for (i = 0; i < 24; i++)
+		r->palette[232 + i] = rgb_to_pixel(visual, 8 + 10 * i, 8 + 10 * i, 8 + 10 * i);
+}
+
+/*!
+ *	\fn	static bool rasterize_glyphs(struct vt102_xshm * r, XFontStruct * font)
+ *	\brief	fills the bitmap font cache, by having the x server render all of the glyphs of a font, and reading them back
+ *
+ *	\param	r	the renderer
+ *	\param	font	the font
+ *	\return	true on success, false on failure */
+static bool rasterize_glyphs(struct vt102_xshm * r, XFontStruct * font)
+{
+Pixmap pixmap;
+GC gc;
+XGCValues gcvals;
+XImage * image;
+uint32_t * glyph;
+int c, x, y, w;
+char ch;
+
+	if (!(r->glyphs = malloc(NR_GLYPHS * r->font_width * r->font_height * sizeof * r->glyphs)))
+		return false;
+	/* render all of the glyphs, side by side, in a bitmap */
+	w = NR_GLYPHS * r->font_width;
+	pixmap = XCreatePixmap(r->disp, r->win, w, r->font_height, 1);
+	gcvals.foreground = 0;
+	gcvals.font = font->fid;
+	gc = XCreateGC(r->disp, pixmap, GCForeground | GCFont, &gcvals);
+	XFillRectangle(r->disp, pixmap, gc, 0, 0, w, r->font_height);
+	XSetForeground(r->disp, gc, 1);
+	for (c = 0; c < NR_GLYPHS; c++)
+	{
+		ch = c;
+		XDrawString(r->disp, pixmap, gc, r->lbearing + c * r->font_width, r->ascent, &ch, 1);
+	}
+	image = XGetImage(r->disp, pixmap, 0, 0, w, r->font_height, 1, XYPixmap);
+	XFreeGC(r->disp, gc);
+	XFreePixmap(r->disp, pixmap);
+	if (!image)
+		return false;
+	/* convert the bitmap to mask words */
+	for (c = 0; c < NR_GLYPHS; c++)
+	{
+		glyph = r->glyphs + c * r->font_width * r->font_height;
+		for (y = 0; y < r->font_height; y++)
+			for (x = 0; x < r->font_width; x++)
+				glyph[y * r->font_width + x] = XGetPixel(image, c * r->font_width + x, y) ? ~ (uint32_t) 0 : 0;
+	}
+	XDestroyImage(image);
+	return true;
+}
+
+/*!
+ *	\fn	static void release_framebuffer(struct vt102_xshm * r)
+ *	\brief	releases the framebuffer, and the shared memory segment holding it
+ *
+ *	\param	r	the renderer
+ *	\return	none */
+static void release_framebuffer(struct vt102_xshm * r)
+{
+	if (!r->image)
+		return;
+	if (r->fb)
+	{
+		XShmDetach(r->disp, &r->shminfo);
+		XSync(r->disp, False);
+	}
+	XDestroyImage(r->image);
+	if (r->shminfo.shmaddr != (char *) -1)
+		shmdt(r->shminfo.shmaddr);
+	r->image = 0;
+	r->fb = 0;
+	r->width = r->height = 0;
+}
+
+/*!
+ *	\fn	static bool alloc_framebuffer(struct vt102_xshm * r, int width, int height)
+ *	\brief	(re)allocates the framebuffer, in a shared memory segment attached by the x server
+ *
+ *	\param	r	the renderer
+ *	\param	width	the framebuffer width, in character cells
+ *	\param	height	the framebuffer height, in character cells
+ *	\return	true on success, false on failure */
+static bool alloc_framebuffer(struct vt102_xshm * r, int width, int height)
+{
+int screen, (* old_handler)(Display *, XErrorEvent *);
+size_t size;
+
+	release_framebuffer(r);
+	screen = DefaultScreen(r->disp);
+	r->shminfo.shmaddr = (char *) -1;
+	if (!(r->image = XShmCreateImage(r->disp, DefaultVisual(r->disp, screen), DefaultDepth(r->disp, screen),
+					ZPixmap, 0, &r->shminfo, width * r->font_width, height * r->font_height)))
+		return false;
+	if (r->image->bits_per_pixel != 32)
+		goto error;
+	size = r->image->bytes_per_line * r->image->height;
+	if ((r->shminfo.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600)) == -1)
+		goto error;
+	r->shminfo.shmaddr = r->image->data = shmat(r->shminfo.shmid, 0, 0);
+	if (r->shminfo.shmaddr == (char *) -1)
+	{
+		shmctl(r->shminfo.shmid, IPC_RMID, 0);
+		goto error;
+	}
+	r->shminfo.readOnly = False;
+	attach_failed = false;
+	old_handler = XSetErrorHandler(attach_error_handler);
+	XShmAttach(r->disp, &r->shminfo);
+	XSync(r->disp, False);
+	XSetErrorHandler(old_handler);
+	/* the segment is destroyed once both this process
+	 * and the x server have detached from it */
+	shmctl(r->shminfo.shmid, IPC_RMID, 0);
+	if (attach_failed)
+		goto error;
+	r->fb = (uint32_t *) r->image->data;
+	r->stride = r->image->bytes_per_line / sizeof * r->fb;
+	r->width = width;
+	r->height = height;
+	return true;
+
+error:
+	release_framebuffer(r);
+	return false;
+}
+
+/*!
+ *	\fn	static void blit_span(struct vt102_xshm * r, int x, int y, const unsigned char * text, int len, uint32_t attr)
+ *	\brief	renders a span of characters, all having the same graphics rendition attributes, into the framebuffer
+ *
+ *	\param	r	the renderer
+ *	\param	x	the column of the first character
+ *	\param	y	the row of the characters
+ *	\param	text	the character codes
+ *	\param	len	the number of characters
+ *	\param	attr	the graphics rendition attribute word of the characters
+ *	\return	none */
+static void blit_span(struct vt102_xshm * r, int x, int y, const unsigned char * text, int len, uint32_t attr)
+{
+const uint32_t * restrict m;
+uint32_t * row, * restrict dst, fg, bg, diff;
+int i, j, k, w, h;
+
+	w = r->font_width;
+	h = r->font_height;
+	fg = r->palette[vt102_attr_fg(attr)];
+	bg = r->palette[vt102_attr_bg(attr)];
+	diff = fg ^ bg;
+	row = r->fb + y * h * r->stride + x * w;
+	for (k = 0; k < len; k++, row += w)
+	{
+		m = r->glyphs + text[k] * w * h;
+		dst = row;
+		if (!(attr & VT102_ATTR_BOLD))
+			/* straight, branch-free loops over
+			 * the pixels - these get vectorized */
+			for (j = 0; j < h; j++, dst += r->stride, m += w)
+				for (i = 0; i < w; i++)
+					dst[i] = bg ^ (diff & m[i]);
+		else
+			/* render bold characters by overstriking
+			 * the glyph, one pixel to the right */
+			for (j = 0; j < h; j++, dst += r->stride, m += w)
+			{
+				dst[0] = bg ^ (diff & m[0]);
+				for (i = 1; i < w; i++)
+					dst[i] = bg ^ (diff & (m[i] | m[i - 1]));
+			}
+	}
+	if ((attr & VT102_ATTR_UNDERLINE) && r->ascent + 1 < h)
+	{
+		dst = r->fb + (y * h + r->ascent + 1) * r->stride + x * w;
+		for (i = 0; i < len * w; i++)
+			dst[i] = fg;
+	}
+}
+
+/*!
+ *	\fn	static void scroll_framebuffer(struct vt102_xshm * r, struct vt102_scroll_op * op)
+ *	\brief	applies a scroll operation queued by the vt102 backend to the framebuffer
+ *
+ *	the rows scrolled in are marked by the backend for
+ *	refreshing, and are redrawn afterwards
+ *
+ *	\param	r	the renderer
+ *	\param	op	the scroll operation
+ *	\return	none */
+static void scroll_framebuffer(struct vt102_xshm * r, struct vt102_scroll_op * op)
+{
+int n, delta, row_size;
+uint32_t * top;
+
+	n = op->bottom - op->top + 1;
+	delta = op->delta < 0 ? - op->delta : op->delta;
+	/* see if anything is left to be moved */
+	if (delta >= n)
+		return;
+	row_size = r->font_height * r->stride;
+	top = r->fb + op->top * row_size;
+	if (op->delta > 0)
+		memmove(top, top + delta * row_size, (n - delta) * row_size * sizeof * top);
+	else
+		memmove(top + delta * row_size, top, (n - delta) * row_size * sizeof * top);
+}
+
+/*
+ *
+ * exported functions follow
+ *
+ */
+
+/*!
+ *	\fn	struct vt102_xshm * vt102_xshm_create(Display * disp, Window win, XFontStruct * font, const unsigned long * ansi_color_pixels)
+ *	\brief	creates a shared memory x renderer
+ *
+ *	\param	disp	the x server connection
+ *	\param	win	the window to render to
+ *	\param	font	the font to render the characters with
+ *	\param	ansi_color_pixels	the pixel values of the eight
+ *				ansi colors (see the comments for struct
+ *				term_data in vt102-backend-generic.h)
+ *	\return	a pointer to the new renderer, or null if the
+ *		shared memory x extension cannot be used (or on
+ *		failure - out of memory) */
+struct vt102_xshm * vt102_xshm_create(Display * disp, Window win, XFontStruct * font, const unsigned long * ansi_color_pixels)
+{
+struct vt102_xshm * r;
+Visual * visual;
+XGCValues gcvals;
+
+	visual = DefaultVisual(disp, DefaultScreen(disp));
+	if (!XShmQueryExtension(disp) || visual->class != TrueColor)
+		return 0;
+	if (!(r = calloc(1, sizeof * r)))
+		return 0;
+	r->disp = disp;
+	r->win = win;
+	r->font_width = font->max_bounds.rbearing - font->min_bounds.lbearing;
+	r->font_height = font->max_bounds.ascent + font->max_bounds.descent;
+	r->lbearing = - font->min_bounds.lbearing;
+	r->ascent = font->max_bounds.ascent;
+	r->cursor_y = -1;
+	build_palette(r, visual, ansi_color_pixels);
+	if (!rasterize_glyphs(r, font))
+	{
+		free(r->glyphs);
+		free(r);
+		return 0;
+	}
+	gcvals.foreground = r->palette[7];
+	gcvals.graphics_exposures = False;
+	r->gc = XCreateGC(disp, win, GCForeground | GCGraphicsExposures, &gcvals);
+	/* see if the x server can attach to a shared memory segment */
+	if (!alloc_framebuffer(r, 1, 1))
+	{
+		vt102_xshm_destroy(r);
+		return 0;
+	}
+	return r;
+}
+
+/*!
+ *	\fn	void vt102_xshm_destroy(struct vt102_xshm * r)
+ *	\brief	destroys a shared memory x renderer
+ *
+ *	\param	r	the renderer to destroy
+ *	\return	none */
+void vt102_xshm_destroy(struct vt102_xshm * r)
+{
+	release_framebuffer(r);
+	XFreeGC(r->disp, r->gc);
+	free(r->glyphs);
+	free(r);
+}
+
+/*!
+ *	\fn	void vt102_xshm_render(struct vt102_xshm * r, struct term_data * tdata, struct vt102_xshm_frame_stats * stats)
+ *	\brief	renders the changes made to a vt102 screen, and presents them in the window
+ *
+ *	the changes are consumed - the row refresh-needed flags
+ *	and the scroll operation queue of the screen are reset;
+ *	when this returns, the x server is done reading the
+ *	framebuffer
+ *
+ *	\param	r	the renderer
+ *	\param	tdata	the screen to render
+ *	\param	stats	the amount of drawing done is stored here
+ *	\return	none */
+void vt102_xshm_render(struct vt102_xshm * r, struct term_data * tdata, struct vt102_xshm_frame_stats * stats)
+{
+int i, j, k, x, x1, y0, y1;
+unsigned char * chrow;
+uint32_t * grrow, grdata;
+
+	memset(stats, 0, sizeof * stats);
+	if (tdata->con_width != r->width || tdata->con_height != r->height)
+	{
+		/* the screen has been resized - redraw all of it */
+		if (!alloc_framebuffer(r, tdata->con_width, tdata->con_height))
+			return;
+		r->cursor_y = -1;
+		tdata->nr_scroll_ops = 0;
+		for (i = 0; i < tdata->con_height; i++)
+		{
+			tdata->must_refresh_line_buf[i] = true;
+			tdata->dirty_spans[i].x0 = 0;
+			tdata->dirty_spans[i].x1 = tdata->con_width;
+		}
+	}
+	/* the range of rows to present */
+	y0 = r->height;
+	y1 = -1;
+	/* first move the screen contents scrolled, then
+	 * redraw the rows that have changed */
+	for (i = 0; i < tdata->nr_scroll_ops; i++)
+	{
+		scroll_framebuffer(r, tdata->scroll_ops + i);
+		if (tdata->scroll_ops[i].top < y0)
+			y0 = tdata->scroll_ops[i].top;
+		if (tdata->scroll_ops[i].bottom > y1)
+			y1 = tdata->scroll_ops[i].bottom;
+	}
+	tdata->nr_scroll_ops = 0;
+	for (i = 0; i < tdata->con_height; i++)
+	{
+		if (!tdata->must_refresh_line_buf[i])
+			continue;
+		chrow = vt102_generic_backend_chrow(tdata, i);
+		grrow = vt102_generic_backend_grrow(tdata, i);
+		x1 = tdata->dirty_spans[i].x1;
+		for (j = tdata->dirty_spans[i].x0; j < x1; j = k)
+		{
+			grdata = grrow[j];
+			for (k = j + 1; k < x1; k++)
+				if (grrow[k] != grdata)
+					break;
+			if (grdata >> VT102_ATTR_CHAR_SHIFT)
+				/* the bitmap font cache only holds the glyphs
+				 * of the characters in the range 0 - 255 - draw
+				 * placeholders for the rest */
+				for (x = j; x < k; x++)
+					blit_span(r, x, i, (const unsigned char *) "?", 1, grdata);
+			else
+				blit_span(r, j, i, chrow + j, k - j, grdata);
+		}
+		stats->nr_rows_drawn ++;
+		stats->nr_cells_drawn += x1 - tdata->dirty_spans[i].x0;
+		tdata->must_refresh_line_buf[i] = false;
+		if (i < y0)
+			y0 = i;
+		if (i > y1)
+			y1 = i;
+	}
+	/* erase the cursor drawn with the previous frame */
+	if (r->cursor_y >= 0 && r->cursor_y < r->height)
+	{
+		if (r->cursor_y < y0)
+			y0 = r->cursor_y;
+		if (r->cursor_y > y1)
+			y1 = r->cursor_y;
+	}
+	if (y1 >= y0)
+	{
+		XShmPutImage(r->disp, r->win, r->gc, r->image,
+				0, y0 * r->font_height,
+				0, y0 * r->font_height,
+				r->width * r->font_width,
+				(y1 - y0 + 1) * r->font_height,
+				False);
+		stats->nr_requests ++;
+	}
+	/* draw the cursor */
+	XDrawRectangle(r->disp, r->win, r->gc,
+			tdata->cursor_x * r->font_width,
+			tdata->cursor_y * r->font_height,
+			r->font_width - 1,
+			r->font_height - 1);
+	r->cursor_x = tdata->cursor_x;
+	r->cursor_y = tdata->cursor_y;
+	/* wait for the x server to finish reading the framebuffer,
+	 * before it gets modified for the next frame */
+	XSync(r->disp, False);
+	stats->nr_requests += 2;
+}
+
@@ -0,0 +1,81 @@
+/*!
+ *	\file	vt102-xshm.h
+ *	\brief	vt102 terminal emulator shared memory x renderer header file
+ *	\author	shopov
+ *
+ *	this module renders the screen of the generic vt102 backend
+ *	to an x window by rasterizing the characters on the client
+ *	side, into a framebuffer shared with the x server (by means
+ *	of the MIT-SHM x extension), and presenting each frame with
+ *	a single XShmPutImage() request - as opposed to issuing x
+ *	drawing requests for every stride of text
+ *
+ *	the renderer reads the term_data (see vt102-backend-generic.h)
+ *	screen state in the same way the x front-ends do - it applies
+ *	the scroll operations queued, redraws the spans of characters
+ *	that must be refreshed, and resets the row refresh-needed
+ *	flags and the scroll operation queue; so term_data snapshots
+ *	(see vt102-snapshot.h) can be rendered as well
+ *
+ *	the glyphs of the font are rasterized once, when the renderer
+ *	is created, into a bitmap font cache; all 256 colors of the
+ *	palette (see VT102_ATTR_xxx in vt102-backend-generic.h) are
+ *	rendered
+ *
+ *	the shared memory extension is only available for local x
+ *	displays, and only 32 bits per pixel true color visuals are
+ *	supported; if the renderer cannot be used,
+ *	vt102_xshm_create() fails, and the front-end should fall
+ *	back to rendering with x drawing requests
+ *
+ *	\note	programs using this module must be linked with
+ *		the x extension library (-lXext)
+ *
+ *	Revision summary:
+ *
+ *	$Log: $
+ */
+
+/*
+ *
+ * include section follows
+ *
+ */
+#include <X11/Xlib.h>
+
+/*
+ *
+ * opaque data types follow
+ *
+ */
+struct vt102_xshm;
+/* defined in vt102-backend-generic.h */
+struct term_data;
+
+/*
+ *
+ * exported data types follow
+ *
+ */
+
+/*! the amount of drawing done when rendering a frame */
+struct vt102_xshm_frame_stats
+{
+	/*! the number of screen rows redrawn */
+	int nr_rows_drawn;
+	/*! the number of character cells redrawn */
+	int nr_cells_drawn;
+	/*! the number of requests made to the x server */
+	int nr_requests;
+};
+
+/*
+ *
+ * exported function prototypes follow
+ *
+ */
+
+struct vt102_xshm * vt102_xshm_create(Display * disp, Window win, XFontStruct * font, const unsigned long * ansi_color_pixels);
+void vt102_xshm_destroy(struct vt102_xshm * r);
+void vt102_xshm_render(struct vt102_xshm * r, struct term_data * tdata, struct vt102_xshm_frame_stats * stats);
+
@@ -536,10 +536,17 @@ Table 5-7 describes modes specified in ANSI X3.64-1979 that are permanently set,
  *
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 
+#include "vt102-scan.h"
+#ifndef VT102_STATIC_BACKEND
+/* otherwise, the backend compiled in the same translation
+ * unit has already included these, see vt102-generic-static.c */
 #include "vt102.h"
+#include "vt102-trace.h"
+#endif
 
 /*
  *
@@ -552,14 +559,14 @@ Table 5-7 describes modes specified in ANSI X3.64-1979 that are permanently set,
 extern dtrace(char * msg, int line);
 #define panic(msg)	do { dtrace(msg, __LINE__); while (0); } while (0)
 
-/*! the maximum length of an ansi command string that can be handled
+/*! the maximum number of parameters supported in an ansi command string
  *
- * \todo	this is currently arbitrary - maybe put
- *		a more well-defined value here */
-//static const int MAX_ANSI_CMD_LEN = 32;
-#define MAX_ANSI_CMD_LEN 32
-/*! the maximum number of parameters supported in an ansi command string */
-static const int MAX_NR_ANSI_CMD_PARAMS = 32;
+ * any parameters past this number are ignored */
+#define MAX_NR_ANSI_CMD_PARAMS	32
+/*! the maximum value of an ansi command parameter; larger values are clamped to this */
+#define MAX_ANSI_CMD_PARAM_VALUE	65535
+/*! the DEC private mode number of the synchronized update mode (BSU/ESU - begin/end synchronized update) */
+#define DEC_MODE_SYNCHRONIZED_UPDATE	2026
 
 /*
  *
@@ -614,19 +621,199 @@ struct vt102_state
 		 *
 		 * the state machine is reading characters
 		 * following an already detected ansi CSI sequence
-		 * (control sequence introducer - ESC '[') */
+		 * (control sequence introducer - ESC '['); no
+		 * characters of the command string have been
+		 * read yet */
 		VT102_STATE_ANSI_CMD_READ,
+		/*! the state machine is reading the parameters of an ecma-48 ansi command sequence */
+		VT102_STATE_ANSI_CMD_PARAM,
+		/*! the state machine is reading an ecma-48 ansi command sequence that will be ignored
+		 *
+		 * this is an ansi command sequence containing
+		 * intermediate characters, or parameter
+		 * characters not supported by the vt102 */
+		VT102_STATE_ANSI_CMD_IGNORE,
+		/*! the number of states of the state machine */
+		VT102_NR_STATES,
 	}
 	state;
-	/*! the buffer holding a complete ansi command string
+	/*! the parameters of the ansi command string being read
 	 *
-	 * the CSI (control sequence introducer bytes - ESC '[')
-	 * are not stored here */
-	unsigned char cmd[MAX_ANSI_CMD_LEN];
-	/*! the index in the cmd buffer above of the first character past the command string already stored in the cmd buffer */
-	int cmd_idx;
+	 * the parameters are accumulated here as the command
+	 * string characters are received; parameters past
+	 * MAX_NR_ANSI_CMD_PARAMS are accumulated in the
+	 * last, extra, element, which is then discarded;
+	 * all elements past the parameters read so far are
+	 * always zero (which is the default value of a parameter) */
+	int cmd_params[MAX_NR_ANSI_CMD_PARAMS + 1];
+	/*! the number of parameters of the ansi command string read so far, including the one being read */
+	int nr_cmd_params;
+	/*! true if the ansi command string being read has a private parameter sequence (first character in the range 0x3c - 0x3f) */
+	bool is_private_param;
+	/*! the bits of the code point of the utf-8 sequence being decoded, accumulated so far */
+	unsigned int utf8_codepoint;
+	/*! the number of continuation bytes still expected for the utf-8 sequence being decoded, zero if no sequence is being decoded */
+	int utf8_nr_pending;
+	/*! the range the next continuation byte of the utf-8 sequence being decoded must be in
+	 *
+	 * this is narrower than 0x80 - 0xbf for the second byte of some
+	 * sequences, so that overlong encodings, utf-16 surrogates and
+	 * code points past U+10FFFF are rejected as soon as possible */
+	unsigned char utf8_lower, utf8_upper;
 	/*! the data structure holding the interface to a vt102 terminal emulator backend */
 	struct vt102_backend_ops * backend_ops;
+	/*! the command parser counters */
+	struct vt102_stats stats;
+};
+
+/*! the actions performed by the command parser state machine on an input character
+ *
+ * these are named after the actions in the state machine of
+ * the DEC terminal parser by Paul Williams (see
+ * http://www.vt100.net/emu/dec_ansi_parser), which this
+ * command parser state machine is a subset of */
+enum parser_action
+{
+	/*! ignore the input character */
+	ACTION_IGNORE		=	0,
+	/*! display the input character */
+	ACTION_PRINT,
+	/*! handle the input (control) character */
+	ACTION_EXECUTE,
+	/*! discard any ansi command string read so far - an escape sequence is starting */
+	ACTION_CLEAR,
+	/*! process the final character of an escape sequence */
+	ACTION_ESC_DISPATCH,
+	/*! abort an escape sequence, whose final character is not known */
+	ACTION_ESC_UNKNOWN,
+	/*! mark the ansi command string being read as having a private parameter sequence */
+	ACTION_PRIVATE_MARKER,
+	/*! accumulate the input (parameter) character in the ansi command parameters */
+	ACTION_PARAM,
+	/*! process the ansi command string, the input character is its final character */
+	ACTION_CSI_DISPATCH,
+	/*! ignore the ansi command string, the input character is its final character */
+	ACTION_CSI_IGNORE,
+	/*! the state machine is in an invalid state */
+	ACTION_PANIC,
+};
+
+/*! an entry in the command parser state transition table */
+struct parser_transition
+{
+	/*! the action to perform on the input character, one of the enum parser_action constants */
+	unsigned char action;
+	/*! the state to move the state machine to */
+	unsigned char next_state;
+};
+
+/*
+ *
+ * local data follows
+ *
+ */
+
+/*! the command parser state transition table
+ *
+ * this is indexed by the current state of the state machine and
+ * the (7 bit) input character, so that processing a character
+ * takes a single table lookup, followed by performing the action
+ * found in the table; entries for ranges of characters are filled
+ * in first, and then some of the entries in these ranges are
+ * overridden for particular characters
+ *
+ * note that an escape character (ESC) starts a new escape sequence
+ * in any state, and that when an escape sequence is started, a
+ * control character (or any other character which is not a known
+ * escape sequence final character) aborts the escape sequence, but
+ * that control characters are ignored while reading an ansi command
+ * string */
+static const struct parser_transition parser_table[VT102_NR_STATES][128] =
+{
+	[VT102_STATE_INVALID] =
+	{
+		[0x00 ... 0x7f]	=	{ ACTION_PANIC, VT102_STATE_INVALID, },
+		[ANSI_ESC]	=	{ ACTION_CLEAR, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+	},
+	[VT102_STATE_NORMAL_INPUT] =
+	{
+		[0x00 ... 0x1f]	=	{ ACTION_EXECUTE, VT102_STATE_NORMAL_INPUT, },
+		[0x20 ... 0x7f]	=	{ ACTION_PRINT, VT102_STATE_NORMAL_INPUT, },
+		[ANSI_ESC]	=	{ ACTION_CLEAR, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+	},
+	[VT102_STATE_ESCAPE_SEQUENCE_STARTED] =
+	{
+		[0x00 ... 0x7f]	=	{ ACTION_ESC_UNKNOWN, VT102_STATE_NORMAL_INPUT, },
+		[ANSI_ESC]	=	{ ACTION_CLEAR, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		/* ansi CSI (control sequence introducer) - wait for
+		 * more characters to determine the exact command requested */
+		['[']		=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_READ, },
+		/* SCS - select character sets - not supported; the
+		 * character set designator that follows is ignored
+		 * as an unknown escape sequence final character */
+		['(']		=	{ ACTION_IGNORE, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		/* IND - index - not supported */
+		['D']		=	{ ACTION_IGNORE, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		/* RI - reverse index */
+		['M']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_NORMAL_INPUT, },
+		/* SS2, SS3, NEL, DECSC, DECRC, HTS, line attributes,
+		 * DECID, RIS - not supported */
+		['N']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['O']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['E']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['7']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['8']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['H']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['#']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['Z']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		['c']		=	{ ACTION_ESC_DISPATCH, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+		/* vt52 compatible mode - ignored */
+		['=']		=	{ ACTION_IGNORE, VT102_STATE_NORMAL_INPUT, },
+		['>']		=	{ ACTION_IGNORE, VT102_STATE_NORMAL_INPUT, },
+	},
+	/* an ansi command string is being read until a final
+	 * byte is recognized (a final byte is one in the range
+	 * 0x40 - 0x7e, bytes before it in the range 0x30 - 0x3f
+	 * are parameter bytes, in the range 0x20 - 0x2f -
+	 * intermediate bytes); the parameters are accumulated
+	 * as they are read, the only parameter bytes supported
+	 * by the vt102 are decimal digits, parameter delimiters
+	 * (';'), and a private parameter sequence marker in the
+	 * range 0x3c - 0x3f as the first byte of the command
+	 * string; the vt102 does not support any intermediate
+	 * bytes - commands containing them, or unsupported
+	 * parameter bytes, are ignored */
+	[VT102_STATE_ANSI_CMD_READ] =
+	{
+		[0x00 ... 0x1f]	=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_READ, },
+		[0x20 ... 0x2f]	=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[0x30 ... 0x39]	=	{ ACTION_PARAM, VT102_STATE_ANSI_CMD_PARAM, },
+		[':']		=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[';']		=	{ ACTION_PARAM, VT102_STATE_ANSI_CMD_PARAM, },
+		[0x3c ... 0x3f]	=	{ ACTION_PRIVATE_MARKER, VT102_STATE_ANSI_CMD_PARAM, },
+		[0x40 ... 0x7e]	=	{ ACTION_CSI_DISPATCH, VT102_STATE_NORMAL_INPUT, },
+		[0x7f]		=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_READ, },
+		[ANSI_ESC]	=	{ ACTION_CLEAR, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+	},
+	[VT102_STATE_ANSI_CMD_PARAM] =
+	{
+		[0x00 ... 0x1f]	=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_PARAM, },
+		[0x20 ... 0x2f]	=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[0x30 ... 0x39]	=	{ ACTION_PARAM, VT102_STATE_ANSI_CMD_PARAM, },
+		[':']		=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[';']		=	{ ACTION_PARAM, VT102_STATE_ANSI_CMD_PARAM, },
+		[0x3c ... 0x3f]	=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[0x40 ... 0x7e]	=	{ ACTION_CSI_DISPATCH, VT102_STATE_NORMAL_INPUT, },
+		[0x7f]		=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_PARAM, },
+		[ANSI_ESC]	=	{ ACTION_CLEAR, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+	},
+	[VT102_STATE_ANSI_CMD_IGNORE] =
+	{
+		[0x00 ... 0x3f]	=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[0x40 ... 0x7e]	=	{ ACTION_CSI_IGNORE, VT102_STATE_NORMAL_INPUT, },
+		[0x7f]		=	{ ACTION_IGNORE, VT102_STATE_ANSI_CMD_IGNORE, },
+		[ANSI_ESC]	=	{ ACTION_CLEAR, VT102_STATE_ESCAPE_SEQUENCE_STARTED, },
+	},
 };
 
 /*
@@ -667,23 +854,23 @@ static void handle_control_char(struct vt102_state * state, unsigned int input_c
                         ////!!!! panic("");
 			break;
 		/* Backspace 		*/ case ANSI_BS:/* 	Moves cursor to the left one character position; if cursor is at left margin, no action occurs.*/
-			state->backend_ops->handle_backspace(state->backend_ops->param);
+			VT102_BACKEND_CALL(state->backend_ops, handle_backspace, state->backend_ops->param);
 			break;
 		/* Horizontal tab 	*/ case ANSI_HT:/* 	Moves cursor to next tab stop, or to right margin if there are no more tab stops.*/
-                        state->backend_ops->handle_horiz_tab(state->backend_ops->param, state);
+                        VT102_BACKEND_CALL(state->backend_ops, handle_horiz_tab, state->backend_ops->param, state);
 			break;
 		/* Linefeed 		*/ case ANSI_LF:/* 	Causes a linefeed or a new line operation. (See Linefeed/New Line). Also causes printing if auto print operation is selected.*/
-			state->backend_ops->handle_linefeed(state->backend_ops->param);
+			VT102_BACKEND_CALL(state->backend_ops, handle_linefeed, state->backend_ops->param);
 			break;
 		/* Vertical tab 	*/ case ANSI_VT:/* 	Processed as LF.*/
                         /*!	\todo	handle this properly!!! */
                         //panic("");
 			break;
 		/* Form feed 		*/ case ANSI_FF:/* 	Processed as LF. FF can also be selected as a half-duplex turnaround character.*/
-			state->backend_ops->handle_linefeed(state->backend_ops->param);
+			VT102_BACKEND_CALL(state->backend_ops, handle_linefeed, state->backend_ops->param);
 			break;
 		/* Carriage return 	*/ case ANSI_CR:/* 	Moves cursor to left margin on current line. CR can also be selected as a half-duplex turnaround character.*/
-			state->backend_ops->handle_carriage_return(state->backend_ops->param);
+			VT102_BACKEND_CALL(state->backend_ops, handle_carriage_return, state->backend_ops->param);
 			break;
 		/* Shift out 		*/ case ANSI_SO:/* 	Selects G1 character set designated by a select character set sequence.*/
                         /*!	\todo	handle this properly!!! */
@@ -721,122 +908,106 @@ static void handle_control_char(struct vt102_state * state, unsigned int input_c
 }
 
 /*!
- *	\fn	static bool is_displayable(unsigned int input_char)
- *	\brief	tells if a character is not a control character (i.e., outside the range 0x00 - 0x1f)
+ *	\fn	static inline void clear_ansi_cmd(struct vt102_state * state)
+ *	\brief	discards the parameters of the ansi command string read so far
  *
- *	\param	input_char	the input character
- *	\return	true, if the input character is not a control character
- *		(i.e. when it is in the range 0x20 - 0x7f), false otherwise
- *		(i.e. when it is a control character in the range 0x00 - 0x1f) */
-static bool is_displayable(unsigned int input_char)
+ *	\param	state	the vt102 state variable
+ *	\return	none */
+static inline void clear_ansi_cmd(struct vt102_state * state)
 {
-	return input_char > 0x1f;
+	/* only the parameters read so far may be nonzero */
+	while (state->nr_cmd_params)
+		state->cmd_params[-- state->nr_cmd_params] = 0;
+	state->is_private_param = false;
 }
 
 /*!
- *	\fn	static inline void put_in_cmd_buf(struct vt102_state * state, int input_char)
- *	\brief	puts a character in the ansi command buffer of the state passed, performing various checks
+ *	\fn	static inline void put_param_char(struct vt102_state * state, unsigned int input_char)
+ *	\brief	accumulates an ansi command string parameter character (a decimal digit, or a ';' parameter delimiter) in the parameters of the state passed
  *
- *	\param	state	the vt102 state variable in which the command buffer
- *			resides
- *	\param	input_char	the character to put in the buffer
+ *	\param	state	the vt102 state variable
+ *	\param	input_char	the parameter character
  *	\return	none */
-static inline void put_in_cmd_buf(struct vt102_state * state, int input_char)
+static inline void put_param_char(struct vt102_state * state, unsigned int input_char)
 {
-	if (state->cmd_idx >= MAX_ANSI_CMD_LEN)
+int * param;
+
+	if (!state->nr_cmd_params)
+		/* start the first parameter */
+		state->nr_cmd_params = 1;
+	if (input_char == ';')
 	{
-		panic("");
+		/* start the next parameter, unless already past
+		 * the last parameter supported */
+		if (state->nr_cmd_params <= MAX_NR_ANSI_CMD_PARAMS)
+			state->nr_cmd_params ++;
+		return;
 	}
-	state->cmd[state->cmd_idx++] = input_char;
+	param = state->cmd_params + state->nr_cmd_params - 1;
+	* param = * param * 10 + input_char - '0';
+	if (* param > MAX_ANSI_CMD_PARAM_VALUE)
+		* param = MAX_ANSI_CMD_PARAM_VALUE;
 }
 
 /*!
- *	\fn	static void process_ansi_cmd(struct vt102_state * state)
+ *	\fn	static void set_private_modes(struct vt102_state * state, const int * cmd_params, int nr_params, bool enable)
+ *	\brief	processes the parameters of a DEC private SM/RM (set mode/reset mode) command
+ *
+ *	the only private mode supported at this time is the synchronized
+ *	update mode (2026); the others are ignored
+ *
+ *	\param	state	the vt102 state variable
+ *	\param	cmd_params	the mode numbers
+ *	\param	nr_params	the number of mode numbers
+ *	\param	enable	true if the modes are to be set, false if they are to be reset
+ *	\return	none */
+static void set_private_modes(struct vt102_state * state, const int * cmd_params, int nr_params, bool enable)
+{
+int i;
+
+	for (i = 0; i < nr_params; i++)
+		switch (cmd_params[i])
+		{
+			case DEC_MODE_SYNCHRONIZED_UPDATE:
+				if (state->backend_ops->set_synchronized_update)
+					VT102_BACKEND_CALL(state->backend_ops, set_synchronized_update,
+							state->backend_ops->param, enable);
+				break;
+		}
+}
+
+/*!
+ *	\fn	static void process_ansi_cmd(struct vt102_state * state, unsigned int c)
  *	\brief	processes a completely received ansi command string
  *
  *	\todo	document error handling
  *
- *	this function takes as input a complete ansi command string,
- *	extracts any command parameters, and executes the command requested
+ *	this function takes the command parameters already accumulated
+ *	while the ansi command string was being received, and executes
+ *	the command requested
  *
  *	\param	state	the vt102 state variable in which the command
- *			buffer resides
+ *			parameters reside
+ *	\param	c	the final character of the ansi command string
+ *			(the command character)
  *	\return	none */
-static void process_ansi_cmd(struct vt102_state * state)
+static void process_ansi_cmd(struct vt102_state * state, unsigned int c)
 {
 int nr_params;
-int cmd_params[MAX_NR_ANSI_CMD_PARAMS];
+int * cmd_params;
 int i;
-/* this variable holds the numerical parameter currently extracted */
-int param;
-unsigned char c;
-bool is_private_param;
 /* the generic parameter value used when invoking functions from the backend */
 void * backend_param;
-bool is_scanning_param;
-
-
-	printf("%s(): ", __func__);
-	for (i = 0; i < state->cmd_idx; i++)
-		printf("%i ", state->cmd[i]);
-
-	/* zero-out parameters value by default */
-	memset(cmd_params, 0, sizeof cmd_params);
-	i = nr_params = param = 0;
-	is_scanning_param = is_private_param = false;
-	/* extract ansi command parameters */
-	/* see if this is the start of a
-	 * private parameter sequence (first character in
-	 * the range 0x3c - 0x3f) */
-	if (0x3c <= state->cmd[0] && state->cmd[0] <= 0x3f)
-	{
-		is_private_param = true;
-		/* skip to next character */
-		i++;
-	}
-	while (i < state->cmd_idx)
-	{
-		/* get the next byte from the command string */
-		c = state->cmd[i++];
-		/* see if this is a parameter delimiter */
-		if (c == ';')
-		{
-			is_scanning_param = true;
-			if (nr_params == MAX_NR_ANSI_CMD_PARAMS)
-				panic("");
-			cmd_params[nr_params++] = param;
-			param = 0;
-			continue;
-		}
-		/* see if this is a numerical parameter character */
-		if (0x30 <= c && c <= 0x3f)
-		{
-			is_scanning_param = true;
-			if (0x3a <= c && c <= 0x3f)
-				panic("");
-			param *= 10;
-			param += c - 0x30;
-		}
-		else
-		{
-			/* assume this is the end of the parameter list -
-			 * the final (command) character */
-			if (is_scanning_param)
-			{
-				if (nr_params == MAX_NR_ANSI_CMD_PARAMS)
-					panic("");
-				cmd_params[nr_params++] = param;
-			}
-			break;
-		}
-	}
-	/* the vt102 does not support intermediate characters, so expect
-	 * processing has arrived at the final character */
-	if (i != state->cmd_idx)
-	{
-		////!!!!panic("");
-		return;
-	}
+
+	cmd_params = state->cmd_params;
+	nr_params = state->nr_cmd_params;
+	if (nr_params > MAX_NR_ANSI_CMD_PARAMS)
+		/* ignore the excess parameters */
+		nr_params = MAX_NR_ANSI_CMD_PARAMS;
+	VT102_TRACE(VT102_TRACE_LEVEL_DEBUG, VT102_TRACE_ANSI_CMD,
+			c, nr_params, cmd_params[0], cmd_params[1]);
+	state->stats.nr_ansi_cmds ++;
+	state->stats.nr_ansi_cmds_by_final_char[c] ++;
 
 	backend_param = state->backend_ops->param;
 	/* extract the final character (the command character)
@@ -851,17 +1022,19 @@ bool is_scanning_param;
 			panic(cmd_params);cmd_params[i] = 0; panic(cmd_params);
 			panic("");
 #endif
-			printf("set mode: ");
-			for (i = 0; i < nr_params; i++)
-				printf("%i ", cmd_params[i]);
+			if (state->is_private_param)
+				set_private_modes(state, cmd_params, nr_params, true);
+			VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_SET_MODE,
+					nr_params, cmd_params[0], cmd_params[1], cmd_params[2]);
 			break;
 		case 'l':
 			/* RM - reset mode */
 			////!!!!panic("");
                         panic("");
-                        printf("reset mode: ");
-			for (i = 0; i < nr_params; i++)
-				printf("%i ", cmd_params[i]);
+			if (state->is_private_param)
+				set_private_modes(state, cmd_params, nr_params, false);
+			VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_RESET_MODE,
+					nr_params, cmd_params[0], cmd_params[1], cmd_params[2]);
 			break;
 		case 'm':
 			/* SGR - select graphic rendition */
@@ -869,13 +1042,13 @@ bool is_scanning_param;
 			if (nr_params == 0)
 				/* parameter default value */
 				nr_params = 1;
-			state->backend_ops->select_graphic_rendition(backend_param,
+			VT102_BACKEND_CALL(state->backend_ops, select_graphic_rendition, backend_param,
 					cmd_params,
 					nr_params);
 			break;
 		case 'r':
 			/* DECSTBM - set top and bottom margins (scrolling region) */
-			state->backend_ops->set_top_and_bottom_margins(backend_param,
+			VT102_BACKEND_CALL(state->backend_ops, set_top_and_bottom_margins, backend_param,
 					cmd_params[0] - 1,
 					cmd_params[1] - 1);
 			break;
@@ -890,7 +1063,7 @@ bool is_scanning_param;
 				i = 1;
 			else
 				i = cmd_params[0];
-                        state->backend_ops->move_cursor_relative(backend_param, 0, -i);
+                        VT102_BACKEND_CALL(state->backend_ops, move_cursor_relative, backend_param, 0, -i);
 			break;
 		case 'B':
 			/* CUD - cursor down */
@@ -899,7 +1072,7 @@ bool is_scanning_param;
 				i = 1;
 			else
 				i = cmd_params[0];
-			state->backend_ops->move_cursor_relative(backend_param, 0, i);
+			VT102_BACKEND_CALL(state->backend_ops, move_cursor_relative, backend_param, 0, i);
 			break;
 		case 'C':
 			/* CUF - cursor forward(right) */
@@ -908,7 +1081,7 @@ bool is_scanning_param;
 				i = 1;
 			else
 				i = cmd_params[0];
-			state->backend_ops->move_cursor_relative(backend_param, i, 0);
+			VT102_BACKEND_CALL(state->backend_ops, move_cursor_relative, backend_param, i, 0);
 			break;
 		case 'D':
 			/* CUB - cursor backward(left) */
@@ -917,14 +1090,14 @@ bool is_scanning_param;
 				i = 1;
 			else
 				i = cmd_params[0];
-			state->backend_ops->move_cursor_relative(backend_param, -i, 0);
+			VT102_BACKEND_CALL(state->backend_ops, move_cursor_relative, backend_param, -i, 0);
 			break;
 		case 'H':
 			/* CUP - identical to HVP */
 			/* CUP - cursor position */
 			/* move home if no parameters, otherwise -
 			 * parameters Pl; Pc */
-			state->backend_ops->move_cursor_absolute(backend_param, cmd_params[1] - 1, cmd_params[0] - 1);
+			VT102_BACKEND_CALL(state->backend_ops, move_cursor_absolute, backend_param, cmd_params[1] - 1, cmd_params[0] - 1);
 			break;
 		case 'f':
 			/* HVP - identical to CUP */
@@ -955,7 +1128,7 @@ bool is_scanning_param;
 			if (nr_params == 0)
 			{
 				/* EL - erase in line (cursor to end of line) */
-				state->backend_ops->erase_line_from_cursor_to_end(backend_param);
+				VT102_BACKEND_CALL(state->backend_ops, erase_line_from_cursor_to_end, backend_param);
 			}
 			else if (nr_params == 1)
 			{
@@ -967,7 +1140,7 @@ bool is_scanning_param;
 						break;
 					case 1:
 						/* EL - erase in line (beginning of line to cursor) */
-						state->backend_ops->erase_line_from_beginning_to_cursor(backend_param);
+						VT102_BACKEND_CALL(state->backend_ops, erase_line_from_beginning_to_cursor, backend_param);
 						break;
 					case 2:
 						/* EL - erase in line (entire line containing cursor) */
@@ -986,7 +1159,7 @@ bool is_scanning_param;
 			if (nr_params == 0)
 			{
 				/* ED - erase in display (cursor to end of screen) */
-				state->backend_ops->erase_display_from_cursor_to_end(backend_param);
+				VT102_BACKEND_CALL(state->backend_ops, erase_display_from_cursor_to_end, backend_param);
 			}
 			else if (nr_params == 1)
 			{
@@ -1002,7 +1175,7 @@ bool is_scanning_param;
 						break;
 					case 2:
 						/* ED - erase in display (entire screen) */
-						state->backend_ops->erase_display(backend_param);
+						VT102_BACKEND_CALL(state->backend_ops, erase_display, backend_param);
 						break;
 					default:
 						panic("");
@@ -1015,19 +1188,19 @@ bool is_scanning_param;
 		case 'P':
 			/* DCH - delete character */
 			/* Deletes Pn characters, starting with the character at cursor position. When a character is deleted, all characters to the right of cursor move left. This creates a space character at right margin. This character has same character attribute as the last character moved left. */
-                        state->backend_ops->delete_characters_at_cursor(backend_param,
+                        VT102_BACKEND_CALL(state->backend_ops, delete_characters_at_cursor, backend_param,
                                         cmd_params[0] ? cmd_params[0] : 1);
 			break;
 		case 'L':
 			/* IL - insert line */
 			/* Inserts Pn lines at line with cursor. Lines displayed below cursor move down. Lines moved past the bottom margin are lost. This sequence is ignored when cursor is outside scrolling region. */
-			state->backend_ops->insert_lines_at_cursor(backend_param,
+			VT102_BACKEND_CALL(state->backend_ops, insert_lines_at_cursor, backend_param,
 					cmd_params[0] ? cmd_params[0] : 1);
 			break;
 		case 'M':
 			/* DL - delete line */
 			/* Deletes Pn lines, starting at line with cursor. As lines are deleted, lines displayed below cursor move up. Lines added to bottom of screen have spaces with same character attributes as last line moved up. This sequence is ignored when cursor is outside scrolling region. */
-			state->backend_ops->delete_lines_at_cursor(backend_param,
+			VT102_BACKEND_CALL(state->backend_ops, delete_lines_at_cursor, backend_param,
 					cmd_params[0] ? cmd_params[0] : 1);
 			break;
 		/* print commands - not supported */
@@ -1071,7 +1244,7 @@ bool is_scanning_param;
                                 i = 1;
                         else
                                 i = cmd_params[0];
-                        state->backend_ops->move_cursor_column_absolute(state->backend_ops->param, i - 1);
+                        VT102_BACKEND_CALL(state->backend_ops, move_cursor_column_absolute, state->backend_ops->param, i - 1);
                         break;
                 /*! \todo	this is not really supported by the vt102 */
                 case 'b':
@@ -1085,11 +1258,283 @@ bool is_scanning_param;
                         if (i > 1024)
                                 i = 1024;
                         while (i > 0)
-                                state->backend_ops->display_char(state->backend_ops->param, 'x', state), i--;
+                                VT102_BACKEND_CALL(state->backend_ops, display_char, state->backend_ops->param, 'x', state), i--;
                         break;
 	}
 }
 
+/*!
+ *	\fn	static void process_escape_sequence(struct vt102_state * state, unsigned int final_char)
+ *	\brief	processes a completely received escape sequence (one that is not an ansi command string)
+ *
+ *	\param	state	the vt102 state variable
+ *	\param	final_char	the character following the escape character
+ *	\return	none */
+static void process_escape_sequence(struct vt102_state * state, unsigned int final_char)
+{
+	switch (final_char)
+	{
+		/*******************************/
+		/* SCS - select character sets */
+		/*******************************/
+		case 'N':
+			/* SS2 - single shift 2 */
+			panic("");
+			break;
+		case 'O':
+			/* SS3 - single shift 3 */
+			panic("");
+			break;
+
+		/*******************/
+		/* cursor movement */
+		/*******************/
+		case 'M':
+			/* RI - reverse index; move cursor up one line
+			 * in the same column - scroll if necessary */
+			VT102_BACKEND_CALL(state->backend_ops, cursor_reverse_index, state->backend_ops->param);
+			break;
+		case 'E':
+			/* NEL - next line; move cursor down one line,
+			 * to the first position - scroll if necessary */
+			panic("");
+			break;
+		case '7':
+			/* DECSC - save cursor (and attributes) */
+			panic("");
+			break;
+		case '8':
+			/* DECRC - restore cursor (and attributes) */
+			panic("");
+			break;
+
+		/*************/
+		/* tab stops */
+		/*************/
+		case 'H':
+			/* HTS - horizontal tab set (at current column) */
+			panic("");
+			break;
+
+		/*******************/
+		/* line attributes */
+		/*******************/
+		case '#':
+			panic("");
+			break;
+
+		/***********/
+		/* reports */
+		/***********/
+		case 'Z':
+			/* DECID - identify terminal (what are you)
+			 * this is not recommended */
+			panic("");
+			break;
+
+		/*********/
+		/* reset */
+		/*********/
+		case 'c':
+			/* RIS - reset to initial state */
+			panic("");
+			break;
+		default:
+			panic("");
+	}
+}
+
+/*!
+ *	\fn	static inline void parse_ascii_char(struct vt102_state * state, unsigned int input_char)
+ *	\brief	the main vt102 command parser state machine
+ *
+ *	the state machine is driven by the parser_table[] state
+ *	transition table
+ *
+ *	\param	state		the state machine state variable
+ *	\param	input_char	the input character to process, must
+ *				be in the range 0 - 0x7f
+ *	\return	none */
+static inline void parse_ascii_char(struct vt102_state * state, unsigned int input_char)
+{
+const struct parser_transition * t;
+
+	t = & parser_table[state->state][input_char];
+	state->state = t->next_state;
+	/* displaying characters is by far the most frequent action */
+	if (t->action == ACTION_PRINT)
+	{
+		state->stats.nr_printable ++;
+		VT102_BACKEND_CALL(state->backend_ops, display_char, state->backend_ops->param, input_char, state);
+		return;
+	}
+	switch (t->action)
+	{
+		case ACTION_IGNORE:
+			break;
+		case ACTION_EXECUTE:
+			state->stats.nr_control ++;
+			handle_control_char(state, input_char);
+			break;
+		case ACTION_CLEAR:
+			clear_ansi_cmd(state);
+			break;
+		case ACTION_ESC_DISPATCH:
+			state->stats.nr_escape_sequences ++;
+			process_escape_sequence(state, input_char);
+			break;
+		case ACTION_ESC_UNKNOWN:
+			VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_UNKNOWN_ESCAPE,
+					input_char, 0, 0, 0);
+			////!!!!panic("");
+			break;
+		case ACTION_PRIVATE_MARKER:
+			state->is_private_param = true;
+			break;
+		case ACTION_PARAM:
+			put_param_char(state, input_char);
+			break;
+		case ACTION_CSI_DISPATCH:
+			process_ansi_cmd(state, input_char);
+			clear_ansi_cmd(state);
+			break;
+		case ACTION_CSI_IGNORE:
+			/* the vt102 does not support intermediate characters */
+			////!!!!panic("");
+			VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_ANSI_CMD_IGNORED,
+					input_char, state->nr_cmd_params, 0, 0);
+			state->stats.nr_ansi_cmds_ignored ++;
+			clear_ansi_cmd(state);
+			break;
+		case ACTION_PANIC:
+		default:
+			panic("");
+	}
+}
+
+/*!
+ *	\fn	static void display_codepoint(struct vt102_state * state, unsigned int codepoint)
+ *	\brief	processes a character decoded from a utf-8 sequence
+ *
+ *	characters in the range U+00A0 - U+10FFFF are displayed in
+ *	the normal input state, and ignored in all other states (the
+ *	escape sequence or ansi command string being read, if any,
+ *	continues); the c1 control characters (U+0080 - U+009F) are
+ *	not supported by the vt102, and are ignored
+ *
+ *	\param	state		the state machine state variable
+ *	\param	codepoint	the character decoded
+ *	\return	none */
+static void display_codepoint(struct vt102_state * state, unsigned int codepoint)
+{
+	if (codepoint < 0xa0 || state->state != VT102_STATE_NORMAL_INPUT)
+		return;
+	state->stats.nr_printable ++;
+	VT102_BACKEND_CALL(state->backend_ops, display_char, state->backend_ops->param, codepoint, state);
+}
+
+/*!
+ *	\fn	static void decode_utf8(struct vt102_state * state, unsigned int input_char)
+ *	\brief	the utf-8 decoder, in front of the command parser state machine
+ *
+ *	this processes a byte which is either part of a multibyte
+ *	utf-8 sequence, or interrupts one; malformed sequences - as
+ *	well as stray continuation bytes, and bytes which can never
+ *	appear in utf-8 - are displayed as the replacement character
+ *	(U+FFFD), one for each maximal subpart of a valid sequence
+ *	(the practice recommended by the unicode standard), and an ascii
+ *	character interrupting a sequence is then processed as usual
+ *
+ *	\param	state		the state machine state variable
+ *	\param	input_char	the input character to process
+ *	\return	none */
+static void decode_utf8(struct vt102_state * state, unsigned int input_char)
+{
+	if (state->utf8_nr_pending)
+	{
+		if (input_char >= state->utf8_lower && input_char <= state->utf8_upper)
+		{
+			state->utf8_codepoint = state->utf8_codepoint << 6 | (input_char & 0x3f);
+			state->utf8_lower = 0x80;
+			state->utf8_upper = 0xbf;
+			if (!-- state->utf8_nr_pending)
+				display_codepoint(state, state->utf8_codepoint);
+			return;
+		}
+		/* the sequence is truncated - the input character
+		 * is not part of it, and is processed on its own */
+		state->utf8_nr_pending = 0;
+		state->stats.nr_utf8_errors ++;
+		VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_UTF8_MALFORMED,
+				input_char, 0, 0, 0);
+		display_codepoint(state, VT102_REPLACEMENT_CHAR);
+		if (input_char < 0x80)
+		{
+			parse_ascii_char(state, input_char);
+			return;
+		}
+	}
+	state->utf8_lower = 0x80;
+	state->utf8_upper = 0xbf;
+	if (input_char >= 0xc2 && input_char <= 0xdf)
+	{
+		state->utf8_codepoint = input_char & 0x1f;
+		state->utf8_nr_pending = 1;
+	}
+	else if (input_char >= 0xe0 && input_char <= 0xef)
+	{
+		state->utf8_codepoint = input_char & 0x0f;
+		state->utf8_nr_pending = 2;
+		if (input_char == 0xe0)
+			/* reject overlong encodings */
+			state->utf8_lower = 0xa0;
+		else if (input_char == 0xed)
+			/* reject utf-16 surrogates */
+			state->utf8_upper = 0x9f;
+	}
+	else if (input_char >= 0xf0 && input_char <= 0xf4)
+	{
+		state->utf8_codepoint = input_char & 0x07;
+		state->utf8_nr_pending = 3;
+		if (input_char == 0xf0)
+			/* reject overlong encodings */
+			state->utf8_lower = 0x90;
+		else if (input_char == 0xf4)
+			/* reject code points past U+10FFFF */
+			state->utf8_upper = 0x8f;
+	}
+	else
+	{
+		/* a stray continuation byte, or a byte which
+		 * is never part of a valid utf-8 sequence */
+		state->stats.nr_utf8_errors ++;
+		VT102_TRACE(VT102_TRACE_LEVEL_WARNING, VT102_TRACE_UTF8_MALFORMED,
+				input_char, 0, 0, 0);
+		display_codepoint(state, VT102_REPLACEMENT_CHAR);
+	}
+}
+
+/*!
+ *	\fn	static inline void parse_input_char(struct vt102_state * state, unsigned int input_char)
+ *	\brief	processes an input character - passes it to the utf-8 decoder, or to the command parser state machine
+ *
+ *	the input is utf-8 encoded; ascii characters are passed to the
+ *	command parser state machine directly, unless a multibyte utf-8
+ *	sequence is being decoded; this is the body of
+ *	vt102_command_input_parser(), which is also inlined in
+ *	vt102_command_input_parser_buf()
+ *
+ *	\param	state		the state machine state variable
+ *	\param	input_char	the input character to process
+ *	\return	none */
+static inline void parse_input_char(struct vt102_state * state, unsigned int input_char)
+{
+	if (input_char >= 0x80 || state->utf8_nr_pending)
+		decode_utf8(state, input_char & 0xff);
+	else
+		parse_ascii_char(state, input_char);
+}
+
 /*
  *
  * exported functions follow
@@ -1105,196 +1550,63 @@ bool is_scanning_param;
  *	\return	none */
 void vt102_command_input_parser(struct vt102_state * state, unsigned int input_char)
 {
+	state->stats.nr_bytes ++;
+	parse_input_char(state, input_char);
+}
 
-	/* normalize the input character - strip the eighth bit */
-	/*! \todo	is this correct */
-	if (input_char & 0x80)
-	{
-		printf("warning: bit 7 set ");
-	}
-	input_char &= 0x7f;
-	if (input_char == 27)
-	{
-		state->state = VT102_STATE_NORMAL_INPUT;
-	}
-	switch (state->state)
+/*!
+ *	\fn	void vt102_command_input_parser_buf(struct vt102_state * state, const unsigned char * buf, size_t len)
+ *	\brief	feeds a whole buffer of input characters to the vt102 command parser state machine
+ *
+ *	this is equivalent to invoking vt102_command_input_parser()
+ *	for each character in the buffer, but it is faster for
+ *	the most common case - while the state machine is in the
+ *	normal input state, runs of plain displayable characters
+ *	(found by vt102_scan_printable(), which skips over them many
+ *	characters at a time on most cpus) are handed over to the backend in one display_string() call (or,
+ *	if the backend does not provide this, in a tight loop of
+ *	display_char() calls), and the state machine proper is only
+ *	entered for escape and control characters (and for the DEL
+ *	character and the bytes of multibyte utf-8 sequences, which
+ *	are decoded by decode_utf8() - so that pure ascii input is
+ *	not slowed down by the utf-8 decoding at all)
+ *
+ *	\param	state	the state machine state variable
+ *	\param	buf	the input characters to process
+ *	\param	len	the number of characters in the buffer
+ *	\return	none */
+void vt102_command_input_parser_buf(struct vt102_state * state, const unsigned char * buf, size_t len)
+{
+const unsigned char * end, * run;
+void (*display_char)(void * param, unsigned int ch, struct vt102_state * state);
+void * backend_param;
+
+	state->stats.nr_bytes += len;
+	end = buf + len;
+	while (buf < end)
 	{
-		case VT102_STATE_INVALID:
-			panic("");
-			break;
-		case VT102_STATE_NORMAL_INPUT:
-			if (is_displayable(input_char))
-                                state->backend_ops->display_char(state->backend_ops->param, input_char, state);
-			else if (input_char == ANSI_ESC)
-			{
-				state->state = VT102_STATE_ESCAPE_SEQUENCE_STARTED;
-			}
-			else
-				/* assume this is a control character */
-				handle_control_char(state, input_char);
-			break;
-		case VT102_STATE_ESCAPE_SEQUENCE_STARTED:
-			switch (input_char)
-			{
-				case '[':
-				/* ansi CSI (control sequence introducer)
-				 * sequence detected -
-				 * wait for more characters
-			         * to determine the exact command
-				 * requested */
-					state->state = VT102_STATE_ANSI_CMD_READ;
-					break;
-
-				/*******************************/
-				/* SCS - select character sets */
-				/*******************************/
-				case '(':
-					////!!!!panic("");
-					break;
-				case 'N':
-					/* SS2 - single shift 2 */
-					panic("");
-					break;
-				case 'O':
-					/* SS3 - single shift 3 */
-					panic("");
-					break;
-				/*******************************/
-				/*******************************/
-				/*******************************/
-
-				/*******************/
-				/* cursor movement */
-				/*******************/
-				case 'D':
-					/* IND - index; move cursor down one line
-					 * in the same column - scroll if necessary */
-                                        //panic("");
-					break;
-				case 'M':
-					/* RI - reverse index; move cursor up one line
-					 * in the same column - scroll if necessary */
-					state->backend_ops->cursor_reverse_index(state->backend_ops->param);
-					state->state = VT102_STATE_NORMAL_INPUT;
-					state->cmd_idx = 0;
-					break;
-				case 'E':
-					/* NEL - next line; move cursor down one line,
-					 * to the first position - scroll if necessary */
-					panic("");
-					break;
-				case '7':
-					/* DECSC - save cursor (and attributes) */
-					panic("");
-					break;
-				case '8':
-					/* DECRC - restore cursor (and attributes) */
-					panic("");
-					break;
-				/*******************/
-				/*******************/
-				/*******************/
-
-				/*************/
-				/* tab stops */
-				/*************/
-				case 'H':
-					/* HTS - horizontal tab set (at current column) */
-					panic("");
-					break;
-				/*************/
-				/*************/
-				/*************/
-
-				/*******************/
-				/* line attributes */
-				/*******************/
-				case '#':
-					panic("");
-					break;
-				/*******************/
-				/*******************/
-				/*******************/
-
-
-				/***********/
-				/* reports */
-				/***********/
-				case 'Z':
-					/* DECID - identify terminal (what are you)
-					 * this is not recommended */
-					panic("");
-					break;
-				/***********/
-				/***********/
-				/***********/
-
-				/*********/
-				/* reset */
-				/*********/
-				case 'c':
-					/* RIS - reset to initial state */
-					panic("");
-					break;
-				/*********/
-				/*********/
-				/*********/
-				/**********************************/
-				/* vt52 compatible mode - ignored */
-				/**********************************/
-				case '=':
-				case '>':
-					state->state = VT102_STATE_NORMAL_INPUT;
-					state->cmd_idx = 0;
-					break;
-				/**********************************/
-				/**********************************/
-				/**********************************/
-
-				/* unhandled codes */
-				default:
-					printf("%s(): unknown escape character - %c\n", __func__, input_char);
-					////!!!!panic("");
-					state->state = VT102_STATE_NORMAL_INPUT;
-					state->cmd_idx = 0;
-			}
-			break;
-		case VT102_STATE_ANSI_CMD_READ:
-			/* an ansi command string is being read in the state->cmd
-			 * buffer until a final byte is recognized (a final byte
-		         * is one in the range 0x40 - 0x7e, bytes before it in
-			 * the range 0x30 - 0x3f are parameter bytes, in the
-			 * range 0x20 - 0x2f - intermediate bytes; if other bytes
-			 * are found - the escaped command sequencer is aborted */
-			if (0x30 <= input_char && input_char <= 0x3f)
-			{
-				/* a parameter character */
-				put_in_cmd_buf(state, input_char);
-			}
-			else if (0x20 <= input_char && input_char <= 0x2f)
-			{
-				/* an intermediate character */
-				/* the vt102 does not support any intermediate
-				 * characters */
-				put_in_cmd_buf(state, input_char);
-			}
-			else if (0x40 <= input_char && input_char <= 0x7e)
+		/* bytes past 0x7f are always passed to the utf-8 decoder */
+		if (state->state == VT102_STATE_NORMAL_INPUT && * buf < 0x80 && !state->utf8_nr_pending)
+		{
+			backend_param = state->backend_ops->param;
+			run = buf;
+			buf += vt102_scan_printable(buf, end - buf);
+			state->stats.nr_printable += buf - run;
+			if (state->backend_ops->display_string)
 			{
-				/* the final character */
-				put_in_cmd_buf(state, input_char);
-				process_ansi_cmd(state);
-				/* reset the state machine to normal input state */
-				state->state = VT102_STATE_NORMAL_INPUT;
-				state->cmd_idx = 0;
+				if (buf != run)
+					VT102_BACKEND_CALL(state->backend_ops, display_string, backend_param, run, buf - run, state);
 			}
 			else
 			{
-				/* an invalid character - abort the current
-				 * command sequence */
+				display_char = state->backend_ops->display_char;
+				while (run < buf)
+					display_char(backend_param, * run ++, state);
 			}
-			break;
-		default:
-			panic("");
+			if (buf == end)
+				break;
+		}
+		parse_input_char(state, * buf ++);
 	}
 }
 
@@ -1311,15 +1623,19 @@ void vt102_command_input_parser(struct vt102_state * state, unsigned int input_c
  *				terminal emulator backend
  *	\return	a pointer to the newly initialized vt102
  *		emulator state to be used in subsequent
- *		calls to the emulator */
+ *		calls to the emulator, or null on error
+ *		(out of memory) */
 struct vt102_state * init_vt102(struct vt102_backend_ops * backend_ops)
 {
 struct vt102_state * s;
 
 	if (!(s = calloc(1, sizeof * s)))
-		panic("");
+		return 0;
 	if (!(s->backend_ops = calloc(1, sizeof * s->backend_ops)))
-		panic("");
+	{
+		free(s);
+		return 0;
+	}
 	* s->backend_ops = * backend_ops;
 	s->state = VT102_STATE_NORMAL_INPUT;
 	return s;
@@ -1335,8 +1651,10 @@ struct vt102_state * s;
  *	\return	none */
 void destroy_vt102(struct vt102_state * state)
 {
-        /* nothing really to do, just destroy the backend */
+        /* destroy the backend, then release the parser state */
         state->backend_ops->destroy_vt102_generic_backend(state->backend_ops->param);
+        free(state->backend_ops);
+        free(state);
 }
 
 
@@ -1359,3 +1677,87 @@ struct vt102_backend_ops * vt102_get_backend_ops(struct vt102_state * state)
 	return state->backend_ops;
 }
 
+/*!
+ *	\fn	bool vt102_parser_is_idle(struct vt102_state * state)
+ *	\brief	tells if the vt102 command parser is in between commands
+ *
+ *	i.e. if no escape sequence, ansi command string or utf-8
+ *	encoded character has been partially read; the state of the
+ *	terminal emulator is then completely described by the backend
+ *	data, which e.g. allows taking a copy of the backend data that
+ *	processing can later be resumed from (see vt102-record.h)
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\return	true, if the command parser is in between
+ *		commands, false otherwise */
+bool vt102_parser_is_idle(struct vt102_state * state)
+{
+	return state->state == VT102_STATE_NORMAL_INPUT && !state->utf8_nr_pending;
+}
+
+/*!
+ *	\fn	void vt102_parser_reset(struct vt102_state * state)
+ *	\brief	discards any command partially read by the vt102 command parser
+ *
+ *	the backend data is not touched, and the counters are kept
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\return	none */
+void vt102_parser_reset(struct vt102_state * state)
+{
+	clear_ansi_cmd(state);
+	state->utf8_nr_pending = 0;
+	state->state = VT102_STATE_NORMAL_INPUT;
+}
+
+
+/*!
+ *	\fn	void vt102_get_stats(struct vt102_state * state, struct vt102_stats * stats)
+ *	\brief	retrieves the vt102 command parser counters
+ *
+ *	\note	the counters are not synchronized in any way -
+ *		if the command parser is run in a thread of its
+ *		own, this must be called from that thread
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\param	stats	the counters are stored here
+ *	\return	none */
+void vt102_get_stats(struct vt102_state * state, struct vt102_stats * stats)
+{
+	* stats = state->stats;
+}
+
+/*!
+ *	\fn	void vt102_print_stats(struct vt102_state * state, FILE * f)
+ *	\brief	prints the vt102 command parser counters
+ *
+ *	\note	see the note for vt102_get_stats()
+ *
+ *	\param	state	the state variable of the vt102
+ *			terminal emulator command parser
+ *	\param	f	the stream to print the counters to
+ *	\return	none */
+void vt102_print_stats(struct vt102_state * state, FILE * f)
+{
+struct vt102_stats * s;
+int i;
+
+	s = &state->stats;
+	fprintf(f, "parser: %llu bytes, %llu displayable, %llu control characters, "
+			"%lu escape sequences, %lu ansi commands (%lu ignored), "
+			"%lu malformed utf-8 sequences\n",
+			s->nr_bytes, s->nr_printable, s->nr_control,
+			s->nr_escape_sequences, s->nr_ansi_cmds, s->nr_ansi_cmds_ignored,
+			s->nr_utf8_errors);
+	if (!s->nr_ansi_cmds)
+		return;
+	fprintf(f, "ansi commands:");
+	for (i = 0; i < VT102_NR_ANSI_CMD_FINAL_CHARS; i++)
+		if (s->nr_ansi_cmds_by_final_char[i])
+			fprintf(f, " %c:%lu", i, s->nr_ansi_cmds_by_final_char[i]);
+	fprintf(f, "\n");
+}
+
@@ -15,6 +15,29 @@
  *	$Log: $
  */
 
+/*
+ *
+ * include section follows
+ *
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ *
+ * exported constants follow
+ *
+ */
+
+enum
+{
+	/*! the number of entries in the ansi command dispatch histogram - one for each (7 bit) final character */
+	VT102_NR_ANSI_CMD_FINAL_CHARS	=	128,
+	/*! the character displayed in place of malformed utf-8 sequences, and of characters that cannot be displayed */
+	VT102_REPLACEMENT_CHAR		=	0xfffd,
+};
+
 /*
  *
  * opaque data types follow
@@ -28,6 +51,30 @@ struct vt102_state;
  *
  */
 
+/*! vt102 command parser counters
+ *
+ * these are cumulative, since the command parser has
+ * been initialized; see vt102_get_stats() */
+struct vt102_stats
+{
+	/*! the number of input characters processed */
+	unsigned long long nr_bytes;
+	/*! the number of displayable characters processed */
+	unsigned long long nr_printable;
+	/*! the number of control characters processed */
+	unsigned long long nr_control;
+	/*! the number of escape sequences (other than ansi command strings) processed */
+	unsigned long nr_escape_sequences;
+	/*! the number of ansi command strings processed */
+	unsigned long nr_ansi_cmds;
+	/*! the number of ansi command strings ignored, because they are not supported */
+	unsigned long nr_ansi_cmds_ignored;
+	/*! the number of malformed utf-8 sequences (displayed as the replacement character, U+FFFD) */
+	unsigned long nr_utf8_errors;
+	/*! the number of ansi command strings processed, for each final (command) character */
+	unsigned long nr_ansi_cmds_by_final_char[VT102_NR_ANSI_CMD_FINAL_CHARS];
+};
+
 /*! a structure describing the functional interface to a backend */
 struct vt102_backend_ops
 {
@@ -47,7 +94,9 @@ struct vt102_backend_ops
 	/*! display a character (character is not a control character), move the cursor one position to the right
 	 *
 	 * the 'ch' parameter holds the character to display,
-         * it will be a displayable (non-control) character
+         * it will be a displayable (non-control) character - a unicode
+         * code point, in the range U+0020 - U+007E or U+00A0 - U+10FFFF
+         * (the input is utf-8 encoded)
          *
          * \note	the 'state' pointer below is needed because
          *		the display_char() routine may need to scroll
@@ -63,6 +112,21 @@ struct vt102_backend_ops
          *		invoked (in all, this is a bit of a hack and
          *		as such is somewhat ugly...) */
         void (*display_char)(void * param, unsigned int ch, struct vt102_state * state);
+	/*! display a string of characters (none of which is a control character), advancing the cursor accordingly
+	 *
+	 * this is optional - if it is null, the characters are
+	 * displayed one by one by calling display_char(); if
+	 * present, it must be equivalent to invoking display_char()
+	 * for each of the 'n' characters in 's', in order (these
+	 * are all ascii characters, in the range 0x20 - 0x7e); this
+	 * is used by vt102_command_input_parser_buf() for displaying
+	 * runs of displayable characters in one call
+	 *
+	 * \note	the 'state' pointer has the same purpose as
+	 *		for display_char() above
+	 * \note	if display_char() is overridden, this routine
+	 *		must either be overridden as well, or be set to null */
+	void (*display_string)(void * param, const unsigned char * s, int n, struct vt102_state * state);
 	/*! SGR - select graphic rendition
 	 * 
 	 * selecting an attribute does not turn off other
@@ -241,6 +305,19 @@ struct vt102_backend_ops
 	 *(033 133 077 066 143)
 	 */
 	void (*query_terminal_id)(void * param);
+	/*! DECSET/DECRST 2026 - begin/end a synchronized update (BSU/ESU)
+	 *
+	 * the remote host brackets the output of a whole screen
+	 * update with these, so that the screen is not displayed
+	 * partially updated; this is not a DEC vt102 command,
+	 * but one which many terminal emulators (and the
+	 * applications running in them) support - see
+	 * the comments about the 'sync_update' field of struct
+	 * term_data in vt102-backend-generic.h
+	 *
+	 * this routine is optional, and may be null - the
+	 * mode is ignored then */
+	void (*set_synchronized_update)(void * param, bool enable);
         /*
          *
          * maintenance routines
@@ -249,6 +326,40 @@ struct vt102_backend_ops
         void (*destroy_vt102_generic_backend)(struct vt102_state * state);
 };
 
+/*
+ *
+ * exported macros follow
+ *
+ */
+
+/*! invokes a backend function through a vt102_backend_ops function pointer table
+ *
+ * normally, this is a plain indirect call through the table;
+ * when VT102_STATIC_BACKEND is defined, it must be a function-like
+ * macro mapping the name of a vt102_backend_ops member (e.g.
+ * display_char) to the function implementing it in a backend
+ * compiled in the same translation unit (see vt102-generic-static.c);
+ * the function in the table is then compared against that one,
+ * and, if they are the same, it is called directly - so that
+ * the compiler can inline it - or else it is called through the
+ * table, so that functions overridden in the table (the approved
+ * mechanism for hooking backend functions, see the comments about
+ * 'generic_ptr' in vt102-backend-generic.h) still get invoked
+ *
+ * \param	ops	the vt102_backend_ops function pointer table; this
+ *			may be evaluated more than once
+ * \param	op	the name of the vt102_backend_ops member to invoke;
+ *			when VT102_STATIC_BACKEND is defined, the backend
+ *			compiled in must implement it
+ * \param	...	the arguments of the backend function */
+#ifdef VT102_STATIC_BACKEND
+#define VT102_BACKEND_CALL(ops, op, ...)						\
+	((ops)->op == (__typeof__((ops)->op)) VT102_STATIC_BACKEND(op) ?		\
+		VT102_STATIC_BACKEND(op)(__VA_ARGS__) : (ops)->op(__VA_ARGS__))
+#else
+#define VT102_BACKEND_CALL(ops, op, ...)	((ops)->op(__VA_ARGS__))
+#endif
+
 /*
  *
  * exported function prototypes follow
@@ -256,7 +367,12 @@ struct vt102_backend_ops
  */
 
 void vt102_command_input_parser(struct vt102_state * state, unsigned int input_char);
+void vt102_command_input_parser_buf(struct vt102_state * state, const unsigned char * buf, size_t len);
 struct vt102_backend_ops * vt102_get_backend_ops(struct vt102_state * state);
+bool vt102_parser_is_idle(struct vt102_state * state);
+void vt102_parser_reset(struct vt102_state * state);
 struct vt102_state * init_vt102(struct vt102_backend_ops * backend_ops);
 void destroy_vt102(struct vt102_state * state);
+void vt102_get_stats(struct vt102_state * state, struct vt102_stats * stats);
+void vt102_print_stats(struct vt102_state * state, FILE * f);
 